@@ -44,6 +44,7 @@
 #include "console_ssh.h"
 #include "ovms_netmanager.h"
 #include "ovms_config.h"
+#include "ovms_script.h"
 
 static void wolf_logger(enum wolfSSH_LogLevel level, const char* const msg);
 static const char *tag = "ssh";
@@ -764,6 +765,7 @@ void ConsoleSSH::HandleDeviceEvent(void* pEvent)
                     msg.append("mkdir: ").append(strerror(errno)).append("\n");
                   else
                     {
+                    MyScripts.InvalidateEventIndex(m_path.c_str());
                     wolfSSH_stream_send(m_ssh, (uint8_t*)"", 1);
                     break;
                     }
@@ -51,3 +51,29 @@ uint16_t crc16(const char *data, size_t length)
   return crc;
   }
 
+// CRC-32 (IEEE 802.3), pass 0 as the initial crc or the result of the
+// previous call to continue a running checksum. Uses a nibble table as a
+// compromise between speed and flash/cache footprint.
+static const uint32_t crc32_nibble[16] =
+  {
+  0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC,
+  0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+  0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+  0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+  };
+
+uint32_t crc32(uint32_t crc, const char *data, size_t length)
+  {
+  crc = ~crc;
+
+  while (length>0)
+    {
+    crc ^= (uint8_t)*data++;
+    length--;
+
+    crc = (crc >> 4) ^ crc32_nibble[crc & 0x0f];
+    crc = (crc >> 4) ^ crc32_nibble[crc & 0x0f];
+    }
+
+  return ~crc;
+  }
@@ -35,5 +35,6 @@
 #include <unistd.h>
 
 uint16_t crc16(const char *data, size_t length);
+uint32_t crc32(uint32_t crc, const char *data, size_t length);
 
 #endif //#ifndef __CRYPT_CRC_H__
@@ -35,6 +35,7 @@
 
 #include <string.h>
 #include "crypt_rc4.h"
+#include "crypt_base64.h"
 
 /**
  * Get ready for an encrypt/decrypt operation
@@ -89,3 +90,43 @@ void RC4_crypt(RC4_CTX1 *ctx1, RC4_CTX2 *ctx2, uint8_t *msg, int length)
   ctx1->y = y;
   }
 
+/**
+ * Encrypt and base64 encode in one pass, without modifying the input.
+ * Output is 4 chars per 3 input bytes (padded), not NUL terminated; a
+ * pointer to its end is returned. For a message split into several
+ * calls, all but the last part need a length divisible by 3.
+ * The output may overlap the input if it starts at least
+ * (length+2)/3 bytes before it.
+ */
+uint8_t *RC4_crypt_base64(RC4_CTX1 *ctx1, RC4_CTX2 *ctx2, const uint8_t *msg, int length, uint8_t *out)
+  {
+  int i, n;
+  uint8_t *m, x, y, a, b;
+  uint8_t in[3];
+
+  x = ctx1->x;
+  y = ctx1->y;
+  m = ctx2->m;
+
+  for (i = 0; i < length; i += 3)
+    {
+    n = (length - i < 3) ? (length - i) : 3;
+    in[1] = in[2] = 0;
+    for (int k = 0; k < n; k++)
+      {
+      a = m[++x];
+      y += a;
+      m[x] = b = m[y];
+      m[y] = a;
+      in[k] = msg[i+k] ^ m[(uint8_t)(a + b)];
+      }
+    *out++ = cb64[ in[0] >> 2 ];
+    *out++ = cb64[ ((in[0] & 0x03) << 4) | ((in[1] & 0xf0) >> 4) ];
+    *out++ = (n > 1) ? cb64[ ((in[1] & 0x0f) << 2) | ((in[2] & 0xc0) >> 6) ] : '=';
+    *out++ = (n > 2) ? cb64[ in[2] & 0x3f ] : '=';
+    }
+
+  ctx1->x = x;
+  ctx1->y = y;
+  return out;
+  }
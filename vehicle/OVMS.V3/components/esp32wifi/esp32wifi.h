@@ -70,7 +70,7 @@ class esp32wifi : public pcp
     void EventWifiStaDisconnected(std::string event, void* data);
     void EventWifiApState(std::string event, void* data);
     void EventWifiApUpdate(std::string event, void* data);
-    void EventTimer10(std::string event, void* data);
+    void EventTimer10(event_id_t event, void* data);
     void EventWifiScanDone(std::string event, void* data);
     void OutputStatus(int verbosity, OvmsWriter* writer);
 
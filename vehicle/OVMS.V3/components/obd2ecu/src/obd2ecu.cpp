@@ -161,7 +161,9 @@ static void OBD2ECU_task(void *pvParameters)
   }
 
 obd2ecu::obd2ecu(const char* name, canbus* can)
-  : pcp(name)
+  : pcp(name),
+    m_cfg_autocreate("obd2ecu", "autocreate", false),
+    m_cfg_private("obd2ecu", "private", false)
   { 
   m_can = can;
   xTaskCreatePinnedToCore(OBD2ECU_task, "OBDII ECU Task", 6144, (void*)this, 5, &m_task, 1);
@@ -507,7 +509,7 @@ void obd2ecu::IncomingFrame(CAN_frame_t* p_frame)
       { metric = m_pidmap[mapped_pid]->Execute();
       }
       else
-      { if (MyConfig.GetParamValueBool("obd2ecu","autocreate"))
+      { if (m_cfg_autocreate)
           m_pidmap[mapped_pid] = new obd2pid(mapped_pid); // Creates it as Unimplemented, if enabled
           // note: don't 'Addpid' the PID to the supported vectors.  Only done when support set by config.
         metric = 0.0;
@@ -629,7 +631,7 @@ void obd2ecu::IncomingFrame(CAN_frame_t* p_frame)
         case 2:
           ESP_LOGD(TAG, "Requested VIN");
           
-          if(MyConfig.GetParamValueBool("obd2ecu","private"))   /* ignore request for privacy's sake. Doesn't seem to matter to Dongle. */
+          if(m_cfg_private)   /* ignore request for privacy's sake. Doesn't seem to matter to Dongle. */
           { ESP_LOGD(TAG, "VIN request ignored");
             break;
           }
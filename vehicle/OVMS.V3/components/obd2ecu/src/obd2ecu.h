@@ -37,6 +37,7 @@
 #include "pcp.h"
 #include "can.h"
 #include "ovms_metrics.h"
+#include "ovms_config.h"
 
 class obd2pid
   {
@@ -92,6 +93,8 @@ class obd2ecu : public pcp
     PidMap m_pidmap;
     uint32_t m_supported_01_20;  // bitmap of PIDs configured 0x01 through 0x20
     uint32_t m_supported_21_40;  // bitmap of PIDs configured 0x21 through 0x40
+    ConfigHandle<bool> m_cfg_autocreate;
+    ConfigHandle<bool> m_cfg_private;
 
   public:
     void IncomingFrame(CAN_frame_t* p_frame);
@@ -31,6 +31,9 @@
 #include "ovms_log.h"
 static const char *TAG = "ovms-server-v2";
 
+#include <limits.h>
+#include <unistd.h>
+#include <algorithm>
 #include "ovms.h"
 #include "buffered_shell.h"
 #include "ovms_peripherals.h"
@@ -143,6 +146,36 @@ static struct
   { "",          "" }                      // 15 PARAM_COOLDOWN
   };
 
+// Status message scheduling, per vehicle state (parked, driving, charging):
+//  min:    minimum interval for sends triggered by metric changes (seconds)
+//  period: interval of the periodic checks, without / with apps connected
+// Messages are only sent if their content has changed.
+static const struct
+  {
+  const char* name;
+  uint16_t min[V2_STATE_COUNT];
+  uint16_t period[2][V2_STATE_COUNT];
+  } v2_sched[V2_MSG_COUNT]
+  =
+  {
+  { "stat",         {  5, 10,  2 }, { { 600, 600, 300 }, { 60, 60, 30 } } },
+  { "environment",  {  2,  2,  2 }, { { 600, 600, 600 }, { 60, 60, 60 } } },
+  { "gps",          { 10,  2, 10 }, { { 600, 300, 600 }, { 60, 30, 60 } } },
+  { "group",        { 10, 10, 10 }, { { 600, 600, 600 }, { 60, 60, 60 } } },
+  { "tpms",         { 10, 10, 10 }, { { 600, 600, 600 }, { 60, 60, 60 } } },
+  { "firmware",     { 60, 60, 60 }, { { 600, 600, 600 }, { 60, 60, 60 } } },
+  { "capabilities", { 60, 60, 60 }, { { 600, 600, 600 }, { 60, 60, 60 } } }
+  };
+
+// Transmission order (priority) per vehicle state:
+static const uint8_t v2_order[V2_STATE_COUNT][V2_MSG_COUNT]
+  =
+  {
+  { V2_MSG_ENVIRONMENT, V2_MSG_STAT, V2_MSG_GPS, V2_MSG_TPMS, V2_MSG_GROUP, V2_MSG_FIRMWARE, V2_MSG_CAPABILITIES },
+  { V2_MSG_GPS, V2_MSG_ENVIRONMENT, V2_MSG_STAT, V2_MSG_TPMS, V2_MSG_GROUP, V2_MSG_FIRMWARE, V2_MSG_CAPABILITIES },
+  { V2_MSG_STAT, V2_MSG_ENVIRONMENT, V2_MSG_GPS, V2_MSG_GROUP, V2_MSG_TPMS, V2_MSG_FIRMWARE, V2_MSG_CAPABILITIES }
+  };
+
 OvmsServerV2 *MyOvmsServerV2 = NULL;
 size_t MyOvmsServerV2Modifier = 0;
 size_t MyOvmsServerV2Reader = 0;
@@ -187,6 +220,115 @@ bool OvmsServerV2ReaderCallback(OvmsNotifyType* type, OvmsNotifyEntry* entry)
     return true; // No server v2 running, so just discard
   }
 
+static void OvmsServerV2RxWatch(void *pvParameters)
+  {
+  OvmsServerV2 *me = (OvmsServerV2*)pvParameters;
+  me->RxWatchTask();
+  }
+
+/**
+ * RxWatchTask: wake up the server task when the socket becomes readable,
+ *  so the server task can sleep until it has something to do instead of
+ *  polling. After each wakeup, we wait for the server task to consume
+ *  the data before watching again. The socket is only used with
+ *  m_rxwatch_mutex held, see CloseConnection().
+ */
+void OvmsServerV2::RxWatchTask()
+  {
+  fd_set rfds, efds;
+  while (1)
+    {
+    xSemaphoreTake(m_rxwatch_mutex, portMAX_DELAY);
+    int sock = m_conn->Socket();
+    if (sock < 0)
+      {
+      // Wait for the next connection:
+      xSemaphoreGive(m_rxwatch_mutex);
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+      continue;
+      }
+    FD_ZERO(&rfds);
+    FD_SET(sock, &rfds);
+    FD_ZERO(&efds);
+    FD_SET(sock, &efds);
+    struct timeval timeout;
+    timeout.tv_sec = 10;  // Recheck the socket periodically
+    timeout.tv_usec = 0;
+    int ready = select(sock+1, &rfds, NULL, &efds, &timeout);
+    xSemaphoreGive(m_rxwatch_mutex);
+    if (ready != 0)
+      {
+      Wakeup(OVMS_SERVER_V2_WAKE_RX);
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+      }
+    }
+  }
+
+void OvmsServerV2::Wakeup(uint32_t reason)
+  {
+  xTaskNotify(m_task, reason, eSetBits);
+  }
+
+/**
+ * Backoff: wait before the next connection attempt. The delay doubles
+ *  with each failure, and is randomized over the upper half of the
+ *  interval so a fleet of modules does not reconnect in lockstep after
+ *  a server restart.
+ */
+void OvmsServerV2::Backoff()
+  {
+  if (m_backoff == 0)
+    m_backoff = OVMS_SERVER_V2_BACKOFF_MIN;
+  else if (m_backoff < OVMS_SERVER_V2_BACKOFF_MAX)
+    m_backoff = std::min(m_backoff*2, OVMS_SERVER_V2_BACKOFF_MAX);
+  m_stat_connectfails++;
+
+  uint32_t delay = m_backoff*500 + esp_random() % (m_backoff*500 + 1);
+  ESP_LOGI(TAG, "Reconnecting in %u.%u seconds", delay/1000, (delay%1000)/100);
+  vTaskDelay(delay / portTICK_PERIOD_MS);
+  }
+
+/**
+ * NextWait: seconds until the next scheduled action of the server task:
+ *  a periodic or deferred status message, streaming or a ping
+ */
+uint32_t OvmsServerV2::NextWait(uint32_t lasttx_stream)
+  {
+  uint32_t now = monotonictime;
+  uint32_t wait = OVMS_SERVER_V2_MAXWAIT;
+  int apps = (StandardMetrics.ms_s_v2_peers->AsInt() > 0) ? 1 : 0;
+  v2_state_t state = V2_STATE_PARKED;
+  if (StandardMetrics.ms_v_charge_inprogress->AsBool())
+    state = V2_STATE_CHARGING;
+  else if (StandardMetrics.ms_v_env_on->AsBool())
+    state = V2_STATE_DRIVING;
+
+  auto until = [&](uint32_t due)
+    {
+    if ((int32_t)(due - now) <= 0)
+      wait = 0;
+    else if (due - now < wait)
+      wait = due - now;
+    };
+
+  uint32_t pending = m_now;
+  for (int msg=0; msg<V2_MSG_COUNT; msg++)
+    {
+    until(m_msgstat[msg].lastcheck + v2_sched[msg].period[apps][state]);
+    if (pending & (1 << msg))
+      until(m_msgstat[msg].lastsent + v2_sched[msg].min[state]);
+    }
+  if (m_streaming && apps && StandardMetrics.ms_v_env_on->AsBool())
+    until(lasttx_stream + m_streaming + 1);
+  if (m_pingsent)
+    until(m_pingsent + OVMS_SERVER_V2_PING_TIMEOUT);
+  else
+    until(m_lastrx + OVMS_SERVER_V2_PING_IDLE);
+
+  // monotonictime has a one second resolution:
+  return (wait > 0) ? wait : 1;
+  }
+
 void OvmsServerV2::ServerTask()
   {
   ESP_LOGI(TAG, "OVMS Server v2 task running");
@@ -196,9 +338,10 @@ void OvmsServerV2::ServerTask()
   else
     m_units_distance = Kilometers;
 
-  int lasttx = 0;
   int lasttx_stream = 0;
   int peers = 0;
+  bool all = true;
+  uint32_t wakeup;
   MAINLOOP: while(1)
     {
     if (!MyNetManager.m_connected_any)
@@ -206,67 +349,89 @@ void OvmsServerV2::ServerTask()
       SetStatus("Waiting for network connectivity");
       while (!MyNetManager.m_connected_any)
         {
-        vTaskDelay(5000 / portTICK_PERIOD_MS);
+        // Woken by network.up, the timeout is a fallback:
+        xTaskNotifyWait(0, ULONG_MAX, NULL, 30000 / portTICK_PERIOD_MS);
         }
       SetStatus("Network connectivity established");
       }
 
     if (!Connect())
       {
-      vTaskDelay(10000 / portTICK_PERIOD_MS);
+      Backoff();
       continue;
       }
 
     if (!Login())
       {
       Disconnect();
-      vTaskDelay(10000 / portTICK_PERIOD_MS);
+      Backoff();
       continue;
       }
 
     SetStatus("Connected and logged in");
+    m_stat_connects++;
+    m_backoff = 0;
+    m_lastrx = monotonictime;
+    m_pingsent = 0;
+    all = true;
     m_pending_notify_info = true;
     m_pending_notify_error = true;
     m_pending_notify_alert = true;
     m_pending_notify_data = true;
     m_pending_notify_data_last = 0;
     StandardMetrics.ms_s_v2_connected->SetValue(true);
+    xTaskNotifyGive(m_rxwatch_task);  // Watch the new socket
     while(1)
       {
-      if (!m_conn.IsOpen())
+      if (m_tx_failed)
         {
-        // Loop until connection is open
-        vTaskDelay(10000 / portTICK_PERIOD_MS);
+        // Data has been lost, the tx cipher stream is out of sync:
+        Disconnect();
+        SetStatus("Error: Transmit failed",true);
+        }
+      if (!m_conn->IsOpen())
+        {
+        Backoff();
         goto MAINLOOP;
         }
 
       // Handle incoming requests
-      while ((m_buffer->HasLine() >= 0)&&(m_conn.IsOpen()))
+      while ((m_buffer->HasLine() >= 0)&&(m_conn->IsOpen()))
         {
         peers = StandardMetrics.ms_s_v2_peers->AsInt();
         ProcessServerMsg();
         if (StandardMetrics.ms_s_v2_peers->AsInt() > peers)
           {
           ESP_LOGI(TAG, "One or more peers have connected");
-          lasttx = 0; // A peer has connected, so force a transmission of status messages
+          all = true; // A peer has connected, so force a transmission of status messages
           }
         }
 
-      // Periodic transmission of metrics
+      // Detect silent connection drops the TCP keepalive does not catch,
+      //  i.e. a server or NAT gateway that has lost the connection state:
+      uint32_t mono = monotonictime;
+      if (m_pingsent && (mono - m_pingsent >= OVMS_SERVER_V2_PING_TIMEOUT))
+        {
+        m_stat_pingtimeouts++;
+        Disconnect();
+        SetStatus("Error: Server ping timeout",true);
+        continue;
+        }
+      else if (!m_pingsent && (mono - m_lastrx >= OVMS_SERVER_V2_PING_IDLE))
+        {
+        Transmit("MP-0 A");
+        m_pingsent = mono;
+        }
+
+      // Scheduled transmission of metrics
       peers = StandardMetrics.ms_s_v2_peers->AsInt();
       bool caron = StandardMetrics.ms_v_env_on->AsBool();
       int now = StandardMetrics.ms_m_monotonic->AsInt();
-      int next = (peers==0) ? 600 : 60;
-      if ((lasttx==0)||(now>(lasttx+next)))
+      TransmitScheduled(all);
+      if (all)
         {
-        TransmitMsgStat(true);          // Send always, periodically
-        TransmitMsgEnvironment(true);   // Send always, periodically
-        TransmitMsgGPS(lasttx==0);
-        TransmitMsgGroup(lasttx==0);
-        TransmitMsgTPMS(lasttx==0);
-        TransmitMsgFirmware(lasttx==0);
-        TransmitMsgCapabilities(lasttx==0);
-        lasttx = lasttx_stream = now;
+        all = false;
+        lasttx_stream = now;
         }
       else if (m_streaming && caron && peers && now > lasttx_stream+m_streaming)
         {
@@ -274,22 +439,29 @@ void OvmsServerV2::ServerTask()
         lasttx_stream = now;
         }
 
-      if (m_now_stat) TransmitMsgStat();
-      if (m_now_environment) TransmitMsgEnvironment();
-      if (m_now_gps) TransmitMsgGPS();
-      if (m_now_group) TransmitMsgGroup();
-      if (m_now_tpms) TransmitMsgTPMS();
-      if (m_now_firmware) TransmitMsgFirmware();
-      if (m_now_capabilities) TransmitMsgCapabilities();
-
       if (m_pending_notify_info) TransmitNotifyInfo();
       if (m_pending_notify_error) TransmitNotifyError();
       if (m_pending_notify_alert) TransmitNotifyAlert();
       if (m_pending_notify_data) TransmitNotifyData();
 
-      // Poll for new data
-      if ((m_buffer->PollSocket(m_conn.Socket(),1000) < 0)||
-          (!MyNetManager.m_connected_any))
+      // Send all messages of this round at once:
+      TransmitFlush();
+
+      // Sleep until socket data, a signal or the next scheduled action.
+      //  Data already received by the connection (TLS) can be read now.
+      wakeup = 0;
+      if (m_conn->Pending() > 0)
+        wakeup = OVMS_SERVER_V2_WAKE_RX;
+      else
+        xTaskNotifyWait(0, ULONG_MAX, &wakeup, NextWait(lasttx_stream) * 1000 / portTICK_PERIOD_MS);
+      if (wakeup) m_stat_wakeups++;
+      if (wakeup & OVMS_SERVER_V2_WAKE_RX)
+        {
+        if (m_buffer->PollConnection(m_conn,0) < 0)
+          Disconnect();
+        xTaskNotifyGive(m_rxwatch_task);
+        }
+      if (!MyNetManager.m_connected_any)
         {
         Disconnect();
         }
@@ -320,6 +492,10 @@ void OvmsServerV2::ProcessServerMsg()
   char code = line[5];
   const char* payload = line.c_str()+6;
 
+  // Any valid message proves the connection is alive:
+  m_lastrx = monotonictime;
+  m_pingsent = 0;
+
   switch(code)
     {
     case 'A': // PING
@@ -327,6 +503,10 @@ void OvmsServerV2::ProcessServerMsg()
       Transmit("MP-0 a");
       break;
       }
+    case 'a': // PING response
+      {
+      break;
+      }
     case 'Z': // Peer connections
       {
       int oldpeers = StandardMetrics.ms_s_v2_peers->AsInt();
@@ -449,6 +629,7 @@ void OvmsServerV2::ProcessCommand(const char* payload)
       }
     case 5: // Reboot
       {
+      MyEvents.SignalEventSync("system.shutdown", NULL);
       esp_restart();
       break;
       }
@@ -641,59 +822,147 @@ void OvmsServerV2::ProcessCommand(const char* payload)
 
 void OvmsServerV2::Transmit(const std::ostringstream& message)
   {
-  const char* bp = message.str().c_str();
-  int len = strlen(bp);
-  if (len==0) return;
-
-  char* s = new char[len+1];
-  strncpy(s,bp,len+1);
-  ESP_LOGI(TAG, "Send %s",s);
-
-  RC4_crypt(&m_crypto_tx1, &m_crypto_tx2, (uint8_t*)s, len);
+  std::string s = message.str();
+  Transmit(s.data(), s.length());
+  }
 
-  char* buf = new char[(len*2)+4];
-  base64encode((uint8_t*)s, len, (uint8_t*)buf);
-  strcat(buf,"\r\n");
-  m_conn.Write(buf,strlen(buf));
+void OvmsServerV2::Transmit(const std::string& message)
+  {
+  Transmit(message.data(), message.length());
+  }
 
-  delete [] buf;
-  delete [] s;
+void OvmsServerV2::Transmit(const char* message)
+  {
+  Transmit(message, strlen(message));
   }
 
-void OvmsServerV2::Transmit(const std::string& message)
+/**
+ * Transmit: encrypt & encode the message into the transmit arena.
+ *  Messages from the server task are collected and sent with a single
+ *  write by TransmitFlush() at the end of the task loop iteration,
+ *  messages from other tasks are sent immediately.
+ */
+void OvmsServerV2::Transmit(const char* message, size_t length)
   {
-  int len = message.length();
-  char* s = new char[len];
-  memcpy(s,message.c_str(),len);
-  ESP_LOGI(TAG, "Send %s",message.c_str());
+  if (length == 0) return;
+  ESP_LOGI(TAG, "Send %.*s", (int)length, message);
 
-  RC4_crypt(&m_crypto_tx1, &m_crypto_tx2, (uint8_t*)s, len);
+  xSemaphoreTake(m_tx_mutex, portMAX_DELAY);
+  TransmitEncode(message, length);
+  xSemaphoreGive(m_tx_mutex);
+  }
 
-  char* buf = new char[(len*2)+4];
-  base64encode((uint8_t*)s, len, (uint8_t*)buf);
-  strcat(buf,"\r\n");
-  m_conn.Write(buf,strlen(buf));
+/**
+ * Transmitf: printf style API, formatting directly into the arena
+ */
+void OvmsServerV2::Transmitf(const char* fmt, ...)
+  {
+  va_list args;
+  xSemaphoreTake(m_tx_mutex, portMAX_DELAY);
+  for (int pass=0; pass<2; pass++)
+    {
+    // The text is formatted into the upper part of the free space, the
+    // encoded message grows up to it (4 chars for 3 bytes):
+    size_t room = OVMS_PROTOCOL_V2_TXARENA - m_tx_size;
+    size_t gap = room/4 + 4;
+    if (room > gap + 2)
+      {
+      char* text = m_tx_arena + m_tx_size + gap;
+      va_start(args, fmt);
+      int len = vsnprintf(text, room - gap, fmt, args);
+      va_end(args);
+      if ((len >= 0) && ((size_t)len < room - gap) &&
+          ((size_t)(len+2)/3 <= gap) && (((size_t)(len+2)/3)*4 + 2 <= room))
+        {
+        if (len > 0)
+          {
+          ESP_LOGI(TAG, "Send %s", text);
+          TransmitEncode(text, len);
+          }
+        xSemaphoreGive(m_tx_mutex);
+        return;
+        }
+      }
+    if (m_tx_size == 0)
+      break;
+    TransmitWrite();
+    }
+  xSemaphoreGive(m_tx_mutex);
+
+  // Too long for the arena:
+  char *buffer;
+  va_start(args, fmt);
+  int len = vasprintf(&buffer, fmt, args);
+  va_end(args);
+  if (len > 0)
+    Transmit(buffer, len);
+  free(buffer);
+  }
 
-  delete [] buf;
-  delete [] s;
+/**
+ * TransmitFlush: send the messages collected in the arena
+ */
+void OvmsServerV2::TransmitFlush()
+  {
+  xSemaphoreTake(m_tx_mutex, portMAX_DELAY);
+  if (m_tx_size > 0)
+    TransmitWrite();
+  xSemaphoreGive(m_tx_mutex);
   }
 
-void OvmsServerV2::Transmit(const char* message)
+// Call with m_tx_mutex held. Messages too long for the arena are sent
+// in parts, split at multiples of 3 bytes to keep the encoding intact.
+void OvmsServerV2::TransmitEncode(const char* message, size_t length)
   {
-  int len = strlen(message);
-  char* s = new char[len];
-  memcpy(s,message,len);
-  ESP_LOGI(TAG, "Send %s",message);
+  if ((m_tx_size > 0) && (((length+2)/3)*4 + 2 > OVMS_PROTOCOL_V2_TXARENA - m_tx_size))
+    TransmitWrite();
 
-  RC4_crypt(&m_crypto_tx1, &m_crypto_tx2, (uint8_t*)s, len);
+  while (length > 0)
+    {
+    size_t room = OVMS_PROTOCOL_V2_TXARENA - m_tx_size;
+    if (room < 6)
+      {
+      TransmitWrite();
+      continue;
+      }
+    size_t n = ((room-2)/4)*3;
+    if (n > length) n = length;
+    uint8_t* end = RC4_crypt_base64(&m_crypto_tx1, &m_crypto_tx2,
+      (const uint8_t*)message, n, (uint8_t*)m_tx_arena + m_tx_size);
+    m_tx_size = (char*)end - m_tx_arena;
+    message += n;
+    length -= n;
+    }
+  m_tx_arena[m_tx_size++] = '\r';
+  m_tx_arena[m_tx_size++] = '\n';
+  m_tx_stat_messages++;
 
-  char* buf = new char[(len*2)+4];
-  base64encode((uint8_t*)s, len, (uint8_t*)buf);
-  strcat(buf,"\r\n");
-  m_conn.Write(buf,strlen(buf));
+  if (xTaskGetCurrentTaskHandle() != m_task)
+    TransmitWrite();
+  }
 
-  delete [] buf;
-  delete [] s;
+// Call with m_tx_mutex held. The arena is empty afterwards, a failed
+// write (i.e. the send timeout) drops the data, the server task then
+// closes the connection.
+void OvmsServerV2::TransmitWrite()
+  {
+  size_t done = 0;
+  while ((done < m_tx_size) && m_conn->IsOpen())
+    {
+    ssize_t n = m_conn->Write(m_tx_arena + done, m_tx_size - done);
+    if (n <= 0)
+      {
+      ESP_LOGW(TAG, "Transmit failed, %u bytes dropped", m_tx_size - done);
+      m_tx_failed = true;
+      if (xTaskGetCurrentTaskHandle() != m_task)
+        Wakeup(OVMS_SERVER_V2_WAKE_TXFAIL);
+      break;
+      }
+    done += n;
+    }
+  m_tx_stat_writes++;
+  m_tx_stat_bytes += done;
+  m_tx_size = 0;
   }
 
 void OvmsServerV2::SetStatus(const char* status, bool fault)
@@ -711,7 +980,8 @@ bool OvmsServerV2::Connect()
   m_server = MyConfig.GetParamValue("server.v2", "server");
   m_password = MyConfig.GetParamValue("server.v2", "password");
   m_port = MyConfig.GetParamValue("server.v2", "port");
-  if (m_port.empty()) m_port = "6867";
+  bool tls = MyConfig.GetParamValueBool("server.v2", "tls", false);
+  if (m_port.empty()) m_port = tls ? "6870" : "6867";
 
   ESP_LOGI(TAG, "Connection is %s:%s %s/%s",
     m_server.c_str(), m_port.c_str(),
@@ -733,13 +1003,64 @@ bool OvmsServerV2::Connect()
     return false;
     }
 
-  m_conn.Connect(m_server.c_str(), m_port.c_str());
-  if (!m_conn.IsOpen())
+  OvmsNetTcpConnection* conn = &m_tcp;
+#ifdef CONFIG_OVMS_COMP_SERVER_V2_TLS
+  bool tls_cache = MyConfig.GetParamValueBool("server.v2", "tls.cache", true);
+  if (tls)
     {
+    if (!m_tls_cache_loaded)
+      {
+      // The cache holds session secrets, remove the unprotected copy of
+      // earlier builds:
+      unlink(OVMS_SERVER_V2_TLS_CACHE_OLD);
+      if (tls_cache)
+        OvmsNetTlsConnection::LoadSessionCache(OVMS_SERVER_V2_TLS_CACHE);
+      m_tls_cache_loaded = true;
+      }
+    m_tls.SetPin(MyConfig.GetParamValue("server.v2", "tls.pin"));
+    conn = &m_tls;
+    }
+#else
+  if (tls)
+    ESP_LOGW(TAG, "TLS support not included in this build, connecting without");
+#endif // #ifdef CONFIG_OVMS_COMP_SERVER_V2_TLS
+  CloseConnection(conn);
+
+  m_conn->Connect(m_server.c_str(), m_port.c_str(), OVMS_SERVER_V2_CONNECT_TIMEOUT);
+  if (!m_conn->IsOpen())
+    {
+#ifdef CONFIG_OVMS_COMP_SERVER_V2_TLS
+    if ((m_conn == &m_tls) && m_tls.m_pin_mismatch)
+      {
+      SetStatus("Error: TLS server key does not match the pin (see 'server v2 pin')",true);
+      return false;
+      }
+#endif // #ifdef CONFIG_OVMS_COMP_SERVER_V2_TLS
     SetStatus("Error: Cannot establish tcp/ip connection to server",true);
     return false;
     }
 
+#ifdef CONFIG_OVMS_COMP_SERVER_V2_TLS
+  if ((m_conn == &m_tls) && !m_tls.m_resumed)
+    {
+    // Trust on first use: pin the server key for all later connects. A
+    // certificate pin of an earlier build is replaced by the key pin.
+    if ((MyConfig.GetParamValue("server.v2", "tls.pin").empty() || m_tls.m_pin_legacy) &&
+        !m_tls.m_fingerprint.empty())
+      {
+      ESP_LOGW(TAG, "TLS server key pinned %s: %s", m_tls.m_pin_legacy ? "from certificate pin" : "on first use",
+        m_tls.m_fingerprint.c_str());
+      MyConfig.SetParamValue("server.v2", "tls.pin", m_tls.m_fingerprint);
+      }
+    // Keep the new session for resumption after a reboot:
+    else if (tls_cache && m_tls.SessionPersistable())
+      OvmsNetTlsConnection::SaveSessionCache(OVMS_SERVER_V2_TLS_CACHE);
+    }
+#endif // #ifdef CONFIG_OVMS_COMP_SERVER_V2_TLS
+  m_conn->SetKeepAlive(OVMS_SERVER_V2_KEEPALIVE_IDLE,
+    OVMS_SERVER_V2_KEEPALIVE_INTVL, OVMS_SERVER_V2_KEEPALIVE_COUNT);
+  m_conn->SetSendTimeout(OVMS_SERVER_V2_SEND_TIMEOUT);
+
   ESP_LOGI(TAG, "Connected to OVMS Server V2 at %s",m_server.c_str());
   SetStatus("Connected to server");
   return true;
@@ -747,14 +1068,36 @@ bool OvmsServerV2::Connect()
 
 void OvmsServerV2::Disconnect()
   {
-  if (m_conn.IsOpen())
-    {
-    m_conn.Disconnect();
+  bool open = m_conn->IsOpen();
+  CloseConnection();
+  if (open)
     SetStatus("Error: Disconnected from OVMS Server V2",true);
-    }
   StandardMetrics.ms_s_v2_connected->SetValue(false);
   }
 
+/**
+ * CloseConnection: close the socket and optionally switch to the next
+ *  connection object. The rx watch task and transmissions from other
+ *  tasks use the socket concurrently, so they are locked out first.
+ *  Shutting down the receive side ends a select() in progress.
+ */
+void OvmsServerV2::CloseConnection(OvmsNetTcpConnection* next)
+  {
+  xSemaphoreTake(m_tx_mutex, portMAX_DELAY);
+  m_tx_size = 0;
+  m_tx_failed = false;
+  int sock = m_conn->Socket();
+  if (sock >= 0)
+    shutdown(sock, SHUT_RD);
+  xSemaphoreTake(m_rxwatch_mutex, portMAX_DELAY);
+  if (m_conn->IsOpen())
+    m_conn->Disconnect();
+  if (next)
+    m_conn = next;
+  xSemaphoreGive(m_rxwatch_mutex);
+  xSemaphoreGive(m_tx_mutex);
+  }
+
 bool OvmsServerV2::Login()
   {
   SetStatus("Logging in...");
@@ -781,16 +1124,16 @@ bool OvmsServerV2::Login()
   ESP_LOGI(TAG, "Sending server login: %s",hello);
   strcat(hello,"\r\n");
 
-  m_conn.Write(hello, strlen(hello));
+  m_conn->Write(hello, strlen(hello));
 
   // Wait 20 seconds for a server response
   while (m_buffer->HasLine() < 0)
     {
-    int result = m_buffer->PollSocket(m_conn.Socket(),20000);
+    int result = m_buffer->PollConnection(m_conn,20000);
     if (result <= 0)
       {
       ESP_LOGI(TAG, "Server response is incomplete (%d bytes)",m_buffer->UsedSpace());
-      m_conn.Disconnect();
+      CloseConnection();
       SetStatus("Error: Server response is incomplete",true);
       return false;
       }
@@ -851,10 +1194,95 @@ bool OvmsServerV2::Login()
     }
   }
 
-void OvmsServerV2::TransmitMsgStat(bool always)
+/**
+ * TransmitScheduled: send the status messages due, in the priority
+ *  order of the vehicle state. Messages are due periodically, or when
+ *  an important metric has changed and the minimum interval has passed.
+ *  all: send all messages now, i.e. after login or a peer connect
+ */
+void OvmsServerV2::TransmitScheduled(bool all)
+  {
+  uint32_t now = monotonictime;
+  int apps = (StandardMetrics.ms_s_v2_peers->AsInt() > 0) ? 1 : 0;
+  v2_state_t state = V2_STATE_PARKED;
+  if (StandardMetrics.ms_v_charge_inprogress->AsBool())
+    state = V2_STATE_CHARGING;
+  else if (StandardMetrics.ms_v_env_on->AsBool())
+    state = V2_STATE_DRIVING;
+
+  uint32_t pending = m_now.exchange(0);
+  for (int i=0; i<V2_MSG_COUNT; i++)
+    {
+    int msg = v2_order[state][i];
+    v2_msgstat_t& ms = m_msgstat[msg];
+    if (all)
+      {
+      ms.valid = false;
+      ms.lastcheck = now;
+      TransmitMsg(msg, true);
+      }
+    else if (now - ms.lastcheck >= v2_sched[msg].period[apps][state])
+      {
+      // Stat & environment are checked always, others if modified:
+      ms.lastcheck = now;
+      TransmitMsg(msg, (msg == V2_MSG_STAT) || (msg == V2_MSG_ENVIRONMENT));
+      }
+    else if (pending & (1 << msg))
+      {
+      if (now - ms.lastsent >= v2_sched[msg].min[state])
+        TransmitMsg(msg, false);
+      else
+        m_now |= (1 << msg);  // Retry next round
+      }
+    }
+  }
+
+void OvmsServerV2::TransmitMsg(int msg, bool always)
+  {
+  switch (msg)
+    {
+    case V2_MSG_STAT:         TransmitMsgStat(always); break;
+    case V2_MSG_ENVIRONMENT:  TransmitMsgEnvironment(always); break;
+    case V2_MSG_GPS:          TransmitMsgGPS(always); break;
+    case V2_MSG_GROUP:        TransmitMsgGroup(always); break;
+    case V2_MSG_TPMS:         TransmitMsgTPMS(always); break;
+    case V2_MSG_FIRMWARE:     TransmitMsgFirmware(always); break;
+    case V2_MSG_CAPABILITIES: TransmitMsgCapabilities(always); break;
+    default: break;
+    }
+  }
+
+/**
+ * TransmitMessage: send a status message unless its content is the same
+ *  as the last one sent
+ */
+void OvmsServerV2::TransmitMessage(int msg, const std::string& message)
+  {
+  v2_msgstat_t& ms = m_msgstat[msg];
+  uint32_t crc = crc32(0, message.data(), message.length());
+  uint32_t encoded = ((message.length()+2)/3)*4 + 2;
+  if (ms.valid && (ms.crc == crc))
+    {
+    ms.skipped++;
+    ms.bytes_saved += encoded;
+    return;
+    }
+  Transmit(message);
+  ms.crc = crc;
+  ms.valid = true;
+  ms.sent++;
+  ms.bytes += encoded;
+  ms.lastsent = monotonictime;
+  }
+
+void OvmsServerV2::MapMetrics(int msg, std::initializer_list<OvmsMetric*> metrics)
   {
-  m_now_stat = false;
+  for (OvmsMetric* m : metrics)
+    m_metric_msgs[m] |= (1 << msg);
+  }
 
+void OvmsServerV2::TransmitMsgStat(bool always)
+  {
   bool modified =
     StandardMetrics.ms_v_bat_soc->IsModifiedAndClear(MyOvmsServerV2Modifier) |
     StandardMetrics.ms_v_charge_voltage->IsModifiedAndClear(MyOvmsServerV2Modifier) |
@@ -885,91 +1313,107 @@ void OvmsServerV2::TransmitMsgStat(bool always)
   // Quick exit if nothing modified
   if ((!always)&&(!modified)) return;
 
-  int mins_range = StandardMetrics.ms_v_charge_duration_range->AsInt();
-  int mins_soc = StandardMetrics.ms_v_charge_duration_soc->AsInt();
-  bool charging = StandardMetrics.ms_v_charge_inprogress->AsBool();
+  // The charge state group is updated by the vehicle task while we read it,
+  // so read it as a coherent snapshot:
+  OvmsMetricSnapshot snapshot({
+    StandardMetrics.ms_v_bat_soc,
+    StandardMetrics.ms_v_charge_state,
+    StandardMetrics.ms_v_charge_substate,
+    StandardMetrics.ms_v_charge_mode,
+    StandardMetrics.ms_v_charge_inprogress,
+    StandardMetrics.ms_v_charge_duration_range,
+    StandardMetrics.ms_v_charge_duration_soc,
+    StandardMetrics.ms_v_bat_power });
 
   std::ostringstream buffer;
-  buffer
-    << std::fixed
-    << std::setprecision(2)
-    << "MP-0 S"
-    << StandardMetrics.ms_v_bat_soc->AsInt()
-    << ","
-    << ((m_units_distance == Kilometers) ? "K" : "M")
-    << ","
-    << StandardMetrics.ms_v_charge_voltage->AsInt()
-    << ","
-    << StandardMetrics.ms_v_charge_current->AsInt()
-    << ","
-    << StandardMetrics.ms_v_charge_state->AsString("stopped")
-    << ","
-    << StandardMetrics.ms_v_charge_mode->AsString("standard")
-    << ","
-    << StandardMetrics.ms_v_bat_range_ideal->AsInt(0, m_units_distance)
-    << ","
-    << StandardMetrics.ms_v_bat_range_est->AsInt(0, m_units_distance)
-    << ","
-    << StandardMetrics.ms_v_charge_climit->AsInt()
-    << ","
-    << StandardMetrics.ms_v_charge_time->AsInt(0,Minutes)
-    << ","
-    << "0"  // car_charge_b4
-    << ","
-    << StandardMetrics.ms_v_charge_kwh->AsInt()
-    << ","
-    << chargesubstate_key(StandardMetrics.ms_v_charge_substate->AsString(""))
-    << ","
-    << chargestate_key(StandardMetrics.ms_v_charge_state->AsString("stopped"))
-    << ","
-    << chargemode_key(StandardMetrics.ms_v_charge_mode->AsString("standard"))
-    << ","
-    << StandardMetrics.ms_v_charge_timermode->AsBool()
-    << ","
-    << StandardMetrics.ms_v_charge_timerstart->AsInt()
-    << ","
-    << "0"  // car_stale_timer
-    << ","
-    << StandardMetrics.ms_v_bat_cac->AsFloat()
-    << ","
-    << StandardMetrics.ms_v_charge_duration_full->AsInt()
-    << ","
-    << (((mins_range >= 0) && (mins_range < mins_soc)) ? mins_range : mins_soc)
-    << ","
-    << (int) StandardMetrics.ms_v_charge_limit_range->AsFloat(0, m_units_distance)
-    << ","
-    << StandardMetrics.ms_v_charge_limit_soc->AsInt()
-    << ","
-    << (StandardMetrics.ms_v_env_cooling->AsBool() ? 0 : -1)
-    << ","
-    << "0"  // car_cooldown_tbattery
-    << ","
-    << "0"  // car_cooldown_timelimit
-    << ","
-    << "0"  // car_chargeestimate
-    << ","
-    << mins_range
-    << ","
-    << mins_soc
-    << ","
-    << StandardMetrics.ms_v_bat_range_full->AsInt(0, m_units_distance)
-    << ","
-    << "0"  // car_chargetype
-    << ","
-    << (charging ? -StandardMetrics.ms_v_bat_power->AsFloat() : 0)
-    << ","
-    << StandardMetrics.ms_v_bat_voltage->AsFloat()
-    << ","
-    << StandardMetrics.ms_v_bat_soh->AsInt()
-    ;
+  do
+    {
+    snapshot.Begin();
+
+    int mins_range = StandardMetrics.ms_v_charge_duration_range->AsInt();
+    int mins_soc = StandardMetrics.ms_v_charge_duration_soc->AsInt();
+    bool charging = StandardMetrics.ms_v_charge_inprogress->AsBool();
 
-  Transmit(buffer.str().c_str());
+    buffer.str("");
+    buffer
+      << std::fixed
+      << std::setprecision(2)
+      << "MP-0 S"
+      << StandardMetrics.ms_v_bat_soc->AsInt()
+      << ","
+      << ((m_units_distance == Kilometers) ? "K" : "M")
+      << ","
+      << StandardMetrics.ms_v_charge_voltage->AsInt()
+      << ","
+      << StandardMetrics.ms_v_charge_current->AsInt()
+      << ","
+      << StandardMetrics.ms_v_charge_state->AsString("stopped")
+      << ","
+      << StandardMetrics.ms_v_charge_mode->AsString("standard")
+      << ","
+      << StandardMetrics.ms_v_bat_range_ideal->AsInt(0, m_units_distance)
+      << ","
+      << StandardMetrics.ms_v_bat_range_est->AsInt(0, m_units_distance)
+      << ","
+      << StandardMetrics.ms_v_charge_climit->AsInt()
+      << ","
+      << StandardMetrics.ms_v_charge_time->AsInt(0,Minutes)
+      << ","
+      << "0"  // car_charge_b4
+      << ","
+      << StandardMetrics.ms_v_charge_kwh->AsInt()
+      << ","
+      << chargesubstate_key(StandardMetrics.ms_v_charge_substate->AsString(""))
+      << ","
+      << chargestate_key(StandardMetrics.ms_v_charge_state->AsString("stopped"))
+      << ","
+      << chargemode_key(StandardMetrics.ms_v_charge_mode->AsString("standard"))
+      << ","
+      << StandardMetrics.ms_v_charge_timermode->AsBool()
+      << ","
+      << StandardMetrics.ms_v_charge_timerstart->AsInt()
+      << ","
+      << "0"  // car_stale_timer
+      << ","
+      << StandardMetrics.ms_v_bat_cac->AsFloat()
+      << ","
+      << StandardMetrics.ms_v_charge_duration_full->AsInt()
+      << ","
+      << (((mins_range >= 0) && (mins_range < mins_soc)) ? mins_range : mins_soc)
+      << ","
+      << (int) StandardMetrics.ms_v_charge_limit_range->AsFloat(0, m_units_distance)
+      << ","
+      << StandardMetrics.ms_v_charge_limit_soc->AsInt()
+      << ","
+      << (StandardMetrics.ms_v_env_cooling->AsBool() ? 0 : -1)
+      << ","
+      << "0"  // car_cooldown_tbattery
+      << ","
+      << "0"  // car_cooldown_timelimit
+      << ","
+      << "0"  // car_chargeestimate
+      << ","
+      << mins_range
+      << ","
+      << mins_soc
+      << ","
+      << StandardMetrics.ms_v_bat_range_full->AsInt(0, m_units_distance)
+      << ","
+      << "0"  // car_chargetype
+      << ","
+      << (charging ? -StandardMetrics.ms_v_bat_power->AsFloat() : 0)
+      << ","
+      << StandardMetrics.ms_v_bat_voltage->AsFloat()
+      << ","
+      << StandardMetrics.ms_v_bat_soh->AsInt()
+      ;
+    } while (snapshot.Changed());
+
+  TransmitMessage(V2_MSG_STAT, buffer.str());
   }
 
 void OvmsServerV2::TransmitMsgGPS(bool always)
   {
-  m_now_gps = false;
-
   bool modified =
     StandardMetrics.ms_v_pos_latitude->IsModifiedAndClear(MyOvmsServerV2Modifier) |
     StandardMetrics.ms_v_pos_longitude->IsModifiedAndClear(MyOvmsServerV2Modifier) |
@@ -985,46 +1429,57 @@ void OvmsServerV2::TransmitMsgGPS(bool always)
   // Quick exit if nothing modified
   if ((!always)&&(!modified)) return;
 
-  bool stale =
-    StandardMetrics.ms_v_pos_latitude->IsStale() ||
-    StandardMetrics.ms_v_pos_longitude->IsStale() ||
-    StandardMetrics.ms_v_pos_direction->IsStale() ||
-    StandardMetrics.ms_v_pos_altitude->IsStale();
-
-  char drivemode[10];
-  sprintf(drivemode, "%x", StandardMetrics.ms_v_env_drivemode->AsInt());
+  OvmsMetricSnapshot snapshot({
+    StandardMetrics.ms_v_pos_latitude,
+    StandardMetrics.ms_v_pos_longitude,
+    StandardMetrics.ms_v_pos_direction,
+    StandardMetrics.ms_v_pos_altitude,
+    StandardMetrics.ms_v_pos_speed });
 
   std::ostringstream buffer;
-  buffer
-    << "MP-0 L"
-    << StandardMetrics.ms_v_pos_latitude->AsString("0",Other,6)
-    << ","
-    << StandardMetrics.ms_v_pos_longitude->AsString("0",Other,6)
-    << ","
-    << StandardMetrics.ms_v_pos_direction->AsString("0")
-    << ","
-    << StandardMetrics.ms_v_pos_altitude->AsString("0")
-    << ","
-    << StandardMetrics.ms_v_pos_gpslock->AsBool(false)
-    << ((stale)?",0,":",1,")
-    << ((m_units_distance == Kilometers)? StandardMetrics.ms_v_pos_speed->AsString("0") : StandardMetrics.ms_v_pos_speed->AsString("0",Mph))
-    << ","
-    << drivemode
-    << ","
-    << StandardMetrics.ms_v_bat_power->AsString("0",Other,1)
-    << ","
-    << StandardMetrics.ms_v_bat_energy_used->AsString("0",Other,0)
-    << ","
-    << StandardMetrics.ms_v_bat_energy_recd->AsString("0",Other,0)
-    ;
+  do
+    {
+    snapshot.Begin();
+
+    bool stale =
+      StandardMetrics.ms_v_pos_latitude->IsStale() ||
+      StandardMetrics.ms_v_pos_longitude->IsStale() ||
+      StandardMetrics.ms_v_pos_direction->IsStale() ||
+      StandardMetrics.ms_v_pos_altitude->IsStale();
+
+    char drivemode[10];
+    sprintf(drivemode, "%x", StandardMetrics.ms_v_env_drivemode->AsInt());
+
+    buffer.str("");
+    buffer
+      << "MP-0 L"
+      << StandardMetrics.ms_v_pos_latitude->AsString("0",Other,6)
+      << ","
+      << StandardMetrics.ms_v_pos_longitude->AsString("0",Other,6)
+      << ","
+      << StandardMetrics.ms_v_pos_direction->AsString("0")
+      << ","
+      << StandardMetrics.ms_v_pos_altitude->AsString("0")
+      << ","
+      << StandardMetrics.ms_v_pos_gpslock->AsBool(false)
+      << ((stale)?",0,":",1,")
+      << ((m_units_distance == Kilometers)? StandardMetrics.ms_v_pos_speed->AsString("0") : StandardMetrics.ms_v_pos_speed->AsString("0",Mph))
+      << ","
+      << drivemode
+      << ","
+      << StandardMetrics.ms_v_bat_power->AsString("0",Other,1)
+      << ","
+      << StandardMetrics.ms_v_bat_energy_used->AsString("0",Other,0)
+      << ","
+      << StandardMetrics.ms_v_bat_energy_recd->AsString("0",Other,0)
+      ;
+    } while (snapshot.Changed());
 
-  Transmit(buffer.str().c_str());
+  TransmitMessage(V2_MSG_GPS, buffer.str());
   }
 
 void OvmsServerV2::TransmitMsgTPMS(bool always)
   {
-  m_now_tpms = false;
-
   bool modified =
     StandardMetrics.ms_v_tpms_fl_t->IsModifiedAndClear(MyOvmsServerV2Modifier) |
     StandardMetrics.ms_v_tpms_fr_t->IsModifiedAndClear(MyOvmsServerV2Modifier) |
@@ -1069,13 +1524,11 @@ void OvmsServerV2::TransmitMsgTPMS(bool always)
     << ((stale)?",0":",1")
     ;
 
-  Transmit(buffer.str().c_str());
+  TransmitMessage(V2_MSG_TPMS, buffer.str());
   }
 
 void OvmsServerV2::TransmitMsgFirmware(bool always)
   {
-  m_now_firmware = false;
-
   bool modified =
     StandardMetrics.ms_m_version->IsModifiedAndClear(MyOvmsServerV2Modifier) |
     StandardMetrics.ms_v_vin->IsModifiedAndClear(MyOvmsServerV2Modifier) |
@@ -1100,7 +1553,7 @@ void OvmsServerV2::TransmitMsgFirmware(bool always)
     << StandardMetrics.ms_m_net_provider->AsString("")
     ;
 
-  Transmit(buffer.str().c_str());
+  TransmitMessage(V2_MSG_FIRMWARE, buffer.str());
   }
 
 uint8_t Doors1()
@@ -1162,8 +1615,6 @@ uint8_t Doors5()
 
 void OvmsServerV2::TransmitMsgEnvironment(bool always)
   {
-  m_now_environment = false;
-
   bool modified =
     // doors 1
     StandardMetrics.ms_v_door_fl->IsModifiedAndClear(MyOvmsServerV2Modifier) |
@@ -1259,7 +1710,7 @@ void OvmsServerV2::TransmitMsgEnvironment(bool always)
     << StandardMetrics.ms_v_bat_12v_current->AsString("0")
     ;
 
-  Transmit(buffer.str().c_str());
+  TransmitMessage(V2_MSG_ENVIRONMENT, buffer.str());
   }
 
 void OvmsServerV2::TransmitNotifyInfo()
@@ -1276,11 +1727,7 @@ void OvmsServerV2::TransmitNotifyInfo()
     OvmsNotifyEntry* e = info->FirstUnreadEntry(MyOvmsServerV2Reader, 0);
     if (e == NULL) return;
 
-    std::ostringstream buffer;
-    buffer
-      << "MP-0 PI"
-      << mp_encode(e->GetValue());
-    Transmit(buffer.str().c_str());
+    Transmitf("MP-0 PI%s", mp_encode(e->GetValue()).c_str());
 
     info->MarkRead(MyOvmsServerV2Reader, e);
     }
@@ -1300,11 +1747,8 @@ void OvmsServerV2::TransmitNotifyError()
     OvmsNotifyEntry* e = alert->FirstUnreadEntry(MyOvmsServerV2Reader, 0);
     if (e == NULL) return;
 
-    std::ostringstream buffer;
-    buffer
-      << "MP-0 PE"
-      << e->GetValue(); // no mp_encode; payload structure "<vehicletype>,<errorcode>,<errordata>"
-    Transmit(buffer.str().c_str());
+    // no mp_encode; payload structure "<vehicletype>,<errorcode>,<errordata>"
+    Transmitf("MP-0 PE%s", e->GetValue().c_str());
 
     alert->MarkRead(MyOvmsServerV2Reader, e);
     }
@@ -1324,11 +1768,7 @@ void OvmsServerV2::TransmitNotifyAlert()
     OvmsNotifyEntry* e = alert->FirstUnreadEntry(MyOvmsServerV2Reader, 0);
     if (e == NULL) return;
 
-    std::ostringstream buffer;
-    buffer
-      << "MP-0 PA"
-      << mp_encode(e->GetValue());
-    Transmit(buffer.str().c_str());
+    Transmitf("MP-0 PA%s", mp_encode(e->GetValue()).c_str());
 
     alert->MarkRead(MyOvmsServerV2Reader, e);
     }
@@ -1348,6 +1788,22 @@ void OvmsServerV2::TransmitNotifyData()
     OvmsNotifyEntry* e = data->FirstUnreadEntry(MyOvmsServerV2Reader, m_pending_notify_data_last);
     if (e == NULL) return;
 
+    OvmsNotifyEntryBatch* batch = e->AsBatch();
+    if (batch)
+      {
+      // Send all records, they get acknowledged individually:
+      size_t pos = 0;
+      const char* rec;
+      size_t len;
+      uint32_t id = batch->m_id;
+      while (batch->NextRecord(pos, rec, len))
+        {
+        Transmitf("MP-0 h%u,%u,%.*s", ++id, monotonictime - e->m_created, (int)len, rec);
+        }
+      m_pending_notify_data_last = id;
+      continue;
+      }
+
     std::string msg = e->GetValue();
     ESP_LOGD(TAG, "TransmitNotifyData: msg=%s", msg.c_str());
 
@@ -1356,15 +1812,7 @@ void OvmsServerV2::TransmitNotifyData()
     if (eol != std::string::npos)
       msg.resize(eol);
 
-    std::ostringstream buffer;
-    buffer
-      << "MP-0 h"
-      << e->m_id
-      << ","
-      << monotonictime - e->m_created
-      << ","
-      << msg;
-    Transmit(buffer.str().c_str());
+    Transmitf("MP-0 h%u,%u,%s", e->m_id, monotonictime - e->m_created, msg.c_str());
     m_pending_notify_data_last = e->m_id;
     }
   }
@@ -1377,7 +1825,9 @@ void OvmsServerV2::HandleNotifyDataAck(uint32_t ack)
   OvmsNotifyEntry* e = data->FindEntry(ack);
   if (e)
     {
-    data->MarkRead(MyOvmsServerV2Reader, e);
+    OvmsNotifyEntryBatch* batch = e->AsBatch();
+    if ((batch == NULL) || batch->AckRecord(ack))
+      data->MarkRead(MyOvmsServerV2Reader, e);
     }
   }
 
@@ -1389,44 +1839,11 @@ void OvmsServerV2::MetricModified(OvmsMetric* metric)
   if (StandardMetrics.ms_s_v2_peers->AsInt() == 0)
     return;
 
-  if ((metric == StandardMetrics.ms_v_charge_climit)||
-      (metric == StandardMetrics.ms_v_charge_state)||
-      (metric == StandardMetrics.ms_v_charge_substate)||
-      (metric == StandardMetrics.ms_v_charge_mode)||
-      (metric == StandardMetrics.ms_v_charge_inprogress)||
-      (metric == StandardMetrics.ms_v_env_cooling)||
-      (metric == StandardMetrics.ms_v_bat_cac)||
-      (metric == StandardMetrics.ms_v_bat_soh))
-    {
-    m_now_stat = true;
-    }
-
-  if ((metric == StandardMetrics.ms_v_door_fl)||
-      (metric == StandardMetrics.ms_v_door_fr)||
-      (metric == StandardMetrics.ms_v_door_chargeport)||
-      (metric == StandardMetrics.ms_v_charge_pilot)||
-      (metric == StandardMetrics.ms_v_charge_inprogress)||
-      (metric == StandardMetrics.ms_v_env_handbrake)||
-      (metric == StandardMetrics.ms_v_env_on)||
-      (metric == StandardMetrics.ms_v_env_locked)||
-      (metric == StandardMetrics.ms_v_env_valet)||
-      (metric == StandardMetrics.ms_v_door_hood)||
-      (metric == StandardMetrics.ms_v_door_trunk)||
-      (metric == StandardMetrics.ms_v_env_awake)||
-      (metric == StandardMetrics.ms_v_env_cooling)||
-      (metric == StandardMetrics.ms_v_env_alarm)||
-      (metric == StandardMetrics.ms_v_door_rl)||
-      (metric == StandardMetrics.ms_v_door_rr)||
-      (metric == StandardMetrics.ms_v_env_charging12v)||
-      (metric == StandardMetrics.ms_v_env_hvac))
+  auto k = m_metric_msgs.find(metric);
+  if (k != m_metric_msgs.end())
     {
-    m_now_environment = true;
-    }
-
-  if ((metric == StandardMetrics.ms_v_env_drivemode)||
-      (metric == StandardMetrics.ms_v_pos_gpslock))
-    {
-    m_now_gps = true;
+    m_now |= k->second;
+    Wakeup(OVMS_SERVER_V2_WAKE_METRIC);
     }
   }
 
@@ -1440,11 +1857,7 @@ bool OvmsServerV2::IncomingNotification(OvmsNotifyType* type, OvmsNotifyEntry* e
       m_pending_notify_info = true;
       return false; // No connection, so leave it queued for when we do
       }
-    std::ostringstream buffer;
-    buffer
-      << "MP-0 PI"
-      << mp_encode(entry->GetValue());
-    Transmit(buffer.str().c_str());
+    Transmitf("MP-0 PI%s", mp_encode(entry->GetValue()).c_str());
     return true; // Mark it as read, as we've managed to send it
     }
   else if (strcmp(type->m_name,"error")==0)
@@ -1455,11 +1868,8 @@ bool OvmsServerV2::IncomingNotification(OvmsNotifyType* type, OvmsNotifyEntry* e
       m_pending_notify_error = true;
       return false; // No connection, so leave it queued for when we do
       }
-    std::ostringstream buffer;
-    buffer
-      << "MP-0 PE"
-      << entry->GetValue(); // no mp_encode; payload structure "<vehicletype>,<errorcode>,<errordata>"
-    Transmit(buffer.str().c_str());
+    // no mp_encode; payload structure "<vehicletype>,<errorcode>,<errordata>"
+    Transmitf("MP-0 PE%s", entry->GetValue().c_str());
     return true; // Mark it as read, as we've managed to send it
     }
   else if (strcmp(type->m_name,"alert")==0)
@@ -1470,17 +1880,14 @@ bool OvmsServerV2::IncomingNotification(OvmsNotifyType* type, OvmsNotifyEntry* e
       m_pending_notify_alert = true;
       return false; // No connection, so leave it queued for when we do
       }
-    std::ostringstream buffer;
-    buffer
-      << "MP-0 PA"
-      << mp_encode(entry->GetValue());
-    Transmit(buffer.str().c_str());
+    Transmitf("MP-0 PA%s", mp_encode(entry->GetValue()).c_str());
     return true; // Mark it as read, as we've managed to send it
     }
   else if (strcmp(type->m_name,"data")==0)
     {
     // Data notifications
     m_pending_notify_data = true;
+    Wakeup(OVMS_SERVER_V2_WAKE_NOTIFY);
     return false; // We just flag it for later transmission
     }
   else
@@ -1490,19 +1897,23 @@ bool OvmsServerV2::IncomingNotification(OvmsNotifyType* type, OvmsNotifyEntry* e
 /**
  * EventListener:
  */
-void OvmsServerV2::EventListener(std::string event, void* data)
+void OvmsServerV2::EventListener(event_id_t event, void* data)
   {
-  if (event == "system.modem.received.ussd")
+  if (event == m_event_ussd)
     {
     // forward USSD response to server:
     std::string buf = "MP-0 c41,0,";
     buf.append(mp_encode((char*) data));
     Transmit(buf);
     }
-  else if (event == "config.changed" || event == "config.mounted")
+  else if (event == EVENT_CONFIG_MOUNTED)
     {
     ConfigChanged((OvmsConfigParam*) data);
     }
+  else if ((event == m_event_netup) || (event == m_event_netdown))
+    {
+    Wakeup(OVMS_SERVER_V2_WAKE_NETWORK);
+    }
   }
 
 /**
@@ -1516,12 +1927,10 @@ void OvmsServerV2::ConfigChanged(OvmsConfigParam* param)
 
 void OvmsServerV2::TransmitMsgCapabilities(bool always)
   {
-  m_now_capabilities = false;
   }
 
 void OvmsServerV2::TransmitMsgGroup(bool always)
   {
-  m_now_group = false;
   }
 
 std::string OvmsServerV2::ReadLine()
@@ -1538,15 +1947,63 @@ OvmsServerV2::OvmsServerV2(const char* name)
     ESP_LOGI(TAG, "OVMS Server V2 registered metric modifier is #%d",MyOvmsServerV2Modifier);
     }
 
+  m_conn = &m_tcp;
+#ifdef CONFIG_OVMS_COMP_SERVER_V2_TLS
+  m_tls_cache_loaded = false;
+#endif // #ifdef CONFIG_OVMS_COMP_SERVER_V2_TLS
   m_buffer = new OvmsBuffer(1024);
+  m_tx_arena = new char[OVMS_PROTOCOL_V2_TXARENA];
+  m_tx_size = 0;
+  m_tx_failed = false;
+  m_tx_mutex = xSemaphoreCreateMutex();
+  m_rxwatch_mutex = xSemaphoreCreateMutex();
+  m_tx_stat_messages = 0;
+  m_tx_stat_writes = 0;
+  m_tx_stat_bytes = 0;
+  m_backoff = 0;
+  m_lastrx = 0;
+  m_pingsent = 0;
+  m_stat_connects = 0;
+  m_stat_connectfails = 0;
+  m_stat_pingtimeouts = 0;
+  m_stat_wakeups = 0;
+  memset(m_msgstat, 0, sizeof(m_msgstat));
+  m_now = 0;
+
+  // Metrics to send ASAP when changed:
+  MapMetrics(V2_MSG_STAT, {
+    StandardMetrics.ms_v_charge_climit,
+    StandardMetrics.ms_v_charge_state,
+    StandardMetrics.ms_v_charge_substate,
+    StandardMetrics.ms_v_charge_mode,
+    StandardMetrics.ms_v_charge_inprogress,
+    StandardMetrics.ms_v_env_cooling,
+    StandardMetrics.ms_v_bat_cac,
+    StandardMetrics.ms_v_bat_soh });
+  MapMetrics(V2_MSG_ENVIRONMENT, {
+    StandardMetrics.ms_v_door_fl,
+    StandardMetrics.ms_v_door_fr,
+    StandardMetrics.ms_v_door_chargeport,
+    StandardMetrics.ms_v_charge_pilot,
+    StandardMetrics.ms_v_charge_inprogress,
+    StandardMetrics.ms_v_env_handbrake,
+    StandardMetrics.ms_v_env_on,
+    StandardMetrics.ms_v_env_locked,
+    StandardMetrics.ms_v_env_valet,
+    StandardMetrics.ms_v_door_hood,
+    StandardMetrics.ms_v_door_trunk,
+    StandardMetrics.ms_v_env_awake,
+    StandardMetrics.ms_v_env_cooling,
+    StandardMetrics.ms_v_env_alarm,
+    StandardMetrics.ms_v_door_rl,
+    StandardMetrics.ms_v_door_rr,
+    StandardMetrics.ms_v_env_charging12v,
+    StandardMetrics.ms_v_env_hvac });
+  MapMetrics(V2_MSG_GPS, {
+    StandardMetrics.ms_v_env_drivemode,
+    StandardMetrics.ms_v_pos_gpslock });
   SetStatus("Starting");
-  m_now_stat = false;
-  m_now_gps = false;
-  m_now_tpms = false;
-  m_now_firmware = false;
-  m_now_environment = false;
-  m_now_capabilities = false;
-  m_now_group = false;
+  m_now = 0;
   m_streaming = 0;
 
   m_pending_notify_info = false;
@@ -1562,28 +2019,48 @@ OvmsServerV2::OvmsServerV2(const char* name)
 
   if (MyOvmsServerV2Reader == 0)
     {
-    MyOvmsServerV2Reader = MyNotify.RegisterReader(TAG, COMMAND_RESULT_NORMAL, std::bind(OvmsServerV2ReaderCallback, _1, _2));
+    MyOvmsServerV2Reader = MyNotify.RegisterReader(TAG, COMMAND_RESULT_NORMAL, std::bind(OvmsServerV2ReaderCallback, _1, _2), true);
     }
 
   // init event listener:
-  MyEvents.RegisterEvent(TAG, "system.modem.received.ussd", std::bind(&OvmsServerV2::EventListener, this, _1, _2));
-  MyEvents.RegisterEvent(TAG, "config.changed", std::bind(&OvmsServerV2::EventListener, this, _1, _2));
-  MyEvents.RegisterEvent(TAG, "config.mounted", std::bind(&OvmsServerV2::EventListener, this, _1, _2));
+  m_event_ussd = MyEvents.GetEventId("system.modem.received.ussd");
+  MyEvents.RegisterEvent(TAG, m_event_ussd, std::bind(&OvmsServerV2::EventListener, this, _1, _2));
+  MyEvents.RegisterEvent(TAG, EVENT_CONFIG_MOUNTED, std::bind(&OvmsServerV2::EventListener, this, _1, _2));
+  m_event_netup = MyEvents.GetEventId("network.up");
+  m_event_netdown = MyEvents.GetEventId("network.down");
+  MyEvents.RegisterEvent(TAG, m_event_netup, std::bind(&OvmsServerV2::EventListener, this, _1, _2));
+  MyEvents.RegisterEvent(TAG, m_event_netdown, std::bind(&OvmsServerV2::EventListener, this, _1, _2));
+  MyConfig.RegisterChangeListener(TAG, "vehicle", "stream",
+    [this](const ConfigChangeList& changes) { ConfigChanged(NULL); });
   
   // read config:
   ConfigChanged(NULL);
+
+  xTaskCreatePinnedToCore(OvmsServerV2RxWatch, "OVMS V2 Rx", 2048, (void*)this, 5, &m_rxwatch_task, 1);
   }
 
 OvmsServerV2::~OvmsServerV2()
   {
   MyMetrics.DeregisterListener(TAG);
+  MyConfig.DeregisterChangeListener(TAG);
   MyNotify.ClearReader(TAG);
+  MyEvents.DeregisterEvent(TAG);
   Disconnect();
+  xSemaphoreTake(m_rxwatch_mutex, portMAX_DELAY);
+  vTaskDelete(m_rxwatch_task);
+  xSemaphoreGive(m_rxwatch_mutex);
   if (m_buffer)
     {
     delete m_buffer;
     m_buffer = NULL;
     }
+  if (m_tx_arena)
+    {
+    delete [] m_tx_arena;
+    m_tx_arena = NULL;
+    }
+  vSemaphoreDelete(m_tx_mutex);
+  vSemaphoreDelete(m_rxwatch_mutex);
   }
 
 void OvmsServerV2::SetPowerMode(PowerMode powermode)
@@ -1632,9 +2109,56 @@ void ovmsv2_status(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc
   else
     {
     writer->puts(MyOvmsServerV2->m_status.c_str());
+    writer->printf("Transmitted %u messages in %u writes, %u bytes\n",
+      MyOvmsServerV2->m_tx_stat_messages, MyOvmsServerV2->m_tx_stat_writes,
+      MyOvmsServerV2->m_tx_stat_bytes);
+    writer->printf("Connected %u times, %u failed attempts, %u ping timeouts, %u wakeups\n",
+      MyOvmsServerV2->m_stat_connects, MyOvmsServerV2->m_stat_connectfails,
+      MyOvmsServerV2->m_stat_pingtimeouts, MyOvmsServerV2->m_stat_wakeups);
+#ifdef CONFIG_OVMS_COMP_SERVER_V2_TLS
+    OvmsNetTlsConnection& tls = MyOvmsServerV2->m_tls;
+    if (MyOvmsServerV2->m_conn == &tls)
+      {
+      writer->printf("TLS %s handshake: %u ms, %u bytes sent, %u received\n",
+        tls.m_resumed ? "resumed" : "full", tls.m_handshake_ms,
+        tls.m_handshake_tx, tls.m_handshake_rx);
+      if (!tls.m_fingerprint.empty())
+        writer->printf("TLS server key SPKI SHA-256: %s\n", tls.m_fingerprint.c_str());
+      if (tls.m_pin_mismatch)
+        writer->puts("TLS server key does not match the pin: check the server, then re-pin by 'server v2 pin clear'");
+      }
+#endif // #ifdef CONFIG_OVMS_COMP_SERVER_V2_TLS
+    uint32_t saved = 0;
+    for (int k=0; k<V2_MSG_COUNT; k++)
+      {
+      v2_msgstat_t& ms = MyOvmsServerV2->m_msgstat[k];
+      if (ms.sent + ms.skipped == 0) continue;
+      writer->printf("  %-12s %u sent (%u bytes), %u unchanged (%u bytes saved)\n",
+        v2_sched[k].name, ms.sent, ms.bytes, ms.skipped, ms.bytes_saved);
+      saved += ms.bytes_saved;
+      }
+    writer->printf("Unchanged status messages saved %u bytes\n", saved);
     }
   }
 
+#ifdef CONFIG_OVMS_COMP_SERVER_V2_TLS
+void ovmsv2_pin(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  if ((argc > 0) && (strcmp(argv[0], "clear") == 0))
+    {
+    // The next full handshake pins the server key again (trust on first use)
+    MyConfig.DeleteInstance("server.v2", "tls.pin");
+    writer->puts("TLS server key pin cleared, the next connect pins the server key");
+    return;
+    }
+  std::string pin = MyConfig.GetParamValue("server.v2", "tls.pin");
+  if (pin.empty())
+    writer->puts("TLS server key not pinned, the next connect pins the server key");
+  else
+    writer->printf("TLS server key pin (SPKI SHA-256): %s\n", pin.c_str());
+  }
+#endif // #ifdef CONFIG_OVMS_COMP_SERVER_V2_TLS
+
 class OvmsServerV2Init
     {
     public: OvmsServerV2Init();
@@ -1649,6 +2173,9 @@ OvmsServerV2Init::OvmsServerV2Init()
   cmd_v2->RegisterCommand("start","Start an OVMS V2 Server Connection",ovmsv2_start, "", 0, 0);
   cmd_v2->RegisterCommand("stop","Stop an OVMS V2 Server Connection",ovmsv2_stop, "", 0, 0);
   cmd_v2->RegisterCommand("status","Show OVMS V2 Server connection status",ovmsv2_status, "", 0, 0);
+#ifdef CONFIG_OVMS_COMP_SERVER_V2_TLS
+  cmd_v2->RegisterCommand("pin","Show or clear the TLS server key pin",ovmsv2_pin, "[clear]", 0, 1);
+#endif // #ifdef CONFIG_OVMS_COMP_SERVER_V2_TLS
 
   MyConfig.RegisterParam("server.v2", "V2 Server Configuration", true, false);
   // Our instances:
@@ -36,14 +36,76 @@
 #include <iostream>
 #include <iomanip>
 #include <sys/time.h>
+#include <map>
+#include <atomic>
+#include <initializer_list>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 #include "ovms_server.h"
 #include "ovms_net.h"
 #include "ovms_buffer.h"
 #include "crypt_rc4.h"
 #include "ovms_metrics.h"
 #include "ovms_notify.h"
+#include "ovms_events.h"
 
 #define OVMS_PROTOCOL_V2_TOKENSIZE 22
+#define OVMS_PROTOCOL_V2_TXARENA   2048   // Encoded messages pending transmission
+
+// Connection supervision:
+#define OVMS_SERVER_V2_CONNECT_TIMEOUT  20000   // TCP connect timeout (ms)
+#define OVMS_SERVER_V2_BACKOFF_MIN      5       // Reconnect delay, doubled on each failure (s)
+#define OVMS_SERVER_V2_BACKOFF_MAX      300     // ...up to (s)
+#define OVMS_SERVER_V2_KEEPALIVE_IDLE   60      // TCP keepalive: idle time before first probe (s)
+#define OVMS_SERVER_V2_KEEPALIVE_INTVL  15      // ...probe interval (s)
+#define OVMS_SERVER_V2_KEEPALIVE_COUNT  4       // ...failed probes to drop the connection
+#define OVMS_SERVER_V2_SEND_TIMEOUT     20      // Blocking socket write timeout (s)
+#define OVMS_SERVER_V2_PING_IDLE        300     // Ping the server after no rx for (s)
+#define OVMS_SERVER_V2_PING_TIMEOUT     30      // ...and disconnect without response after (s)
+#define OVMS_SERVER_V2_MAXWAIT          60      // Max server task sleep (s)
+#define OVMS_SERVER_V2_TLS_CACHE        "/store/ovms_config/.v2tls" // Persistent TLS session cache (protected path)
+#define OVMS_SERVER_V2_TLS_CACHE_OLD    "/store/ovms_v2tls"
+
+// Server task wakeup reasons (task notification bits):
+#define OVMS_SERVER_V2_WAKE_RX          0x01    // Socket readable
+#define OVMS_SERVER_V2_WAKE_METRIC      0x02    // Metric change to transmit
+#define OVMS_SERVER_V2_WAKE_NOTIFY      0x04    // Notification queued
+#define OVMS_SERVER_V2_WAKE_NETWORK     0x08    // Network up / down
+#define OVMS_SERVER_V2_WAKE_TXFAIL      0x10    // Socket write failed
+
+// Status messages, in default transmission order:
+enum v2_msg_t
+  {
+  V2_MSG_STAT = 0,                // S
+  V2_MSG_ENVIRONMENT,             // D
+  V2_MSG_GPS,                     // L
+  V2_MSG_GROUP,                   // G
+  V2_MSG_TPMS,                    // W
+  V2_MSG_FIRMWARE,                // F
+  V2_MSG_CAPABILITIES,            // V
+  V2_MSG_COUNT
+  };
+
+// Vehicle states for the message scheduling:
+enum v2_state_t
+  {
+  V2_STATE_PARKED = 0,
+  V2_STATE_DRIVING,
+  V2_STATE_CHARGING,
+  V2_STATE_COUNT
+  };
+
+typedef struct
+  {
+  uint32_t sent;
+  uint32_t skipped;               // Content unchanged, not sent
+  uint32_t bytes;                 // Encoded bytes sent
+  uint32_t bytes_saved;           // Encoded bytes not sent
+  uint32_t crc;                   // Content of the last message sent
+  bool valid;                     // ...crc valid
+  uint32_t lastsent;              // monotonictime
+  uint32_t lastcheck;             // monotonictime of the last periodic check
+  } v2_msgstat_t;
 
 class OvmsServerV2 : public OvmsServer
   {
@@ -56,21 +118,39 @@ class OvmsServerV2 : public OvmsServer
 
   public:
     void ServerTask();
+    void RxWatchTask();
+    void Wakeup(uint32_t reason);
 
   protected:
     bool Connect();
     void Disconnect();
+    void CloseConnection(OvmsNetTcpConnection* next = NULL);
     bool Login();
     void ProcessServerMsg();
     void ProcessCommand(const char* payload);
     void Transmit(const std::ostringstream& message);
     void Transmit(const std::string& message);
     void Transmit(const char* message);
+    void Transmit(const char* message, size_t length);
+    void Transmitf(const char* fmt, ...);
+    void TransmitFlush();
     void SetStatus(const char* status, bool fault=false);
+    void Backoff();
+    uint32_t NextWait(uint32_t lasttx_stream);
+
+  protected:
+    void TransmitEncode(const char* message, size_t length);
+    void TransmitWrite();
 
   protected:
     std::string ReadLine();
 
+  protected:
+    void TransmitScheduled(bool all);
+    void TransmitMsg(int msg, bool always);
+    void TransmitMessage(int msg, const std::string& message);
+    void MapMetrics(int msg, std::initializer_list<OvmsMetric*> metrics);
+
   protected:
     void TransmitMsgStat(bool always = false);
     void TransmitMsgGPS(bool always = false);
@@ -90,15 +170,22 @@ class OvmsServerV2 : public OvmsServer
   public:
     void MetricModified(OvmsMetric* metric);
     bool IncomingNotification(OvmsNotifyType* type, OvmsNotifyEntry* entry);
-    void EventListener(std::string event, void* data);
+    void EventListener(event_id_t event, void* data);
     void ConfigChanged(OvmsConfigParam* param);
 
   public:
     std::string m_status;
+    OvmsNetTcpConnection* m_conn;   // Connection in use: m_tcp or m_tls
+    OvmsNetTcpConnection m_tcp;
+#ifdef CONFIG_OVMS_COMP_SERVER_V2_TLS
+    OvmsNetTlsConnection m_tls;
+#endif // #ifdef CONFIG_OVMS_COMP_SERVER_V2_TLS
 
   protected:
     metric_unit_t m_units_distance;
-    OvmsNetTcpConnection m_conn;
+#ifdef CONFIG_OVMS_COMP_SERVER_V2_TLS
+    bool m_tls_cache_loaded;
+#endif // #ifdef CONFIG_OVMS_COMP_SERVER_V2_TLS
     OvmsBuffer* m_buffer;
     std::string m_vehicleid;
     std::string m_server;
@@ -111,20 +198,44 @@ class OvmsServerV2 : public OvmsServer
     RC4_CTX1 m_crypto_tx1;
     RC4_CTX2 m_crypto_tx2;
 
-    bool m_now_stat;
-    bool m_now_gps;
-    bool m_now_tpms;
-    bool m_now_firmware;
-    bool m_now_environment;
-    bool m_now_capabilities;
-    bool m_now_group;
+    char* m_tx_arena;
+    size_t m_tx_size;
+    volatile bool m_tx_failed;      // A write failed, the connection needs to be closed
+    SemaphoreHandle_t m_tx_mutex;   // Guards the arena and the tx cipher state
+
+    TaskHandle_t m_rxwatch_task;
+    SemaphoreHandle_t m_rxwatch_mutex;  // Held by the rx watch task while it uses the socket
+    int m_backoff;                  // Current reconnect delay base (s), 0 = connected
+    uint32_t m_lastrx;              // monotonictime of the last server message
+    uint32_t m_pingsent;            // monotonictime of the pending ping, 0 = none
+
+  public:
+    uint32_t m_tx_stat_messages;
+    uint32_t m_tx_stat_writes;
+    uint32_t m_tx_stat_bytes;
+    uint32_t m_stat_connects;
+    uint32_t m_stat_connectfails;
+    uint32_t m_stat_pingtimeouts;
+    uint32_t m_stat_wakeups;
+
+  protected:
+    std::map<OvmsMetric*, uint32_t> m_metric_msgs;   // Metric → V2_MSG_* bits to send ASAP
+    std::atomic<uint32_t> m_now;    // V2_MSG_* bits pending
     int m_streaming;
 
+  public:
+    v2_msgstat_t m_msgstat[V2_MSG_COUNT];
+
+  protected:
     bool m_pending_notify_info;
     bool m_pending_notify_error;
     bool m_pending_notify_alert;
     bool m_pending_notify_data;
     uint32_t m_pending_notify_data_last;
+
+    event_id_t m_event_ussd;
+    event_id_t m_event_netup;
+    event_id_t m_event_netdown;
   };
 
 #endif //#ifndef __OVMS_SERVER_V2_H__
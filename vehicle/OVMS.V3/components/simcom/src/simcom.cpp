@@ -139,7 +139,8 @@ void simcom::Task()
   }
 
 simcom::simcom(const char* name, uart_port_t uartnum, int baud, int rxpin, int txpin, int pwregpio, int dtregpio)
-  : pcp(name), m_buffer(SIMCOM_BUF_SIZE), m_mux(this), m_ppp(&m_mux,GSM_MUX_CHAN_DATA), m_nmea(&m_mux, GSM_MUX_CHAN_NMEA)
+  : pcp(name), m_buffer(SIMCOM_BUF_SIZE), m_mux(this), m_ppp(&m_mux,GSM_MUX_CHAN_DATA), m_nmea(&m_mux, GSM_MUX_CHAN_NMEA),
+    m_cfg_enable_gps("modem", "enable.gps", false)
   {
   m_task = 0;
   m_uartnum = uartnum;
@@ -162,11 +163,15 @@ simcom::simcom(const char* name, uart_port_t uartnum, int baud, int rxpin, int t
 
   using std::placeholders::_1;
   using std::placeholders::_2;
-  MyEvents.RegisterEvent(TAG,"ticker.1", std::bind(&simcom::Ticker, this, _1, _2));
-  MyEvents.RegisterEvent(TAG, "vehicle.require.gps", std::bind(&simcom::EventListener, this, _1, _2));
-  MyEvents.RegisterEvent(TAG, "vehicle.release.gps", std::bind(&simcom::EventListener, this, _1, _2));
-  MyEvents.RegisterEvent(TAG, "vehicle.require.gpstime", std::bind(&simcom::EventListener, this, _1, _2));
-  MyEvents.RegisterEvent(TAG, "vehicle.release.gpstime", std::bind(&simcom::EventListener, this, _1, _2));
+  m_event_require_gps = MyEvents.GetEventId("vehicle.require.gps");
+  m_event_release_gps = MyEvents.GetEventId("vehicle.release.gps");
+  m_event_require_gpstime = MyEvents.GetEventId("vehicle.require.gpstime");
+  m_event_release_gpstime = MyEvents.GetEventId("vehicle.release.gpstime");
+  MyEvents.RegisterEvent(TAG,EVENT_TICKER_1, std::bind(&simcom::Ticker, this, _1, _2));
+  MyEvents.RegisterEvent(TAG, m_event_require_gps, std::bind(&simcom::EventListener, this, _1, _2));
+  MyEvents.RegisterEvent(TAG, m_event_release_gps, std::bind(&simcom::EventListener, this, _1, _2));
+  MyEvents.RegisterEvent(TAG, m_event_require_gpstime, std::bind(&simcom::EventListener, this, _1, _2));
+  MyEvents.RegisterEvent(TAG, m_event_release_gpstime, std::bind(&simcom::EventListener, this, _1, _2));
   }
 
 simcom::~simcom()
@@ -243,7 +248,7 @@ void simcom::SetPowerMode(PowerMode powermode)
     }
   }
 
-void simcom::Ticker(std::string event, void* data)
+void simcom::Ticker(event_id_t event, void* data)
   {
   m_state1_ticker++;
   SimcomState1 newstate = State1Ticker1();
@@ -262,9 +267,9 @@ void simcom::Ticker(std::string event, void* data)
     }
   }
 
-void simcom::EventListener(std::string event, void* data)
+void simcom::EventListener(event_id_t event, void* data)
   {
-  if (event == "vehicle.require.gps")
+  if (event == m_event_require_gps)
     {
     m_gps_required = true;
     if (!m_nmea.m_connected)
@@ -276,10 +281,10 @@ void simcom::EventListener(std::string event, void* data)
         m_nmea.Startup(m_gps_required);
       }
     }
-  else if (event == "vehicle.release.gps")
+  else if (event == m_event_release_gps)
     {
     m_gps_required = false;
-    if (m_nmea.m_connected && !MyConfig.GetParamValueBool("modem", "enable.gps", false))
+    if (m_nmea.m_connected && !m_cfg_enable_gps)
       {
       // if we were powered on just for GPS, power off:
       if (m_state1 == NetHold)
@@ -288,11 +293,11 @@ void simcom::EventListener(std::string event, void* data)
         m_nmea.Shutdown();
       }
     }
-  else if (event == "vehicle.require.gpstime")
+  else if (event == m_event_require_gpstime)
     {
     m_nmea.m_gpstime_required = true;
     }
-  else if (event == "vehicle.release.gpstime")
+  else if (event == m_event_release_gpstime)
     {
     m_nmea.m_gpstime_required = false;
     }
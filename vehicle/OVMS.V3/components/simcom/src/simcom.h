@@ -35,6 +35,7 @@
 #include "gsmnmea.h"
 #include "pcp.h"
 #include "ovms_events.h"
+#include "ovms_config.h"
 #include "gsmmux.h"
 #include "ovms_buffer.h"
 
@@ -125,6 +126,11 @@ class simcom : public pcp
     bool         m_gps_required;
     int          m_line_unfinished;
     std::string  m_line_buffer;
+    event_id_t   m_event_require_gps;
+    event_id_t   m_event_release_gps;
+    event_id_t   m_event_require_gpstime;
+    event_id_t   m_event_release_gpstime;
+    ConfigHandle<bool> m_cfg_enable_gps;
 
   protected:
     void SetState1(SimcomState1 newstate);
@@ -142,8 +148,8 @@ class simcom : public pcp
     void StartTask();
     void StopTask();
     void Task();
-    void Ticker(std::string event, void* data);
-    void EventListener(std::string event, void* data);
+    void Ticker(event_id_t event, void* data);
+    void EventListener(event_id_t event, void* data);
     void IncomingMuxData(GsmMuxChannel* channel);
     void SendSetState1(SimcomState1 newstate);
     bool IsStarted();
@@ -448,7 +448,12 @@ OvmsVehicle::OvmsVehicle()
 
   using std::placeholders::_1;
   using std::placeholders::_2;
-  MyEvents.RegisterEvent(TAG, "ticker.1", std::bind(&OvmsVehicle::VehicleTicker1, this, _1, _2));
+  MyEvents.RegisterEvent(TAG, EVENT_TICKER_1, std::bind(&OvmsVehicle::VehicleTicker1, this, _1, _2));
+  MyEvents.RegisterEvent(TAG, EVENT_TICKER_10, std::bind(&OvmsVehicle::VehicleTickerN, this, _1, _2));
+  MyEvents.RegisterEvent(TAG, EVENT_TICKER_60, std::bind(&OvmsVehicle::VehicleTickerN, this, _1, _2));
+  MyEvents.RegisterEvent(TAG, EVENT_TICKER_300, std::bind(&OvmsVehicle::VehicleTickerN, this, _1, _2));
+  MyEvents.RegisterEvent(TAG, EVENT_TICKER_600, std::bind(&OvmsVehicle::VehicleTickerN, this, _1, _2));
+  MyEvents.RegisterEvent(TAG, EVENT_TICKER_3600, std::bind(&OvmsVehicle::VehicleTickerN, this, _1, _2));
   MyEvents.RegisterEvent(TAG, "config.changed", std::bind(&OvmsVehicle::VehicleConfigChanged, this, _1, _2));
   MyEvents.RegisterEvent(TAG, "config.mounted", std::bind(&OvmsVehicle::VehicleConfigChanged, this, _1, _2));
 
@@ -544,7 +549,7 @@ void OvmsVehicle::RegisterCanBus(int bus, CAN_mode_t mode, CAN_speed_t speed)
     }
   }
 
-void OvmsVehicle::VehicleTicker1(std::string event, void* data)
+void OvmsVehicle::VehicleTicker1(event_id_t event, void* data)
   {
   m_ticker++;
 
@@ -554,11 +559,6 @@ void OvmsVehicle::VehicleTicker1(std::string event, void* data)
     }
 
   Ticker1(m_ticker);
-  if ((m_ticker % 10) == 0) Ticker10(m_ticker);
-  if ((m_ticker % 60) == 0) Ticker60(m_ticker);
-  if ((m_ticker % 300) == 0) Ticker300(m_ticker);
-  if ((m_ticker % 600) == 0) Ticker600(m_ticker);
-  if ((m_ticker % 3600) == 0) Ticker3600(m_ticker);
 
   if (StandardMetrics.ms_v_env_on->AsBool())
     StandardMetrics.ms_v_env_parktime->SetValue(0);
@@ -571,6 +571,22 @@ void OvmsVehicle::VehicleTicker1(std::string event, void* data)
     StandardMetrics.ms_v_charge_time->SetValue(0);
   }
 
+// The longer tickers follow the ticker events, which housekeeping schedules
+// as separate jobs in different phases, instead of all firing together on
+// the 1s ticker:
+void OvmsVehicle::VehicleTickerN(event_id_t event, void* data)
+  {
+  switch (event)
+    {
+    case EVENT_TICKER_10:   Ticker10(m_ticker); break;
+    case EVENT_TICKER_60:   Ticker60(m_ticker); break;
+    case EVENT_TICKER_300:  Ticker300(m_ticker); break;
+    case EVENT_TICKER_600:  Ticker600(m_ticker); break;
+    case EVENT_TICKER_3600: Ticker3600(m_ticker); break;
+    default: break;
+    }
+  }
+
 void OvmsVehicle::Ticker1(uint32_t ticker)
   {
   }
@@ -70,7 +70,8 @@ class OvmsVehicle
     bool m_registeredlistener;
 
   private:
-    void VehicleTicker1(std::string event, void* data);
+    void VehicleTicker1(event_id_t event, void* data);
+    void VehicleTickerN(event_id_t event, void* data);
     void VehicleConfigChanged(std::string event, void* data);
     void PollerSend();
     void PollerReceive(CAN_frame_t* frame);
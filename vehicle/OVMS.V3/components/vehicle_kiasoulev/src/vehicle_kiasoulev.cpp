@@ -95,7 +95,6 @@ OvmsVehicleKiaSoulEv::OvmsVehicleKiaSoulEv()
   ESP_LOGI(TAG, "Kia Soul EV v3.0 vehicle module");
 
   memset( m_vin, 0, sizeof(m_vin));
-  memset( ks_battery_cell_voltage ,0, sizeof(ks_battery_cell_voltage));
   memset( ks_battery_module_temp, 0, sizeof(ks_battery_module_temp));
   memset( ks_tpms_id, 0, sizeof(ks_tpms_id));
 
@@ -131,6 +130,7 @@ OvmsVehicleKiaSoulEv::OvmsVehicleKiaSoulEv()
 
   // init metrics:
   m_version = MyMetrics.InitString("x.ks.version", 0, VERSION " " __DATE__ " " __TIME__);
+  m_b_cell_volt = MyMetrics.InitVector<float>("x.ks.b.cell.volt", 10, KS_BATT_CELLS, NULL, Volts);
   m_b_cell_volt_max = MyMetrics.InitFloat("x.ks.b.cell.volt.max", 10, 0, Volts);
   m_b_cell_volt_min = MyMetrics.InitFloat("x.ks.b.cell.volt.min", 10, 0, Volts);
   m_b_cell_volt_max_no = MyMetrics.InitInt("x.ks.b.cell.volt.max.no", 10, 0);
@@ -139,8 +139,8 @@ OvmsVehicleKiaSoulEv::OvmsVehicleKiaSoulEv()
   m_b_cell_det_min = MyMetrics.InitFloat("x.ks.b.cell.det.min", 0, 0, Percentage);
   m_b_cell_det_max_no = MyMetrics.InitInt("x.ks.b.cell.det.max.no", 10, 0);
   m_b_cell_det_min_no = MyMetrics.InitInt("x.ks.b.cell.det.min.no", 10, 0);
-  m_c_power = MyMetrics.InitFloat("x.ks.c.power", 10, 0, kW);
-  m_c_speed = MyMetrics.InitFloat("x.ks.c.speed", 10, 0, Kph);
+  m_c_power = MyMetrics.InitScalar<float, kW>("x.ks.c.power", 10, 0);
+  m_c_speed = MyMetrics.InitScalar<float, Kph>("x.ks.c.speed", 10, 0);
   m_b_min_temperature = MyMetrics.InitInt("x.ks.b.min.temp", 10, 0, Celcius);
   m_b_max_temperature = MyMetrics.InitInt("x.ks.b.max.temp", 10, 0, Celcius);
   m_b_inlet_temperature = MyMetrics.InitInt("x.ks.b.inlet.temp", 10, 0, Celcius);
@@ -523,7 +523,7 @@ void OvmsVehicleKiaSoulEv::IncomingPollReply(canbus* bus, uint16_t type, uint16_
 					if (m_poll_ml_frame > 0) {
 						if (m_poll_ml_frame == 1) // 02 21 01 - 21
 						{
-							m_c_power->SetValue( (float)CAN_UINT(1)/100.0, kW);
+							m_c_power->Set( (float)CAN_UINT(1)/100.0 );
 							//ks_battery_avail_discharge = (UINT8)(((UINT) can_databuffer[5 + CAN_ADJ]
 							//        | ((UINT) can_databuffer[4 + CAN_ADJ] << 8))>>2);
 							bVal = CAN_BYTE(5);
@@ -586,8 +586,7 @@ void OvmsVehicleKiaSoulEv::IncomingPollReply(canbus* bus, uint16_t type, uint16_
 				case 0x04:
 					// diag page 02-04: skip first frame (no data)
 					base = ((pid-2)<<5) + m_poll_ml_offset - (length - 3);
-					for (bVal = 0; bVal < length && ((base + bVal)<sizeof (ks_battery_cell_voltage)); bVal++)
-						ks_battery_cell_voltage[base + bVal] = CAN_BYTE(bVal);
+					SetCellVoltages(base, data, length);
 					break;
 
 				case 0x05:
@@ -595,8 +594,7 @@ void OvmsVehicleKiaSoulEv::IncomingPollReply(canbus* bus, uint16_t type, uint16_
 						{
 						//TODO Untested.
 						base = ((pid-2)<<5) + m_poll_ml_offset - (length - 3);
-						for (bVal = 0; bVal < length && ((base + bVal)<sizeof (ks_battery_cell_voltage)); bVal++)
-							ks_battery_cell_voltage[base + bVal] = CAN_BYTE(bVal);
+						SetCellVoltages(base, data, length);
 
 						m_b_inlet_temperature->SetValue( CAN_BYTE(5) );
 						m_b_min_temperature->SetValue( CAN_BYTE(6) );
@@ -640,6 +638,22 @@ void OvmsVehicleKiaSoulEv::IncomingPollReply(canbus* bus, uint16_t type, uint16_
 	  }
   }
 
+/**
+ * SetCellVoltages: publish a range of raw cell voltages (1/50 V) to the
+ * cell vector metric
+ */
+void OvmsVehicleKiaSoulEv::SetCellVoltages(uint16_t base, const uint8_t* data, uint16_t count)
+	{
+	float volts[KS_BATT_CELLS];
+	if (base >= KS_BATT_CELLS)
+		return;
+	if (count > KS_BATT_CELLS - base)
+		count = KS_BATT_CELLS - base;
+	for (uint16_t i = 0; i < count; i++)
+		volts[i] = (float)data[i] / 50.0;
+	m_b_cell_volt->SetElements(base, volts, count);
+	}
+
 /**
  * Ticker1: Called every second
  */
@@ -678,7 +692,7 @@ void OvmsVehicleKiaSoulEv::Ticker1(uint32_t ticker)
 	  }
 	else if (ks_charge_bits.ChargingChademo)  // **** ChaDeMo charging ****
 		{
-		SetChargeMetrics(StdMetrics.ms_v_bat_voltage->AsFloat(400,Volts), -ks_battery_current / 10.0, m_c_power->AsFloat(0,kW) * 10 / StdMetrics.ms_v_bat_voltage->AsFloat(400,Volts), true);
+		SetChargeMetrics(StdMetrics.ms_v_bat_voltage->AsFloat(400,Volts), -ks_battery_current / 10.0, m_c_power->Get() * 10 / StdMetrics.ms_v_bat_voltage->AsFloat(400,Volts), true);
 	  }
 
 	//
@@ -796,7 +810,7 @@ void OvmsVehicleKiaSoulEv::Ticker1(uint32_t ticker)
 	  ks_cum_charge_start = 0;
 	  StdMetrics.ms_v_charge_inprogress->SetValue( false );
 		StdMetrics.ms_v_env_charging12v->SetValue( false );
-		m_c_speed->SetValue(0);
+		m_c_speed->Set(0);
 
     // Send charge alert:
     RequestNotify(SEND_ChargeState);
@@ -833,7 +847,7 @@ void OvmsVehicleKiaSoulEv::SetChargeMetrics(float voltage, float current, float
 	//"Typical" consumption based on battery temperature and ambient temperature.
 	float temp = (StdMetrics.ms_v_bat_temp->AsFloat(Celcius) + StdMetrics.ms_v_env_temp->AsFloat(Celcius))/2;
 	float consumption = 15+(20-temp)*3.0/8.0; //kWh/100km
-	m_c_speed->SetValue( (voltage * current * 100) / consumption, Kph);
+	m_c_speed->Set( (voltage * current * 100) / consumption );
 	}
 
 /**
@@ -1018,24 +1032,26 @@ void xks_cells(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, co
 
 	if(verbosity>788)
 		{
-		for (uint8_t i=0; i < sizeof (soul->ks_battery_cell_voltage); i++)
+		for (uint8_t i=0; i < KS_BATT_CELLS; i++)
 			{
 			if( i % 10 == 0) writer->printf("\n%02d:",i+1);
-			writer->printf("%.*fV ", 2, (float)soul->ks_battery_cell_voltage[i]/50.0);
+			writer->printf("%.*fV ", 2, soul->m_b_cell_volt->GetElement(i));
 			}
 		writer->printf("\n");
 		}
 	else
 		{
+		float volts[KS_BATT_CELLS];
+		size_t cells = soul->m_b_cell_volt->GetElements(0, volts, KS_BATT_CELLS);
 		uint8_t i, lines=(verbosity-80)/11;
 		// Count each voltage and print out number of cells with that voltage.
 		// Handles up to as many lines as verbosity allows. Hopefully it will be enough
 		for( i=0;i<225; i++)
 			{
 			uint8_t cnt=0;
-			for (uint8_t a=0; a < sizeof (soul->ks_battery_cell_voltage) && lines>0; a++)
+			for (uint8_t a=0; a < cells && lines>0; a++)
 				{
-				if( soul->ks_battery_cell_voltage[a]==i) cnt++;
+				if( (uint8_t)roundf(volts[a]*50)==i) cnt++;
 				}
 			if(cnt>0)
 				{
@@ -33,6 +33,8 @@
 
 using namespace std;
 
+#define KS_BATT_CELLS 101             // Battery cells monitored
+
 typedef union {
   struct { //TODO Is this the correct order, or should it be swapped?
     unsigned char Park : 1;
@@ -69,7 +71,7 @@ class OvmsVehicleKiaSoulEv : public OvmsVehicle
     virtual OvmsVehicle::vehicle_command_t CommandUnlock(const char* pin);
 
     uint32_t ks_tpms_id[4];
-    uint8_t ks_battery_cell_voltage[101];
+    OvmsMetricVector<float>* m_b_cell_volt;   // Battery cell voltages
     OvmsMetricInt* 		m_b_cell_volt_max_no;		//Max cell voltage no           02 21 01 -> 23 7
     OvmsMetricInt* 		m_b_cell_volt_min_no; 	//Min cell voltage no           02 21 01 -> 24 2
     OvmsMetricFloat*	m_b_cell_volt_max;     // Battery cell maximum voltage
@@ -99,6 +101,7 @@ class OvmsVehicleKiaSoulEv : public OvmsVehicle
     void DoNotify();
     void vehicle_kiasoulev_car_on(bool isOn);
     void UpdateMaxRangeAndSOH(void);
+    void SetCellVoltages(uint16_t base, const uint8_t* data, uint16_t count);
     uint16_t calcMinutesRemaining(float target);
     bool SendCanMessage_sync(uint16_t id, uint8_t count,
     					uint8_t serviceId, uint8_t b1, uint8_t b2, uint8_t b3, uint8_t b4,
@@ -116,8 +119,8 @@ class OvmsVehicleKiaSoulEv : public OvmsVehicle
 
     // Kia Soul EV specific metrics
     OvmsMetricString* m_version;
-    OvmsMetricFloat*  m_c_power;            				// Available charge power
-    OvmsMetricFloat*  m_c_speed;									// km/h
+    OvmsMetricScalar<float, kW>*  m_c_power;		// Available charge power
+    OvmsMetricScalar<float, Kph>* m_c_speed;		// km/h
 
 		#define CFG_DEFAULT_MAXRANGE 160
     int ks_maxrange = CFG_DEFAULT_MAXRANGE;        // Configured max range at 20 °C
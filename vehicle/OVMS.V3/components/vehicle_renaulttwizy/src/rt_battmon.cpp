@@ -31,6 +31,7 @@ static const char *TAG = "v-renaulttwizy";
 #include "rt_battmon.h"
 #include "metrics_standard.h"
 #include "ovms_notify.h"
+#include "string_writer.h"
 
 #include "vehicle_renaulttwizy.h"
 
@@ -62,14 +63,6 @@ const char* const x_rt_b_pack_temp_max[] = { "x.rt.b.pack.1.temp.max" };
 const char* const x_rt_b_pack_temp_watches[] = { "x.rt.b.pack.1.temp.watches" };
 const char* const x_rt_b_pack_temp_alerts[] = { "x.rt.b.pack.1.temp.alerts" };
 const char* const x_rt_b_pack_temp_stddev_max[] = { "x.rt.b.pack.1.temp.stddev.max" };
-const char* const x_rt_b_cmod_temp_act[] = { "x.rt.b.cmod.01.temp.act", "x.rt.b.cmod.02.temp.act", "x.rt.b.cmod.03.temp.act", "x.rt.b.cmod.04.temp.act", "x.rt.b.cmod.05.temp.act", "x.rt.b.cmod.06.temp.act", "x.rt.b.cmod.07.temp.act", "x.rt.b.cmod.08.temp.act" };
-const char* const x_rt_b_cmod_temp_min[] = { "x.rt.b.cmod.01.temp.min", "x.rt.b.cmod.02.temp.min", "x.rt.b.cmod.03.temp.min", "x.rt.b.cmod.04.temp.min", "x.rt.b.cmod.05.temp.min", "x.rt.b.cmod.06.temp.min", "x.rt.b.cmod.07.temp.min", "x.rt.b.cmod.08.temp.min" };
-const char* const x_rt_b_cmod_temp_max[] = { "x.rt.b.cmod.01.temp.max", "x.rt.b.cmod.02.temp.max", "x.rt.b.cmod.03.temp.max", "x.rt.b.cmod.04.temp.max", "x.rt.b.cmod.05.temp.max", "x.rt.b.cmod.06.temp.max", "x.rt.b.cmod.07.temp.max", "x.rt.b.cmod.08.temp.max" };
-const char* const x_rt_b_cmod_temp_maxdev[] = { "x.rt.b.cmod.01.temp.maxdev", "x.rt.b.cmod.02.temp.maxdev", "x.rt.b.cmod.03.temp.maxdev", "x.rt.b.cmod.04.temp.maxdev", "x.rt.b.cmod.05.temp.maxdev", "x.rt.b.cmod.06.temp.maxdev", "x.rt.b.cmod.07.temp.maxdev", "x.rt.b.cmod.08.temp.maxdev" };
-const char* const x_rt_b_cell_volt_act[] = { "x.rt.b.cell.01.volt.act", "x.rt.b.cell.02.volt.act", "x.rt.b.cell.03.volt.act", "x.rt.b.cell.04.volt.act", "x.rt.b.cell.05.volt.act", "x.rt.b.cell.06.volt.act", "x.rt.b.cell.07.volt.act", "x.rt.b.cell.08.volt.act", "x.rt.b.cell.09.volt.act", "x.rt.b.cell.10.volt.act", "x.rt.b.cell.11.volt.act", "x.rt.b.cell.12.volt.act", "x.rt.b.cell.13.volt.act", "x.rt.b.cell.14.volt.act", "x.rt.b.cell.15.volt.act", "x.rt.b.cell.16.volt.act" };
-const char* const x_rt_b_cell_volt_min[] = { "x.rt.b.cell.01.volt.min", "x.rt.b.cell.02.volt.min", "x.rt.b.cell.03.volt.min", "x.rt.b.cell.04.volt.min", "x.rt.b.cell.05.volt.min", "x.rt.b.cell.06.volt.min", "x.rt.b.cell.07.volt.min", "x.rt.b.cell.08.volt.min", "x.rt.b.cell.09.volt.min", "x.rt.b.cell.10.volt.min", "x.rt.b.cell.11.volt.min", "x.rt.b.cell.12.volt.min", "x.rt.b.cell.13.volt.min", "x.rt.b.cell.14.volt.min", "x.rt.b.cell.15.volt.min", "x.rt.b.cell.16.volt.min" };
-const char* const x_rt_b_cell_volt_max[] = { "x.rt.b.cell.01.volt.max", "x.rt.b.cell.02.volt.max", "x.rt.b.cell.03.volt.max", "x.rt.b.cell.04.volt.max", "x.rt.b.cell.05.volt.max", "x.rt.b.cell.06.volt.max", "x.rt.b.cell.07.volt.max", "x.rt.b.cell.08.volt.max", "x.rt.b.cell.09.volt.max", "x.rt.b.cell.10.volt.max", "x.rt.b.cell.11.volt.max", "x.rt.b.cell.12.volt.max", "x.rt.b.cell.13.volt.max", "x.rt.b.cell.14.volt.max", "x.rt.b.cell.15.volt.max", "x.rt.b.cell.16.volt.max" };
-const char* const x_rt_b_cell_volt_maxdev[] = { "x.rt.b.cell.01.volt.maxdev", "x.rt.b.cell.02.volt.maxdev", "x.rt.b.cell.03.volt.maxdev", "x.rt.b.cell.04.volt.maxdev", "x.rt.b.cell.05.volt.maxdev", "x.rt.b.cell.06.volt.maxdev", "x.rt.b.cell.07.volt.maxdev", "x.rt.b.cell.08.volt.maxdev", "x.rt.b.cell.09.volt.maxdev", "x.rt.b.cell.10.volt.maxdev", "x.rt.b.cell.11.volt.maxdev", "x.rt.b.cell.12.volt.maxdev", "x.rt.b.cell.13.volt.maxdev", "x.rt.b.cell.14.volt.maxdev", "x.rt.b.cell.15.volt.maxdev", "x.rt.b.cell.16.volt.maxdev" };
 // END Battery metrics names
 
 
@@ -109,13 +102,19 @@ void OvmsVehicleRenaultTwizy::BatteryInit()
   for (i = 0; i < BATT_PACKS; i++)
     twizy_batt[i].InitMetrics(i);
   
+  // Cell module & cell metrics are vectors indexed by module / cell number - 1,
+  // they replace the former x.rt.b.cmod.NN.* / x.rt.b.cell.NN.* metrics (see changes.txt)
   m_batt_cmod_count = MyMetrics.InitInt("x.rt.b.cmod.cnt", SM_STALE_HIGH, batt_cmod_count);
-  for (i = 0; i < BATT_CMODS; i++)
-    twizy_cmod[i].InitMetrics(i);
+  m_batt_cmod_temp_act = MyMetrics.InitVector<float>("x.rt.b.cmod.temp.act", SM_STALE_HIGH, BATT_CMODS, NULL, Celcius);
+  m_batt_cmod_temp_min = MyMetrics.InitVector<float>("x.rt.b.cmod.temp.min", SM_STALE_HIGH, BATT_CMODS, NULL, Celcius);
+  m_batt_cmod_temp_max = MyMetrics.InitVector<float>("x.rt.b.cmod.temp.max", SM_STALE_HIGH, BATT_CMODS, NULL, Celcius);
+  m_batt_cmod_temp_maxdev = MyMetrics.InitVector<float>("x.rt.b.cmod.temp.maxdev", SM_STALE_HIGH, BATT_CMODS, NULL, Celcius);
   
   m_batt_cell_count = MyMetrics.InitInt("x.rt.b.cell.cnt", SM_STALE_HIGH, batt_cell_count);
-  for (i = 0; i < BATT_CELLS; i++)
-    twizy_cell[i].InitMetrics(i);
+  m_batt_cell_volt_act = MyMetrics.InitVector<float>("x.rt.b.cell.volt.act", SM_STALE_HIGH, BATT_CELLS, NULL, Volts);
+  m_batt_cell_volt_min = MyMetrics.InitVector<float>("x.rt.b.cell.volt.min", SM_STALE_HIGH, BATT_CELLS, NULL, Volts);
+  m_batt_cell_volt_max = MyMetrics.InitVector<float>("x.rt.b.cell.volt.max", SM_STALE_HIGH, BATT_CELLS, NULL, Volts);
+  m_batt_cell_volt_maxdev = MyMetrics.InitVector<float>("x.rt.b.cell.volt.maxdev", SM_STALE_HIGH, BATT_CELLS, NULL, Volts);
   
   // init commands
   
@@ -181,11 +180,36 @@ void OvmsVehicleRenaultTwizy::BatteryUpdate()
   for (battery_pack &pack : twizy_batt)
     pack.UpdateMetrics();
   
-  for (battery_cmod &cmod : twizy_cmod)
-    cmod.UpdateMetrics();
+  // cmod & cell metrics are vectors, update them in one go each:
   
-  for (battery_cell &cell : twizy_cell)
-    cell.UpdateMetrics();
+  float values[BATT_CELLS];
+  int i;
+  
+  for (i = 0; i < BATT_CMODS; i++)
+    values[i] = (float) twizy_cmod[i].temp_act - 40;
+  m_batt_cmod_temp_act->SetElements(0, values, BATT_CMODS);
+  for (i = 0; i < BATT_CMODS; i++)
+    values[i] = (float) twizy_cmod[i].temp_min - 40;
+  m_batt_cmod_temp_min->SetElements(0, values, BATT_CMODS);
+  for (i = 0; i < BATT_CMODS; i++)
+    values[i] = (float) twizy_cmod[i].temp_max - 40;
+  m_batt_cmod_temp_max->SetElements(0, values, BATT_CMODS);
+  for (i = 0; i < BATT_CMODS; i++)
+    values[i] = (float) twizy_cmod[i].temp_maxdev;
+  m_batt_cmod_temp_maxdev->SetElements(0, values, BATT_CMODS);
+  
+  for (i = 0; i < BATT_CELLS; i++)
+    values[i] = (float) twizy_cell[i].volt_act / 200;
+  m_batt_cell_volt_act->SetElements(0, values, BATT_CELLS);
+  for (i = 0; i < BATT_CELLS; i++)
+    values[i] = (float) twizy_cell[i].volt_min / 200;
+  m_batt_cell_volt_min->SetElements(0, values, BATT_CELLS);
+  for (i = 0; i < BATT_CELLS; i++)
+    values[i] = (float) twizy_cell[i].volt_max / 200;
+  m_batt_cell_volt_max->SetElements(0, values, BATT_CELLS);
+  for (i = 0; i < BATT_CELLS; i++)
+    values[i] = (float) twizy_cell[i].volt_maxdev / 200;
+  m_batt_cell_volt_maxdev->SetElements(0, values, BATT_CELLS);
   
 }
 
@@ -484,56 +508,26 @@ bool battery_pack::IsModified(size_t m_modifier)
 }
 
 
-void battery_cmod::InitMetrics(int i)
-{
-  m_temp_act = MyMetrics.InitFloat(x_rt_b_cmod_temp_act[i], SM_STALE_HIGH, 0, Celcius);
-  m_temp_min = MyMetrics.InitFloat(x_rt_b_cmod_temp_min[i], SM_STALE_HIGH, 0, Celcius);
-  m_temp_max = MyMetrics.InitFloat(x_rt_b_cmod_temp_max[i], SM_STALE_HIGH, 0, Celcius);
-  m_temp_maxdev = MyMetrics.InitFloat(x_rt_b_cmod_temp_maxdev[i], SM_STALE_HIGH, 0, Celcius);
-}
-
-void battery_cmod::UpdateMetrics()
-{
-  *m_temp_act = (float) temp_act - 40;
-  *m_temp_min = (float) temp_min - 40;
-  *m_temp_max = (float) temp_max - 40;
-  *m_temp_maxdev = (float) temp_maxdev;
-}
-
-bool battery_cmod::IsModified(size_t m_modifier)
+/**
+ * BatteryCmodIsModified / BatteryCellIsModified: get & clear modification flags
+ */
+bool OvmsVehicleRenaultTwizy::BatteryCmodIsModified(int cmod)
 {
   bool modified =
-    m_temp_act->IsModifiedAndClear(m_modifier) |
-    m_temp_min->IsModifiedAndClear(m_modifier) |
-    m_temp_max->IsModifiedAndClear(m_modifier) |
-    m_temp_maxdev->IsModifiedAndClear(m_modifier);
+    m_batt_cmod_temp_act->IsElementModifiedAndClear(cmod, m_modifier) |
+    m_batt_cmod_temp_min->IsElementModifiedAndClear(cmod, m_modifier) |
+    m_batt_cmod_temp_max->IsElementModifiedAndClear(cmod, m_modifier) |
+    m_batt_cmod_temp_maxdev->IsElementModifiedAndClear(cmod, m_modifier);
   return modified;
 }
 
-
-void battery_cell::InitMetrics(int i)
-{
-  m_volt_act = MyMetrics.InitFloat(x_rt_b_cell_volt_act[i], SM_STALE_HIGH, 0, Volts);
-  m_volt_min = MyMetrics.InitFloat(x_rt_b_cell_volt_min[i], SM_STALE_HIGH, 0, Volts);
-  m_volt_max = MyMetrics.InitFloat(x_rt_b_cell_volt_max[i], SM_STALE_HIGH, 0, Volts);
-  m_volt_maxdev = MyMetrics.InitFloat(x_rt_b_cell_volt_maxdev[i], SM_STALE_HIGH, 0, Volts);
-}
-
-void battery_cell::UpdateMetrics()
-{
-  *m_volt_act = (float) volt_act / 200;
-  *m_volt_min = (float) volt_min / 200;
-  *m_volt_max = (float) volt_max / 200;
-  *m_volt_maxdev = (float) volt_maxdev / 200;
-}
-
-bool battery_cell::IsModified(size_t m_modifier)
+bool OvmsVehicleRenaultTwizy::BatteryCellIsModified(int cell)
 {
   bool modified =
-    m_volt_act->IsModifiedAndClear(m_modifier) |
-    m_volt_min->IsModifiedAndClear(m_modifier) |
-    m_volt_max->IsModifiedAndClear(m_modifier) |
-    m_volt_maxdev->IsModifiedAndClear(m_modifier);
+    m_batt_cell_volt_act->IsElementModifiedAndClear(cell, m_modifier) |
+    m_batt_cell_volt_min->IsElementModifiedAndClear(cell, m_modifier) |
+    m_batt_cell_volt_max->IsElementModifiedAndClear(cell, m_modifier) |
+    m_batt_cell_volt_maxdev->IsElementModifiedAndClear(cell, m_modifier);
   return modified;
 }
 
@@ -934,6 +928,10 @@ void OvmsVehicleRenaultTwizy::FormatCellData(int verbosity, OvmsWriter* writer,
  */
 void OvmsVehicleRenaultTwizy::BatterySendDataUpdate(bool force)
 {
+  // collect all records in one batch:
+  OvmsNotifyEntryBatch* batch = new OvmsNotifyEntryBatch(1024);
+  StringWriter record(128);
+  
   bool overall_modified = force |
     m_batt_cell_count->IsModifiedAndClear(m_modifier) |
     m_batt_cmod_count->IsModifiedAndClear(m_modifier);
@@ -955,22 +953,30 @@ void OvmsVehicleRenaultTwizy::BatterySendDataUpdate(bool force)
       StdMetrics.ms_v_bat_voltage->IsModifiedAndClear(m_modifier) |
       twizy_batt[pack].IsModified(m_modifier);
       
-    if (pack_modified)
-      MyNotify.NotifyCommandf("data", "xrt batt data-pack %d", pack+1);
+    if (pack_modified) {
+      record.clear();
+      FormatPackData(COMMAND_RESULT_NORMAL, &record, pack);
+      batch->Append(record);
+    }
     
   }
   
   for (int cell=0; cell < batt_cell_count; cell++) {
     
     bool cell_modified = overall_modified |
-      twizy_cell[cell].IsModified(m_modifier) |
-      twizy_cmod[cell>>1].IsModified(m_modifier);
+      BatteryCellIsModified(cell) |
+      BatteryCmodIsModified(cell>>1);
     
-    if (cell_modified)
-      MyNotify.NotifyCommandf("data", "xrt batt data-cell %d", cell+1);
+    if (cell_modified) {
+      record.clear();
+      FormatCellData(COMMAND_RESULT_NORMAL, &record, cell);
+      batch->Append(record);
+    }
     
   }
   
+  MyNotify.NotifyBatch("data", batch);
+
 }
 
 
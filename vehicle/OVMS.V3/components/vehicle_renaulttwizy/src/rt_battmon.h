@@ -95,16 +95,7 @@ struct battery_cmod // cell module
   UINT8 temp_max = 0; // charge cycle max temperature
   float temp_maxdev = 0; // charge cycle max temperature deviation
   
-  // Metrics
-  
-  void InitMetrics(int i);
-  void UpdateMetrics();
-  bool IsModified(size_t modifier);
-  
-  OvmsMetricFloat *m_temp_act;
-  OvmsMetricFloat *m_temp_min;
-  OvmsMetricFloat *m_temp_max;
-  OvmsMetricFloat *m_temp_maxdev;
+  // Metrics: see vector metrics m_batt_cmod_*
   
 };
 
@@ -117,16 +108,7 @@ struct battery_cell
   UINT volt_max = 0; // charge cycle max voltage
   float volt_maxdev = 0; // charge cycle max voltage deviation
   
-  // Metrics
-  
-  void InitMetrics(int i);
-  void UpdateMetrics();
-  bool IsModified(size_t modifier);
-  
-  OvmsMetricFloat *m_volt_act;
-  OvmsMetricFloat *m_volt_min;
-  OvmsMetricFloat *m_volt_max;
-  OvmsMetricFloat *m_volt_maxdev;
+  // Metrics: see vector metrics m_batt_cell_*
   
 };
 
@@ -340,6 +340,8 @@ class OvmsVehicleRenaultTwizy : public OvmsVehicle
   
   private:
     void BatteryCheckDeviations();
+    bool BatteryCmodIsModified(int cmod);
+    bool BatteryCellIsModified(int cell);
   
   protected:
     #define BATT_PACKS      1
@@ -357,6 +359,16 @@ class OvmsVehicleRenaultTwizy : public OvmsVehicle
     OvmsMetricInt *m_batt_cmod_count;
     OvmsMetricInt *m_batt_cell_count;
     
+    OvmsMetricVector<float> *m_batt_cmod_temp_act;
+    OvmsMetricVector<float> *m_batt_cmod_temp_min;
+    OvmsMetricVector<float> *m_batt_cmod_temp_max;
+    OvmsMetricVector<float> *m_batt_cmod_temp_maxdev;
+    
+    OvmsMetricVector<float> *m_batt_cell_volt_act;
+    OvmsMetricVector<float> *m_batt_cell_volt_min;
+    OvmsMetricVector<float> *m_batt_cell_volt_max;
+    OvmsMetricVector<float> *m_batt_cell_volt_maxdev;
+    
     battery_pack twizy_batt[BATT_PACKS];
     battery_cmod twizy_cmod[BATT_CMODS];
     battery_cell twizy_cell[BATT_CELLS];
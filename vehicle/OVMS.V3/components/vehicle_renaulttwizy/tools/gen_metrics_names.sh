@@ -9,11 +9,8 @@ PACK_METRICS="\
   volt.min volt.max volt.watches volt.alerts volt.stddev.max \
   temp.min temp.max temp.watches temp.alerts temp.stddev.max"
 
-CMOD_CNT=8
-CMOD_METRICS="temp.act temp.min temp.max temp.maxdev"
-
-CELL_CNT=16
-CELL_METRICS="volt.act volt.min volt.max volt.maxdev"
+# Note: cmod & cell metrics are vectors (x.rt.b.cmod.temp.act etc.),
+#   see BatteryInit()
 
 SPEED_CNT=3
 declare -a SPEED_NAMES=("cst" "acc" "dec")
@@ -42,30 +39,6 @@ for f in $PACK_METRICS ; do
   echo ' };'
 done
 
-for f in $CMOD_METRICS ; do
-  fu=${f//\./_}
-  printf 'const char* const x_rt_b_cmod_%s[] = { ' "$fu"
-  sep=""
-  for ((i = 0; i < $CMOD_CNT; i++)) ; do
-    ih=$((i + 1))
-    printf '%s"x.rt.b.cmod.%02d.%s"' "$sep" "$ih" "$f"
-    sep=", "
-  done
-  echo ' };'
-done
-
-for f in $CELL_METRICS ; do
-  fu=${f//\./_}
-  printf 'const char* const x_rt_b_cell_%s[] = { ' "$fu"
-  sep=""
-  for ((i = 0; i < $CELL_CNT; i++)) ; do
-    ih=$((i + 1))
-    printf '%s"x.rt.b.cell.%02d.%s"' "$sep" "$ih" "$f"
-    sep=", "
-  done
-  echo ' };'
-done
-
 echo '// END Battery metrics names'
 echo
 
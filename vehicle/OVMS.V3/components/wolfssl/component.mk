@@ -66,5 +66,14 @@ COMPONENT_OBJS += wolfcrypt/src/wc_port.o
 COMPONENT_OBJS += wolfcrypt/src/wolfevent.o
 COMPONENT_OBJS += wolfcrypt/src/wolfmath.o
 
+ifdef CONFIG_OVMS_COMP_SERVER_V2_TLS
+COMPONENT_SRCDIRS += src
+COMPONENT_OBJS += src/internal.o
+COMPONENT_OBJS += src/io.o
+COMPONENT_OBJS += src/keys.o
+COMPONENT_OBJS += src/ssl.o
+COMPONENT_OBJS += src/tls.o
+endif
+
 CFLAGS += -DWOLFSSL_USER_SETTINGS
 endif
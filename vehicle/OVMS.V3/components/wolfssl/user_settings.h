@@ -12,7 +12,6 @@
 
 #define BUILDING_WOLFSSL
 #define HAVE_VISIBILITY 1
-#define WOLFCRYPT_ONLY
 #define NO_DEV_RANDOM
 #define NO_MAIN_DRIVER
 #define FREERTOS
@@ -58,3 +57,17 @@
 //#define WOLFSSL_SHA3
 #define WOLFSSL_SHA384
 #define WOLFSSL_SHA512
+
+// TLS client (V2 server connection), else crypto library only
+
+#include "sdkconfig.h"
+#ifdef CONFIG_OVMS_COMP_SERVER_V2_TLS
+#define NO_WOLFSSL_SERVER
+#define NO_OLD_TLS
+#define HAVE_SNI
+#define HAVE_SESSION_TICKET
+#define KEEP_PEER_CERT
+#define PERSIST_SESSION_CACHE
+#else
+#define WOLFCRYPT_ONLY
+#endif // #ifdef CONFIG_OVMS_COMP_SERVER_V2_TLS
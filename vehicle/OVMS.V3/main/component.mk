@@ -5,3 +5,8 @@
 
 COMPONENT_ADD_INCLUDEDIRS := .
 COMPONENT_ADD_LDFLAGS = -Wl,--whole-archive -l$(COMPONENT_NAME) -Wl,--no-whole-archive
+
+ifdef CONFIG_OVMS_COMP_SERVER_V2_TLS
+COMPONENT_EXTRA_INCLUDES := ${IDF_PATH}/components/freertos/include/freertos
+CXXFLAGS += -DWOLFSSL_USER_SETTINGS
+endif
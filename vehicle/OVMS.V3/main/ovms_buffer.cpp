@@ -33,6 +33,7 @@ static const char *TAG = "buffer";
 
 #include "ovms_buffer.h"
 #include "ovms_command.h"
+#include "ovms_net.h"
 #include <sys/socket.h>
 
 OvmsBuffer::OvmsBuffer(size_t size, void* userdata)
@@ -226,3 +227,40 @@ int OvmsBuffer::PollSocket(int sock, long timeoutms)
   return n;
   }
 
+// As PollSocket(), but reading through the connection (i.e. decrypting
+// TLS). Data the connection has already received is read without waiting
+// for the socket.
+int OvmsBuffer::PollConnection(OvmsNetConnection* conn, long timeoutms)
+  {
+  int sock = conn->Socket();
+  if (sock < 0) return -1;
+
+  if (conn->Pending() == 0)
+    {
+    fd_set fds;
+    FD_ZERO(&fds);
+    FD_SET(sock,&fds);
+
+    struct timeval timeout;
+    timeout.tv_sec = timeoutms/1000;
+    timeout.tv_usec = (timeoutms%1000)*1000;
+
+    int result = select(sock+1, &fds, 0, 0, &timeout);
+    if (result <= 0) return 0;
+    }
+
+  size_t avail = FreeSpace();
+  if (avail==0) return 0;
+  uint8_t *buf = new uint8_t[avail];
+  int n = (int)conn->Read(buf, avail);
+  if (n == 0)
+    {
+    n = -1;
+    }
+  else if (n > 0)
+    {
+    Push(buf,n);
+    }
+  delete [] buf;
+  return n;
+  }
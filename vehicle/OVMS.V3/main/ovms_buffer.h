@@ -34,6 +34,8 @@
 #include <string>
 #include <stdint.h>
 
+class OvmsNetConnection;
+
 class OvmsBuffer
   {
   public:
@@ -61,6 +63,7 @@ class OvmsBuffer
 
   public:
     int PollSocket(int sock, long timeoutms);
+    int PollConnection(OvmsNetConnection* conn, long timeoutms);
 
   public:
     void* m_userdata;
@@ -36,12 +36,16 @@ static const char *TAG = "config";
 #include <string.h>
 #include <sstream>
 #include <dirent.h>
+#include <vector>
 #include "ovms_config.h"
 #include "ovms_command.h"
 #include "ovms_events.h"
+#include "ovms_scheduler.h"
+#include "ovms_config_bundle.h"
 
 #define OVMS_CONFIGPATH "/store/ovms_config"
-#define OVMS_MAXVALSIZE 2500
+#define OVMS_CONFIGLOG  "/store/ovms_config.kv"
+#define OVMS_MAXVALSIZE CONFIGSTORE_MAX_VALUE
 //#define OVMS_PERSIST_METADATA
 
 
@@ -135,10 +139,172 @@ void config_rm(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, co
   MyConfig.DeregisterParam(argv[0]);
   }
 
+void config_export(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  if (!MyConfig.ismounted()) return;
+
+  // Non-readable params (passwords) are only exported on request, and only
+  // into the protected config directory:
+  bool secrets = (argc > 1) && (strcmp(argv[0], "-s") == 0);
+  std::string path(argv[argc-1]);
+  if (argc > 1 && !secrets)
+    {
+    writer->printf("Error: Unknown option %s\n", argv[0]);
+    return;
+    }
+  if (secrets &&
+      (path.compare(0, strlen(OVMS_CONFIGPATH "/"), OVMS_CONFIGPATH "/") != 0 ||
+       path.find("..") != std::string::npos))
+    {
+    writer->puts("Error: Secrets can only be exported to " OVMS_CONFIGPATH "/...");
+    return;
+    }
+
+  bool json = (path.length() > 5) && (path.compare(path.length()-5, 5, ".json") == 0);
+  FILE* f = fopen(path.c_str(), "w");
+  if (f == NULL)
+    {
+    writer->printf("Error: Cannot create %s\n", path.c_str());
+    return;
+    }
+
+  OvmsConfigBundleWriter bundle(f, json);
+  int skipped = 0;
+  std::vector<std::string> oversize;
+  xSemaphoreTake(MyConfig.m_mutex, portMAX_DELAY);
+  for (ConfigMap::iterator it=MyConfig.m_map.begin(); it!=MyConfig.m_map.end(); ++it)
+    {
+    OvmsConfigParam* p = it->second;
+    if (!secrets && !p->Readable())
+      {
+      skipped++;
+      continue;
+      }
+    for (ConfigParamMap::iterator k=p->m_map.begin(); k!=p->m_map.end(); ++k)
+      {
+      // Add() fails on records beyond the binary format limits, write
+      // errors are reported by Finish():
+      if (!bundle.Add(it->first, k->first, k->second))
+        oversize.push_back(it->first + "/" + k->first);
+      }
+    }
+  xSemaphoreGive(MyConfig.m_mutex);
+  bool ok = bundle.Finish();
+  if (fclose(f) != 0) ok = false;
+
+  if (ok)
+    {
+    writer->printf("Exported %u instances to %s", bundle.m_count, path.c_str());
+    if (skipped)
+      writer->printf(" (%d non-readable params skipped, use -s to include)", skipped);
+    writer->puts("");
+    if (!oversize.empty())
+      {
+      writer->printf("Warning: %u instance(s) too large for the bundle, not exported:\n", oversize.size());
+      for (const std::string& key : oversize)
+        writer->printf("  %s\n", key.c_str());
+      }
+    }
+  else
+    writer->printf("Error: Write to %s failed\n", path.c_str());
+  }
+
+void config_import(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  if (!MyConfig.ismounted()) return;
+
+  FILE* f = fopen(argv[0], "r");
+  if (f == NULL)
+    {
+    writer->printf("Error: Cannot open %s\n", argv[0]);
+    return;
+    }
+
+  // Verify the complete bundle before applying anything:
+  OvmsConfigBundleReader bundle(f);
+  if (!bundle.Read(NULL))
+    {
+    writer->printf("Error: Invalid bundle, %s (after %u instances)\n", bundle.m_error, bundle.m_count);
+    fclose(f);
+    return;
+    }
+  rewind(f);
+
+  int skipped = 0;
+  bool ok;
+    {
+    // One transaction: listeners get a single delivery, the flush is
+    // deferred until the import is complete
+    OvmsConfigTransaction txn;
+    ok = bundle.Read([&skipped](const std::string& param, const std::string& instance, const std::string& value)
+      {
+      OvmsConfigParam* p = MyConfig.CachedParam(param);
+      if (p == NULL)
+        {
+        MyConfig.RegisterParam(param, "", true, false);
+        p = MyConfig.CachedParam(param);
+        }
+      if (p->Writable())
+        p->SetValue(instance, value);
+      else
+        skipped++;
+      });
+    if (!ok)
+      {
+      // I/O error or the file changed since the verification: restore
+      // the previous values instead of leaving a partial import
+      txn.Abort();
+      }
+    }
+  fclose(f);
+
+  if (!ok)
+    {
+    writer->printf("Error: Import failed, %s (after %u instances), configuration unchanged\n",
+      bundle.m_error ? bundle.m_error : "read error", bundle.m_count);
+    return;
+    }
+
+  writer->printf("Imported %u instances from %s", bundle.m_count - skipped, argv[0]);
+  if (skipped)
+    writer->printf(" (%d skipped, parameter is not writeable)", skipped);
+  writer->puts("");
+  }
+
+void config_flush(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  if (!MyConfig.ismounted()) return;
+
+  int written = MyConfig.Flush();
+  OvmsConfigStore* store = &MyConfig.m_store;
+  if (written < 0)
+    writer->puts("Error: Cannot write to the store, changes are kept for a retry");
+  else
+    writer->printf("Flushed %d param(s)\n", written);
+  writer->printf("Statistics: %u changes, %u records written, %u writes avoided, %u write errors, %u rejected\n",
+    MyConfig.m_stat_changes, MyConfig.m_stat_writes, MyConfig.m_stat_writes_avoided,
+    MyConfig.m_stat_write_errors, MyConfig.m_stat_rejected);
+  writer->printf("Store: %u bytes, %u garbage, %u keys, %u compactions, %u truncations\n",
+    store->Size(), store->Garbage(), store->Keys(),
+    store->m_stat_compactions, store->m_stat_truncations);
+  }
+
 OvmsConfig::OvmsConfig()
   {
   ESP_LOGI(TAG, "Initialising CONFIG (1400)");
 
+  m_mounted = false;
+  m_flush_pending = false;
+  m_mutex = xSemaphoreCreateMutex();
+  m_stat_changes = 0;
+  m_stat_writes = 0;
+  m_stat_writes_avoided = 0;
+  m_stat_write_errors = 0;
+  m_stat_rejected = 0;
+  m_txn_lock = xSemaphoreCreateRecursiveMutex();
+  m_txn_owner = NULL;
+  m_txn_depth = 0;
+
   OvmsCommand* cmd_store = MyCommandApp.RegisterCommand("store","STORE framework",NULL,"",0,0,true);
   cmd_store->RegisterCommand("mount","Mount STORE",store_mount,"",0,0,true);
   cmd_store->RegisterCommand("unmount","Unmount STORE",store_unmount,"",0,0,true);
@@ -147,8 +313,17 @@ OvmsConfig::OvmsConfig()
   cmd_config->RegisterCommand("list","Show configuration parameters/instances",config_list,"[<param>]",0,1,true);
   cmd_config->RegisterCommand("set","Set parameter:instance=value",config_set,"<param> <instance> <value>",3,3,true);
   cmd_config->RegisterCommand("rm","Remove parameter:instance",config_rm,"<param> {<instance> | *}",2,2,true);
+  cmd_config->RegisterCommand("export","Export configuration to a (.json) file",config_export,
+    "[-s] <file>\n-s: include non-readable params (passwords), file must be in " OVMS_CONFIGPATH,1,2,true);
+  cmd_config->RegisterCommand("import","Import configuration from a file",config_import,"<file>",1,1,true);
+  cmd_config->RegisterCommand("flush","Write pending changes to the store",config_flush,"",0,0,true);
 
   RegisterParam("password", "Password store", true, false);
+
+  #undef bind  // Kludgy, but works
+  using std::placeholders::_1;
+  using std::placeholders::_2;
+  MyEvents.RegisterEvent(TAG,"system.shutdown", std::bind(&OvmsConfig::EventShutdown, this, _1, _2));
   }
 
 OvmsConfig::~OvmsConfig()
@@ -179,6 +354,49 @@ esp_err_t OvmsConfig::mount()
     mkdir(OVMS_CONFIGPATH,0);
     }
 
+  // Rebuild the params from the store log:
+  std::map<std::string, ConfigParamMap> state;
+  bool existing = m_store.Open(OVMS_CONFIGLOG,
+    [&state](uint8_t type, const std::string& param, const std::string& instance, const std::string& value)
+    {
+    switch (type)
+      {
+      case CONFIGSTORE_SET:       state[param][instance] = value; break;
+      case CONFIGSTORE_DEL:       state[param].erase(instance); break;
+      case CONFIGSTORE_DELPARAM:  state.erase(param); break;
+      }
+    });
+
+  if (!existing)
+    {
+    esp_err_t err = MigrateLegacy();
+    if (err != ESP_OK) return err;
+    }
+  else
+    {
+    for (ConfigMap::iterator it=m_map.begin(); it!=m_map.end(); ++it)
+      it->second->m_map.clear();
+    for (auto it=state.begin(); it!=state.end(); ++it)
+      {
+      if (it->second.empty()) continue;
+      // Register the param in case this was not already done
+      if (CachedParam(it->first) == NULL)
+        RegisterParam(it->first, "", true, false);
+      CachedParam(it->first)->m_map = it->second;
+      }
+    }
+
+  UpdateAllHandles();
+  MyEvents.SignalEvent(EVENT_CONFIG_MOUNTED, NULL);
+  return ESP_OK;
+  }
+
+// One time migration from the original layout (one file per param in
+// OVMS_CONFIGPATH) to the store log. The param files are left in place, so
+// a firmware downgrade still finds the config as it was before the update.
+esp_err_t OvmsConfig::MigrateLegacy()
+  {
+  struct stat ds;
   DIR *dir;
   struct dirent *dp;
   if ((dir = opendir(OVMS_CONFIGPATH)) == NULL)
@@ -188,9 +406,27 @@ esp_err_t OvmsConfig::mount()
     }
   while ((dp = readdir(dir)) != NULL)
     {
+    std::string name(dp->d_name);
+    if (name.empty() || name[0] == '.')
+      continue;   // Not a param, i.e. the server V2 TLS session cache
+    if (name.length() > 4 && name.compare(name.length()-4, 4, ".tmp") == 0)
+      {
+      // Left over from an interrupted rewrite: the temp file is only
+      // complete if the original has already been removed
+      std::string tmppath = std::string(OVMS_CONFIGPATH "/") + name;
+      name.resize(name.length()-4);
+      std::string path = std::string(OVMS_CONFIGPATH "/") + name;
+      if (stat(path.c_str(), &ds) == 0)
+        {
+        unlink(tmppath.c_str());
+        continue;
+        }
+      ESP_LOGW(TAG, "Recovering config param %s from interrupted write", name.c_str());
+      rename(tmppath.c_str(), path.c_str());
+      }
     // Register the param in case this was not already done
-    if (CachedParam(dp->d_name) == NULL)
-      RegisterParam(dp->d_name, "", true, false);
+    if (CachedParam(name) == NULL)
+      RegisterParam(name, "", true, false);
     }
   closedir(dir);
 
@@ -198,10 +434,28 @@ esp_err_t OvmsConfig::mount()
     {
     it->second->Load();
     }
-  MyEvents.SignalEvent("config.mounted", NULL);
+
+  xSemaphoreTake(m_mutex, portMAX_DELAY);
+  bool ok = m_store.Compact(std::bind(&OvmsConfig::Snapshot, this, std::placeholders::_1));
+  xSemaphoreGive(m_mutex);
+  if (ok)
+    ESP_LOGI(TAG, "Migrated %u params to %s", m_map.size(), OVMS_CONFIGLOG);
+  else
+    ESP_LOGE(TAG, "Error: Migration to %s failed", OVMS_CONFIGLOG);
   return ESP_OK;
   }
 
+void OvmsConfig::Snapshot(OvmsConfigStore* store)
+  {
+  // Config mutex held by caller
+  for (ConfigMap::iterator it=m_map.begin(); it!=m_map.end(); ++it)
+    {
+    OvmsConfigParam* p = it->second;
+    for (ConfigParamMap::iterator k=p->m_map.begin(); k!=p->m_map.end(); ++k)
+      store->Append(CONFIGSTORE_SET, p->GetName(), k->first, k->second);
+    }
+  }
+
 esp_err_t OvmsConfig::unmount()
   {
 //  if (spiffs_is_mounted)
@@ -209,9 +463,12 @@ esp_err_t OvmsConfig::unmount()
 
   if (m_mounted)
     {
+    Flush();
+    m_store.Close();
     esp_vfs_fat_spiflash_unmount("/store", m_store_wlh);
     m_mounted = false;
-    MyEvents.SignalEvent("config.unmounted", NULL);
+    UpdateAllHandles();
+    MyEvents.SignalEvent(EVENT_CONFIG_UNMOUNTED, NULL);
     }
 
   return ESP_OK;
@@ -222,13 +479,89 @@ bool OvmsConfig::ismounted()
   return m_mounted;
   }
 
+void OvmsConfig::ScheduleFlush(uint32_t delay)
+  {
+  MyScheduler.RunOnce(TAG, delay, std::bind(&OvmsConfig::FlushDeferred, this), true);
+  }
+
+void OvmsConfig::FlushDeferred()
+  {
+  // Don't write a partial transaction, unless forced by Flush()
+  if (TransactionOpen())
+    ScheduleFlush();
+  else
+    Flush();
+  }
+
+// Write the dirty params to the store. Params stay dirty until the store
+// has been closed without error, else the changes are kept, and the store
+// is reopened (repairing a torn tail) for a retry. Returns the number of
+// params written, -1 on a store error.
+int OvmsConfig::Flush()
+  {
+  int written = 0;
+  xSemaphoreTake(m_mutex, portMAX_DELAY);
+  m_flush_pending = false;
+  if (m_mounted)
+    {
+    if (m_store.Failed())
+      {
+      ESP_LOGW(TAG, "Reopening %s after a write error", OVMS_CONFIGLOG);
+      m_store.Open(OVMS_CONFIGLOG, NULL);
+      }
+    std::vector<OvmsConfigParam*> flushed;
+    bool ok = true;
+    for (ConfigMap::iterator it=m_map.begin(); ok && it!=m_map.end(); ++it)
+      {
+      if (!it->second->IsDirty())
+        continue;
+      if (it->second->Flush())
+        flushed.push_back(it->second);
+      else
+        ok = false;
+      }
+    if (!m_store.End())
+      ok = false;
+    if (ok)
+      {
+      for (OvmsConfigParam* p : flushed)
+        p->Flushed();
+      written = flushed.size();
+      if (m_store.NeedsCompaction())
+        m_store.Compact(std::bind(&OvmsConfig::Snapshot, this, std::placeholders::_1));
+      }
+    else
+      {
+      ESP_LOGE(TAG, "Error: Cannot write to %s, retrying in %u s", OVMS_CONFIGLOG, OVMS_CONFIG_RETRY_MS/1000);
+      m_stat_write_errors++;
+      written = -1;
+      m_flush_pending = true;
+      ScheduleFlush(OVMS_CONFIG_RETRY_MS);
+      }
+    }
+  xSemaphoreGive(m_mutex);
+  return written;
+  }
+
+void OvmsConfig::EventShutdown(std::string event, void* data)
+  {
+  int written = Flush();
+  if (written > 0)
+    ESP_LOGI(TAG, "Flushed %d param(s) on shutdown", written);
+  }
+
 void OvmsConfig::RegisterParam(std::string name, std::string title, bool writable, bool readable)
   {
   auto k = m_map.find(name);
   if (k == m_map.end())
     {
     OvmsConfigParam* p = new OvmsConfigParam(name, title, writable, readable);
+    // Params are registered during static initialisation, before the
+    // scheduler (and thus a concurrent flush) is running:
+    bool lock = (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING);
+    if (lock) xSemaphoreTake(m_mutex, portMAX_DELAY);
     m_map[name] = p;
+    if (lock) xSemaphoreGive(m_mutex);
     }
   else
     {
@@ -242,8 +575,10 @@ void OvmsConfig::DeregisterParam(std::string name)
   if (k != m_map.end())
     {
     k->second->DeleteParam();
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
     delete k->second;
     m_map.erase(k);
+    xSemaphoreGive(m_mutex);
     }
   }
 
@@ -387,6 +722,303 @@ bool OvmsConfig::ProtectedPath(std::string path)
 #endif // #ifdef CONFIG_OVMS_DEV_CONFIGVFS
   }
 
+void OvmsConfig::RegisterChangeListener(std::string caller, std::string param, std::string prefix, ConfigChangeCallback callback)
+  {
+  OvmsConfigChangeListener* listener = new OvmsConfigChangeListener(caller, param, prefix, callback);
+  bool lock = (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING);
+  if (lock) xSemaphoreTake(m_mutex, portMAX_DELAY);
+  m_listeners.push_back(listener);
+  if (lock) xSemaphoreGive(m_mutex);
+  }
+
+void OvmsConfig::DeregisterChangeListener(std::string caller)
+  {
+  bool lock = (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING);
+  if (lock) xSemaphoreTake(m_mutex, portMAX_DELAY);
+  for (auto it=m_listeners.begin(); it!=m_listeners.end(); )
+    {
+    if ((*it)->m_caller == caller)
+      {
+      delete *it;
+      it = m_listeners.erase(it);
+      }
+    else
+      ++it;
+    }
+  if (lock) xSemaphoreGive(m_mutex);
+  }
+
+void OvmsConfig::BeginTransaction()
+  {
+  xSemaphoreTakeRecursive(m_txn_lock, portMAX_DELAY);
+  xSemaphoreTake(m_mutex, portMAX_DELAY);
+  m_txn_owner = xTaskGetCurrentTaskHandle();
+  m_txn_depth++;
+  xSemaphoreGive(m_mutex);
+  }
+
+void OvmsConfig::AbortTransaction()
+  {
+  // Restore the original values of all changes recorded so far, then end
+  // the transaction without delivering anything:
+  ConfigChangeList changes;
+  xSemaphoreTake(m_mutex, portMAX_DELAY);
+  if (m_txn_depth > 0 && m_txn_owner == xTaskGetCurrentTaskHandle())
+    changes = m_txn.m_changes;
+  xSemaphoreGive(m_mutex);
+  for (auto c=changes.begin(); c!=changes.end(); ++c)
+    {
+    OvmsConfigParam* p = CachedParam(c->param);
+    if (p == NULL) continue;
+    if (!c->olddefined)
+      p->DeleteInstance(c->instance);
+    else
+      p->SetValue(c->instance, c->oldvalue);
+    }
+  xSemaphoreTake(m_mutex, portMAX_DELAY);
+  if (m_txn_depth > 0 && m_txn_owner == xTaskGetCurrentTaskHandle())
+    m_txn.Clear();
+  xSemaphoreGive(m_mutex);
+  CommitTransaction();
+  }
+
+void OvmsConfig::CommitTransaction()
+  {
+  OvmsConfigChangeSet changes;
+  xSemaphoreTake(m_mutex, portMAX_DELAY);
+  if (m_txn_depth > 0 && --m_txn_depth == 0)
+    {
+    m_txn_owner = NULL;
+    changes.Swap(m_txn);
+    }
+  xSemaphoreGive(m_mutex);
+  xSemaphoreGiveRecursive(m_txn_lock);
+  DeliverChanges(changes);
+  }
+
+OvmsConfigChangeSet* OvmsConfig::ChangeSet(OvmsConfigChangeSet* direct)
+  {
+  // Config mutex held by caller
+  if (m_txn_depth > 0 && m_txn_owner == xTaskGetCurrentTaskHandle())
+    return &m_txn;
+  return direct;
+  }
+
+bool OvmsConfig::InTransaction()
+  {
+  xSemaphoreTake(m_mutex, portMAX_DELAY);
+  bool owned = (m_txn_depth > 0 && m_txn_owner == xTaskGetCurrentTaskHandle());
+  xSemaphoreGive(m_mutex);
+  return owned;
+  }
+
+bool OvmsConfig::TransactionOpen()
+  {
+  xSemaphoreTake(m_mutex, portMAX_DELAY);
+  bool open = (m_txn_depth > 0);
+  xSemaphoreGive(m_mutex);
+  return open;
+  }
+
+// Record a change, NULL values are undefined (instance created or deleted)
+void OvmsConfigChangeSet::Record(OvmsConfigParam* param, const std::string& instance,
+                                 const std::string* oldvalue, const std::string* newvalue)
+  {
+  // Config mutex held by caller
+  std::string key = param->GetName();
+  key.push_back(0);
+  key.append(instance);
+  auto k = m_index.find(key);
+  if (k != m_index.end())
+    {
+    // Repeated change within the transaction: keep the original old value
+    m_changes[k->second].newvalue = newvalue ? *newvalue : std::string();
+    m_changes[k->second].newdefined = (newvalue != NULL);
+    }
+  else
+    {
+    OvmsConfigChange change = { param->GetName(), instance,
+      oldvalue ? *oldvalue : std::string(), newvalue ? *newvalue : std::string(),
+      (oldvalue != NULL), (newvalue != NULL) };
+    m_index[key] = m_changes.size();
+    m_changes.push_back(change);
+    }
+  for (auto it=m_params.begin(); it!=m_params.end(); ++it)
+    {
+    if (*it == param) return;
+    }
+  m_params.push_back(param);
+  }
+
+void OvmsConfigChangeSet::Discard(OvmsConfigParam* param)
+  {
+  // Config mutex held by caller
+  for (auto it=m_params.begin(); it!=m_params.end(); ++it)
+    {
+    if (*it == param)
+      {
+      m_params.erase(it);
+      return;
+      }
+    }
+  }
+
+void OvmsConfigChangeSet::Swap(OvmsConfigChangeSet& other)
+  {
+  m_changes.swap(other.m_changes);
+  m_index.swap(other.m_index);
+  m_params.swap(other.m_params);
+  }
+
+void OvmsConfigChangeSet::Clear()
+  {
+  m_changes.clear();
+  m_index.clear();
+  m_params.clear();
+  }
+
+void OvmsConfig::DeliverChanges(OvmsConfigChangeSet& changes)
+  {
+  std::vector< std::pair<ConfigChangeCallback, ConfigChangeList> > deliveries;
+
+  if (changes.m_changes.empty() && changes.m_params.empty())
+    return;
+
+  // Collect the deliveries under the mutex, run the callbacks without it:
+  xSemaphoreTake(m_mutex, portMAX_DELAY);
+  for (auto l=m_listeners.begin(); l!=m_listeners.end(); ++l)
+    {
+    ConfigChangeList matches;
+    for (auto c=changes.m_changes.begin(); c!=changes.m_changes.end(); ++c)
+      {
+      if ((c->oldvalue != c->newvalue) && (*l)->Matches(*c))
+        matches.push_back(*c);
+      }
+    if (!matches.empty())
+      deliveries.push_back(std::make_pair((*l)->m_callback, matches));
+    }
+  xSemaphoreGive(m_mutex);
+
+  for (auto d=deliveries.begin(); d!=deliveries.end(); ++d)
+    d->first(d->second);
+  for (auto p=changes.m_params.begin(); p!=changes.m_params.end(); ++p)
+    MyEvents.SignalEventSync(EVENT_CONFIG_CHANGED, *p);
+  changes.Clear();
+  }
+
+OvmsConfigChangeListener::OvmsConfigChangeListener(std::string caller, std::string param, std::string prefix, ConfigChangeCallback callback)
+  {
+  m_caller = caller;
+  m_param = param;
+  m_prefix = prefix;
+  m_callback = callback;
+  }
+
+OvmsConfigChangeListener::~OvmsConfigChangeListener()
+  {
+  }
+
+bool OvmsConfigChangeListener::Matches(const OvmsConfigChange& change)
+  {
+  return (change.param == m_param) &&
+         (change.instance.compare(0, m_prefix.length(), m_prefix) == 0);
+  }
+
+void OvmsConfig::RegisterHandle(OvmsConfigHandleBase* handle)
+  {
+  bool lock = (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING);
+  if (lock) xSemaphoreTake(m_mutex, portMAX_DELAY);
+  m_handles.insert(std::make_pair(handle->m_param, handle));
+  UpdateHandles(handle->m_param, &handle->m_instance);
+  if (lock) xSemaphoreGive(m_mutex);
+  }
+
+void OvmsConfig::DeregisterHandle(OvmsConfigHandleBase* handle)
+  {
+  bool lock = (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING);
+  if (lock) xSemaphoreTake(m_mutex, portMAX_DELAY);
+  auto range = m_handles.equal_range(handle->m_param);
+  for (auto it=range.first; it!=range.second; ++it)
+    {
+    if (it->second == handle)
+      {
+      m_handles.erase(it);
+      break;
+      }
+    }
+  if (lock) xSemaphoreGive(m_mutex);
+  }
+
+void OvmsConfig::UpdateHandles(const std::string& param, const std::string* instance)
+  {
+  // Config mutex held by caller
+  auto range = m_handles.equal_range(param);
+  if (range.first == range.second)
+    return;
+  OvmsConfigParam* p = CachedParam(param);
+  for (auto it=range.first; it!=range.second; ++it)
+    {
+    OvmsConfigHandleBase* handle = it->second;
+    if (instance && handle->m_instance != *instance)
+      continue;
+    const std::string* value = NULL;
+    if (p)
+      {
+      auto k = p->m_map.find(handle->m_instance);
+      if (k != p->m_map.end())
+        value = &k->second;
+      }
+    handle->Update(value);
+    }
+  }
+
+void OvmsConfig::UpdateAllHandles()
+  {
+  xSemaphoreTake(m_mutex, portMAX_DELAY);
+  auto it = m_handles.begin();
+  while (it != m_handles.end())
+    {
+    UpdateHandles(it->first);
+    it = m_handles.upper_bound(it->first);
+    }
+  xSemaphoreGive(m_mutex);
+  }
+
+OvmsConfigHandleBase::OvmsConfigHandleBase(std::string param, std::string instance)
+  {
+  m_param = param;
+  m_instance = instance;
+  }
+
+OvmsConfigHandleBase::~OvmsConfigHandleBase()
+  {
+  }
+
+void OvmsConfigHandleBase::Attach()
+  {
+  MyConfig.RegisterHandle(this);
+  }
+
+void OvmsConfigHandleBase::Detach()
+  {
+  MyConfig.DeregisterHandle(this);
+  }
+
+template<> int ConfigHandle<int>::Parse(const std::string& value)
+  {
+  return atoi(value.c_str());
+  }
+
+template<> float ConfigHandle<float>::Parse(const std::string& value)
+  {
+  return atof(value.c_str());
+  }
+
+template<> bool ConfigHandle<bool>::Parse(const std::string& value)
+  {
+  return ((value == "yes")||(value == "1")||(value == "true"));
+  }
+
 OvmsConfigParam::OvmsConfigParam(std::string name, std::string title, bool writable, bool readable)
   {
   m_name = name;
@@ -394,17 +1026,14 @@ OvmsConfigParam::OvmsConfigParam(std::string name, std::string title, bool writa
   m_writable = writable;
   m_readable = readable;
   m_loaded = false;
-
-  if (MyConfig.ismounted())
-    {
-    LoadConfig();
-    }
+  m_dirty = false;
   }
 
 OvmsConfigParam::~OvmsConfigParam()
   {
   }
 
+// Load the param from its file in the original layout (migration only)
 void OvmsConfigParam::LoadConfig()
   {
   if (m_loaded) return;  // Protected against loading more than once
@@ -456,37 +1085,113 @@ void OvmsConfigParam::LoadConfig()
 
 void OvmsConfigParam::SetValue(std::string instance, std::string value)
   {
-  if (m_map.find(instance) == m_map.end() || m_map[instance] != value)
+  OvmsConfigChangeSet direct;
+  xSemaphoreTake(MyConfig.m_mutex, portMAX_DELAY);
+  auto k = m_map.find(instance);
+  if (k == m_map.end() || k->second != value)
     {
+    MyConfig.ChangeSet(&direct)->Record(this, instance, (k == m_map.end()) ? NULL : &k->second, &value);
     m_map[instance] = value;
-    RewriteConfig();
-    MyEvents.SignalEvent("config.changed", this);
+    MarkDirty(instance);
+    MyConfig.UpdateHandles(m_name, &instance);
     }
+  xSemaphoreGive(MyConfig.m_mutex);
+  MyConfig.DeliverChanges(direct);
   }
 
 void OvmsConfigParam::DeleteParam()
   {
-  std::string path(OVMS_CONFIGPATH);
-  path.append("/");
-  path.append(m_name);
-  unlink(path.c_str());
-  MyEvents.SignalEvent("config.changed", this);
+  OvmsConfigChangeSet direct;
+  xSemaphoreTake(MyConfig.m_mutex, portMAX_DELAY);
+  OvmsConfigChangeSet* changes = MyConfig.ChangeSet(&direct);
+  m_dirty = false;
+  m_dirty_instances.clear();
+  for (ConfigParamMap::iterator it=m_map.begin(); it!=m_map.end(); ++it)
+    changes->Record(this, it->first, &it->second, NULL);
+  // The param may be deleted after this, so config.changed can't be deferred:
+  changes->Discard(this);
+  if (MyConfig.m_store.Append(CONFIGSTORE_DELPARAM, m_name) && MyConfig.m_store.End())
+    MyConfig.m_stat_writes++;
+  else
+    {
+    // Delete the instances one by one on the next flush:
+    MyConfig.m_store.End();
+    for (ConfigParamMap::iterator it=m_map.begin(); it!=m_map.end(); ++it)
+      MarkDirty(it->first);
+    }
+  m_map.clear();
+  MyConfig.UpdateHandles(m_name);
+  xSemaphoreGive(MyConfig.m_mutex);
+  MyEvents.SignalEventSync(EVENT_CONFIG_CHANGED, this);
+  MyConfig.DeliverChanges(direct);
   }
 
 bool OvmsConfigParam::DeleteInstance(std::string instance)
   {
   bool ret = false;
+  OvmsConfigChangeSet direct;
+  xSemaphoreTake(MyConfig.m_mutex, portMAX_DELAY);
   auto k = m_map.find(instance);
   if (k != m_map.end())
     {
+    MyConfig.ChangeSet(&direct)->Record(this, instance, &k->second, NULL);
     m_map.erase(k);
-    RewriteConfig();
+    MarkDirty(instance);
+    MyConfig.UpdateHandles(m_name, &instance);
     ret = true;
     }
-  MyEvents.SignalEvent("config.changed", this);
+  xSemaphoreGive(MyConfig.m_mutex);
+  MyConfig.DeliverChanges(direct);
   return ret;
   }
 
+void OvmsConfigParam::MarkDirty(const std::string& instance)
+  {
+  // Config mutex held by caller
+  MyConfig.m_stat_changes++;
+  if (!m_dirty_instances.insert(instance).second)
+    MyConfig.m_stat_writes_avoided++;
+  m_dirty = true;
+  if (!MyConfig.m_flush_pending)
+    {
+    MyConfig.m_flush_pending = true;
+    MyConfig.ScheduleFlush();
+    }
+  }
+
+// Append the dirty instances to the store, config mutex held by caller.
+// They stay dirty until Flushed(), returns false on a store error.
+bool OvmsConfigParam::Flush()
+  {
+  for (auto it=m_dirty_instances.begin(); it!=m_dirty_instances.end(); )
+    {
+    auto k = m_map.find(*it);
+    bool ok = (k != m_map.end())
+      ? MyConfig.m_store.Append(CONFIGSTORE_SET, m_name, k->first, k->second)
+      : MyConfig.m_store.Append(CONFIGSTORE_DEL, m_name, *it);
+    if (ok)
+      MyConfig.m_stat_writes++;
+    else if (MyConfig.m_store.Failed())
+      return false;
+    else
+      {
+      // Too large for the store: the value is kept in RAM only
+      MyConfig.m_stat_rejected++;
+      it = m_dirty_instances.erase(it);
+      continue;
+      }
+    ++it;
+    }
+  return true;
+  }
+
+void OvmsConfigParam::Flushed()
+  {
+  // Config mutex held by caller
+  m_dirty_instances.clear();
+  m_dirty = false;
+  }
+
 std::string OvmsConfigParam::GetValue(std::string instance)
   {
   auto k = m_map.find(instance);
@@ -528,28 +1233,6 @@ std::string OvmsConfigParam::GetName()
   return m_name;
   }
 
-void OvmsConfigParam::RewriteConfig()
-  {
-  std::string path(OVMS_CONFIGPATH);
-  path.append("/");
-  path.append(m_name);
-  FILE* f = fopen(path.c_str(), "w");
-  if (f)
-    {
-#ifdef OVMS_PERSIST_METADATA
-    // write meta data:
-    fprintf(f, "#access=%s%s\n", m_readable ? "r" : "", m_writable ? "w" : "");
-    fprintf(f, "#title=%s\n", m_title.c_str());
-#endif
-    // write instances:
-    for (ConfigParamMap::iterator it=m_map.begin(); it!=m_map.end(); ++it)
-      {
-      fprintf(f,"%s\t%s\n",it->first.c_str(),it->second.c_str());
-      }
-    fclose(f);
-    }
-  }
-
 void OvmsConfigParam::Load()
   {
   if (!m_loaded) LoadConfig();
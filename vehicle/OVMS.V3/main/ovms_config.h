@@ -33,9 +33,23 @@
 
 #include "string"
 #include "map"
+#include "set"
+#include <atomic>
+#include <vector>
+#include <functional>
 #include "esp_err.h"
 #include "esp_vfs_fat.h"
 #include "wear_levelling.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "ovms_config_store.h"
+
+// Changes are written back to the store after this delay, so a burst of
+// changes (e.g. a script or web form setting many keys) causes a single
+// store record per changed instance:
+#define OVMS_CONFIG_WRITEBACK_MS  2000
+#define OVMS_CONFIG_RETRY_MS      30000   // Retry delay after a store write error
 
 typedef std::map<std::string, std::string> ConfigParamMap;
 
@@ -57,9 +71,12 @@ class OvmsConfigParam
     std::string GetName();
     const char* GetTitle() { return m_title.c_str(); }
     void Load();
+    bool IsDirty() { return m_dirty; }
+    bool Flush();
+    void Flushed();
 
   protected:
-    void RewriteConfig();
+    void MarkDirty(const std::string& instance);
     void LoadConfig();
 
   protected:
@@ -68,6 +85,8 @@ class OvmsConfigParam
     bool m_writable;
     bool m_readable;
     bool m_loaded;
+    bool m_dirty;
+    std::set<std::string> m_dirty_instances;    // Changed since the last flush
 
   public:
     ConfigParamMap m_map;
@@ -75,6 +94,116 @@ class OvmsConfigParam
 
 typedef std::map<std::string, OvmsConfigParam*> ConfigMap;
 
+// Config handles cache the parsed value of a param instance, so frequent
+// readers (tickers, frame handlers) don't need to look up and parse the
+// value on each access. The config updates the handle on every change,
+// reading it is a single atomic load. Handles must not be constructed
+// before MyConfig, i.e. use them as members or locals, not as statics.
+class OvmsConfigHandleBase
+  {
+  public:
+    OvmsConfigHandleBase(std::string param, std::string instance);
+    virtual ~OvmsConfigHandleBase();
+
+  public:
+    virtual void Update(const std::string* value) = 0;  // NULL = undefined
+
+  protected:
+    void Attach();
+    void Detach();
+
+  public:
+    std::string m_param;
+    std::string m_instance;
+  };
+
+typedef std::multimap<std::string, OvmsConfigHandleBase*> ConfigHandleMap;
+
+// Change listeners get the changes of their param (and instance prefix)
+// delivered as one batch per transaction. An undefined old or new value is
+// passed as an empty string, as GetParamValue() would return it, the
+// defined flags tell it from an empty value.
+typedef struct
+  {
+  std::string param;
+  std::string instance;
+  std::string oldvalue;
+  std::string newvalue;
+  bool olddefined;                // Instance existed before the change
+  bool newdefined;                // ...exists after it
+  } OvmsConfigChange;
+
+typedef std::vector<OvmsConfigChange> ConfigChangeList;
+typedef std::function<void(const ConfigChangeList& changes)> ConfigChangeCallback;
+
+class OvmsConfigChangeListener
+  {
+  public:
+    OvmsConfigChangeListener(std::string caller, std::string param, std::string prefix, ConfigChangeCallback callback);
+    ~OvmsConfigChangeListener();
+
+  public:
+    bool Matches(const OvmsConfigChange& change);
+
+  public:
+    std::string m_caller;
+    std::string m_param;
+    std::string m_prefix;
+    ConfigChangeCallback m_callback;
+  };
+
+typedef std::vector<OvmsConfigChangeListener*> ConfigChangeListenerList;
+
+// Changes recorded for delivery: those of the open transaction, or of a
+// single change made outside of it.
+class OvmsConfigChangeSet
+  {
+  public:
+    void Record(OvmsConfigParam* param, const std::string& instance,
+                const std::string* oldvalue, const std::string* newvalue);
+    void Discard(OvmsConfigParam* param);
+    void Swap(OvmsConfigChangeSet& other);
+    void Clear();
+
+  public:
+    ConfigChangeList m_changes;
+    std::map<std::string, size_t> m_index;        // param\0instance → m_changes index
+    std::vector<OvmsConfigParam*> m_params;       // Params to signal config.changed for
+  };
+
+template <typename T> class ConfigHandle : public OvmsConfigHandleBase
+  {
+  public:
+    ConfigHandle(std::string param, std::string instance, T defvalue = T())
+      : OvmsConfigHandleBase(param, instance), m_default(defvalue), m_value(defvalue)
+      {
+      Attach();
+      }
+    ~ConfigHandle()
+      {
+      Detach();
+      }
+
+  public:
+    T Get() const { return m_value.load(std::memory_order_relaxed); }
+    operator T() const { return Get(); }
+    void Update(const std::string* value)
+      {
+      m_value.store((value && !value->empty()) ? Parse(*value) : m_default, std::memory_order_relaxed);
+      }
+
+  protected:
+    static T Parse(const std::string& value);
+
+  protected:
+    T m_default;
+    std::atomic<T> m_value;
+  };
+
+template<> int ConfigHandle<int>::Parse(const std::string& value);
+template<> float ConfigHandle<float>::Parse(const std::string& value);
+template<> bool ConfigHandle<bool>::Parse(const std::string& value);
+
 class OvmsConfig
   {
   public:
@@ -101,6 +230,33 @@ class OvmsConfig
     bool ProtectedPath(std::string path);
     OvmsConfigParam* CachedParam(std::string param);
 
+  public:
+    void ScheduleFlush(uint32_t delay = OVMS_CONFIG_WRITEBACK_MS);
+    void FlushDeferred();
+    int Flush();
+    void EventShutdown(std::string event, void* data);
+
+  protected:
+    esp_err_t MigrateLegacy();
+    void Snapshot(OvmsConfigStore* store);
+
+  public:
+    void RegisterChangeListener(std::string caller, std::string param, std::string prefix, ConfigChangeCallback callback);
+    void DeregisterChangeListener(std::string caller);
+    void BeginTransaction();
+    void CommitTransaction();
+    void AbortTransaction();
+    OvmsConfigChangeSet* ChangeSet(OvmsConfigChangeSet* direct);
+    bool InTransaction();
+    bool TransactionOpen();
+    void DeliverChanges(OvmsConfigChangeSet& changes);
+
+  public:
+    void RegisterHandle(OvmsConfigHandleBase* handle);
+    void DeregisterHandle(OvmsConfigHandleBase* handle);
+    void UpdateHandles(const std::string& param, const std::string* instance = NULL);
+    void UpdateAllHandles();
+
   public:
     esp_err_t mount();
     esp_err_t unmount();
@@ -112,9 +268,43 @@ class OvmsConfig
     wl_handle_t m_store_wlh;
 
   public:
+    SemaphoreHandle_t m_mutex;        // Guards param maps & dirty flags against the flush
+    bool m_flush_pending;
     ConfigMap m_map;
+    OvmsConfigStore m_store;
+    ConfigHandleMap m_handles;        // Param name → handles
+    ConfigChangeListenerList m_listeners;
+    SemaphoreHandle_t m_txn_lock;     // Recursive, serialises transactions of different tasks
+    TaskHandle_t m_txn_owner;         // Task with the open transaction
+    int m_txn_depth;                  // Nesting level of the open transaction
+    OvmsConfigChangeSet m_txn;        // Changes to deliver on commit
+
+  public:
+    uint32_t m_stat_changes;          // Changes marking a param dirty
+    uint32_t m_stat_writes;           // Store records written
+    uint32_t m_stat_writes_avoided;   // Changes merged into a pending write
+    uint32_t m_stat_write_errors;     // Flushes failed, changes kept for a retry
+    uint32_t m_stat_rejected;         // Instances too large for the store
   };
 
 extern OvmsConfig MyConfig;
 
+// Scope guard for a config transaction: changes made within are delivered
+// to the change listeners (and signalled as config.changed) once, when the
+// outermost transaction ends. A transaction belongs to the task that began
+// it: other tasks wait in BeginTransaction(), and their changes made outside
+// of a transaction are delivered at once. Abort() restores the values
+// changed so far in the open transaction (including those of enclosing
+// scopes) and ends it without delivering anything.
+class OvmsConfigTransaction
+  {
+  public:
+    OvmsConfigTransaction() { m_open = true; MyConfig.BeginTransaction(); }
+    ~OvmsConfigTransaction() { if (m_open) MyConfig.CommitTransaction(); }
+    void Abort() { if (m_open) { m_open = false; MyConfig.AbortTransaction(); } }
+
+  protected:
+    bool m_open;
+  };
+
 #endif //#ifndef __CONFIG_H__
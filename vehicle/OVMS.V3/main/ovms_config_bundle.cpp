@@ -0,0 +1,419 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Date:          14th March 2017
+;
+;    Changes:
+;    1.0  Initial release
+;
+;    (C) 2011       Michael Stegen / Stegen Electronics
+;    (C) 2011-2017  Mark Webb-Johnson
+;    (C) 2011        Sonny Chen @ EPRO/DX
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+
+#include <string.h>
+#include "ovms_config_bundle.h"
+#include "crypt_crc.h"
+
+OvmsConfigBundleWriter::OvmsConfigBundleWriter(FILE* file, bool json)
+  {
+  m_file = file;
+  m_json = json;
+  m_failed = false;
+  m_crc = 0;
+  m_len = 0;
+  m_count = 0;
+
+  if (m_json)
+    Put("{", 1);
+  else
+    {
+    uint8_t version = CONFIGBUNDLE_VERSION;
+    Put(CONFIGBUNDLE_MAGIC, 7);
+    Put(&version, 1);
+    }
+  }
+
+OvmsConfigBundleWriter::~OvmsConfigBundleWriter()
+  {
+  }
+
+bool OvmsConfigBundleWriter::Flush()
+  {
+  if ((m_len > 0) && (fwrite(m_buf, 1, m_len, m_file) != m_len))
+    m_failed = true;
+  m_len = 0;
+  return !m_failed;
+  }
+
+bool OvmsConfigBundleWriter::Put(const void* data, size_t length)
+  {
+  const char* src = (const char*)data;
+  if (!m_json)
+    m_crc = crc32(m_crc, src, length);
+  while (length > 0)
+    {
+    if ((m_len == CONFIGBUNDLE_BUFSIZE) && !Flush())
+      return false;
+    size_t n = CONFIGBUNDLE_BUFSIZE - m_len;
+    if (n > length) n = length;
+    memcpy(m_buf + m_len, src, n);
+    m_len += n;
+    src += n;
+    length -= n;
+    }
+  return !m_failed;
+  }
+
+bool OvmsConfigBundleWriter::PutU16(uint16_t value)
+  {
+  uint8_t le[2] = { (uint8_t)(value & 0xff), (uint8_t)(value >> 8) };
+  return Put(le, 2);
+  }
+
+bool OvmsConfigBundleWriter::PutJsonString(const std::string& value)
+  {
+  Put("\"", 1);
+  size_t start = 0;
+  for (size_t k = 0; k < value.length(); k++)
+    {
+    unsigned char c = value[k];
+    if ((c >= 0x20) && (c != '"') && (c != '\\'))
+      continue;
+    // Flush the plain part, then escape:
+    Put(value.data() + start, k - start);
+    start = k + 1;
+    char esc[8];
+    switch (c)
+      {
+      case '"':   Put("\\\"", 2); break;
+      case '\\':  Put("\\\\", 2); break;
+      case '\n':  Put("\\n", 2); break;
+      case '\r':  Put("\\r", 2); break;
+      case '\t':  Put("\\t", 2); break;
+      default:
+        snprintf(esc, sizeof(esc), "\\u%04x", c);
+        Put(esc, 6);
+        break;
+      }
+    }
+  Put(value.data() + start, value.length() - start);
+  return Put("\"", 1);
+  }
+
+bool OvmsConfigBundleWriter::Add(const std::string& param, const std::string& instance, const std::string& value)
+  {
+  if (m_failed)
+    return false;
+
+  if (m_json)
+    {
+    if (param != m_lastparam)
+      {
+      Put(m_lastparam.empty() ? "\n  " : "\n  },\n  ", m_lastparam.empty() ? 3 : 8);
+      PutJsonString(param);
+      Put(": {\n    ", 8);
+      m_lastparam = param;
+      }
+    else
+      Put(",\n    ", 6);
+    PutJsonString(instance);
+    Put(": ", 2);
+    PutJsonString(value);
+    }
+  else
+    {
+    if ((param.length() == 0) || (param.length() > 0xff) ||
+        (instance.length() > 0xffff) || (value.length() > 0xffff))
+      return false;
+    uint8_t paramlen = param.length();
+    Put(&paramlen, 1);
+    PutU16(instance.length());
+    PutU16(value.length());
+    Put(param.data(), param.length());
+    Put(instance.data(), instance.length());
+    Put(value.data(), value.length());
+    }
+
+  if (!m_failed) m_count++;
+  return !m_failed;
+  }
+
+bool OvmsConfigBundleWriter::Finish()
+  {
+  if (m_json)
+    {
+    if (m_lastparam.empty())
+      Put("}\n", 2);
+    else
+      Put("\n  }\n}\n", 7);
+    }
+  else
+    {
+    uint8_t end = 0;
+    Put(&end, 1);
+    uint32_t crc = m_crc;
+    uint8_t le[4] = { (uint8_t)crc, (uint8_t)(crc >> 8), (uint8_t)(crc >> 16), (uint8_t)(crc >> 24) };
+    Put(le, 4);
+    }
+  return Flush();
+  }
+
+OvmsConfigBundleReader::OvmsConfigBundleReader(FILE* file)
+  {
+  m_file = file;
+  m_crc = 0;
+  m_pos = 0;
+  m_len = 0;
+  m_count = 0;
+  m_error = NULL;
+  }
+
+OvmsConfigBundleReader::~OvmsConfigBundleReader()
+  {
+  }
+
+bool OvmsConfigBundleReader::Fail(const char* error)
+  {
+  if (m_error == NULL) m_error = error;
+  return false;
+  }
+
+bool OvmsConfigBundleReader::Fill()
+  {
+  if (m_pos < m_len)
+    return true;
+  m_pos = 0;
+  m_len = fread(m_buf, 1, CONFIGBUNDLE_BUFSIZE, m_file);
+  return (m_len > 0);
+  }
+
+bool OvmsConfigBundleReader::Get(void* data, size_t length, bool crc)
+  {
+  char* dst = (char*)data;
+  while (length > 0)
+    {
+    if (!Fill())
+      return Fail("unexpected end of file");
+    size_t n = m_len - m_pos;
+    if (n > length) n = length;
+    memcpy(dst, m_buf + m_pos, n);
+    if (crc)
+      m_crc = crc32(m_crc, dst, n);
+    m_pos += n;
+    dst += n;
+    length -= n;
+    }
+  return true;
+  }
+
+bool OvmsConfigBundleReader::GetString(std::string& value, size_t length)
+  {
+  value.resize(length);
+  return (length == 0) || Get(&value[0], length);
+  }
+
+bool OvmsConfigBundleReader::GetU16(uint16_t& value)
+  {
+  uint8_t le[2];
+  if (!Get(le, 2)) return false;
+  value = le[0] | (le[1] << 8);
+  return true;
+  }
+
+int OvmsConfigBundleReader::Peek()
+  {
+  if (!Fill())
+    return -1;
+  return (unsigned char)m_buf[m_pos];
+  }
+
+int OvmsConfigBundleReader::Next()
+  {
+  int c = Peek();
+  if (c >= 0) m_pos++;
+  return c;
+  }
+
+int OvmsConfigBundleReader::SkipSpace()
+  {
+  int c;
+  while (((c = Peek()) == ' ') || (c == '\t') || (c == '\r') || (c == '\n'))
+    m_pos++;
+  return c;
+  }
+
+// Read the bundle, calling callback for each instance. Binary bundles are
+// only verified by the CRC at the end, so to apply a bundle atomically,
+// Read() it with a NULL callback first, then rewind and read it again.
+bool OvmsConfigBundleReader::Read(ConfigBundleCallback callback)
+  {
+  m_crc = 0;
+  m_pos = 0;
+  m_len = 0;
+  m_count = 0;
+  m_error = NULL;
+
+  int c = SkipSpace();
+  if (c == '{')
+    return ReadJson(callback);
+  else if (c == CONFIGBUNDLE_MAGIC[0])
+    return ReadBinary(callback);
+  return Fail("unknown format");
+  }
+
+bool OvmsConfigBundleReader::ReadBinary(ConfigBundleCallback callback)
+  {
+  char magic[8];
+  if (!Get(magic, 8))
+    return false;
+  if (memcmp(magic, CONFIGBUNDLE_MAGIC, 7) != 0)
+    return Fail("bad magic");
+  if (magic[7] != CONFIGBUNDLE_VERSION)
+    return Fail("unsupported version");
+
+  std::string param, instance, value;
+  while (1)
+    {
+    uint8_t paramlen;
+    uint16_t instancelen, valuelen;
+    if (!Get(&paramlen, 1)) return false;
+    if (paramlen == 0) break;
+    if (!GetU16(instancelen) || !GetU16(valuelen) ||
+        !GetString(param, paramlen) || !GetString(instance, instancelen) ||
+        !GetString(value, valuelen))
+      return false;
+    if (callback) callback(param, instance, value);
+    m_count++;
+    }
+
+  uint32_t crc = m_crc;
+  uint8_t le[4];
+  if (!Get(le, 4, false))
+    return false;
+  if ((le[0] | (le[1] << 8) | (le[2] << 16) | ((uint32_t)le[3] << 24)) != crc)
+    return Fail("CRC mismatch");
+  return true;
+  }
+
+bool OvmsConfigBundleReader::GetJsonString(std::string& value)
+  {
+  value.clear();
+  int c = SkipSpace();
+  if (c != '"')
+    {
+    // Accept bare numbers and booleans as values:
+    while ((c >= 0) && (strchr(",}] \t\r\n", c) == NULL))
+      {
+      value.push_back(c);
+      m_pos++;
+      c = Peek();
+      }
+    return value.empty() ? Fail("string expected") : true;
+    }
+  m_pos++;
+
+  while ((c = Next()) >= 0)
+    {
+    if (c == '"')
+      return true;
+    if (c != '\\')
+      {
+      value.push_back(c);
+      continue;
+      }
+    switch (c = Next())
+      {
+      case 'n': value.push_back('\n'); break;
+      case 'r': value.push_back('\r'); break;
+      case 't': value.push_back('\t'); break;
+      case 'b': value.push_back('\b'); break;
+      case 'f': value.push_back('\f'); break;
+      case 'u':
+        {
+        char hex[5];
+        if (!Get(hex, 4, false)) return false;
+        hex[4] = 0;
+        unsigned int cp = strtoul(hex, NULL, 16);
+        // Encode as UTF-8 (surrogate pairs are not combined):
+        if (cp < 0x80)
+          value.push_back(cp);
+        else if (cp < 0x800)
+          {
+          value.push_back(0xc0 | (cp >> 6));
+          value.push_back(0x80 | (cp & 0x3f));
+          }
+        else
+          {
+          value.push_back(0xe0 | (cp >> 12));
+          value.push_back(0x80 | ((cp >> 6) & 0x3f));
+          value.push_back(0x80 | (cp & 0x3f));
+          }
+        break;
+        }
+      case -1:
+        return Fail("unexpected end of file");
+      default:
+        value.push_back(c);
+        break;
+      }
+    }
+  return Fail("unterminated string");
+  }
+
+bool OvmsConfigBundleReader::ReadJson(ConfigBundleCallback callback)
+  {
+  std::string param, instance, value;
+  m_pos++;  // '{'
+  if (SkipSpace() == '}')
+    return true;
+
+  while (1)
+    {
+    if (!GetJsonString(param)) return false;
+    if (SkipSpace() != ':') return Fail("':' expected");
+    m_pos++;
+    if (SkipSpace() != '{') return Fail("'{' expected");
+    m_pos++;
+    if (SkipSpace() == '}')
+      m_pos++;
+    else
+      {
+      while (1)
+        {
+        if (!GetJsonString(instance)) return false;
+        if (SkipSpace() != ':') return Fail("':' expected");
+        m_pos++;
+        if (!GetJsonString(value)) return false;
+        if (callback) callback(param, instance, value);
+        m_count++;
+        int c = SkipSpace();
+        m_pos++;
+        if (c == '}') break;
+        if (c != ',') return Fail("',' or '}' expected");
+        }
+      }
+    int c = SkipSpace();
+    m_pos++;
+    if (c == '}') break;
+    if (c != ',') return Fail("',' or '}' expected");
+    }
+  return true;
+  }
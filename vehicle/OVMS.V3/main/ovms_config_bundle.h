@@ -0,0 +1,120 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Date:          14th March 2017
+;
+;    Changes:
+;    1.0  Initial release
+;
+;    (C) 2011       Michael Stegen / Stegen Electronics
+;    (C) 2011-2017  Mark Webb-Johnson
+;    (C) 2011        Sonny Chen @ EPRO/DX
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+
+#ifndef __CONFIG_BUNDLE_H__
+#define __CONFIG_BUNDLE_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <functional>
+
+// Config bundles carry a set of param instances for backup & provisioning.
+// They are streamed through a fixed size buffer in either of two formats:
+//
+// Binary: "OVMSCFG" + version (1), then per instance: paramlen (u8, > 0),
+//         instancelen (u16), valuelen (u16), param, instance, value.
+//         A paramlen of 0 ends the bundle, followed by the CRC-32 of all
+//         preceding bytes (u32). Numbers are little endian.
+// JSON:   { "param": { "instance": "value", ... }, ... }
+//
+// Writers need to add the instances grouped by param.
+
+#define CONFIGBUNDLE_MAGIC      "OVMSCFG"
+#define CONFIGBUNDLE_VERSION    1
+#define CONFIGBUNDLE_BUFSIZE    512
+
+typedef std::function<void(const std::string& param, const std::string& instance,
+                           const std::string& value)> ConfigBundleCallback;
+
+class OvmsConfigBundleWriter
+  {
+  public:
+    OvmsConfigBundleWriter(FILE* file, bool json);
+    ~OvmsConfigBundleWriter();
+
+  public:
+    bool Add(const std::string& param, const std::string& instance, const std::string& value);
+    bool Finish();
+
+  protected:
+    bool Put(const void* data, size_t length);
+    bool PutU16(uint16_t value);
+    bool PutJsonString(const std::string& value);
+    bool Flush();
+
+  protected:
+    FILE* m_file;
+    bool m_json;
+    bool m_failed;
+    uint32_t m_crc;
+    std::string m_lastparam;
+    size_t m_len;
+    char m_buf[CONFIGBUNDLE_BUFSIZE];
+
+  public:
+    uint32_t m_count;
+  };
+
+class OvmsConfigBundleReader
+  {
+  public:
+    OvmsConfigBundleReader(FILE* file);
+    ~OvmsConfigBundleReader();
+
+  public:
+    bool Read(ConfigBundleCallback callback);
+
+  protected:
+    bool ReadBinary(ConfigBundleCallback callback);
+    bool ReadJson(ConfigBundleCallback callback);
+    bool Fill();
+    bool Get(void* data, size_t length, bool crc=true);
+    bool GetString(std::string& value, size_t length);
+    bool GetU16(uint16_t& value);
+    int Peek();
+    int Next();
+    int SkipSpace();
+    bool GetJsonString(std::string& value);
+    bool Fail(const char* error);
+
+  protected:
+    FILE* m_file;
+    uint32_t m_crc;
+    size_t m_pos;
+    size_t m_len;
+    char m_buf[CONFIGBUNDLE_BUFSIZE];
+
+  public:
+    uint32_t m_count;
+    const char* m_error;
+  };
+
+#endif //#ifndef __CONFIG_BUNDLE_H__
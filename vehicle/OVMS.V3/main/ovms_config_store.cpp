@@ -0,0 +1,411 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Date:          14th March 2017
+;
+;    Changes:
+;    1.0  Initial release
+;
+;    (C) 2011       Michael Stegen / Stegen Electronics
+;    (C) 2011-2017  Mark Webb-Johnson
+;    (C) 2011        Sonny Chen @ EPRO/DX
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+
+#include "ovms_log.h"
+static const char *TAG = "config";
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "ovms_config_store.h"
+#include "crypt_crc.h"
+
+OvmsConfigStore::OvmsConfigStore()
+  {
+  m_file = NULL;
+  m_failed = false;
+  m_torn = false;
+  m_live = 0;
+  m_size = 0;
+  m_fail_after = -1;
+  m_stat_records = 0;
+  m_stat_compactions = 0;
+  m_stat_truncations = 0;
+  }
+
+OvmsConfigStore::~OvmsConfigStore()
+  {
+  Close();
+  }
+
+// Open the log at path, replaying all valid records. Returns false if there
+// is no log yet (the store is usable, but the caller may want to migrate).
+bool OvmsConfigStore::Open(std::string path, ConfigStoreReplay replay)
+  {
+  Close();
+  m_path = path;
+  m_failed = false;
+  m_torn = false;
+  m_index.clear();
+  m_live = 0;
+  m_size = 0;
+
+  // Recover from an interrupted compaction: the new log is only complete
+  // if the old one has already been removed
+  struct stat st;
+  std::string newpath = m_path + ".new";
+  if (stat(newpath.c_str(), &st) == 0)
+    {
+    if (stat(m_path.c_str(), &st) == 0)
+      unlink(newpath.c_str());
+    else
+      {
+      ESP_LOGW(TAG, "Store: recovering %s from interrupted compaction", m_path.c_str());
+      rename(newpath.c_str(), m_path.c_str());
+      }
+    }
+
+  if (!Replay(replay))
+    return false;
+
+  if (m_torn)
+    RepairTail();
+
+  return true;
+  }
+
+void OvmsConfigStore::Close()
+  {
+  End();
+  m_path.clear();
+  }
+
+bool OvmsConfigStore::Replay(ConfigStoreReplay replay)
+  {
+  FILE* f = fopen(m_path.c_str(), "rb");
+  if (f == NULL)
+    return false;
+
+  configstore_record_t rec;
+  std::string data;
+  size_t n;
+  while ((n = fread(&rec, 1, sizeof(rec), f)) > 0)
+    {
+    if ((n < sizeof(rec)) || (rec.magic != CONFIGSTORE_MAGIC) ||
+        (rec.type < CONFIGSTORE_SET) || (rec.type > CONFIGSTORE_DELPARAM))
+      {
+      m_torn = true;
+      break;
+      }
+    // Lengths beyond what Append() writes can only be garbage, and must
+    // not drive the allocation:
+    if ((rec.instancelen > CONFIGSTORE_MAX_INSTANCE) || (rec.valuelen > CONFIGSTORE_MAX_VALUE))
+      {
+      m_torn = true;
+      break;
+      }
+    size_t len = rec.paramlen + rec.instancelen + rec.valuelen;
+    data.resize(len);
+    if ((len > 0) && (fread(&data[0], 1, len, f) != len))
+      {
+      m_torn = true;
+      break;
+      }
+    uint32_t crc = rec.crc;
+    rec.crc = 0;
+    if (crc32(crc32(0, (const char*)&rec, sizeof(rec)), data.data(), len) != crc)
+      {
+      m_torn = true;
+      break;
+      }
+
+    std::string param(data, 0, rec.paramlen);
+    std::string instance(data, rec.paramlen, rec.instancelen);
+    std::string value(data, rec.paramlen + rec.instancelen, rec.valuelen);
+    uint32_t size = sizeof(rec) + len;
+    m_size += size;
+    Account(rec.type, param, instance, size);
+    if (replay) replay(rec.type, param, instance, value);
+    }
+  fclose(f);
+
+  if (m_torn)
+    {
+    // Everything after the first bad record is unreachable
+    m_stat_truncations++;
+    ESP_LOGW(TAG, "Store: discarding torn log tail of %s after %u bytes", m_path.c_str(), m_size);
+    }
+  return true;
+  }
+
+// Discard a torn tail by copying the valid part of the log, so new records
+// don't get appended behind the garbage. Uses the compaction file protocol.
+// Until this succeeds, Append() refuses to write.
+bool OvmsConfigStore::RepairTail()
+  {
+  std::string newpath = m_path + ".new";
+  FILE* src = fopen(m_path.c_str(), "rb");
+  if (src == NULL)
+    return false;
+  m_file = fopen(newpath.c_str(), "wb");
+  if (m_file == NULL)
+    {
+    fclose(src);
+    return false;
+    }
+
+  char buf[256];
+  uint32_t left = m_size;
+  while (left > 0)
+    {
+    size_t n = fread(buf, 1, (left < sizeof(buf)) ? left : sizeof(buf), src);
+    if ((n == 0) || !Write(buf, n))
+      break;
+    left -= n;
+    }
+  fclose(src);
+  fclose(m_file);
+  m_file = NULL;
+
+  if ((left > 0) || PowerCut())
+    {
+    if (m_fail_after < 0)
+      {
+      // A real error: retry on the next open, the tail stays torn
+      ESP_LOGE(TAG, "Store: cannot repair %s", m_path.c_str());
+      unlink(newpath.c_str());
+      m_failed = false;
+      }
+    return false;
+    }
+  unlink(m_path.c_str());
+  if (PowerCut()) return false;
+  if (rename(newpath.c_str(), m_path.c_str()) != 0)
+    {
+    m_failed = true;
+    return false;
+    }
+  m_torn = false;
+  return true;
+  }
+
+void OvmsConfigStore::Account(uint8_t type, const std::string& param, const std::string& instance, uint32_t size)
+  {
+  std::string key = param;
+  key.push_back(0);
+
+  switch (type)
+    {
+    case CONFIGSTORE_SET:
+      {
+      key.append(instance);
+      auto k = m_index.find(key);
+      if (k != m_index.end())
+        {
+        m_live -= k->second;
+        k->second = size;
+        }
+      else
+        m_index[key] = size;
+      m_live += size;
+      break;
+      }
+    case CONFIGSTORE_DEL:
+      {
+      key.append(instance);
+      auto k = m_index.find(key);
+      if (k != m_index.end())
+        {
+        m_live -= k->second;
+        m_index.erase(k);
+        }
+      break;
+      }
+    case CONFIGSTORE_DELPARAM:
+      {
+      auto k = m_index.lower_bound(key);
+      while ((k != m_index.end()) && (k->first.compare(0, key.length(), key) == 0))
+        {
+        m_live -= k->second;
+        k = m_index.erase(k);
+        }
+      break;
+      }
+    }
+  }
+
+// Simulated power loss: once m_fail_after bytes have been written, nothing
+// else reaches the file system
+bool OvmsConfigStore::PowerCut()
+  {
+  if (m_failed)
+    return true;
+  if (m_fail_after == 0)
+    {
+    m_failed = true;
+    return true;
+    }
+  return false;
+  }
+
+bool OvmsConfigStore::Write(const void* data, size_t length)
+  {
+  if (PowerCut())
+    return false;
+  if ((m_fail_after >= 0) && (length > (size_t)m_fail_after))
+    {
+    fwrite(data, 1, m_fail_after, m_file);
+    m_fail_after = 0;
+    m_failed = true;
+    return false;
+    }
+  if (fwrite(data, 1, length, m_file) != length)
+    {
+    m_failed = true;
+    return false;
+    }
+  if (m_fail_after > 0)
+    m_fail_after -= length;
+  return true;
+  }
+
+// Append a record to the log. The file stays open until End(), so a batch
+// of changes costs one open/close. Returns false on a store error (see
+// Failed()), or if the record exceeds the size limits (the store stays
+// usable).
+bool OvmsConfigStore::Append(uint8_t type, const std::string& param,
+                             const std::string& instance, const std::string& value)
+  {
+  if (m_path.empty() || m_failed || m_torn)
+    return false;
+  if ((param.length() > 0xff) || (instance.length() > CONFIGSTORE_MAX_INSTANCE) ||
+      (value.length() > CONFIGSTORE_MAX_VALUE))
+    {
+    ESP_LOGE(TAG, "Store: record too large for %s/%s", param.c_str(), instance.c_str());
+    return false;
+    }
+  if (m_file == NULL)
+    {
+    m_file = fopen(m_path.c_str(), "ab");
+    if (m_file == NULL)
+      {
+      ESP_LOGE(TAG, "Store: cannot open %s", m_path.c_str());
+      m_failed = true;
+      return false;
+      }
+    }
+
+  configstore_record_t rec;
+  rec.magic = CONFIGSTORE_MAGIC;
+  rec.type = type;
+  rec.paramlen = param.length();
+  rec.instancelen = instance.length();
+  rec.valuelen = value.length();
+  rec.crc = 0;
+  uint32_t crc = crc32(0, (const char*)&rec, sizeof(rec));
+  crc = crc32(crc, param.data(), param.length());
+  crc = crc32(crc, instance.data(), instance.length());
+  rec.crc = crc32(crc, value.data(), value.length());
+
+  if (!Write(&rec, sizeof(rec)) ||
+      !Write(param.data(), param.length()) ||
+      !Write(instance.data(), instance.length()) ||
+      !Write(value.data(), value.length()))
+    {
+    ESP_LOGE(TAG, "Store: write error on %s", m_path.c_str());
+    return false;
+    }
+
+  uint32_t size = sizeof(rec) + param.length() + instance.length() + value.length();
+  m_size += size;
+  Account(type, param, instance, size);
+  m_stat_records++;
+  return true;
+  }
+
+bool OvmsConfigStore::End()
+  {
+  if (m_file == NULL)
+    return !m_failed;
+  if (fclose(m_file) != 0)
+    m_failed = true;
+  m_file = NULL;
+  return !m_failed;
+  }
+
+bool OvmsConfigStore::NeedsCompaction()
+  {
+  if (m_path.empty() || m_failed || m_torn)
+    return false;
+  return (m_size >= CONFIGSTORE_COMPACT_MIN) &&
+         ((m_size - m_live) * 100 > m_size * CONFIGSTORE_COMPACT_PCT);
+  }
+
+// Rewrite the log from a snapshot of the live state: the snapshot function
+// is called with the store redirected to a new file, and needs to Append()
+// a CONFIGSTORE_SET record for every current value. The new file replaces
+// the log by unlink & rename, see Open() for the recovery.
+bool OvmsConfigStore::Compact(std::function<void(OvmsConfigStore* store)> snapshot)
+  {
+  if (m_path.empty() || !End())
+    return false;
+
+  std::string newpath = m_path + ".new";
+  m_file = fopen(newpath.c_str(), "wb");
+  if (m_file == NULL)
+    {
+    ESP_LOGE(TAG, "Store: cannot create %s", newpath.c_str());
+    return false;
+    }
+
+  // The new log replaces a torn one as well:
+  m_torn = false;
+  m_index.clear();
+  m_live = 0;
+  m_size = 0;
+  snapshot(this);
+  bool ok = End();
+
+  if (ok && !PowerCut())
+    {
+    unlink(m_path.c_str());
+    if (!PowerCut() && rename(newpath.c_str(), m_path.c_str()) == 0)
+      {
+      m_stat_compactions++;
+      ESP_LOGI(TAG, "Store: compacted %s to %u bytes (%u keys)", m_path.c_str(), m_size, m_index.size());
+      return true;
+      }
+    }
+
+  if (m_fail_after < 0)
+    {
+    // A real error: keep using the old log
+    ESP_LOGE(TAG, "Store: compaction of %s failed", m_path.c_str());
+    unlink(newpath.c_str());
+    m_failed = false;
+    m_index.clear();
+    m_live = 0;
+    m_size = 0;
+    Replay(NULL);
+    if (m_torn)
+      RepairTail();
+    }
+  return false;
+  }
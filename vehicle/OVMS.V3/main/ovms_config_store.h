@@ -0,0 +1,116 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Date:          14th March 2017
+;
+;    Changes:
+;    1.0  Initial release
+;
+;    (C) 2011       Michael Stegen / Stegen Electronics
+;    (C) 2011-2017  Mark Webb-Johnson
+;    (C) 2011        Sonny Chen @ EPRO/DX
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+
+#ifndef __CONFIG_STORE_H__
+#define __CONFIG_STORE_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <map>
+#include <functional>
+
+// Log-structured key-value store backing the config: changes are appended
+// as CRC protected records, the current state is rebuilt by replaying the
+// log on open. Once the garbage (overwritten or deleted records) exceeds the
+// threshold, the live records are compacted into a new log file.
+//
+// The store only uses stdio, so it can be tested on any host against a plain
+// file (see "test configstore" and tools/configstoretest.cpp).
+
+#define CONFIGSTORE_MAGIC           0x564B      // "KV"
+#define CONFIGSTORE_COMPACT_MIN     8192        // Minimum log size to compact
+#define CONFIGSTORE_COMPACT_PCT     50          // Garbage percentage to compact
+#define CONFIGSTORE_MAX_INSTANCE    1024        // Longest instance name stored
+#define CONFIGSTORE_MAX_VALUE       2500        // Longest value stored
+
+#define CONFIGSTORE_SET             1           // param, instance, value
+#define CONFIGSTORE_DEL             2           // param, instance
+#define CONFIGSTORE_DELPARAM        3           // param
+
+typedef struct __attribute__ ((__packed__))
+  {
+  uint16_t magic;
+  uint8_t type;
+  uint8_t paramlen;
+  uint16_t instancelen;
+  uint16_t valuelen;
+  uint32_t crc;                   // Header (with crc=0) plus data
+  } configstore_record_t;
+
+typedef std::function<void(uint8_t type, const std::string& param,
+                           const std::string& instance, const std::string& value)> ConfigStoreReplay;
+
+class OvmsConfigStore
+  {
+  public:
+    OvmsConfigStore();
+    ~OvmsConfigStore();
+
+  public:
+    bool Open(std::string path, ConfigStoreReplay replay);
+    void Close();
+    bool IsOpen() { return !m_path.empty(); }
+    bool Failed() { return m_failed || m_torn; }   // Appends refused until reopened
+    bool Append(uint8_t type, const std::string& param,
+                const std::string& instance = "", const std::string& value = "");
+    bool End();
+    bool NeedsCompaction();
+    bool Compact(std::function<void(OvmsConfigStore* store)> snapshot);
+
+  protected:
+    bool Replay(ConfigStoreReplay replay);
+    bool RepairTail();
+    void Account(uint8_t type, const std::string& param, const std::string& instance, uint32_t size);
+    bool Write(const void* data, size_t length);
+    bool PowerCut();
+
+  protected:
+    std::string m_path;
+    FILE* m_file;
+    bool m_failed;                  // Write error or simulated power loss
+    bool m_torn;                    // Log has a torn/corrupt tail to discard
+    std::map<std::string, uint32_t> m_index;  // param\0instance → live record size
+    uint32_t m_live;
+    uint32_t m_size;
+
+  public:
+    int32_t m_fail_after;           // Power loss simulation: bytes left to write, -1 = off
+    uint32_t m_stat_records;        // Records appended
+    uint32_t m_stat_compactions;
+    uint32_t m_stat_truncations;    // Torn/corrupt log tails discarded on open
+
+  public:
+    uint32_t Size() { return m_size; }
+    uint32_t Garbage() { return m_size - m_live; }
+    uint32_t Keys() { return m_index.size(); }
+  };
+
+#endif //#ifndef __CONFIG_STORE_H__
@@ -33,10 +33,16 @@ static const char *TAG = "events";
 
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include "esp_event_loop.h"
+#include "xtensa/hal.h"
+#include "ovms.h"
 #include "ovms_events.h"
 #include "ovms_command.h"
+#include "ovms_config.h"
+#include "ovms_metrics.h"
 #include "ovms_script.h"
+#include "ovms_module.h"
 
 OvmsEvents MyEvents __attribute__ ((init_priority (1200)));
 
@@ -58,7 +64,73 @@ void event_raise(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc,
   MyEvents.SignalEvent(event, NULL);
   }
 
+void event_async(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  if (strcmp(cmd->GetName(),"on")==0)
+    MyEvents.m_async = true;
+  else
+    MyEvents.m_async = false;
+
+  writer->printf("Asynchronous event dispatch is now %s\n",cmd->GetName());
+  }
+
+void event_status(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  if ((argc > 0)&&(strcmp(argv[0],"reset")==0))
+    {
+    MyEvents.m_stat_queued = 0;
+    MyEvents.m_stat_coalesced = 0;
+    MyEvents.m_stat_sync = 0;
+    MyEvents.m_stat_overflow = 0;
+    MyEvents.m_stat_dispatched = 0;
+    MyEvents.m_stat_maxdepth = 0;
+    MyEvents.m_stat_latency_max = 0;
+    MyEvents.m_stat_latency_total = 0;
+    writer->puts("Event statistics reset");
+    return;
+    }
+
+  writer->printf("Dispatch:    %s\n", MyEvents.m_async ? "asynchronous" : "synchronous");
+  writer->printf("Queued:      %u (max depth %u of %d)\n",
+    MyEvents.m_stat_queued.load(), MyEvents.m_stat_maxdepth.load(), EVENT_QUEUE_SIZE);
+  writer->printf("Coalesced:   %u\n", MyEvents.m_stat_coalesced.load());
+  writer->printf("Synchronous: %u (%u on queue overflow)\n",
+    MyEvents.m_stat_sync.load(), MyEvents.m_stat_overflow.load());
+  uint32_t dispatched = MyEvents.m_stat_dispatched;
+  writer->printf("Dispatched:  %u\n", dispatched);
+  if (dispatched > 0)
+    {
+    writer->printf("Latency:     avg %u ms, max %u ms\n",
+      (MyEvents.m_stat_latency_total / dispatched) * portTICK_PERIOD_MS,
+      MyEvents.m_stat_latency_max * portTICK_PERIOD_MS);
+    }
+  }
+
+void event_stats(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  if ((argc > 0)&&(strcmp(argv[0],"reset")==0))
+    {
+    MyEvents.ResetStats();
+    writer->puts("Event handler statistics reset");
+    return;
+    }
+  MyEvents.ShowStats(writer);
+  }
+
+static void StatMax(std::atomic<uint32_t>& stat, uint32_t value)
+  {
+  uint32_t cur = stat;
+  while (value > cur && !stat.compare_exchange_weak(cur, value));
+  }
+
+static void EventLaunchTask(void *pvParameters)
+  {
+  OvmsEvents* me = (OvmsEvents*)pvParameters;
+  me->EventTask();
+  }
+
 OvmsEvents::OvmsEvents()
+  : m_trie("*")
   {
   ESP_LOGI(TAG, "Initialising EVENTS (1200)");
 
@@ -68,6 +140,42 @@ OvmsEvents::OvmsEvents()
   m_trace = false;
 #endif // #ifdef CONFIG_OVMS_DEV_DEBUGEVENTS
 
+  m_async = true;
+  m_slow_threshold = 50000 * CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ;
+  m_stats_metrics = false;
+  m_metric_slow_count = NULL;
+  m_metric_slow_max = NULL;
+  m_metric_slow_handler = NULL;
+  m_stat_queued = 0;
+  m_stat_coalesced = 0;
+  m_stat_sync = 0;
+  m_stat_overflow = 0;
+  m_stat_dispatched = 0;
+  m_stat_maxdepth = 0;
+  m_stat_latency_max = 0;
+  m_stat_latency_total = 0;
+
+  // Intern the standard events, in the order of their ID constants
+  m_mutex = xSemaphoreCreateMutex();
+  m_taskid = NULL;
+  m_queue = NULL;
+  GetEventId("");
+  GetEventId("ticker.1");
+  GetEventId("ticker.10");
+  GetEventId("ticker.60");
+  GetEventId("ticker.300");
+  GetEventId("ticker.600");
+  GetEventId("ticker.3600");
+  GetEventId("config.changed");
+  GetEventId("config.mounted");
+  GetEventId("config.unmounted");
+
+  // Events are normally delivered by our own task, so that signalling
+  // from timer callbacks or driver tasks returns immediately
+  m_queue = xQueueCreate(EVENT_QUEUE_SIZE, sizeof(event_queue_t));
+  xTaskCreatePinnedToCore(EventLaunchTask, "OVMS Events", 8192, (void*)this, 5, &m_taskid, 1);
+  AddTaskToMap(m_taskid);
+
   ESP_ERROR_CHECK(esp_event_loop_init(ReceiveSystemEvent, (void*)this));
 
   // Register our commands
@@ -76,77 +184,496 @@ OvmsEvents::OvmsEvents()
   OvmsCommand* cmd_eventtrace = cmd_event->RegisterCommand("trace","EVENT trace framework", NULL, "", 0, 0, false);
   cmd_eventtrace->RegisterCommand("on","Turn event tracing ON",event_trace,"", 0, 0, false);
   cmd_eventtrace->RegisterCommand("off","Turn event tracing OFF",event_trace,"", 0, 0, false);
+  OvmsCommand* cmd_eventasync = cmd_event->RegisterCommand("async","EVENT asynchronous dispatch", NULL, "", 0, 0, true);
+  cmd_eventasync->RegisterCommand("on","Dispatch opted in events (ticker.*) from the event task",event_async,"", 0, 0, true);
+  cmd_eventasync->RegisterCommand("off","Dispatch events in the caller's context",event_async,"", 0, 0, true);
+  cmd_event->RegisterCommand("status","Show event dispatch statistics",event_status,"[reset]", 0, 1, true);
+  cmd_event->RegisterCommand("stats","Show event handler statistics",event_stats,"[reset]", 0, 1, true);
+
+  #undef bind  // Kludgy, but works
+  using std::placeholders::_1;
+  using std::placeholders::_2;
+  RegisterEvent(TAG, EVENT_CONFIG_MOUNTED, std::bind(&OvmsEvents::ConfigChanged, this, _1, _2));
+  RegisterEvent(TAG, EVENT_TICKER_10, std::bind(&OvmsEvents::ExportStats, this, _1, _2));
   }
 
 OvmsEvents::~OvmsEvents()
   {
   }
 
-void OvmsEvents::RegisterEvent(std::string caller, std::string event, EventCallback callback)
+void OvmsEvents::Lock()
+  {
+  // Static initialisers register events before the scheduler is running
+  if (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING)
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+  }
+
+void OvmsEvents::Unlock()
+  {
+  if (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING)
+    xSemaphoreGive(m_mutex);
+  }
+
+event_id_t OvmsEvents::GetEventId(const std::string& event)
+  {
+  Lock();
+  auto k = m_ids.find(event);
+  if (k != m_ids.end())
+    {
+    event_id_t id = k->second;
+    Unlock();
+    return id;
+    }
+
+  event_id_t id = m_names.size();
+  m_ids[event] = id;
+  m_names.push_back(event);
+  m_handlers.push_back(NULL);
+  m_resolved.push_back(EventHandlerSetPtr());
+  // Periodic events carry no information beyond their occurrence, so a
+  // second signal while one is still pending adds nothing. They are also
+  // the only events dispatched asynchronously by default, all others keep
+  // synchronous delivery unless opted in by SetEventAsync().
+  m_flags.push_back((event.compare(0,7,"ticker.") == 0) ? (EVENTFLAG_COALESCE|EVENTFLAG_ASYNC) : 0);
+  Unlock();
+  return id;
+  }
+
+const std::string& OvmsEvents::GetEventName(event_id_t event)
+  {
+  Lock();
+  const std::string& name = (event < m_names.size()) ? m_names[event] : m_names[EVENT_NONE];
+  Unlock();
+  return name;
+  }
+
+static bool IsEventPattern(const std::string& event)
+  {
+  size_t len = event.length();
+  return ((event == "*") ||
+          ((len > 2) && (event[len-2] == '.') && (event[len-1] == '*')));
+  }
+
+static void DeregisterTrie(EventTrieNode* node, const std::string& caller)
   {
-  auto k = m_map.find(event);
-  if (k == m_map.end())
+  for (EventCallbackList::iterator itc=node->m_handlers.begin(); itc!=node->m_handlers.end();)
     {
-    m_map[event] = new EventCallbackList();
-    k = m_map.find(event);
+    if ((*itc)->m_caller == caller)
+      itc = node->m_handlers.erase(itc);
+    else
+      ++itc;
     }
-  if (k == m_map.end())
+  for (auto it=node->m_children.begin(); it!=node->m_children.end(); ++it)
+    DeregisterTrie(it->second, caller);
+  }
+
+static void ForEachTrie(EventTrieNode* node, std::function<void(const std::string&, EventCallbackEntry*)>& fn)
+  {
+  for (EventCallbackList::iterator itc=node->m_handlers.begin(); itc!=node->m_handlers.end(); ++itc)
+    fn(node->m_pattern, *itc);
+  for (auto it=node->m_children.begin(); it!=node->m_children.end(); ++it)
+    ForEachTrie(it->second, fn);
+  }
+
+void OvmsEvents::AddHandler(const std::string& event, EventCallbackEntry* entry)
+  {
+  if (!IsEventPattern(event))
     {
-    ESP_LOGE(TAG, "Problem registering event %s for caller %s",event.c_str(),caller.c_str());
+    event_id_t id = GetEventId(event);
+    Lock();
+    if (m_handlers[id] == NULL)
+      m_handlers[id] = new EventCallbackList();
+    m_handlers[id]->push_back(entry);
+    InvalidateHandlers();
+    Unlock();
     return;
     }
 
-  EventCallbackList *el = k->second;
-  el->push_back(new EventCallbackEntry(caller,callback));
+  Lock();
+  EventTrieNode* node = &m_trie;
+  size_t end = event.length() - 2;   // strip ".*"
+  size_t pos = 0;
+  while ((event != "*") && (pos <= end))
+    {
+    size_t dot = event.find('.', pos);
+    if ((dot == std::string::npos) || (dot > end)) dot = end;
+    std::string segment = event.substr(pos, dot-pos);
+    auto k = node->m_children.find(segment);
+    if (k == node->m_children.end())
+      {
+      EventTrieNode* child = new EventTrieNode(event.substr(0, dot) + ".*");
+      node->m_children[segment] = child;
+      node = child;
+      }
+    else
+      node = k->second;
+    pos = dot + 1;
+    }
+  node->m_handlers.push_back(entry);
+  InvalidateHandlers();
+  Unlock();
   }
 
-void OvmsEvents::DeregisterEvent(std::string caller)
+void OvmsEvents::InvalidateHandlers()
+  {
+  // Lock held by caller. Sets in use by a running dispatch stay valid
+  // until it drops its reference.
+  for (size_t id=0; id<m_resolved.size(); id++)
+    m_resolved[id].reset();
+  }
+
+EventHandlerSetPtr OvmsEvents::ResolveHandlers(event_id_t event)
+  {
+  // Lock held by caller
+  EventHandlerSet* set = new EventHandlerSet();
+  EventCallbackList* el = m_handlers[event];
+  if (el)
+    set->insert(set->end(), el->begin(), el->end());
+
+  // Walk the trie along the name segments, all but the last one:
+  const std::string& name = m_names[event];
+  std::vector<EventCallbackList*> prefixes;
+  EventTrieNode* node = &m_trie;
+  prefixes.push_back(&node->m_handlers);
+  size_t pos = 0, dot;
+  while ((dot = name.find('.', pos)) != std::string::npos)
+    {
+    auto k = node->m_children.find(name.substr(pos, dot-pos));
+    if (k == node->m_children.end())
+      break;
+    node = k->second;
+    prefixes.push_back(&node->m_handlers);
+    pos = dot + 1;
+    }
+  for (auto it=prefixes.rbegin(); it!=prefixes.rend(); ++it)
+    set->insert(set->end(), (*it)->begin(), (*it)->end());
+
+  return EventHandlerSetPtr(set);
+  }
+
+void OvmsEvents::ForEachHandler(std::function<void(const std::string&, EventCallbackEntry*)> fn)
   {
-  for (EventMap::iterator itm=m_map.begin(); itm!=m_map.end(); ++itm)
+  Lock();
+  for (size_t id=0; id<m_handlers.size(); id++)
     {
-    EventCallbackList* el = itm->second;
+    EventCallbackList* el = m_handlers[id];
+    if (el == NULL) continue;
     for (EventCallbackList::iterator itc=el->begin(); itc!=el->end(); ++itc)
+      fn(m_names[id], *itc);
+    }
+  ForEachTrie(&m_trie, fn);
+  Unlock();
+  }
+
+void OvmsEvents::RegisterEvent(std::string caller, std::string event, EventCallback callback)
+  {
+  AddHandler(event, new EventCallbackEntry(caller,callback));
+  }
+
+void OvmsEvents::RegisterEvent(std::string caller, std::string event, EventIdCallback callback)
+  {
+  AddHandler(event, new EventCallbackEntry(caller,callback));
+  }
+
+void OvmsEvents::RegisterEvent(std::string caller, event_id_t event, EventIdCallback callback)
+  {
+  Lock();
+  if (event >= m_handlers.size())
+    {
+    Unlock();
+    ESP_LOGE(TAG, "Problem registering event #%d for caller %s",event,caller.c_str());
+    return;
+    }
+  if (m_handlers[event] == NULL)
+    m_handlers[event] = new EventCallbackList();
+  m_handlers[event]->push_back(new EventCallbackEntry(caller,callback));
+  InvalidateHandlers();
+  Unlock();
+  }
+
+void OvmsEvents::DeregisterEvent(std::string caller)
+  {
+  // Entries are not freed, a dispatch may still be using them
+  Lock();
+  for (size_t id=0; id<m_handlers.size(); id++)
+    {
+    EventCallbackList* el = m_handlers[id];
+    if (el == NULL) continue;
+    for (EventCallbackList::iterator itc=el->begin(); itc!=el->end();)
       {
       EventCallbackEntry* ec = *itc;
       if (ec->m_caller == caller)
         {
-        el->erase(itc);
+        itc = el->erase(itc);
         }
+      else
+        ++itc;
       }
-    if (el->empty())
+    }
+  DeregisterTrie(&m_trie, caller);
+  InvalidateHandlers();
+  Unlock();
+  }
+
+void OvmsEvents::EventTask()
+  {
+  event_queue_t msg;
+
+  while (1)
+    {
+    if (xQueueReceive(m_queue, &msg, (portTickType)portMAX_DELAY)==pdTRUE)
       {
-      delete el;
-      m_map.erase(itm);
+      // Clear before dispatch, so a new signal during the handlers queues again
+      Lock();
+      m_flags[msg.event] &= ~EVENTFLAG_PENDING;
+      Unlock();
+
+      uint32_t latency = xTaskGetTickCount() - msg.queued;
+      StatMax(m_stat_latency_max, latency);
+      m_stat_latency_total += latency;
+      m_stat_dispatched++;
+
+      DispatchEvent(msg.event, msg.data);
       }
     }
   }
 
 void OvmsEvents::SignalEvent(std::string event, void* data)
   {
+  SignalEvent(GetEventId(event), data);
+  }
+
+void OvmsEvents::SignalEventSync(std::string event, void* data)
+  {
+  SignalEventSync(GetEventId(event), data);
+  }
+
+void OvmsEvents::SetEventAsync(std::string event, bool async)
+  {
+  event_id_t id = GetEventId(event);
+  Lock();
+  if (async)
+    m_flags[id] |= EVENTFLAG_ASYNC;
+  else
+    m_flags[id] &= ~EVENTFLAG_ASYNC;
+  Unlock();
+  }
+
+void OvmsEvents::SignalEvent(event_id_t event, void* data)
+  {
+  // Events with data are delivered synchronously, as the data pointer is
+  // only guaranteed to be valid for the duration of the call
+  if ((!m_async) ||
+      (data != NULL) ||
+      (m_queue == NULL) ||
+      (xTaskGetSchedulerState() != taskSCHEDULER_RUNNING) ||
+      (xTaskGetCurrentTaskHandle() == m_taskid))
+    {
+    SignalEventSync(event, data);
+    return;
+    }
+
+  Lock();
+  if (event >= m_flags.size())
+    {
+    Unlock();
+    ESP_LOGE(TAG, "Signal of unknown event #%d",event);
+    return;
+    }
+  uint8_t flags = m_flags[event];
+  if ((flags & EVENTFLAG_ASYNC) == 0)
+    {
+    // Handlers may rely on the event being delivered before the signal
+    // returns (e.g. sd.unmounted), so only opted in events are queued
+    Unlock();
+    SignalEventSync(event, data);
+    return;
+    }
+  if ((flags & (EVENTFLAG_COALESCE|EVENTFLAG_PENDING)) == (EVENTFLAG_COALESCE|EVENTFLAG_PENDING))
+    {
+    Unlock();
+    m_stat_coalesced++;
+    return;
+    }
+  m_flags[event] = flags | EVENTFLAG_PENDING;
+  Unlock();
+
+  event_queue_t msg;
+  msg.event = event;
+  msg.data = NULL;
+  msg.queued = xTaskGetTickCount();
+  if (xQueueSend(m_queue, &msg, 0) != pdTRUE)
+    {
+    // Queue full: better late in the wrong context than lost
+    Lock();
+    m_flags[event] &= ~EVENTFLAG_PENDING;
+    Unlock();
+    m_stat_overflow++;
+    SignalEventSync(event, data);
+    return;
+    }
+
+  m_stat_queued++;
+  StatMax(m_stat_maxdepth, uxQueueMessagesWaiting(m_queue));
+  }
+
+void OvmsEvents::SignalEventSync(event_id_t event, void* data)
+  {
+  m_stat_sync++;
+  DispatchEvent(event, data);
+  }
+
+void OvmsEvents::DispatchEvent(event_id_t event, void* data)
+  {
+  Lock();
+  if (event >= m_handlers.size())
+    {
+    Unlock();
+    ESP_LOGE(TAG, "Signal of unknown event #%d",event);
+    return;
+    }
+  const std::string& name = m_names[event];
+  EventHandlerSetPtr set = m_resolved[event];
+  if (!set)
+    {
+    set = ResolveHandlers(event);
+    m_resolved[event] = set;
+    }
+  Unlock();
+
   if (m_trace)
     {
-    if (event.compare(0,7,"ticker.") != 0)
+    if (name.compare(0,7,"ticker.") != 0)
       {
       // Log everything but the excessively verbose ticker signals
-      ESP_LOGI(TAG, "Signal(%s)",event.c_str());
+      ESP_LOGI(TAG, "Signal(%s)",name.c_str());
       }
     }
 
-  auto k = m_map.find(event);
-  if (k != m_map.end())
+  for (EventHandlerSet::const_iterator itc=set->begin(); itc!=set->end(); ++itc)
     {
-    EventCallbackList* el = k->second;
-    if (el)
+    EventCallbackEntry* ec = *itc;
+    uint32_t start = xthal_get_ccount();
+    if (ec->m_idcallback)
+      ec->m_idcallback(event, data);
+    else
+      ec->m_callback(name, data);
+    uint32_t cycles = xthal_get_ccount() - start;
+
+    // Synchronous signals dispatch on other tasks concurrently, and the
+    // stats are read and reset under the lock as well:
+    bool slow = (m_slow_threshold > 0) && (cycles > m_slow_threshold);
+    Lock();
+    ec->m_count++;
+    ec->m_time_total += cycles;
+    if (cycles > ec->m_time_max) ec->m_time_max = cycles;
+    if (slow)
       {
-      for (EventCallbackList::iterator itc=el->begin(); itc!=el->end(); ++itc)
-        {
-        EventCallbackEntry* ec = *itc;
-        ec->m_callback(event, data);
-        }
+      ec->m_slow_count++;
+      ec->m_slow_last = monotonictime;
+      }
+    Unlock();
+    if (slow)
+      {
+      ESP_LOGW(TAG, "Slow handler: %s for %s took %u us",
+        ec->m_caller.c_str(), name.c_str(), cycles / CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ);
+      }
+    }
+
+  MyScripts.EventScript(name, data);
+  }
+
+void OvmsEvents::ConfigChanged(event_id_t event, void* data)
+  {
+  // Registered on mount, as MyConfig is initialised after MyEvents:
+  MyConfig.RegisterParam("events", "Event framework", true, true);
+  MyConfig.DeregisterChangeListener(TAG);
+  MyConfig.RegisterChangeListener(TAG, "events", "",
+    [this](const ConfigChangeList& changes) { ReadConfig(); });
+  ReadConfig();
+  }
+
+void OvmsEvents::ReadConfig()
+  {
+  m_slow_threshold = MyConfig.GetParamValueInt("events", "slow.threshold", 50000) * CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ;
+  m_stats_metrics = MyConfig.GetParamValueBool("events", "stats.metrics", false);
+  }
+
+void OvmsEvents::ResetStats()
+  {
+  ForEachHandler([](const std::string& event, EventCallbackEntry* ec)
+    {
+    ec->m_count = 0;
+    ec->m_time_total = 0;
+    ec->m_time_max = 0;
+    ec->m_slow_count = 0;
+    ec->m_slow_last = 0;
+    });
+  }
+
+void OvmsEvents::ShowStats(OvmsWriter* writer)
+  {
+  // Format under the lock, output after: the writer may block
+  std::string out;
+  char line[160];
+  snprintf(line, sizeof(line), "%-30s %-16s %8s %8s %8s %6s %8s\n",
+    "Event", "Caller", "Calls", "Avg(us)", "Max(us)", "Slow", "Last(s)");
+  out.append(line);
+  ForEachHandler([&out,&line](const std::string& event, EventCallbackEntry* ec)
+    {
+    if (ec->m_count == 0) return;
+    uint32_t avg = (uint32_t)(ec->m_time_total / ec->m_count);
+    snprintf(line, sizeof(line), "%-30s %-16s %8u %8u %8u %6u ",
+      event.c_str(), ec->m_caller.c_str(), ec->m_count,
+      avg / CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ,
+      ec->m_time_max / CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ,
+      ec->m_slow_count);
+    out.append(line);
+    if (ec->m_slow_count > 0)
+      {
+      snprintf(line, sizeof(line), "%8u\n", monotonictime - ec->m_slow_last);
+      out.append(line);
       }
+    else
+      out.append("       -\n");
+    });
+  writer->write(out.c_str(), out.length());
+
+  if (m_slow_threshold > 0)
+    writer->printf("Slow handler threshold: %u us\n", m_slow_threshold / CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ);
+  else
+    writer->puts("Slow handler threshold: off");
+  }
+
+void OvmsEvents::ExportStats(event_id_t event, void* data)
+  {
+  if (!m_stats_metrics)
+    return;
+
+  if (m_metric_slow_count == NULL)
+    {
+    m_metric_slow_count = MyMetrics.InitInt("m.event.slow.count", 60, 0);
+    m_metric_slow_max = MyMetrics.InitInt("m.event.slow.max", 60, 0);
+    m_metric_slow_handler = MyMetrics.InitString("m.event.slow.handler", 60, "");
     }
 
-  MyScripts.EventScript(event, data);
+  uint32_t count = 0, max = 0;
+  std::string handler;
+  ForEachHandler([&count,&max,&handler](const std::string& event, EventCallbackEntry* ec)
+    {
+    count += ec->m_slow_count;
+    if (ec->m_time_max > max)
+      {
+      max = ec->m_time_max;
+      handler = event;
+      handler.append("/");
+      handler.append(ec->m_caller);
+      }
+    });
+
+  m_metric_slow_count->SetValue((int)count);
+  m_metric_slow_max->SetValue((int)(max / CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ));
+  m_metric_slow_handler->SetValue(handler);
   }
 
 esp_err_t OvmsEvents::ReceiveSystemEvent(void *ctx, system_event_t *event)
@@ -240,9 +767,36 @@ void OvmsEvents::SignalSystemEvent(system_event_t *event)
 EventCallbackEntry::EventCallbackEntry(std::string caller, EventCallback callback)
   {
   m_caller = caller;
+  m_count = 0;
+  m_time_total = 0;
+  m_time_max = 0;
+  m_slow_count = 0;
+  m_slow_last = 0;
   m_callback = callback;
   }
 
+EventCallbackEntry::EventCallbackEntry(std::string caller, EventIdCallback callback)
+  {
+  m_caller = caller;
+  m_count = 0;
+  m_time_total = 0;
+  m_time_max = 0;
+  m_slow_count = 0;
+  m_slow_last = 0;
+  m_idcallback = callback;
+  }
+
+EventTrieNode::EventTrieNode(std::string pattern)
+  {
+  m_pattern = pattern;
+  }
+
+EventTrieNode::~EventTrieNode()
+  {
+  for (auto it=m_children.begin(); it!=m_children.end(); ++it)
+    delete it->second;
+  }
+
 EventCallbackEntry::~EventCallbackEntry()
   {
   }
@@ -35,23 +35,101 @@
 #include <functional>
 #include <map>
 #include <list>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <stdint.h>
 #include <esp_event.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+#define EVENT_QUEUE_SIZE 40
+
+// Event names are interned to small integer IDs on first use. The standard
+// events below are interned by the framework in this order, so their IDs are
+// compile time constants. Other events get their IDs via GetEventId().
+typedef uint16_t event_id_t;
+
+enum
+  {
+  EVENT_NONE = 0,
+  EVENT_TICKER_1,
+  EVENT_TICKER_10,
+  EVENT_TICKER_60,
+  EVENT_TICKER_300,
+  EVENT_TICKER_600,
+  EVENT_TICKER_3600,
+  EVENT_CONFIG_CHANGED,
+  EVENT_CONFIG_MOUNTED,
+  EVENT_CONFIG_UNMOUNTED,
+  EVENT_STANDARD_COUNT
+  };
+
+#define EVENTFLAG_COALESCE  0x01      // Drop signals while one is pending
+#define EVENTFLAG_PENDING   0x02      // Queued, not yet dispatched
+#define EVENTFLAG_ASYNC     0x04      // Dispatch from the event task
+
+typedef struct
+  {
+  event_id_t event;
+  void* data;                   // Always NULL for queued events
+  TickType_t queued;            // Tick count at the time of queueing
+  } event_queue_t;
+
+class OvmsWriter;
+class OvmsMetricInt;
+class OvmsMetricString;
 
 typedef std::function<void(std::string,void*)> EventCallback;
+typedef std::function<void(event_id_t,void*)> EventIdCallback;
 
 class EventCallbackEntry
   {
   public:
     EventCallbackEntry(std::string caller, EventCallback callback);
+    EventCallbackEntry(std::string caller, EventIdCallback callback);
     virtual ~EventCallbackEntry();
 
   public:
     std::string m_caller;
     EventCallback m_callback;
+    EventIdCallback m_idcallback;
+
+  public:
+    // Profiling, in CPU cycles, guarded by the OvmsEvents lock:
+    uint32_t m_count;
+    uint64_t m_time_total;
+    uint32_t m_time_max;
+    uint32_t m_slow_count;
+    uint32_t m_slow_last;         // monotonictime of last slow call
   };
 
 typedef std::list<EventCallbackEntry*> EventCallbackList;
-typedef std::map<std::string, EventCallbackList*> EventMap;
+
+// Prefix subscriptions ("vehicle.charge.*", or "*" for all events) are kept
+// in a trie of name segments. A pattern matches all events below its prefix,
+// not the prefix itself ("vehicle.charge.*" does not match "vehicle.charge").
+class EventTrieNode
+  {
+  public:
+    EventTrieNode(std::string pattern);
+    ~EventTrieNode();
+
+  public:
+    std::string m_pattern;
+    std::map<std::string, EventTrieNode*> m_children;
+    EventCallbackList m_handlers;
+  };
+
+// The handlers for a concrete event are resolved once and cached until the
+// next (de)registration. Order of delivery: handlers for the exact name,
+// then prefix handlers from the most to the least specific pattern, each
+// group in registration order.
+typedef std::vector<EventCallbackEntry*> EventHandlerSet;
+typedef std::shared_ptr<const EventHandlerSet> EventHandlerSetPtr;
 
 class OvmsEvents
   {
@@ -59,20 +137,73 @@ class OvmsEvents
     OvmsEvents();
     ~OvmsEvents();
 
+  public:
+    event_id_t GetEventId(const std::string& event);
+    const std::string& GetEventName(event_id_t event);
+
   public:
     void RegisterEvent(std::string caller, std::string event, EventCallback callback);
+    void RegisterEvent(std::string caller, std::string event, EventIdCallback callback);
+    void RegisterEvent(std::string caller, event_id_t event, EventIdCallback callback);
     void DeregisterEvent(std::string caller);
+    void SignalEvent(event_id_t event, void* data);
+    void SignalEventSync(event_id_t event, void* data);
     void SignalEvent(std::string event, void* data);
+    void SignalEventSync(std::string event, void* data);
+    void SetEventAsync(std::string event, bool async=true);
 
   public:
     static esp_err_t ReceiveSystemEvent(void *ctx, system_event_t *event);
     void SignalSystemEvent(system_event_t *event);
 
+  public:
+    void EventTask();
+
+  public:
+    void ResetStats();
+    void ShowStats(OvmsWriter* writer);
+
   protected:
-    EventMap m_map;
+    void Lock();
+    void Unlock();
+    void DispatchEvent(event_id_t event, void* data);
+    void AddHandler(const std::string& event, EventCallbackEntry* entry);
+    EventHandlerSetPtr ResolveHandlers(event_id_t event);
+    void InvalidateHandlers();
+    void ForEachHandler(std::function<void(const std::string&, EventCallbackEntry*)> fn);
+    void ConfigChanged(event_id_t event, void* data);
+    void ReadConfig();
+    void ExportStats(event_id_t event, void* data);
+
+  protected:
+    SemaphoreHandle_t m_mutex;
+    std::map<std::string, event_id_t> m_ids;
+    std::deque<std::string> m_names;                  // by ID, references stay valid
+    std::deque<EventCallbackList*> m_handlers;        // by ID
+    std::deque<EventHandlerSetPtr> m_resolved;        // by ID, NULL = not resolved
+    EventTrieNode m_trie;
+    std::deque<uint8_t> m_flags;                      // by ID, EVENTFLAG_*
+    TaskHandle_t m_taskid;
+    QueueHandle_t m_queue;
 
   public:
     bool m_trace;
+    bool m_async;
+    uint32_t m_slow_threshold;                        // CPU cycles, 0 = off
+    bool m_stats_metrics;
+    OvmsMetricInt* m_metric_slow_count;
+    OvmsMetricInt* m_metric_slow_max;
+    OvmsMetricString* m_metric_slow_handler;
+
+  public:
+    std::atomic<uint32_t> m_stat_queued;
+    std::atomic<uint32_t> m_stat_coalesced;
+    std::atomic<uint32_t> m_stat_sync;
+    std::atomic<uint32_t> m_stat_overflow;
+    std::atomic<uint32_t> m_stat_dispatched;
+    std::atomic<uint32_t> m_stat_maxdepth;
+    std::atomic<uint32_t> m_stat_latency_max;
+    std::atomic<uint32_t> m_stat_latency_total;
   };
 
 extern OvmsEvents MyEvents;
@@ -39,6 +39,7 @@ static const char *TAG = "housekeeping";
 #include "ovms_housekeeping.h"
 #include "ovms_peripherals.h"
 #include "ovms_events.h"
+#include "ovms_scheduler.h"
 #include "ovms_config.h"
 #include "ovms_metrics.h"
 #include "metrics_standard.h"
@@ -51,12 +52,6 @@ static const char *TAG = "housekeeping";
 //#include "esp_heap_caps.h"
 //}
 
-void HousekeepingTicker1( TimerHandle_t timer )
-  {
-  Housekeeping* h = (Housekeeping*)pvTimerGetTimerID(timer);
-  h->Ticker1();
-  }
-
 void HousekeepingTask(void *pvParameters)
   {
   Housekeeping* me = (Housekeeping*)pvParameters;
@@ -75,6 +70,7 @@ void HousekeepingTask(void *pvParameters)
   }
 
 Housekeeping::Housekeeping()
+  : m_cfg_factor12v("system.adc", "factor12v", 0)
   {
   ESP_LOGI(TAG, "Initialising HOUSEKEEPING Framework...");
 
@@ -92,9 +88,18 @@ void Housekeeping::init()
   {
   ESP_LOGI(TAG, "Executing on CPU core %d",xPortGetCoreID());
 
-  m_tick = 0;
-  m_timer1 = xTimerCreate("Housekeep ticker",1000 / portTICK_PERIOD_MS,pdTRUE,this,HousekeepingTicker1);
-  xTimerStart(m_timer1, 0);
+  // The second ticker only counts and signals on the scheduler task, the
+  // metric update runs as a ticker.1 handler on the event task. The longer
+  // tickers are scheduler event jobs of their own, each placed in the least
+  // loaded phase, so the minute and hour boundaries don't pile up:
+  MyScheduler.Register(TAG, 1000, std::bind(&Housekeeping::Ticker1, this), 0);
+  MyEvents.RegisterEvent(TAG, EVENT_TICKER_1, std::bind(&Housekeeping::TickerMetrics, this,
+    std::placeholders::_1, std::placeholders::_2));
+  MyScheduler.RegisterEvent(TAG, 10*1000, EVENT_TICKER_10, SCHEDULER_OFFSET_AUTO);
+  MyScheduler.RegisterEvent(TAG, 60*1000, EVENT_TICKER_60, SCHEDULER_OFFSET_AUTO);
+  MyScheduler.RegisterEvent(TAG, 300*1000, EVENT_TICKER_300, SCHEDULER_OFFSET_AUTO);
+  MyScheduler.RegisterEvent(TAG, 600*1000, EVENT_TICKER_600, SCHEDULER_OFFSET_AUTO);
+  MyScheduler.RegisterEvent(TAG, 3600*1000, EVENT_TICKER_3600, SCHEDULER_OFFSET_AUTO);
 
   ESP_LOGI(TAG, "Starting PERIPHERALS...");
   MyPeripherals = new Peripherals();
@@ -153,7 +158,7 @@ void Housekeeping::metrics()
     return;
 
   // Allow the user to adjust the ADC conversion factor
-  float f = MyConfig.GetParamValueFloat("system.adc","factor12v");
+  float f = m_cfg_factor12v;
   if (f == 0) f = 182;
   float v = (float)MyPeripherals->m_esp32adc->read() / f;
   m1->SetValue(v);
@@ -175,19 +180,12 @@ void Housekeeping::metrics()
 
 void Housekeeping::Ticker1()
   {
+  // Runs on the scheduler task: keep this minimal
   monotonictime++;
-  StandardMetrics.ms_m_monotonic->SetValue((int)monotonictime);
-
-  MyEvents.SignalEvent("ticker.1", NULL);
+  MyEvents.SignalEvent(EVENT_TICKER_1, NULL);
+  }
 
-  m_tick++;
-  if ((m_tick % 10)==0) MyEvents.SignalEvent("ticker.10", NULL);
-  if ((m_tick % 60)==0) MyEvents.SignalEvent("ticker.60", NULL);
-  if ((m_tick % 300)==0) MyEvents.SignalEvent("ticker.300", NULL);
-  if ((m_tick % 600)==0) MyEvents.SignalEvent("ticker.600", NULL);
-  if ((m_tick % 3600)==0)
-    {
-    m_tick = 0;
-    MyEvents.SignalEvent("ticker.3600", NULL);
-    }
+void Housekeeping::TickerMetrics(event_id_t event, void* data)
+  {
+  StandardMetrics.ms_m_monotonic->SetValue((int)monotonictime);
   }
@@ -33,7 +33,8 @@
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "freertos/timers.h"
+#include "ovms_config.h"
+#include "ovms_events.h"
 
 class Housekeeping
   {
@@ -46,11 +47,11 @@ class Housekeeping
     void version();
     void metrics();
     void Ticker1();
+    void TickerMetrics(event_id_t event, void* data);
 
   protected:
     TaskHandle_t m_taskid;
-    TimerHandle_t m_timer1;
-    int m_tick;
+    ConfigHandle<float> m_cfg_factor12v;
   };
 
 #endif //#ifndef __HOUSEKEEPING_H__
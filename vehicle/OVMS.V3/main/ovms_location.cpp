@@ -237,7 +237,8 @@ OvmsLocations::OvmsLocations()
   MyMetrics.RegisterListener(TAG, MS_V_POS_LATITUDE, std::bind(&OvmsLocations::UpdatedLatitude, this, _1));
   MyMetrics.RegisterListener(TAG, MS_V_POS_LONGITUDE, std::bind(&OvmsLocations::UpdatedLongitude, this, _1));
   MyEvents.RegisterEvent(TAG,"config.mounted", std::bind(&OvmsLocations::UpdatedConfig, this, _1, _2));
-  MyEvents.RegisterEvent(TAG,"config.changed", std::bind(&OvmsLocations::UpdatedConfig, this, _1, _2));
+  MyConfig.RegisterChangeListener(TAG, LOCATIONS_PARAM, "",
+    [this](const ConfigChangeList& changes) { ReloadMap(); });
 
 #ifdef CONFIG_OVMS_SC_JAVASCRIPT_DUKTAPE
   ESP_LOGI(TAG, "Expanding DUKTAPE javascript engine");
@@ -250,6 +251,8 @@ OvmsLocations::OvmsLocations()
 OvmsLocations::~OvmsLocations()
   {
   MyMetrics.DeregisterListener(TAG);
+  MyEvents.DeregisterEvent(TAG);
+  MyConfig.DeregisterChangeListener(TAG);
   }
 
 void OvmsLocations::UpdatedGpsLock(OvmsMetric* metric)
@@ -351,12 +354,5 @@ OvmsLocation* OvmsLocations::Find(std::string name)
 
 void OvmsLocations::UpdatedConfig(std::string event, void* data)
   {
-  if (event.compare("config.changed")==0)
-    {
-    // Only reload if our parameter has changed
-    OvmsConfigParam*p = (OvmsConfigParam*)data;
-    if (p->GetName().compare(LOCATIONS_PARAM)!=0) return;
-    }
-
   ReloadMap();
   }
@@ -34,9 +34,13 @@ static const char *TAG = "metrics";
 #include <stdlib.h>
 #include <stdio.h>
 #include <sstream>
+#include <math.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 #include "ovms.h"
 #include "ovms_metrics.h"
 #include "ovms_command.h"
+#include "ovms_events.h"
 #include "ovms_script.h"
 #include "string.h"
 
@@ -50,9 +54,9 @@ void metrics_list(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc,
   for (OvmsMetric* m=MyMetrics.m_first; m != NULL; m=m->m_next)
     {
     const char *k = m->m_name;
-    std::string v = m->AsString();
     if ((argc==0)||(strstr(k,argv[0])))
       {
+      std::string v = m->AsString();
       if (v.empty())
         writer->printf("%s\n",k);
       else
@@ -72,6 +76,53 @@ void metrics_set(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc,
     writer->puts("Metric could not be set");
   }
 
+void metrics_deadband(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  OvmsMetric* m = MyMetrics.Find(argv[0]);
+  if (m == NULL)
+    {
+    writer->puts("Unrecognised metric name");
+    return;
+    }
+  if (!m->IsNumeric())
+    {
+    writer->puts("Error: deadbands apply to numeric metrics only");
+    return;
+    }
+  m->SetDeadband(atof(argv[1]), (argc > 2) ? atof(argv[2]) : 0);
+  writer->puts("Metric deadband set");
+  }
+
+void metrics_interval(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  OvmsMetric* m = MyMetrics.Find(argv[0]);
+  if (m == NULL)
+    {
+    writer->puts("Unrecognised metric name");
+    return;
+    }
+  m->SetNotifyInterval(atoi(argv[1]));
+  writer->puts("Metric notification interval set");
+  }
+
+void metrics_ratelimits(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  bool found = false;
+  for (OvmsMetric* m=MyMetrics.m_first; m != NULL; m=m->m_next)
+    {
+    OvmsMetricRateLimit* rl = m->m_ratelimit;
+    if (rl == NULL)
+      continue;
+    if (!found)
+      writer->printf("%-40.40s %10s %8s %8s %10s\n","Metric","Deadband","Rel%","Interval","Suppressed");
+    writer->printf("%-40.40s %10g %8g %6ums %10u\n",
+      m->m_name, rl->m_deadband_abs, rl->m_deadband_rel, rl->m_interval, rl->m_suppressed);
+    found = true;
+    }
+  if (!found)
+    writer->puts("No metric notification limits defined");
+  }
+
 void metrics_trace(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
   {
   if (strcmp(cmd->GetName(),"on")==0)
@@ -136,10 +187,18 @@ OvmsMetrics::OvmsMetrics()
   OvmsCommand* cmd_metric = MyCommandApp.RegisterCommand("metrics","METRICS framework",NULL, "", 1);
   cmd_metric->RegisterCommand("list","Show all metrics",metrics_list, "[<metric>]", 0, 1);
   cmd_metric->RegisterCommand("set","Set the value of a metric",metrics_set, "<metric> <value>", 2, 2, true);
+  cmd_metric->RegisterCommand("deadband","Set notification deadband of a metric",metrics_deadband, "<metric> <absolute> [<relative%>]", 2, 3, true);
+  cmd_metric->RegisterCommand("interval","Set minimum notification interval of a metric",metrics_interval, "<metric> <ms>", 2, 2, true);
+  cmd_metric->RegisterCommand("limits","Show metric notification limits & suppression counts",metrics_ratelimits, "", 0, 0);
   OvmsCommand* cmd_metrictrace = cmd_metric->RegisterCommand("trace","METRIC trace framework", NULL, "", 0, 0, false);
   cmd_metrictrace->RegisterCommand("on","Turn metric tracing ON",metrics_trace,"", 0, 0, false);
   cmd_metrictrace->RegisterCommand("off","Turn metrictracing OFF",metrics_trace,"", 0, 0, false);
 
+  #undef bind  // Kludgy, but works
+  using std::placeholders::_1;
+  using std::placeholders::_2;
+  MyEvents.RegisterEvent(TAG,EVENT_TICKER_1, std::bind(&OvmsMetrics::FlushRateLimits, this, _1, _2));
+
 #ifdef CONFIG_OVMS_SC_JAVASCRIPT_DUKTAPE
   ESP_LOGI(TAG, "Expanding DUKTAPE javascript engine");
   duk_context* ctx = MyScripts.Duktape();
@@ -364,6 +423,15 @@ void OvmsMetrics::NotifyModified(OvmsMetric* metric)
     }
   }
 
+void OvmsMetrics::FlushRateLimits(event_id_t event, void* data)
+  {
+  for (OvmsMetric* m=m_first; m != NULL; m=m->m_next)
+    {
+    if (m->m_ratelimit)
+      m->FlushNotification();
+    }
+  }
+
 size_t OvmsMetrics::RegisterModifier()
   {
   return m_nextmodifier++;
@@ -378,6 +446,8 @@ OvmsMetric::OvmsMetric(const char* name, uint16_t autostale, metric_unit_t units
   m_autostale = autostale;
   m_units = units;
   m_next = NULL;
+  m_seq = 0;
+  m_ratelimit = NULL;
   MyMetrics.RegisterMetric(this);
   }
 
@@ -390,11 +460,71 @@ OvmsMetric::~OvmsMetric()
   //  (i.e. by broadcasting a module shutdown event).
   }
 
+// Writer lock for all metric values. Critical sections are only held for
+// the raw value copy / pointer swap, so a single spinlock is sufficient.
+static portMUX_TYPE s_metrics_mux = portMUX_INITIALIZER_UNLOCKED;
+
+void OvmsMetric::WriteBegin()
+  {
+  portENTER_CRITICAL(&s_metrics_mux);
+  m_seq.fetch_add(1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  }
+
+void OvmsMetric::WriteEnd()
+  {
+  m_defined = true;
+  std::atomic_thread_fence(std::memory_order_release);
+  m_seq.fetch_add(1, std::memory_order_relaxed);
+  portEXIT_CRITICAL(&s_metrics_mux);
+  }
+
+uint32_t OvmsMetric::ReadBegin()
+  {
+  uint32_t seq;
+  while ((seq = m_seq.load(std::memory_order_acquire)) & 1)
+    {
+    // writer active on the other core, spin
+    }
+  return seq;
+  }
+
+bool OvmsMetric::ReadRetry(uint32_t seq)
+  {
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return (m_seq.load(std::memory_order_relaxed) != seq);
+  }
+
+OvmsMetricRef* OvmsMetric::AcquireRef(OvmsMetricRef* const* ref)
+  {
+  portENTER_CRITICAL(&s_metrics_mux);
+  OvmsMetricRef* value = *ref;
+  if (value)
+    value->m_refcount.fetch_add(1, std::memory_order_relaxed);
+  portEXIT_CRITICAL(&s_metrics_mux);
+  return value;
+  }
+
+void OvmsMetric::SwapRef(OvmsMetricRef** ref, OvmsMetricRef* value)
+  {
+  WriteBegin();
+  OvmsMetricRef* old = *ref;
+  *ref = value;
+  WriteEnd();
+  if (old)
+    old->Release();
+  }
+
 std::string OvmsMetric::AsString(const char* defvalue, metric_unit_t units, int precision)
   {
   return std::string(defvalue);
   }
 
+size_t OvmsMetric::AppendTo(char* buf, size_t cap, const char* defvalue, metric_unit_t units, int precision)
+  {
+  return OvmsMetricFormatString(buf, cap, defvalue);
+  }
+
 float OvmsMetric::AsFloat(const float defvalue, metric_unit_t units)
   {
   return defvalue;
@@ -425,11 +555,140 @@ void OvmsMetric::SetModified(bool changed)
   m_lastmodified = monotonictime;
   if (changed)
     {
+    if (m_ratelimit && !m_ratelimit->Notify(AsFloat()))
+      return;
     m_modified.set();
     MyMetrics.NotifyModified(this);
     }
   }
 
+void OvmsMetric::SetDeadband(float absolute, float relative)
+  {
+  if (m_ratelimit == NULL)
+    m_ratelimit = new OvmsMetricRateLimit();
+  m_ratelimit->Configure(absolute, relative);
+  }
+
+void OvmsMetric::SetNotifyInterval(uint32_t ms)
+  {
+  if (m_ratelimit == NULL)
+    m_ratelimit = new OvmsMetricRateLimit();
+  m_ratelimit->Configure(ms);
+  }
+
+uint32_t OvmsMetric::GetSuppressedCount()
+  {
+  return m_ratelimit ? m_ratelimit->m_suppressed : 0;
+  }
+
+// Send the final notification for a suppressed change once settled. The
+// pending state is claimed before reading the value, so a change racing
+// with the flush is either included or pending again.
+void OvmsMetric::FlushNotification()
+  {
+  if (m_ratelimit == NULL || !m_ratelimit->Flush(xTaskGetTickCount() * portTICK_PERIOD_MS))
+    return;
+  m_ratelimit->Notified(AsFloat());
+  m_modified.set();
+  MyMetrics.NotifyModified(this);
+  }
+
+OvmsMetricRateLimit::OvmsMetricRateLimit()
+  {
+  m_mux = portMUX_INITIALIZER_UNLOCKED;
+  m_deadband_abs = 0;
+  m_deadband_rel = 0;
+  m_interval = 0;
+  m_notified_value = 0;
+  m_notified = false;
+  m_pending = false;
+  m_last_notify = 0;
+  m_last_change = 0;
+  m_suppressed = 0;
+  }
+
+void OvmsMetricRateLimit::Configure(float absolute, float relative)
+  {
+  portENTER_CRITICAL(&m_mux);
+  m_deadband_abs = absolute;
+  m_deadband_rel = relative;
+  portEXIT_CRITICAL(&m_mux);
+  }
+
+void OvmsMetricRateLimit::Configure(uint32_t interval)
+  {
+  portENTER_CRITICAL(&m_mux);
+  m_interval = interval;
+  portEXIT_CRITICAL(&m_mux);
+  }
+
+// Called by SetModified() on a change: returns false if the notification
+// is to be suppressed (pending for the flush).
+bool OvmsMetricRateLimit::Notify(float value)
+  {
+  uint32_t now = xTaskGetTickCount() * portTICK_PERIOD_MS;
+  bool suppress = false;
+
+  portENTER_CRITICAL(&m_mux);
+  if (m_notified)
+    {
+    float band = m_deadband_abs;
+    float rel = fabsf(m_notified_value) * m_deadband_rel / 100;
+    if (rel > band) band = rel;
+    if ((band > 0) && (fabsf(value - m_notified_value) <= band))
+      suppress = true;
+    else if ((m_interval > 0) && (now - m_last_notify < m_interval))
+      suppress = true;
+    }
+
+  if (suppress)
+    {
+    m_pending = true;
+    m_last_change = now;
+    m_suppressed++;
+    }
+  else
+    {
+    m_notified_value = value;
+    m_notified = true;
+    m_pending = false;
+    m_last_notify = now;
+    }
+  portEXIT_CRITICAL(&m_mux);
+  return !suppress;
+  }
+
+bool OvmsMetricRateLimit::Settled(uint32_t now)
+  {
+  // A suppressed change is flushed once the value has been stable for
+  // the notification interval (at least one second, the flush ticker):
+  uint32_t settle = (m_interval > 1000) ? m_interval : 1000;
+  return m_pending && (now - m_last_change >= settle);
+  }
+
+// Claim a settled pending notification: returns true if the caller is to
+// send it, and then to record the value sent by Notified().
+bool OvmsMetricRateLimit::Flush(uint32_t now)
+  {
+  portENTER_CRITICAL(&m_mux);
+  bool due = Settled(now);
+  if (due)
+    {
+    m_pending = false;
+    m_last_notify = now;
+    }
+  portEXIT_CRITICAL(&m_mux);
+  return due;
+  }
+
+void OvmsMetricRateLimit::Notified(float value)
+  {
+  portENTER_CRITICAL(&m_mux);
+  m_notified_value = value;
+  m_notified = true;
+  portEXIT_CRITICAL(&m_mux);
+  }
+
 bool OvmsMetric::IsStale()
   {
   if (m_autostale>0)
@@ -485,20 +744,20 @@ OvmsMetricInt::~OvmsMetricInt()
   }
 
 std::string OvmsMetricInt::AsString(const char* defvalue, metric_unit_t units, int precision)
+  {
+  if (!m_defined)
+    return std::string(defvalue);
+  char buffer[16];
+  AppendTo(buffer, sizeof(buffer), defvalue, units, precision);
+  return std::string(buffer);
+  }
+
+size_t OvmsMetricInt::AppendTo(char* buf, size_t cap, const char* defvalue, metric_unit_t units, int precision)
   {
   if (m_defined)
-    {
-    char buffer[33];
-    if ((units != Other)&&(units != m_units))
-      itoa(UnitConvert(m_units,units,m_value),buffer,10);
-    else
-      itoa (m_value,buffer,10);
-    return buffer;
-    }
+    return OvmsMetricFormatInt(buf, cap, AsInt(0, units));
   else
-    {
-    return std::string(defvalue);
-    }
+    return OvmsMetricFormatString(buf, cap, defvalue);
   }
 
 float OvmsMetricInt::AsFloat(const float defvalue, metric_unit_t units)
@@ -508,12 +767,22 @@ float OvmsMetricInt::AsFloat(const float defvalue, metric_unit_t units)
 
 int OvmsMetricInt::AsInt(const int defvalue, metric_unit_t units)
   {
-  if (m_defined)
+  int value;
+  bool defined;
+  uint32_t seq;
+  do
+    {
+    seq = ReadBegin();
+    value = m_value;
+    defined = m_defined;
+    } while (ReadRetry(seq));
+
+  if (defined)
     {
     if ((units != Other)&&(units != m_units))
-      return UnitConvert(m_units,units,m_value);
+      return UnitConvert(m_units,units,value);
     else
-      return m_value;
+      return value;
     }
   else
     return defvalue;
@@ -524,25 +793,16 @@ void OvmsMetricInt::SetValue(int value, metric_unit_t units)
   int nvalue = value;
   if ((units != Other)&&(units != m_units)) nvalue=UnitConvert(units,m_units,value);
 
-  if (m_value != nvalue)
-    {
-    m_value = nvalue;
-    SetModified(true);
-    }
-  else
-    SetModified(false);
+  WriteBegin();
+  bool changed = (m_value != nvalue);
+  m_value = nvalue;
+  WriteEnd();
+  SetModified(changed);
   }
 
 void OvmsMetricInt::SetValue(std::string value)
   {
-  int nvalue = atoi(value.c_str());
-  if (m_value != nvalue)
-    {
-    m_value = nvalue;
-    SetModified(true);
-    }
-  else
-    SetModified(false);
+  SetValue(atoi(value.c_str()));
   }
 
 OvmsMetricBool::OvmsMetricBool(const char* name, uint16_t autostale, metric_unit_t units)
@@ -556,18 +816,20 @@ OvmsMetricBool::~OvmsMetricBool()
   }
 
 std::string OvmsMetricBool::AsString(const char* defvalue, metric_unit_t units, int precision)
+  {
+  if (!m_defined)
+    return std::string(defvalue);
+  char buffer[4];
+  AppendTo(buffer, sizeof(buffer), defvalue, units, precision);
+  return std::string(buffer);
+  }
+
+size_t OvmsMetricBool::AppendTo(char* buf, size_t cap, const char* defvalue, metric_unit_t units, int precision)
   {
   if (m_defined)
-    {
-    if (m_value)
-      return std::string("yes");
-    else
-      return std::string("no");
-    }
+    return OvmsMetricFormatString(buf, cap, AsBool() ? "yes" : "no");
   else
-    {
-    return std::string(defvalue);
-    }
+    return OvmsMetricFormatString(buf, cap, defvalue);
   }
 
 float OvmsMetricBool::AsFloat(const float defvalue, metric_unit_t units)
@@ -577,21 +839,28 @@ float OvmsMetricBool::AsFloat(const float defvalue, metric_unit_t units)
 
 int OvmsMetricBool::AsBool(const bool defvalue)
   {
-  if (m_defined)
-    return m_value;
+  bool value, defined;
+  uint32_t seq;
+  do
+    {
+    seq = ReadBegin();
+    value = m_value;
+    defined = m_defined;
+    } while (ReadRetry(seq));
+
+  if (defined)
+    return value;
   else
     return defvalue;
   }
 
 void OvmsMetricBool::SetValue(bool value)
   {
-  if (m_value != value)
-    {
-    m_value = value;
-    SetModified(true);
-    }
-  else
-    SetModified(false);
+  WriteBegin();
+  bool changed = (m_value != value);
+  m_value = value;
+  WriteEnd();
+  SetModified(changed);
   }
 
 void OvmsMetricBool::SetValue(std::string value)
@@ -601,13 +870,7 @@ void OvmsMetricBool::SetValue(std::string value)
     nvalue = true;
   else
     nvalue = false;
-  if (m_value != nvalue)
-    {
-    m_value = nvalue;
-    SetModified(true);
-    }
-  else
-    SetModified(false);
+  SetValue(nvalue);
   }
 
 OvmsMetricFloat::OvmsMetricFloat(const char* name, uint16_t autostale, metric_unit_t units)
@@ -621,36 +884,40 @@ OvmsMetricFloat::~OvmsMetricFloat()
   }
 
 std::string OvmsMetricFloat::AsString(const char* defvalue, metric_unit_t units, int precision)
+  {
+  if (!m_defined)
+    return std::string(defvalue);
+  std::string result;
+  OvmsMetricAppendElement(result, AsFloat(0, units), precision);
+  return result;
+  }
+
+size_t OvmsMetricFloat::AppendTo(char* buf, size_t cap, const char* defvalue, metric_unit_t units, int precision)
   {
   if (m_defined)
-    {
-    std::ostringstream ss;
-    if (precision >= 0)
-      {
-      ss.precision(precision); // Set desired precision
-      ss << fixed;
-      }
-    if ((units != Other)&&(units != m_units))
-      ss << UnitConvert(m_units,units,m_value);
-    else
-      ss << m_value;
-    std::string s(ss.str());
-    return s;
-    }
+    return OvmsMetricFormatFloat(buf, cap, AsFloat(0, units), precision);
   else
-    {
-    return std::string(defvalue);
-    }
+    return OvmsMetricFormatString(buf, cap, defvalue);
   }
 
 float OvmsMetricFloat::AsFloat(const float defvalue, metric_unit_t units)
   {
-  if (m_defined)
+  float value;
+  bool defined;
+  uint32_t seq;
+  do
+    {
+    seq = ReadBegin();
+    value = m_value;
+    defined = m_defined;
+    } while (ReadRetry(seq));
+
+  if (defined)
     {
     if ((units != Other)&&(units != m_units))
-      return UnitConvert(m_units,units,m_value);
+      return UnitConvert(m_units,units,value);
     else
-      return m_value;
+      return value;
     }
   else
     return defvalue;
@@ -666,53 +933,244 @@ void OvmsMetricFloat::SetValue(float value, metric_unit_t units)
   float nvalue = value;
   if ((units != Other)&&(units != m_units)) nvalue=UnitConvert(units,m_units,value);
 
-  if (m_value != nvalue)
-    {
-    m_value = nvalue;
-    SetModified(true);
-    }
-  else
-    SetModified(false);
+  WriteBegin();
+  bool changed = (m_value != nvalue);
+  m_value = nvalue;
+  WriteEnd();
+  SetModified(changed);
   }
 
 void OvmsMetricFloat::SetValue(std::string value)
   {
-  float nvalue = atof(value.c_str());
-  if (m_value != nvalue)
-    {
-    m_value = nvalue;
-    SetModified(true);
-    }
-  else
-    SetModified(false);
+  SetValue((float)atof(value.c_str()));
   }
 
 OvmsMetricString::OvmsMetricString(const char* name, uint16_t autostale, metric_unit_t units)
   : OvmsMetric(name, autostale, units)
   {
+  m_value = NULL;
   }
 
 OvmsMetricString::~OvmsMetricString()
   {
+  if (m_value)
+    m_value->Release();
   }
 
 std::string OvmsMetricString::AsString(const char* defvalue, metric_unit_t units, int precision)
   {
-  if (m_defined)
-    return m_value;
-  else
+  if (!m_defined)
     return std::string(defvalue);
+
+  OvmsMetricValue<std::string>* value = (OvmsMetricValue<std::string>*) AcquireRef((OvmsMetricRef**)&m_value);
+  if (!value)
+    return std::string("");
+  std::string result(value->m_value);
+  value->Release();
+  return result;
+  }
+
+size_t OvmsMetricString::AppendTo(char* buf, size_t cap, const char* defvalue, metric_unit_t units, int precision)
+  {
+  if (!m_defined)
+    return OvmsMetricFormatString(buf, cap, defvalue);
+
+  OvmsMetricValue<std::string>* value = (OvmsMetricValue<std::string>*) AcquireRef((OvmsMetricRef**)&m_value);
+  if (!value)
+    return OvmsMetricFormatString(buf, cap, "");
+  size_t len = OvmsMetricFormatString(buf, cap, value->m_value.c_str());
+  value->Release();
+  return len;
   }
 
 void OvmsMetricString::SetValue(std::string value)
   {
-  if (m_value.compare(value)!=0)
+  OvmsMetricValue<std::string>* cur = (OvmsMetricValue<std::string>*) AcquireRef((OvmsMetricRef**)&m_value);
+  bool changed = (cur == NULL) ? !value.empty() : (cur->m_value.compare(value) != 0);
+  if (cur)
+    cur->Release();
+  if (changed)
+    SwapRef((OvmsMetricRef**)&m_value, new OvmsMetricValue<std::string>(value));
+  SetModified(changed);
+  }
+
+OvmsMetricSnapshot::OvmsMetricSnapshot(std::initializer_list<OvmsMetric*> metrics, int maxretries)
+  : m_metrics(metrics)
+  {
+  m_seqs.resize(m_metrics.size());
+  m_retries = 0;
+  m_maxretries = maxretries;
+  }
+
+OvmsMetricSnapshot::~OvmsMetricSnapshot()
+  {
+  }
+
+void OvmsMetricSnapshot::Begin()
+  {
+  for (size_t i = 0; i < m_metrics.size(); i++)
+    m_seqs[i] = m_metrics[i] ? m_metrics[i]->GetSequence() : 0;
+  std::atomic_thread_fence(std::memory_order_acquire);
+  }
+
+bool OvmsMetricSnapshot::Changed()
+  {
+  std::atomic_thread_fence(std::memory_order_acquire);
+  bool changed = false;
+  for (size_t i = 0; i < m_metrics.size() && !changed; i++)
+    {
+    if (m_metrics[i] == NULL) continue;
+    uint32_t seq = m_metrics[i]->GetSequence();
+    if ((m_seqs[i] & 1) || (seq != m_seqs[i]))
+      changed = true;
+    }
+  if (!changed)
+    return false;
+  if (++m_retries > m_maxretries)
+    {
+    ESP_LOGD(TAG, "Snapshot: giving up after %d retries", m_maxretries);
+    return false;
+    }
+  return true;
+  }
+
+size_t OvmsMetricFormatString(char* buf, size_t cap, const char* value)
+  {
+  if (cap == 0)
+    return 0;
+  size_t len = 0;
+  while ((len < cap-1) && (value[len] != 0))
+    {
+    buf[len] = value[len];
+    len++;
+    }
+  buf[len] = 0;
+  return len;
+  }
+
+// Write the decimal digits of value backwards, ending at *end:
+static char* format_digits(char* end, uint64_t value, int mindigits = 1)
+  {
+  // use 32 bit arithmetic where possible, 64 bit division is slow on the ESP32
+  while (value > 0xffffffffULL)
+    {
+    *--end = '0' + (value % 10);
+    value /= 10;
+    mindigits--;
+    }
+  uint32_t v = (uint32_t) value;
+  while ((v > 0) || (mindigits > 0))
+    {
+    *--end = '0' + (v % 10);
+    v /= 10;
+    mindigits--;
+    }
+  return end;
+  }
+
+size_t OvmsMetricFormatInt(char* buf, size_t cap, int value)
+  {
+  char tmp[16];
+  char* end = tmp + sizeof(tmp) - 1;
+  *end = 0;
+  uint32_t v = (value < 0) ? -(uint32_t)value : (uint32_t)value;
+  char* p = format_digits(end, v);
+  if (value < 0)
+    *--p = '-';
+  return OvmsMetricFormatString(buf, cap, p);
+  }
+
+static const double s_pow10[] =
+  { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9 };
+
+// Fixed point formatting, returns NULL if the value is out of range:
+static char* format_fixed(char* end, double value, int precision)
+  {
+  bool neg = (value < 0);
+  if (neg) value = -value;
+  if (precision > 9) precision = 9;
+  double r = value * s_pow10[precision];
+  if (r >= 1.8e19)
+    return NULL;
+  uint64_t n = (uint64_t) r;
+  double frac = r - (double) n;
+  if ((frac > 0.5) || ((frac == 0.5) && (n & 1)))
+    n++; // round half to even, like printf
+  uint64_t scale = (uint64_t) s_pow10[precision];
+  char* p = end;
+  if (precision > 0)
+    {
+    p = format_digits(p, n % scale, precision);
+    *--p = '.';
+    }
+  p = format_digits(p, n / scale);
+  if (neg)
+    *--p = '-';
+  return p;
+  }
+
+// Remove trailing fractional zeros (and the decimal point) ending at end:
+static char* strip_zeros(char* start, char* end)
+  {
+  if (memchr(start, '.', end-start) == NULL)
+    return end;
+  while (end[-1] == '0')
+    end--;
+  if (end[-1] == '.')
+    end--;
+  return end;
+  }
+
+size_t OvmsMetricFormatFloat(char* buf, size_t cap, float value, int precision)
+  {
+  char tmp[48];
+  char* end = tmp + sizeof(tmp) - 1;
+  char* p;
+  *end = 0;
+
+  if (isnan(value))
+    return OvmsMetricFormatString(buf, cap, "nan");
+  if (isinf(value))
+    return OvmsMetricFormatString(buf, cap, (value < 0) ? "-inf" : "inf");
+
+  if (precision >= 0)
     {
-    m_value = value;
-    SetModified(true);
+    p = format_fixed(end, value, precision);
+    if (p)
+      return OvmsMetricFormatString(buf, cap, p);
+    // out of range for fixed point, use the general format
+    }
+
+  // General format, 6 significant digits (like printf "%g"):
+  if (value == 0)
+    return OvmsMetricFormatString(buf, cap, "0");
+  double a = fabs((double)value);
+  int x = (int) floor(log10(a));
+  if (floor(a / pow(10, x) * 1e5 + 0.5) >= 1e6)
+    x++;
+  if ((x >= -4) && (x < 6))
+    {
+    p = format_fixed(end, value, 5-x);
+    char* e = strip_zeros(p, end);
+    *e = 0;
+    return OvmsMetricFormatString(buf, cap, p);
     }
   else
-    SetModified(false);
+    {
+    // Exponent notation: mantissa, then "e+XX" / "e-XX"
+    char* q = tmp + 24;
+    *q = 0;
+    p = format_fixed(q, value / pow(10, x), 5);
+    q = strip_zeros(p, q);
+    *q++ = 'e';
+    *q++ = (x < 0) ? '-' : '+';
+    int ax = (x < 0) ? -x : x;
+    if (ax >= 100) *q++ = '0' + (ax / 100);
+    *q++ = '0' + ((ax / 10) % 10);
+    *q++ = '0' + (ax % 10);
+    *q = 0;
+    return OvmsMetricFormatString(buf, cap, p);
+    }
   }
 
 const char* OvmsMetricUnitLabel(metric_unit_t units)
@@ -748,134 +1206,41 @@ const char* OvmsMetricUnitLabel(metric_unit_t units)
     }
   }
 
+// The linear conversions are generated from OVMS_UNIT_CONVERSIONS, so they
+// match the compile time OvmsUnitConversion. Integer results are truncated.
+#define UNIT_PAIR(from, to)   (((from) << 8) | (to))
+#define UNIT_CONVERT(from, to, factor, offset)                              \
+    case UNIT_PAIR(from, to):                                               \
+      return value * (float)(factor) + (float)(offset);
+
 int UnitConvert(metric_unit_t from, metric_unit_t to, int value)
   {
-  switch (from)
-    {
-    case Kilometers:
-      if (to == Miles) return (value*5)/8;
-      else if (to == Meters) return value/1000;
-      break;
-    case Miles:
-      if (to == Kilometers) return (value*8)/5;
-      else if (to == Meters) return (value*8000)/5;
-      break;
-    case KphPS:
-      if (to == MphPS) return (value*5)/8;
-      else if (to == MetersPSS) return value/1000;
-      break;
-    case MphPS:
-      if (to == KphPS) return (value*8)/5;
-      else if (to == MetersPSS) return (value*8000)/5;
-      break;
-    case Celcius:
-      if (to == Fahrenheit) return ((value*9)/5) + 32;
-      break;
-    case Fahrenheit:
-      if (to == Celcius) return ((value-32)*5)/9;
-      break;
-    case kPa:
-      if (to == Pa) return value*1000;
-      else if (to == PSI) return int((float)value * 0.14503773773020923);
-    case Pa:
-      if (to == kPa) return value/1000;
-      else if (to == PSI) return int((float)value * 0.00014503773773020923);
-    case PSI:
-      if (to == kPa) return int((float)value * 6.894757293168361);
-      else if (to == Pa) return int((float)value * 0.006894757293168361);
-      break;
-    case Seconds:
-      if (to == Minutes) return value/60;
-      else if (to == Hours) return value/3600;
-      break;
-    case Minutes:
-      if (to == Seconds) return value*60;
-      else if (to == Hours) return value/60;
-      break;
-    case Hours:
-      if (to == Seconds) return value*3600;
-      else if (to == Minutes) return value*60;
-      break;
-    case Kph:
-      if (to == Mph) return (value*5)/8;
-      break;
-    case Mph:
-      if (to == Kph) return (value*8)/5;
-      break;
-    case dbm:
-      if (to == sq) return (value <= -51)?((value + 113)/2):0;
-      break;
-    case sq:
-      if (to == dbm) return (value <= 31)?(-113 + (value*2)):0;
-      break;
+  switch (UNIT_PAIR(from, to))
+    {
+    case UNIT_PAIR(dbm, sq):
+      return (value <= -51)?((value + 113)/2):0;
+    case UNIT_PAIR(sq, dbm):
+      return (value <= 31)?(-113 + (value*2)):0;
     default:
-      return value;
+      if (from == to)
+        return value;
+      return (int) UnitConvert(from, to, (float) value);
     }
-  return value;
   }
 
 float UnitConvert(metric_unit_t from, metric_unit_t to, float value)
   {
-  switch (from)
-    {
-    case Kilometers:
-      if (to == Miles) return (value*5)/8;
-      else if (to == Meters) return value/1000;
-      break;
-    case Miles:
-      if (to == Kilometers) return (value*8)/5;
-      else if (to == Meters) return (value*8000)/5;
-      break;
-    case KphPS:
-      if (to == MphPS) return (value*5)/8;
-      else if (to == MetersPSS) return value/1000;
-      break;
-    case MphPS:
-      if (to == KphPS) return (value*8)/5;
-      else if (to == MetersPSS) return (value*8000)/5;
-      break;
-    case Celcius:
-      if (to == Fahrenheit) return ((value*9)/5) + 32;
-      break;
-    case Fahrenheit:
-      if (to == Celcius) return ((value-32)*5)/9;
-      break;
-    case kPa:
-      if (to == Pa) return value*1000;
-      else if (to == PSI) return value * 0.14503773773020923;
-    case Pa:
-      if (to == kPa) return value/1000;
-      else if (to == PSI) return value * 0.00014503773773020923;
-    case PSI:
-      if (to == kPa) return value * 6.894757293168361;
-      else if (to == Pa) return value * 0.006894757293168361;
-      break;
-    case Seconds:
-      if (to == Minutes) return value/60;
-      else if (to == Hours) return value/3600;
-      break;
-    case Minutes:
-      if (to == Seconds) return value*60;
-      else if (to == Hours) return value/60;
-      break;
-    case Hours:
-      if (to == Seconds) return value*3600;
-      else if (to == Minutes) return value*60;
-      break;
-    case Kph:
-      if (to == Mph) return (value*5)/8;
-      break;
-    case Mph:
-      if (to == Kph) return (value*8)/5;
-      break;
-    case dbm:
-      if (to == sq) return int((value <= -51)?((value + 113)/2):0);
-      break;
-    case sq:
-      if (to == dbm) return int((value <= 31)?(-113 + (value*2)):0);
-      break;
+  switch (UNIT_PAIR(from, to))
+    {
+    OVMS_UNIT_CONVERSIONS(UNIT_CONVERT)
+    case UNIT_PAIR(dbm, sq):
+      return int((value <= -51)?((value + 113)/2):0);
+    case UNIT_PAIR(sq, dbm):
+      return int((value <= 31)?(-113 + (value*2)):0);
     default:
       return value;
     }
-  return value;
   }
+
+#undef UNIT_CONVERT
+#undef UNIT_PAIR
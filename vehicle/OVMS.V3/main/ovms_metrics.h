@@ -37,9 +37,15 @@
 #include <string>
 #include <bitset>
 #include <stdint.h>
+#include <stdlib.h>
 #include <sstream>
 #include <set>
+#include <atomic>
+#include <initializer_list>
+#include <vector>
+#include <math.h>
 #include "ovms_utils.h"
+#include "ovms_events.h"
 
 #define METRICS_MAX_MODIFIERS 32
 
@@ -91,6 +97,127 @@ extern const char* OvmsMetricUnitLabel(metric_unit_t units);
 extern int UnitConvert(metric_unit_t from, metric_unit_t to, int value);
 extern float UnitConvert(metric_unit_t from, metric_unit_t to, float value);
 
+/**
+ * Heap free formatters for metric values:
+ *  - write the value into buf (capacity cap including the terminating NUL)
+ *  - the output is truncated if necessary and always NUL terminated (cap > 0)
+ *  - return the number of characters written, excluding the NUL
+ *  - FormatFloat: precision < 0 gives the shortest representation with up
+ *    to 6 significant digits (like the iostream default), else fixed point
+ */
+extern size_t OvmsMetricFormatString(char* buf, size_t cap, const char* value);
+extern size_t OvmsMetricFormatInt(char* buf, size_t cap, int value);
+extern size_t OvmsMetricFormatFloat(char* buf, size_t cap, float value, int precision = -1);
+
+inline size_t OvmsMetricFormatElement(char* buf, size_t cap, int value, int precision = -1)
+  { return OvmsMetricFormatInt(buf, cap, value); }
+inline size_t OvmsMetricFormatElement(char* buf, size_t cap, float value, int precision = -1)
+  { return OvmsMetricFormatFloat(buf, cap, value, precision); }
+inline size_t OvmsMetricFormatElement(char* buf, size_t cap, const std::string& value, int precision = -1)
+  { return OvmsMetricFormatString(buf, cap, value.c_str()); }
+template <typename T> size_t OvmsMetricFormatElement(char* buf, size_t cap, const T& value, int precision = -1)
+  {
+  std::ostringstream ss;
+  ss << value;
+  return OvmsMetricFormatString(buf, cap, ss.str().c_str());
+  }
+
+/**
+ * Unbounded element formatters for AsString(): append the value to out,
+ *  same representation as OvmsMetricFormatElement() without truncation
+ */
+inline void OvmsMetricAppendElement(std::string& out, int value, int precision = -1)
+  {
+  char buf[16];
+  OvmsMetricFormatInt(buf, sizeof(buf), value);
+  out.append(buf);
+  }
+inline void OvmsMetricAppendElement(std::string& out, float value, int precision = -1)
+  {
+  std::string buf(48 + (precision > 0 ? precision : 0), '\0');
+  buf.resize(OvmsMetricFormatFloat(&buf[0], buf.size(), value, precision));
+  out.append(buf);
+  }
+inline void OvmsMetricAppendElement(std::string& out, const std::string& value, int precision = -1)
+  { out.append(value); }
+template <typename T> void OvmsMetricAppendElement(std::string& out, const T& value, int precision = -1)
+  {
+  std::ostringstream ss;
+  ss << value;
+  out.append(ss.str());
+  }
+
+/**
+ * OvmsMetricRef: reference counted immutable value container
+ *  - used for metric values that cannot be copied atomically (strings, sets)
+ *  - writers build a new container and swap the pointer (RCU style), readers
+ *    hold a reference while copying, so the old value stays valid until the
+ *    last reader releases it
+ */
+class OvmsMetricRef
+  {
+  public:
+    OvmsMetricRef() : m_refcount(1) {}
+    virtual ~OvmsMetricRef() {}
+
+  public:
+    void Release()
+      {
+      if (std::atomic_fetch_add(&m_refcount, -1) == 1)
+        delete this;
+      }
+
+  public:
+    std::atomic<int> m_refcount;
+  };
+
+template <typename ValueType>
+class OvmsMetricValue : public OvmsMetricRef
+  {
+  public:
+    OvmsMetricValue(const ValueType& value) : m_value(value) {}
+    virtual ~OvmsMetricValue() {}
+
+  public:
+    const ValueType m_value;
+  };
+
+/**
+ * OvmsMetricRateLimit: notification filter for noisy metrics
+ *  - deadband: changes within the absolute or relative (percent of the last
+ *    notified value) band around the last notified value are not notified
+ *  - interval: minimum time between notifications in milliseconds
+ *  - suppressed changes are still stored, a final notification is sent
+ *    when the value has settled (see OvmsMetrics::FlushRateLimits)
+ */
+class OvmsMetricRateLimit
+  {
+  public:
+    OvmsMetricRateLimit();
+
+  public:
+    void Configure(float absolute, float relative);
+    void Configure(uint32_t interval);
+    bool Notify(float value);
+    bool Flush(uint32_t now);
+    void Notified(float value);
+
+  protected:
+    bool Settled(uint32_t now);
+
+  public:
+    portMUX_TYPE m_mux;           // Guards the state, set by any task and the flush ticker
+    float m_deadband_abs;
+    float m_deadband_rel;
+    uint32_t m_interval;
+    float m_notified_value;
+    bool m_notified;
+    bool m_pending;
+    uint32_t m_last_notify;
+    uint32_t m_last_change;
+    uint32_t m_suppressed;
+  };
+
 class OvmsMetric
   {
   public:
@@ -99,6 +226,7 @@ class OvmsMetric
 
   public:
     virtual std::string AsString(const char* defvalue = "", metric_unit_t units = Other, int precision = -1);
+    virtual size_t AppendTo(char* buf, size_t cap, const char* defvalue = "", metric_unit_t units = Other, int precision = -1);
     std::string AsUnitString(const char* defvalue = "", metric_unit_t units = Other, int precision = -1)
       {
       if (!m_defined)
@@ -118,6 +246,27 @@ class OvmsMetric
     virtual bool IsModifiedAndClear(size_t modifier);
     virtual void ClearModified(size_t modifier);
     virtual void SetModified(bool changed=true);
+    virtual bool IsNumeric() { return false; }
+    uint32_t GetSequence() { return m_seq.load(); }
+
+  public:
+    void SetDeadband(float absolute, float relative = 0);
+    void SetNotifyInterval(uint32_t ms);
+    uint32_t GetSuppressedCount();
+    void FlushNotification();
+
+  protected:
+    // Seqlock for values that can be copied in place (scalars, bitsets):
+    //  writers are serialised and make the sequence odd while updating,
+    //  readers copy the value and retry if the sequence was odd or changed.
+    void WriteBegin();
+    void WriteEnd();
+    uint32_t ReadBegin();
+    bool ReadRetry(uint32_t seq);
+
+    // RCU style pointer swap for OvmsMetricRef values:
+    OvmsMetricRef* AcquireRef(OvmsMetricRef* const* ref);
+    void SwapRef(OvmsMetricRef** ref, OvmsMetricRef* value);
 
   public:
     OvmsMetric* m_next;
@@ -128,6 +277,8 @@ class OvmsMetric
     uint16_t m_autostale;
     bool m_defined;
     bool m_stale;
+    std::atomic<uint32_t> m_seq;
+    OvmsMetricRateLimit* m_ratelimit;
   };
 
 class OvmsMetricBool : public OvmsMetric
@@ -138,6 +289,7 @@ class OvmsMetricBool : public OvmsMetric
 
   public:
     std::string AsString(const char* defvalue = "", metric_unit_t units = Other, int precision = -1);
+    size_t AppendTo(char* buf, size_t cap, const char* defvalue = "", metric_unit_t units = Other, int precision = -1);
     float AsFloat(const float defvalue = 0, metric_unit_t units = Other);
     int AsBool(const bool defvalue = false);
     void SetValue(bool value);
@@ -157,12 +309,14 @@ class OvmsMetricInt : public OvmsMetric
 
   public:
     std::string AsString(const char* defvalue = "", metric_unit_t units = Other, int precision = -1);
+    size_t AppendTo(char* buf, size_t cap, const char* defvalue = "", metric_unit_t units = Other, int precision = -1);
     float AsFloat(const float defvalue = 0, metric_unit_t units = Other);
     int AsInt(const int defvalue = 0, metric_unit_t units = Other);
     void SetValue(int value, metric_unit_t units = Other);
     void operator=(int value) { SetValue(value); }
     void SetValue(std::string value);
     void operator=(std::string value) { SetValue(value); }
+    bool IsNumeric() { return true; }
     
   protected:
     int m_value;
@@ -176,12 +330,14 @@ class OvmsMetricFloat : public OvmsMetric
 
   public:
     std::string AsString(const char* defvalue = "", metric_unit_t units = Other, int precision = -1);
+    size_t AppendTo(char* buf, size_t cap, const char* defvalue = "", metric_unit_t units = Other, int precision = -1);
     float AsFloat(const float defvalue = 0, metric_unit_t units = Other);
     int AsInt(const int defvalue = 0, metric_unit_t units = Other);
     void SetValue(float value, metric_unit_t units = Other);
     void operator=(float value) { SetValue(value); }
     void SetValue(std::string value);
     void operator=(std::string value) { SetValue(value); }
+    bool IsNumeric() { return true; }
     
   protected:
     float m_value;
@@ -195,11 +351,12 @@ class OvmsMetricString : public OvmsMetric
 
   public:
     std::string AsString(const char* defvalue = "", metric_unit_t units = Other, int precision = -1);
+    size_t AppendTo(char* buf, size_t cap, const char* defvalue = "", metric_unit_t units = Other, int precision = -1);
     void SetValue(std::string value);
     void operator=(std::string value) { SetValue(value); }
     
   protected:
-    std::string m_value;
+    OvmsMetricValue<std::string>* m_value;
   };
 
 
@@ -224,17 +381,37 @@ class OvmsMetricBitset : public OvmsMetric
       {
       if (!m_defined)
         return std::string(defvalue);
-      std::ostringstream ss;
+      std::bitset<N> value = AsBitset();
+      std::string result;
       for (int i = 0; i < N; i++)
         {
-        if (m_value[i])
+        if (value[i])
           {
-          if (ss.tellp() > 0)
-            ss << ',';
-          ss << i+1;
+          if (!result.empty())
+            result.append(1, ',');
+          OvmsMetricAppendElement(result, i+1);
           }
         }
-      return ss.str();
+      return result;
+      }
+
+    size_t AppendTo(char* buf, size_t cap, const char* defvalue = "", metric_unit_t units = Other, int precision = -1)
+      {
+      if (!m_defined)
+        return OvmsMetricFormatString(buf, cap, defvalue);
+      std::bitset<N> value = AsBitset();
+      size_t len = 0;
+      if (cap > 0) buf[0] = 0;
+      for (int i = 0; i < N; i++)
+        {
+        if (value[i])
+          {
+          if (len > 0)
+            len += OvmsMetricFormatString(buf+len, cap-len, ",");
+          len += OvmsMetricFormatInt(buf+len, cap-len, i+1);
+          }
+        }
+      return len;
       }
     
     void SetValue(std::string value)
@@ -256,18 +433,25 @@ class OvmsMetricBitset : public OvmsMetric
     
     std::bitset<N> AsBitset(const std::bitset<N> defvalue = std::bitset<N>(0), metric_unit_t units = Other)
       {
-      return m_defined ? m_value : defvalue;
+      std::bitset<N> value;
+      bool defined;
+      uint32_t seq;
+      do
+        {
+        seq = ReadBegin();
+        value = m_value;
+        defined = m_defined;
+        } while (ReadRetry(seq));
+      return defined ? value : defvalue;
       }
     
     void SetValue(std::bitset<N> value, metric_unit_t units = Other)
       {
-      if (m_value != value)
-        {
-        m_value = value;
-        SetModified(true);
-        }
-      else
-        SetModified(false);
+      WriteBegin();
+      bool changed = (m_value != value);
+      m_value = value;
+      WriteEnd();
+      SetModified(changed);
       }
     void operator=(std::bitset<N> value) { SetValue(value); }
     
@@ -288,9 +472,12 @@ class OvmsMetricSet : public OvmsMetric
     OvmsMetricSet(const char* name, uint16_t autostale=0, metric_unit_t units = Other)
       : OvmsMetric(name, autostale, units)
       {
+      m_value = NULL;
       }
     virtual ~OvmsMetricSet()
       {
+      if (m_value)
+        m_value->Release();
       }
 
   public:
@@ -298,14 +485,39 @@ class OvmsMetricSet : public OvmsMetric
       {
       if (!m_defined)
         return std::string(defvalue);
-      std::ostringstream ss;
-      for (auto i = m_value.begin(); i != m_value.end(); i++)
+      std::string result;
+      OvmsMetricValue< std::set<ElemType> >* value = (OvmsMetricValue< std::set<ElemType> >*) AcquireRef((OvmsMetricRef**)&m_value);
+      if (value)
+        {
+        for (auto i = value->m_value.begin(); i != value->m_value.end(); i++)
+          {
+          if (!result.empty())
+            result.append(1, ',');
+          OvmsMetricAppendElement(result, *i);
+          }
+        value->Release();
+        }
+      return result;
+      }
+
+    size_t AppendTo(char* buf, size_t cap, const char* defvalue = "", metric_unit_t units = Other, int precision = -1)
+      {
+      if (!m_defined)
+        return OvmsMetricFormatString(buf, cap, defvalue);
+      size_t len = 0;
+      if (cap > 0) buf[0] = 0;
+      OvmsMetricValue< std::set<ElemType> >* value = (OvmsMetricValue< std::set<ElemType> >*) AcquireRef((OvmsMetricRef**)&m_value);
+      if (value)
         {
-        if (ss.tellp() > 0)
-          ss << ',';
-        ss << *i;
+        for (auto i = value->m_value.begin(); i != value->m_value.end(); i++)
+          {
+          if (len > 0)
+            len += OvmsMetricFormatString(buf+len, cap-len, ",");
+          len += OvmsMetricFormatElement(buf+len, cap-len, *i);
+          }
+        value->Release();
         }
-      return ss.str();
+      return len;
       }
     
     void SetValue(std::string value)
@@ -326,25 +538,513 @@ class OvmsMetricSet : public OvmsMetric
     
     std::set<ElemType> AsSet(const std::set<ElemType> defvalue = std::set<ElemType>(), metric_unit_t units = Other)
       {
-      return m_defined ? m_value : defvalue;
+      if (!m_defined)
+        return defvalue;
+      std::set<ElemType> result;
+      OvmsMetricValue< std::set<ElemType> >* value = (OvmsMetricValue< std::set<ElemType> >*) AcquireRef((OvmsMetricRef**)&m_value);
+      if (value)
+        {
+        result = value->m_value;
+        value->Release();
+        }
+      return result;
       }
     
     void SetValue(std::set<ElemType> value, metric_unit_t units = Other)
       {
-      if (m_value != value)
-        {
-        m_value = value;
-        SetModified(true);
-        }
-      else
-        SetModified(false);
+      OvmsMetricValue< std::set<ElemType> >* cur = (OvmsMetricValue< std::set<ElemType> >*) AcquireRef((OvmsMetricRef**)&m_value);
+      bool changed = (cur == NULL) ? !value.empty() : (cur->m_value != value);
+      if (cur)
+        cur->Release();
+      if (changed)
+        SwapRef((OvmsMetricRef**)&m_value, new OvmsMetricValue< std::set<ElemType> >(value));
+      SetModified(changed);
       }
     void operator=(std::set<ElemType> value) { SetValue(value); }
     
   protected:
-    std::set<ElemType> m_value;
+    OvmsMetricValue< std::set<ElemType> >* m_value;
+  };
+
+
+/**
+ * OvmsMetricVector<ElemType>: metric for an array of values of the same kind,
+ *  i.e. battery cell voltages or module temperatures
+ *  - contiguous storage, capacity fixed at creation, size can vary up to it
+ *  - per element modification flags (one bit per modifier, like the metric)
+ *  - bulk update by SetElements(offset, values, count) with one notification
+ *  - statistics (min/max/mean/stddev, argmin/argmax) computed on demand
+ *  - string representation as comma separated list of the elements
+ */
+template <typename ElemType>
+struct OvmsMetricVectorStats
+  {
+  size_t count;
+  ElemType min;
+  ElemType max;
+  size_t argmin;
+  size_t argmax;
+  float mean;
+  float stddev;
+  };
+
+inline int OvmsMetricConvertElement(metric_unit_t from, metric_unit_t to, int value)
+  { return UnitConvert(from, to, value); }
+inline float OvmsMetricConvertElement(metric_unit_t from, metric_unit_t to, float value)
+  { return UnitConvert(from, to, value); }
+template <typename T> T OvmsMetricConvertElement(metric_unit_t from, metric_unit_t to, const T& value)
+  { return value; }
+
+template <typename ElemType>
+class OvmsMetricVector : public OvmsMetric
+  {
+  public:
+    OvmsMetricVector(const char* name, uint16_t autostale=0, size_t capacity=0, metric_unit_t units = Other)
+      : OvmsMetric(name, autostale, units)
+      {
+      m_capacity = capacity;
+      m_size = capacity;
+      m_values = new ElemType[capacity]();
+      m_elem_modified = new std::atomic<uint32_t>[capacity];
+      for (size_t i = 0; i < capacity; i++)
+        m_elem_modified[i] = 0;
+      }
+    virtual ~OvmsMetricVector()
+      {
+      delete [] m_values;
+      delete [] m_elem_modified;
+      }
+
+  public:
+    std::string AsString(const char* defvalue = "", metric_unit_t units = Other, int precision = -1)
+      {
+      if (!m_defined)
+        return std::string(defvalue);
+      std::string result;
+      size_t size = GetSize();
+      for (size_t i = 0; i < size; i++)
+        {
+        if (i > 0)
+          result.append(1, ',');
+        OvmsMetricAppendElement(result, GetElement(i, ElemType(), units), precision);
+        }
+      return result;
+      }
+
+    size_t AppendTo(char* buf, size_t cap, const char* defvalue = "", metric_unit_t units = Other, int precision = -1)
+      {
+      if (!m_defined)
+        return OvmsMetricFormatString(buf, cap, defvalue);
+      size_t len = 0;
+      if (cap > 0) buf[0] = 0;
+      size_t size = GetSize();
+      for (size_t i = 0; i < size; i++)
+        {
+        if (i > 0)
+          len += OvmsMetricFormatString(buf+len, cap-len, ",");
+        len += OvmsMetricFormatElement(buf+len, cap-len, GetElement(i, ElemType(), units), precision);
+        }
+      return len;
+      }
+
+    void SetValue(std::string value)
+      {
+      ElemType* values = new ElemType[m_capacity];
+      size_t count = 0;
+      std::istringstream vs(value);
+      std::string token;
+      while (count < m_capacity && std::getline(vs, token, ','))
+        {
+        std::istringstream ts(token);
+        ts >> values[count++];
+        }
+      // Resize and update in one write, so listeners get a single
+      // notification and never see the new size with the old elements:
+      WriteBegin();
+      bool changed = (count != m_size);
+      m_size = count;
+      changed |= StoreElements(0, values, count);
+      WriteEnd();
+      SetModified(changed);
+      delete [] values;
+      }
+    void operator=(std::string value) { SetValue(value); }
+
+  public:
+    size_t GetCapacity()
+      {
+      return m_capacity;
+      }
+
+    size_t GetSize()
+      {
+      return m_size;
+      }
+
+    void SetSize(size_t size)
+      {
+      if (size > m_capacity) size = m_capacity;
+      if (size == m_size) return;
+      WriteBegin();
+      m_size = size;
+      WriteEnd();
+      SetModified(true);
+      }
+
+    ElemType GetElement(size_t index, const ElemType defvalue = ElemType(), metric_unit_t units = Other)
+      {
+      if (index >= m_capacity)
+        return defvalue;
+      ElemType value;
+      bool valid;
+      uint32_t seq;
+      do
+        {
+        seq = ReadBegin();
+        value = m_values[index];
+        valid = m_defined && (index < m_size);
+        } while (ReadRetry(seq));
+      if (!valid)
+        return defvalue;
+      if ((units != Other)&&(units != m_units))
+        return OvmsMetricConvertElement(m_units, units, value);
+      return value;
+      }
+
+    /**
+     * GetElements: copy up to count elements starting at offset into values,
+     *  returns the number of elements copied
+     */
+    size_t GetElements(size_t offset, ElemType* values, size_t count)
+      {
+      size_t n;
+      uint32_t seq;
+      do
+        {
+        seq = ReadBegin();
+        n = (offset < m_size) ? m_size - offset : 0;
+        if (n > count) n = count;
+        for (size_t i = 0; i < n; i++)
+          values[i] = m_values[offset+i];
+        } while (ReadRetry(seq));
+      return n;
+      }
+
+    std::vector<ElemType> AsVector()
+      {
+      std::vector<ElemType> result(m_capacity);
+      result.resize(GetElements(0, result.data(), m_capacity));
+      return result;
+      }
+
+    void SetElement(size_t index, ElemType value, metric_unit_t units = Other)
+      {
+      if ((units != Other)&&(units != m_units))
+        value = OvmsMetricConvertElement(units, m_units, value);
+      SetElements(index, &value, 1);
+      }
+
+    /**
+     * SetElements: bulk update count elements starting at offset
+     *  - the size grows to include the elements if necessary
+     *  - listeners are notified once if any element has changed
+     */
+    void SetElements(size_t offset, const ElemType* values, size_t count)
+      {
+      if (offset >= m_capacity) return;
+      if (count > m_capacity - offset) count = m_capacity - offset;
+      WriteBegin();
+      bool changed = StoreElements(offset, values, count);
+      if (offset + count > m_size)
+        {
+        m_size = offset + count;
+        changed = true;
+        }
+      WriteEnd();
+      SetModified(changed);
+      }
+
+    bool IsElementModified(size_t index, size_t modifier)
+      {
+      return (index < m_capacity) && (m_elem_modified[index].load() & (1ul << modifier));
+      }
+
+    bool IsElementModifiedAndClear(size_t index, size_t modifier)
+      {
+      if (index >= m_capacity) return false;
+      uint32_t mask = (1ul << modifier);
+      return (std::atomic_fetch_and(&m_elem_modified[index], ~mask) & mask) != 0;
+      }
+
+    /**
+     * GetStats: compute statistics over the current elements
+     *  - loops run over the contiguous storage without branches on the
+     *    accumulators, so the compiler can unroll / vectorize them
+     */
+    OvmsMetricVectorStats<ElemType> GetStats(metric_unit_t units = Other)
+      {
+      OvmsMetricVectorStats<ElemType> stats;
+      uint32_t seq;
+      do
+        {
+        seq = ReadBegin();
+        stats.count = m_size;
+        stats.min = stats.max = ElemType();
+        stats.argmin = stats.argmax = 0;
+        stats.mean = stats.stddev = 0;
+        if (m_size == 0)
+          continue;
+        float sum = 0, sqrsum = 0;
+        for (size_t i = 0; i < m_size; i++)
+          {
+          float v = (float) m_values[i];
+          sum += v;
+          sqrsum += v * v;
+          }
+        for (size_t i = 1; i < m_size; i++)
+          {
+          if (m_values[i] < m_values[stats.argmin]) stats.argmin = i;
+          if (m_values[i] > m_values[stats.argmax]) stats.argmax = i;
+          }
+        stats.min = m_values[stats.argmin];
+        stats.max = m_values[stats.argmax];
+        stats.mean = sum / m_size;
+        float var = sqrsum / m_size - stats.mean * stats.mean;
+        stats.stddev = (var > 0) ? sqrtf(var) : 0;
+        } while (ReadRetry(seq));
+
+      if ((units != Other)&&(units != m_units)&&(stats.count > 0))
+        {
+        stats.min = OvmsMetricConvertElement(m_units, units, stats.min);
+        stats.max = OvmsMetricConvertElement(m_units, units, stats.max);
+        float mean = OvmsMetricConvertElement(m_units, units, stats.mean);
+        // stddev is a difference, so convert it without the unit offset:
+        stats.stddev = fabsf(OvmsMetricConvertElement(m_units, units, stats.mean + stats.stddev) - mean);
+        stats.mean = mean;
+        }
+      return stats;
+      }
+
+  protected:
+    // Copy elements & set their modification flags, call within WriteBegin/End
+    bool StoreElements(size_t offset, const ElemType* values, size_t count)
+      {
+      bool changed = false;
+      for (size_t i = 0; i < count; i++)
+        {
+        if (m_values[offset+i] != values[i])
+          {
+          m_values[offset+i] = values[i];
+          m_elem_modified[offset+i] = 0xffffffff;
+          changed = true;
+          }
+        }
+      return changed;
+      }
+
+  protected:
+    ElemType* m_values;
+    std::atomic<uint32_t>* m_elem_modified;
+    size_t m_capacity;
+    size_t m_size;
+  };
+
+/**
+ * OVMS_UNIT_CONVERSIONS: the linear unit conversions (from, to, factor,
+ *  offset), the single source for OvmsUnitConversion and UnitConvert()
+ */
+#define OVMS_UNIT_CONVERSIONS(X) \
+  X(Kilometers, Miles,       0.621371192, 0)            \
+  X(Kilometers, Meters,      1000, 0)                   \
+  X(Miles,      Kilometers,  1.609344, 0)               \
+  X(Miles,      Meters,      1609.344, 0)               \
+  X(Meters,     Kilometers,  0.001, 0)                  \
+  X(Meters,     Miles,       0.000621371192, 0)         \
+  X(Celcius,    Fahrenheit,  1.8, 32)                   \
+  X(Fahrenheit, Celcius,     5.0/9.0, -160.0/9.0)       \
+  X(kPa,        Pa,          1000, 0)                   \
+  X(kPa,        PSI,         0.14503773773020923, 0)    \
+  X(Pa,         kPa,         0.001, 0)                  \
+  X(Pa,         PSI,         0.00014503773773020923, 0) \
+  X(PSI,        kPa,         6.894757293168361, 0)      \
+  X(PSI,        Pa,          6894.757293168361, 0)      \
+  X(Seconds,    Minutes,     1.0/60, 0)                 \
+  X(Seconds,    Hours,       1.0/3600, 0)               \
+  X(Minutes,    Seconds,     60, 0)                     \
+  X(Minutes,    Hours,       1.0/60, 0)                 \
+  X(Hours,      Seconds,     3600, 0)                   \
+  X(Hours,      Minutes,     60, 0)                     \
+  X(Kph,        Mph,         0.621371192, 0)            \
+  X(Mph,        Kph,         1.609344, 0)               \
+  X(KphPS,      MphPS,       0.621371192, 0)            \
+  X(KphPS,      MetersPSS,   1.0/3.6, 0)                \
+  X(MphPS,      KphPS,       1.609344, 0)               \
+  X(MphPS,      MetersPSS,   0.44704, 0)                \
+  X(MetersPSS,  KphPS,       3.6, 0)                    \
+  X(MetersPSS,  MphPS,       2.2369362921, 0)
+
+/**
+ * OvmsUnitConversion<From,To>: compile time unit conversion
+ *  - linear conversions (factor & offset) for all unit pairs with a
+ *    physical relation, collapsing to a constant multiply/add
+ *  - there is no generic definition, so converting between unrelated units
+ *    (or non linear ones like dbm/sq) fails to compile
+ */
+template <metric_unit_t From, metric_unit_t To>
+struct OvmsUnitConversion;
+
+template <metric_unit_t Unit>
+struct OvmsUnitConversion<Unit, Unit>
+  {
+  template <typename T> static constexpr T Convert(T value) { return value; }
+  };
+
+#define OVMS_UNIT_CONVERSION(from, to, factor, offset)                      \
+  template <> struct OvmsUnitConversion<from, to>                           \
+    {                                                                       \
+    template <typename T> static constexpr T Convert(T value)               \
+      { return (T) (value * (float)(factor) + (float)(offset)); }           \
+    };
+
+OVMS_UNIT_CONVERSIONS(OVMS_UNIT_CONVERSION)
+
+#undef OVMS_UNIT_CONVERSION
+
+/**
+ * OvmsMetricScalar<ValueType,Unit>: numeric metric with the unit fixed at
+ *  compile time
+ *  - Get<To>() / Set<From>() convert by constant factors, an invalid unit
+ *    pair is a compile error
+ *  - the standard dynamic API (AsFloat, AsString, ... with runtime units)
+ *    is still available via the OvmsMetric interface
+ *  - usage:
+ *      OvmsMetricScalar<float, Kilometers>* m = MyMetrics.InitScalar<float, Kilometers>("x.odo");
+ *      m->Set<Miles>(100);
+ *      float km = m->Get();
+ *      float mi = m->Get<Miles>();
+ */
+template <typename ValueType, metric_unit_t Unit>
+class OvmsMetricScalar : public OvmsMetric
+  {
+  public:
+    OvmsMetricScalar(const char* name, uint16_t autostale=0)
+      : OvmsMetric(name, autostale, Unit)
+      {
+      m_value = 0;
+      }
+    virtual ~OvmsMetricScalar()
+      {
+      }
+
+  public:
+    ValueType Get(const ValueType defvalue = 0)
+      {
+      ValueType value;
+      bool defined;
+      uint32_t seq;
+      do
+        {
+        seq = ReadBegin();
+        value = m_value;
+        defined = m_defined;
+        } while (ReadRetry(seq));
+      return defined ? value : defvalue;
+      }
+
+    template <metric_unit_t To>
+    ValueType Get(const ValueType defvalue = 0)
+      {
+      return m_defined ? OvmsUnitConversion<Unit, To>::Convert(Get()) : defvalue;
+      }
+
+    void Set(ValueType value)
+      {
+      WriteBegin();
+      bool changed = (m_value != value);
+      m_value = value;
+      WriteEnd();
+      SetModified(changed);
+      }
+
+    template <metric_unit_t From>
+    void Set(ValueType value)
+      {
+      Set(OvmsUnitConversion<From, Unit>::Convert(value));
+      }
+
+    void operator=(ValueType value) { Set(value); }
+
+  public:
+    // Dynamic access (runtime unit conversion):
+    bool IsNumeric() { return true; }
+    float AsFloat(const float defvalue = 0, metric_unit_t units = Other)
+      {
+      if (!m_defined)
+        return defvalue;
+      float value = (float) Get();
+      if ((units != Other)&&(units != Unit))
+        value = UnitConvert(Unit, units, value);
+      return value;
+      }
+
+    std::string AsString(const char* defvalue = "", metric_unit_t units = Other, int precision = -1)
+      {
+      if (!m_defined)
+        return std::string(defvalue);
+      ValueType value = Get();
+      if ((units != Other)&&(units != Unit))
+        value = OvmsMetricConvertElement(Unit, units, value);
+      std::string result;
+      OvmsMetricAppendElement(result, value, precision);
+      return result;
+      }
+
+    size_t AppendTo(char* buf, size_t cap, const char* defvalue = "", metric_unit_t units = Other, int precision = -1)
+      {
+      if (!m_defined)
+        return OvmsMetricFormatString(buf, cap, defvalue);
+      ValueType value = Get();
+      if ((units != Other)&&(units != Unit))
+        value = OvmsMetricConvertElement(Unit, units, value);
+      return OvmsMetricFormatElement(buf, cap, value, precision);
+      }
+
+    void SetValue(std::string value)
+      {
+      Set((ValueType) atof(value.c_str()));
+      }
+    void operator=(std::string value) { SetValue(value); }
+
+  protected:
+    ValueType m_value;
   };
 
+/**
+ * OvmsMetricSnapshot: coherent read of a group of metrics
+ *  - Begin() records the write sequences of all metrics in the group,
+ *    Changed() tells if any of them has been written since (or is being
+ *    written right now), so the reader should read the group again
+ *  - usage:
+ *      OvmsMetricSnapshot snap({ m1, m2, ... });
+ *      do { snap.Begin(); ...read m1, m2... } while (snap.Changed());
+ *  - Changed() gives up after maxretries to guarantee progress
+ */
+class OvmsMetricSnapshot
+  {
+  public:
+    OvmsMetricSnapshot(std::initializer_list<OvmsMetric*> metrics, int maxretries = 3);
+    virtual ~OvmsMetricSnapshot();
+
+  public:
+    void Begin();
+    bool Changed();
+
+  protected:
+    std::vector<OvmsMetric*> m_metrics;
+    std::vector<uint32_t> m_seqs;
+    int m_retries;
+    int m_maxretries;
+  };
 
 typedef std::function<void(OvmsMetric*)> MetricCallback;
 
@@ -392,6 +1092,23 @@ class OvmsMetrics
         m->SetValue(value);
       return m;
       }
+    template <typename ValueType, metric_unit_t Unit>
+    OvmsMetricScalar<ValueType, Unit> *InitScalar(const char* metric, uint16_t autostale=0, ValueType value=0)
+      {
+      OvmsMetricScalar<ValueType, Unit> *m = (OvmsMetricScalar<ValueType, Unit> *)Find(metric);
+      if (m==NULL) m = new OvmsMetricScalar<ValueType, Unit>(metric, autostale);
+      m->Set(value);
+      return m;
+      }
+    template <typename ElemType>
+    OvmsMetricVector<ElemType> *InitVector(const char* metric, uint16_t autostale=0, size_t capacity=0, const char* value=NULL, metric_unit_t units = Other)
+      {
+      OvmsMetricVector<ElemType> *m = (OvmsMetricVector<ElemType> *)Find(metric);
+      if (m==NULL) m = new OvmsMetricVector<ElemType>(metric, autostale, capacity, units);
+      if (value)
+        m->SetValue(value);
+      return m;
+      }
     template <typename ElemType>
     OvmsMetricSet<ElemType> *InitSet(const char* metric, uint16_t autostale=0, const char* value=NULL, metric_unit_t units = Other)
       {
@@ -406,6 +1123,7 @@ class OvmsMetrics
     void RegisterListener(const char* caller, const char* name, MetricCallback callback);
     void DeregisterListener(const char* caller);
     void NotifyModified(OvmsMetric* metric);
+    void FlushRateLimits(event_id_t event, void* data);
 
   protected:
     MetricCallbackMap m_listeners;
@@ -41,6 +41,7 @@ static const char *TAG = "ovms-module";
 #include "esp_heap_alloc_caps.h"
 #include "ovms_module.h"
 #include "ovms_command.h"
+#include "ovms_events.h"
 
 #define MAX_TASKS 30
 #define DUMPSIZE 1000
@@ -643,6 +644,7 @@ static void module_fault(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, in
 static void module_reset(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
   {
   writer->puts("Resetting system...");
+  MyEvents.SignalEventSync("system.shutdown", NULL);
   esp_restart();
   }
 
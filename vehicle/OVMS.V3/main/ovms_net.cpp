@@ -31,7 +31,18 @@
 #include "ovms_log.h"
 static const char *TAG = "net";
 
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include "ovms.h"
 #include "ovms_net.h"
+#ifdef CONFIG_OVMS_COMP_SERVER_V2_TLS
+#include "freertos/task.h"
+#include <wolfssl/ssl.h>
+#include <wolfssl/wolfcrypt/hash.h>
+#endif // #ifdef CONFIG_OVMS_COMP_SERVER_V2_TLS
 
 OvmsNetConnection::OvmsNetConnection()
   {
@@ -66,6 +77,33 @@ int OvmsNetConnection::Socket()
   return m_sock;
   }
 
+// Enable TCP keepalive probes: first after idle seconds, then every
+// interval seconds, the connection is dropped after count failed probes.
+bool OvmsNetConnection::SetKeepAlive(int idle, int interval, int count)
+  {
+  if (m_sock < 0) return false;
+  int on = 1;
+  if (setsockopt(m_sock, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on)) != 0)
+    return false;
+#ifdef TCP_KEEPIDLE
+  setsockopt(m_sock, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle));
+  setsockopt(m_sock, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval));
+  setsockopt(m_sock, IPPROTO_TCP, TCP_KEEPCNT, &count, sizeof(count));
+#endif // #ifdef TCP_KEEPIDLE
+  return true;
+  }
+
+// Blocking writes fail after the timeout instead of waiting for a peer
+// that stopped reading.
+bool OvmsNetConnection::SetSendTimeout(int seconds)
+  {
+  if (m_sock < 0) return false;
+  struct timeval tv;
+  tv.tv_sec = seconds;
+  tv.tv_usec = 0;
+  return (setsockopt(m_sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv)) == 0);
+  }
+
 ssize_t OvmsNetConnection::Write(const void *buf, size_t nbyte)
   {
   return write(m_sock, buf, nbyte);
@@ -76,6 +114,12 @@ size_t OvmsNetConnection::Read(void *buf, size_t nbyte)
   return read(m_sock, buf, nbyte);
   }
 
+// Number of bytes that can be read without waiting for the socket
+int OvmsNetConnection::Pending()
+  {
+  return 0;
+  }
+
 
 OvmsNetTcpConnection::OvmsNetTcpConnection()
   {
@@ -90,7 +134,10 @@ OvmsNetTcpConnection::~OvmsNetTcpConnection()
   {
   }
 
-bool OvmsNetTcpConnection::Connect(const char* host, const char* service)
+// Connect to host:service. With timeoutms > 0 the connect is done non
+// blocking, and aborted after the timeout. The socket is blocking after
+// the connect in both cases.
+bool OvmsNetTcpConnection::Connect(const char* host, const char* service, int timeoutms)
   {
   // Disconnect, if necessary
   if (m_sock >= 0)
@@ -124,16 +171,417 @@ bool OvmsNetTcpConnection::Connect(const char* host, const char* service)
     return false;
     }
 
+  int flags = fcntl(m_sock, F_GETFL, 0);
+  if (timeoutms > 0)
+    fcntl(m_sock, F_SETFL, flags | O_NONBLOCK);
+
+  err = 0;
   if (connect(m_sock, res->ai_addr, res->ai_addrlen) != 0)
     {
-    ESP_LOGW(TAG, "Error: Failed to connect server %s (error: %d)",host,errno);
+    err = errno;
+    if ((timeoutms > 0) && (err == EINPROGRESS))
+      {
+      fd_set wfds;
+      FD_ZERO(&wfds);
+      FD_SET(m_sock, &wfds);
+      struct timeval timeout;
+      timeout.tv_sec = timeoutms/1000;
+      timeout.tv_usec = (timeoutms%1000)*1000;
+      int result = select(m_sock+1, NULL, &wfds, NULL, &timeout);
+      if (result == 0)
+        err = ETIMEDOUT;
+      else if (result < 0)
+        err = errno;
+      else
+        {
+        socklen_t len = sizeof(err);
+        if (getsockopt(m_sock, SOL_SOCKET, SO_ERROR, &err, &len) != 0)
+          err = errno;
+        }
+      }
+    }
+
+  if (err != 0)
+    {
+    ESP_LOGW(TAG, "Error: Failed to connect server %s (error: %d)",host,err);
     close(m_sock);
     m_sock = -1;
     freeaddrinfo(res);
     return false;
     }
 
+  if (timeoutms > 0)
+    fcntl(m_sock, F_SETFL, flags);
+
   freeaddrinfo(res);
   return true;
   }
 
+
+#ifdef CONFIG_OVMS_COMP_SERVER_V2_TLS
+
+#define TLS_TICKET_STATIC   256     // wolfSSL SESSION_TICKET_LEN
+
+static WOLFSSL_CTX* tls_ctx = NULL;
+
+// The persistent session cache contains raw wolfSSL structures, so it
+// is only valid for the firmware build that saved it:
+static const char tls_cache_build[] = OVMS_VERSION " " __DATE__ " " __TIME__;
+
+bool OvmsNetTlsConnection::TlsInit()
+  {
+  if (tls_ctx) return true;
+  wolfSSL_Init();
+  tls_ctx = wolfSSL_CTX_new(wolfTLSv1_2_client_method());
+  if (tls_ctx == NULL)
+    {
+    ESP_LOGE(TAG, "Error: TLS context allocation failed");
+    return false;
+    }
+  wolfSSL_SetIORecv(tls_ctx, &OvmsNetTlsConnection::IoRecv);
+  wolfSSL_SetIOSend(tls_ctx, &OvmsNetTlsConnection::IoSend);
+  // No CA store: the server is authenticated by the certificate pin
+  wolfSSL_CTX_set_verify(tls_ctx, SSL_VERIFY_PEER, &OvmsNetTlsConnection::Verify);
+  return true;
+  }
+
+OvmsNetTlsConnection::OvmsNetTlsConnection()
+  {
+  m_ssl = NULL;
+  m_mutex = xSemaphoreCreateMutex();
+  m_resume = true;
+  m_resumed = false;
+  m_pin_mismatch = false;
+  m_pin_legacy = false;
+  m_handshake_ms = 0;
+  m_handshake_tx = 0;
+  m_handshake_rx = 0;
+  m_tx = 0;
+  m_rx = 0;
+  }
+
+OvmsNetTlsConnection::~OvmsNetTlsConnection()
+  {
+  Disconnect();
+  vSemaphoreDelete(m_mutex);
+  }
+
+// Pin the server key: hex SHA-256 of the DER SubjectPublicKeyInfo (as shown
+// by "openssl x509 -noout -pubkey | openssl pkey -pubin -outform der |
+// openssl dgst -sha256", colons are ignored). Pins of the whole certificate
+// set by earlier builds are still accepted once, see Verify(). Empty =
+// accept any certificate, and don't resume sessions.
+void OvmsNetTlsConnection::SetPin(const std::string& pin)
+  {
+  m_pin.clear();
+  for (char c : pin)
+    {
+    if (isxdigit(c)) m_pin.push_back(tolower(c));
+    }
+  }
+
+bool OvmsNetTlsConnection::Connect(const char* host, const char* service, int timeoutms)
+  {
+  if (!OvmsNetTcpConnection::Connect(host, service, timeoutms))
+    return false;
+  if (!TlsInit())
+    {
+    OvmsNetTcpConnection::Disconnect();
+    return false;
+    }
+
+  // Bound the handshake, and later reads of incomplete records:
+  if (timeoutms > 0)
+    {
+    struct timeval timeout;
+    timeout.tv_sec = timeoutms/1000;
+    timeout.tv_usec = (timeoutms%1000)*1000;
+    setsockopt(m_sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    }
+
+  xSemaphoreTake(m_mutex, portMAX_DELAY);
+  m_ssl = wolfSSL_new(tls_ctx);
+  if (m_ssl == NULL)
+    {
+    xSemaphoreGive(m_mutex);
+    ESP_LOGE(TAG, "Error: TLS session allocation failed");
+    OvmsNetTcpConnection::Disconnect();
+    return false;
+    }
+  wolfSSL_SetIOReadCtx(m_ssl, this);
+  wolfSSL_SetIOWriteCtx(m_ssl, this);
+  wolfSSL_SetCertCbCtx(m_ssl, this);
+  wolfSSL_UseSNI(m_ssl, WOLFSSL_SNI_HOST_NAME, host, strlen(host));
+  wolfSSL_UseSessionTicket(m_ssl);
+
+  // Resume the last session with this server, if still cached. The pin
+  // is part of the ID, so only sessions verified against it are resumed:
+  std::string id(host);
+  id.append(":");
+  id.append(service);
+  id.append(":");
+  id.append(m_pin);
+  wolfSSL_SetServerID(m_ssl, (const unsigned char*)id.data(), id.length(),
+    (m_resume && !m_pin.empty()) ? 0 : 1);
+
+  m_tx = m_rx = 0;
+  m_pin_mismatch = false;
+  m_pin_legacy = false;
+  uint32_t start = xTaskGetTickCount();
+  int ret = wolfSSL_connect(m_ssl);
+  m_handshake_ms = (xTaskGetTickCount() - start) * portTICK_PERIOD_MS;
+  m_handshake_tx = m_tx;
+  m_handshake_rx = m_rx;
+  if (ret != SSL_SUCCESS)
+    {
+    int err = wolfSSL_get_error(m_ssl, ret);
+    xSemaphoreGive(m_mutex);
+    ESP_LOGW(TAG, "Error: TLS handshake with %s failed (error: %d)", host, err);
+    Disconnect();
+    return false;
+    }
+  m_resumed = wolfSSL_session_reused(m_ssl);
+  xSemaphoreGive(m_mutex);
+
+  ESP_LOGI(TAG, "TLS %s handshake with %s: %u ms, %u bytes sent, %u received",
+    m_resumed ? "resumed" : "full", host, m_handshake_ms, m_handshake_tx, m_handshake_rx);
+  return true;
+  }
+
+void OvmsNetTlsConnection::Disconnect()
+  {
+  xSemaphoreTake(m_mutex, portMAX_DELAY);
+  if (m_ssl)
+    {
+    // No close_notify: the connection is usually dead already, and the
+    // session stays resumable
+    wolfSSL_free(m_ssl);
+    m_ssl = NULL;
+    }
+  xSemaphoreGive(m_mutex);
+  OvmsNetTcpConnection::Disconnect();
+  }
+
+ssize_t OvmsNetTlsConnection::Write(const void *buf, size_t nbyte)
+  {
+  xSemaphoreTake(m_mutex, portMAX_DELAY);
+  int n = (m_ssl) ? wolfSSL_write(m_ssl, buf, nbyte) : -1;
+  xSemaphoreGive(m_mutex);
+  return (n > 0) ? n : -1;
+  }
+
+size_t OvmsNetTlsConnection::Read(void *buf, size_t nbyte)
+  {
+  xSemaphoreTake(m_mutex, portMAX_DELAY);
+  int n = (m_ssl) ? wolfSSL_read(m_ssl, buf, nbyte) : -1;
+  if ((n < 0) && (wolfSSL_get_error(m_ssl, n) == SSL_ERROR_ZERO_RETURN))
+    n = 0;  // close_notify
+  xSemaphoreGive(m_mutex);
+  return n;
+  }
+
+int OvmsNetTlsConnection::Pending()
+  {
+  xSemaphoreTake(m_mutex, portMAX_DELAY);
+  int n = (m_ssl) ? wolfSSL_pending(m_ssl) : 0;
+  xSemaphoreGive(m_mutex);
+  return n;
+  }
+
+int OvmsNetTlsConnection::IoRecv(WOLFSSL* ssl, char* buf, int sz, void* ctx)
+  {
+  OvmsNetTlsConnection* me = (OvmsNetTlsConnection*)ctx;
+  int n = recv(me->m_sock, buf, sz, 0);
+  if (n > 0)
+    {
+    me->m_rx += n;
+    return n;
+    }
+  if (n == 0) return WOLFSSL_CBIO_ERR_CONN_CLOSE;
+  switch (errno)
+    {
+    case EAGAIN:      return WOLFSSL_CBIO_ERR_TIMEOUT;
+    case EINTR:       return WOLFSSL_CBIO_ERR_ISR;
+    case ECONNRESET:  return WOLFSSL_CBIO_ERR_CONN_RST;
+    default:          return WOLFSSL_CBIO_ERR_GENERAL;
+    }
+  }
+
+int OvmsNetTlsConnection::IoSend(WOLFSSL* ssl, char* buf, int sz, void* ctx)
+  {
+  OvmsNetTlsConnection* me = (OvmsNetTlsConnection*)ctx;
+  int n = send(me->m_sock, buf, sz, 0);
+  if (n > 0)
+    {
+    me->m_tx += n;
+    return n;
+    }
+  switch (errno)
+    {
+    case EINTR:       return WOLFSSL_CBIO_ERR_ISR;
+    case ECONNRESET:  return WOLFSSL_CBIO_ERR_CONN_RST;
+    case EPIPE:       return WOLFSSL_CBIO_ERR_CONN_CLOSE;
+    default:          return WOLFSSL_CBIO_ERR_GENERAL;
+    }
+  }
+
+// Read a DER element header at p, return the content and advance p past
+// the element. Only single byte tags are needed for certificates.
+static bool DerElement(const byte*& p, const byte* end, byte& tag, const byte*& content, size_t& len)
+  {
+  if (end - p < 2) return false;
+  tag = *p++;
+  len = *p++;
+  if (len & 0x80)
+    {
+    int n = len & 0x7f;
+    if ((n < 1) || (n > 3) || (end - p < n)) return false;
+    for (len = 0; n > 0; n--)
+      len = (len << 8) | *p++;
+    }
+  if ((size_t)(end - p) < len) return false;
+  content = p;
+  p += len;
+  return true;
+  }
+
+// Find the SubjectPublicKeyInfo in a DER certificate: the seventh element
+// of the TBSCertificate, counting the optional version.
+static bool DerSpki(const byte* der, size_t derlen, const byte*& spki, size_t& spkilen)
+  {
+  const byte* p = der;
+  const byte* end = der + derlen;
+  const byte* content;
+  size_t len;
+  byte tag;
+  if (!DerElement(p, end, tag, content, len) || (tag != 0x30)) return false;  // Certificate
+  p = content; end = content + len;
+  if (!DerElement(p, end, tag, content, len) || (tag != 0x30)) return false;  // TBSCertificate
+  p = content; end = content + len;
+  if (!DerElement(p, end, tag, content, len)) return false;
+  if (tag == 0xa0)                                                            // [0] version
+    {
+    if (!DerElement(p, end, tag, content, len)) return false;
+    }
+  for (int k=0; k<4; k++)   // signature, issuer, validity, subject
+    {
+    if (!DerElement(p, end, tag, content, len)) return false;
+    }
+  spki = p;
+  if (!DerElement(p, end, tag, content, len) || (tag != 0x30)) return false;
+  spkilen = p - spki;
+  return true;
+  }
+
+static bool Sha256Hex(const byte* data, size_t len, char* hex)
+  {
+  byte hash[SHA256_DIGEST_SIZE];
+  if (wc_Sha256Hash(data, len, hash) != 0)
+    return false;
+  for (int k=0; k<SHA256_DIGEST_SIZE; k++)
+    sprintf(hex+k*2, "%02x", hash[k]);
+  return true;
+  }
+
+// Called by wolfSSL on a full handshake, as there is no CA to verify the
+// certificate chain. Resumed sessions were verified against the same pin
+// when established, see the server ID in Connect().
+int OvmsNetTlsConnection::Verify(int preverify, WOLFSSL_X509_STORE_CTX* store)
+  {
+  OvmsNetTlsConnection* me = (OvmsNetTlsConnection*)store->userCtx;
+  if ((me == NULL) || (store->certs == NULL) || (store->totalCerts < 1))
+    return 0;
+
+  // certs[0] is the server certificate:
+  const byte* spki;
+  size_t spkilen;
+  char hex[SHA256_DIGEST_SIZE*2+1];
+  if (!DerSpki(store->certs[0].buffer, store->certs[0].length, spki, spkilen) ||
+      !Sha256Hex(spki, spkilen, hex))
+    {
+    ESP_LOGE(TAG, "Error: TLS server certificate cannot be parsed");
+    return 0;
+    }
+  me->m_fingerprint = hex;
+
+  if (me->m_pin.empty())
+    {
+    ESP_LOGW(TAG, "TLS server key not pinned yet, SPKI SHA-256: %s", hex);
+    return 1;
+    }
+  else if (me->m_pin == me->m_fingerprint)
+    {
+    return 1;
+    }
+
+  char cert[SHA256_DIGEST_SIZE*2+1];
+  if (Sha256Hex(store->certs[0].buffer, store->certs[0].length, cert) && (me->m_pin == cert))
+    {
+    // Certificate pin of an earlier build: still the same server
+    me->m_pin_legacy = true;
+    return 1;
+    }
+  ESP_LOGE(TAG, "Error: TLS server key does not match the pin, SPKI SHA-256: %s", hex);
+  me->m_pin_mismatch = true;
+  return 0;
+  }
+
+// Session tickets too large for the static buffer are kept on the heap
+// by wolfSSL, those sessions can't be restored from a saved cache.
+bool OvmsNetTlsConnection::SessionPersistable()
+  {
+  xSemaphoreTake(m_mutex, portMAX_DELAY);
+  bool ok = false;
+  if (m_ssl)
+    {
+    byte* ticket = new byte[TLS_TICKET_STATIC+1];
+    word32 len = TLS_TICKET_STATIC+1;
+    ok = (wolfSSL_get_SessionTicket(m_ssl, ticket, &len) == SSL_SUCCESS) &&
+         (len <= TLS_TICKET_STATIC);
+    delete [] ticket;
+    }
+  xSemaphoreGive(m_mutex);
+  return ok;
+  }
+
+bool OvmsNetTlsConnection::SaveSessionCache(const char* path)
+  {
+  if (!TlsInit()) return false;
+  int size = wolfSSL_get_session_cache_memsize();
+  char* mem = new char[size];
+  bool ok = false;
+  if (wolfSSL_memsave_session_cache(mem, size) == SSL_SUCCESS)
+    {
+    FILE* f = fopen(path, "w");
+    if (f)
+      {
+      ok = (fwrite(tls_cache_build, sizeof(tls_cache_build), 1, f) == 1) &&
+           (fwrite(mem, size, 1, f) == 1);
+      ok = (fclose(f) == 0) && ok;
+      }
+    }
+  delete [] mem;
+  if (!ok)
+    ESP_LOGW(TAG, "Error: TLS session cache could not be saved to %s", path);
+  return ok;
+  }
+
+bool OvmsNetTlsConnection::LoadSessionCache(const char* path)
+  {
+  if (!TlsInit()) return false;
+  FILE* f = fopen(path, "r");
+  if (f == NULL) return false;
+  int size = wolfSSL_get_session_cache_memsize();
+  char* mem = new char[size];
+  char build[sizeof(tls_cache_build)];
+  bool ok = (fread(build, sizeof(build), 1, f) == 1) &&
+            (memcmp(build, tls_cache_build, sizeof(build)) == 0) &&
+            (fread(mem, size, 1, f) == 1) &&
+            (wolfSSL_memrestore_session_cache(mem, size) == SSL_SUCCESS);
+  fclose(f);
+  delete [] mem;
+  ESP_LOGI(TAG, "TLS session cache %s from %s", ok ? "restored" : "not restored", path);
+  return ok;
+  }
+
+#endif // #ifdef CONFIG_OVMS_COMP_SERVER_V2_TLS
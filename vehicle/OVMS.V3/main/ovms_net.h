@@ -32,12 +32,20 @@
 #define __OVMS_NET_H__
 
 #include <stdint.h>
+#include <string>
+#include "sdkconfig.h"
 #include "lwip/err.h"
 #include "lwip/sockets.h"
 #include "lwip/sys.h"
 #include "lwip/netdb.h"
 #include "lwip/dns.h"
 #include <sys/socket.h>
+#ifdef CONFIG_OVMS_COMP_SERVER_V2_TLS
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+struct WOLFSSL;
+struct WOLFSSL_X509_STORE_CTX;
+#endif // #ifdef CONFIG_OVMS_COMP_SERVER_V2_TLS
 
 class OvmsNetConnection
   {
@@ -49,10 +57,13 @@ class OvmsNetConnection
     virtual bool IsOpen();
     virtual void Disconnect();
     virtual int Socket();
+    bool SetKeepAlive(int idle, int interval, int count);
+    bool SetSendTimeout(int seconds);
 
   public:
     virtual ssize_t Write(const void *buf, size_t nbyte);
     virtual size_t Read(void *buf, size_t nbyte);
+    virtual int Pending();
 
   protected:
     int m_sock;
@@ -66,7 +77,62 @@ class OvmsNetTcpConnection : public OvmsNetConnection
     virtual ~OvmsNetTcpConnection();
 
   public:
-    virtual bool Connect(const char* host, const char* service);
+    virtual bool Connect(const char* host, const char* service, int timeoutms = 0);
   };
 
+#ifdef CONFIG_OVMS_COMP_SERVER_V2_TLS
+
+// TLS 1.2 client connection. The server is authenticated by pinning its
+// public key: the SHA-256 of the certificate's SubjectPublicKeyInfo must
+// match the pin, so certificate renewals keeping the key are accepted.
+// Without a pin, any certificate is accepted on a full handshake, and the
+// caller is expected to pin m_fingerprint (trust on first use).
+// Sessions are cached per host:service:pin, so reconnects resume the
+// session (ticket or session ID) instead of a full handshake, but only if
+// it was established with the current pin.
+class OvmsNetTlsConnection : public OvmsNetTcpConnection
+  {
+  public:
+    OvmsNetTlsConnection();
+    virtual ~OvmsNetTlsConnection();
+
+  public:
+    virtual bool Connect(const char* host, const char* service, int timeoutms = 0);
+    virtual void Disconnect();
+    virtual ssize_t Write(const void *buf, size_t nbyte);
+    virtual size_t Read(void *buf, size_t nbyte);
+    virtual int Pending();
+
+  public:
+    void SetPin(const std::string& pin);
+    bool SessionPersistable();
+    static bool SaveSessionCache(const char* path);
+    static bool LoadSessionCache(const char* path);
+
+  public:
+    bool m_resume;                  // Resume the cached session, if any
+    std::string m_fingerprint;      // Server public key SHA-256 (hex), from the last full handshake
+    bool m_pin_mismatch;            // Last full handshake failed on the pin
+    bool m_pin_legacy;              // ...passed on a certificate pin, to be replaced by m_fingerprint
+    bool m_resumed;                 // Last handshake resumed a cached session
+    uint32_t m_handshake_ms;        // Last handshake duration
+    uint32_t m_handshake_tx;        // ...bytes sent
+    uint32_t m_handshake_rx;        // ...bytes received
+    uint32_t m_tx;                  // Bytes sent on the wire since connect
+    uint32_t m_rx;                  // Bytes received on the wire since connect
+
+  protected:
+    static bool TlsInit();
+    static int IoRecv(WOLFSSL* ssl, char* buf, int sz, void* ctx);
+    static int IoSend(WOLFSSL* ssl, char* buf, int sz, void* ctx);
+    static int Verify(int preverify, WOLFSSL_X509_STORE_CTX* store);
+
+  protected:
+    WOLFSSL* m_ssl;
+    std::string m_pin;
+    SemaphoreHandle_t m_mutex;      // wolfSSL objects are not thread safe
+  };
+
+#endif // #ifdef CONFIG_OVMS_COMP_SERVER_V2_TLS
+
 #endif //#ifndef __OVMS_NET_H__
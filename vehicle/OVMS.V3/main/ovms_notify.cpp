@@ -34,11 +34,17 @@ static const char *TAG = "notify";
 #include <stdlib.h>
 #include <stdio.h>
 #include <sstream>
+#include <set>
+#include <sys/stat.h>
 #include "ovms.h"
 #include "ovms_notify.h"
 #include "ovms_command.h"
+#include "ovms_config.h"
 #include "ovms_events.h"
+#include "ovms_scheduler.h"
 #include "buffered_shell.h"
+#include "string_writer.h"
+#include "xtensa/hal.h"
 #include "string.h"
 
 using namespace std;
@@ -48,6 +54,14 @@ using namespace std;
 
 OvmsNotify       MyNotify       __attribute__ ((init_priority (1820)));
 
+// The pool slots fit all entry types:
+static constexpr size_t notify_max(size_t a, size_t b) { return (a > b) ? a : b; }
+#define NOTIFY_POOL_SLOT notify_max(sizeof(OvmsNotifyEntryString), \
+  notify_max(sizeof(OvmsNotifyEntryCommand), sizeof(OvmsNotifyEntryBatch)))
+static uint64_t notify_pool_memory[NOTIFY_POOL_SIZE * ((NOTIFY_POOL_SLOT + 7) / 8)];
+
+static const char* const notify_overflow_names[] = { "spill", "drop", "reject" };
+
 void notify_trace(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
   {
   if (strcmp(cmd->GetName(),"on")==0)
@@ -74,16 +88,57 @@ void notify_status(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc
     for (OvmsNotifyTypeMap_t::iterator itm=MyNotify.m_types.begin(); itm!=MyNotify.m_types.end(); ++itm)
       {
       OvmsNotifyType* mt = itm->second;
-      writer->printf("  %s: %d entries\n",
-        mt->m_name, mt->m_entries.size());
-      for (NotifyEntryMap_t::iterator ite=mt->m_entries.begin(); ite!=mt->m_entries.end(); ++ite)
+      // Collect the listing locked, output it unlocked:
+      StringWriter list;
+      xSemaphoreTake(mt->m_entries_mutex, portMAX_DELAY);
+      list.printf("  %s: %d entries, ring capacity %d, %d beyond the ring span\n",
+        mt->m_name, mt->m_entries.size(), mt->m_entries.capacity(), mt->m_entries.outside());
+      xSemaphoreTake(mt->m_spool_mutex, portMAX_DELAY);
+      OvmsNotifySpool* sp = mt->m_spool;
+      if (sp)
+        {
+        list.printf("    spool %s: %u paged out, %u queued, %u segments, %u bytes (%u spooled, %u paged in, %u replayed)\n",
+          sp->Dir().c_str(), sp->Backlog(), mt->m_spool_queue.size(), sp->Segments(), sp->Size(),
+          sp->m_stat_spooled, sp->m_stat_paged, sp->m_stat_replayed);
+        }
+      xSemaphoreGive(mt->m_spool_mutex);
+      for (OvmsNotifyEntry* e = mt->m_entries.First(); e; e = mt->m_entries.Next(e->m_id))
         {
-        OvmsNotifyEntry* e = ite->second;
-        writer->printf("    %d: [%d pending] %s\n",
-          ite->first, e->m_readers.count(), e->GetValue().c_str());
+        OvmsNotifyEntryBatch* b = e->AsBatch();
+        if (b)
+          list.printf("    %d: [%d pending] batch of %u records, %u bytes\n",
+            e->m_id, e->m_readers.count(), b->m_count, b->m_size);
+        else if (!e->IsRendered())
+          {
+          // Don't render just for the status display:
+          OvmsNotifyEntryCommand* ec = (OvmsNotifyEntryCommand*)e;
+          list.printf("    %d: [%d pending] (not rendered) %s\n",
+            e->m_id, e->m_readers.count(), ec->m_cmd ? ec->m_cmd : "<producer>");
+          }
+        else
+          list.printf("    %d: [%d pending] %s\n",
+            e->m_id, e->m_readers.count(), e->GetValue().c_str());
         }
+      xSemaphoreGive(mt->m_entries_mutex);
+      writer->write(list.data(), list.size());
       }
     }
+
+  OvmsSlabPool& pool = MyNotify.m_pool;
+  writer->printf("Entry pool: %u/%u slots of %u bytes used, peak %u, %u allocated\n",
+    pool.m_used, pool.Capacity(), pool.SlotSize(), pool.m_peak, pool.m_stat_allocs);
+  writer->printf("  overflow %s: %u spilled to heap, %u dropped, %u rejected\n",
+    notify_overflow_names[MyNotify.m_pool_overflow],
+    MyNotify.m_stat_spilled, MyNotify.m_stat_dropped, MyNotify.m_stat_rejected);
+
+  if (MyNotify.m_stat_lazy > 0)
+    {
+    writer->printf("Lazy entries: %u queued, %u rendered, %u us/render\n",
+      MyNotify.m_stat_lazy, MyNotify.m_stat_rendered,
+      MyNotify.m_stat_rendered
+        ? (uint32_t)(MyNotify.m_stat_render_cycles / MyNotify.m_stat_rendered / CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ)
+        : 0);
+    }
   }
 
 void notify_raise(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
@@ -104,12 +159,27 @@ void notify_raise(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc,
 // MarkRead function is called. The framework can test IsAllRead() to
 // see if all readers have processed the entry and housekeep cleanup
 // appropriately.
+//
+// Entries are allocated from the MyNotify slab pool, to keep alert storms
+// from fragmenting the heap. See OvmsNotify::PoolReserve() for the
+// handling of an exhausted pool.
+
+void* OvmsNotifyEntry::operator new(size_t size)
+  {
+  return MyNotify.PoolAlloc(size);
+  }
+
+void OvmsNotifyEntry::operator delete(void* p)
+  {
+  MyNotify.PoolFree(p);
+  }
 
 OvmsNotifyEntry::OvmsNotifyEntry()
   {
   m_readers.reset();
   m_id = 0;
   m_created = monotonictime;
+  m_spool_seq = 0;
   }
 
 OvmsNotifyEntry::~OvmsNotifyEntry()
@@ -133,40 +203,78 @@ const std::string OvmsNotifyEntry::GetValue()
 
 ////////////////////////////////////////////////////////////////////////
 // OvmsNotifyEntryString is the notification entry for a constant
-// string type.
+// string type. Short texts are stored inline, so a pooled entry needs
+// no heap allocation.
 
 OvmsNotifyEntryString::OvmsNotifyEntryString(const char* value)
   {
-  m_value = std::string(value);
+  SetValue(value, strlen(value));
+  }
+
+OvmsNotifyEntryString::OvmsNotifyEntryString(const char* value, size_t length)
+  {
+  SetValue(value, length);
   }
 
 OvmsNotifyEntryString::~OvmsNotifyEntryString()
   {
+  if (m_value != m_inline)
+    free(m_value);
+  }
+
+void OvmsNotifyEntryString::SetValue(const char* value, size_t length)
+  {
+  m_value = m_inline;
+  if (length >= NOTIFY_INLINE_SIZE)
+    {
+    m_value = (char*)malloc(length+1);
+    if (m_value == NULL)
+      {
+      ESP_LOGE(TAG, "String entry: out of memory, text truncated");
+      m_value = m_inline;
+      length = NOTIFY_INLINE_SIZE-1;
+      }
+    }
+  memcpy(m_value, value, length);
+  m_value[length] = 0;
+  m_length = length;
   }
 
 const std::string OvmsNotifyEntryString::GetValue()
   {
-  return m_value;
+  return std::string(m_value, m_length);
   }
 
 ////////////////////////////////////////////////////////////////////////
 // OvmsNotifyEntryCommand is the notification entry for a command
-// callback type.
+// callback type. The command (or producer) is executed when the first
+// reader fetches the value, so entries that are never read or get
+// dropped cost no shell execution, and readers being offline don't
+// hold rendered output. Note the value reflects the state at that time.
 
 OvmsNotifyEntryCommand::OvmsNotifyEntryCommand(int verbosity, const char* cmd)
   {
+  m_verbosity = verbosity;
   m_cmd = new char[strlen(cmd)+1];
   strcpy(m_cmd,cmd);
-  
-  BufferedShell* bs = new BufferedShell(false, verbosity);
-  bs->ProcessChars(m_cmd, strlen(m_cmd));
-  bs->ProcessChar('\n');
-  bs->Dump(m_value);
-  delete bs;
+  m_caller = NULL;
+  m_rendered = false;
+  }
+
+OvmsNotifyEntryCommand::OvmsNotifyEntryCommand(int verbosity, OvmsNotifyProducer_t producer, const char* caller)
+  {
+  m_verbosity = verbosity;
+  m_cmd = NULL;
+  m_producer = producer;
+  m_caller = caller;
+  m_rendered = false;
   }
 
 OvmsNotifyEntryCommand::~OvmsNotifyEntryCommand()
   {
+  // Wait for a render in progress, see OvmsNotify::ReleaseProducers():
+  xSemaphoreTakeRecursive(MyNotify.m_render_mutex, portMAX_DELAY);
+  xSemaphoreGiveRecursive(MyNotify.m_render_mutex);
   if (m_cmd)
     {
     delete [] m_cmd;
@@ -176,29 +284,210 @@ OvmsNotifyEntryCommand::~OvmsNotifyEntryCommand()
 
 const std::string OvmsNotifyEntryCommand::GetValue()
   {
+  if (!m_rendered)
+    Render();
   return m_value;
   }
 
+void OvmsNotifyEntryCommand::Render()
+  {
+  xSemaphoreTakeRecursive(MyNotify.m_render_mutex, portMAX_DELAY);
+  if (!m_rendered)
+    {
+    uint32_t start = xthal_get_ccount();
+    if (m_cmd)
+      {
+      BufferedShell* bs = new BufferedShell(false, m_verbosity);
+      bs->ProcessChars(m_cmd, strlen(m_cmd));
+      bs->ProcessChar('\n');
+      bs->Dump(m_value);
+      delete bs;
+      delete [] m_cmd;
+      m_cmd = NULL;
+      }
+    else if (m_producer)
+      {
+      StringWriter writer;
+      m_producer(m_verbosity, &writer);
+      m_value.swap(writer);
+      m_producer = nullptr;
+      }
+    m_rendered = true;
+    MyNotify.m_stat_rendered++;
+    MyNotify.m_stat_render_cycles += xthal_get_ccount() - start;
+    }
+  xSemaphoreGiveRecursive(MyNotify.m_render_mutex);
+  }
+
+////////////////////////////////////////////////////////////////////////
+// OvmsNotifyEntryBatch is the notification entry for a batch of data
+// records. The arena grows while records are appended, and is shrunk
+// to fit when the batch is queued.
+
+OvmsNotifyEntryBatch::OvmsNotifyEntryBatch(size_t capacity)
+  {
+  m_capacity = capacity;
+  m_arena = (char*)malloc(m_capacity);
+  if (m_arena == NULL) m_capacity = 0;
+  m_size = 0;
+  m_count = 0;
+  m_maxlen = 0;
+  m_nacked = 0;
+  }
+
+OvmsNotifyEntryBatch::~OvmsNotifyEntryBatch()
+  {
+  if (m_arena)
+    {
+    free(m_arena);
+    m_arena = NULL;
+    }
+  }
+
+// Append a record, up to the first line end (NotifyString() does not batch
+// multi-line texts). Returns false if out of memory.
+bool OvmsNotifyEntryBatch::Append(const char* record, size_t len)
+  {
+  const char* eol = (const char*)memchr(record, '\n', len);
+  if (eol) len = eol - record;
+
+  if (m_size + len + 1 > m_capacity)
+    {
+    size_t capacity = (m_capacity > 0) ? m_capacity : NOTIFY_BATCH_ARENA;
+    while (m_size + len + 1 > capacity)
+      capacity *= 2;
+    char* arena = (char*)realloc(m_arena, capacity);
+    if (arena == NULL)
+      {
+      ESP_LOGE(TAG, "Batch: out of memory, record dropped");
+      return false;
+      }
+    m_arena = arena;
+    m_capacity = capacity;
+    }
+  memcpy(m_arena + m_size, record, len);
+  m_size += len;
+  m_arena[m_size++] = '\n';
+  m_count++;
+  if (len > m_maxlen) m_maxlen = len;
+  return true;
+  }
+
+// Iterate the records: start with pos=0, record is not NUL terminated.
+bool OvmsNotifyEntryBatch::NextRecord(size_t& pos, const char*& record, size_t& len)
+  {
+  if (pos >= m_size)
+    return false;
+  record = m_arena + pos;
+  const char* eol = (const char*)memchr(record, '\n', m_size - pos);
+  len = eol - record;
+  pos += len + 1;
+  return true;
+  }
+
+void OvmsNotifyEntryBatch::Seal()
+  {
+  if ((m_size > 0) && (m_size < m_capacity))
+    {
+    char* arena = (char*)realloc(m_arena, m_size);
+    if (arena)
+      {
+      m_arena = arena;
+      m_capacity = m_size;
+      }
+    }
+  }
+
+// Readers acknowledging single records (V2 historical data): returns true
+// once all records have been acknowledged.
+bool OvmsNotifyEntryBatch::AckRecord(uint32_t id)
+  {
+  if ((id <= m_id) || (id > m_id + m_count))
+    return false;
+  if (m_acked.empty())
+    m_acked.resize(m_count, false);
+  if (!m_acked[id - m_id - 1])
+    {
+    m_acked[id - m_id - 1] = true;
+    m_nacked++;
+    }
+  return (m_nacked == m_count);
+  }
+
+const std::string OvmsNotifyEntryBatch::GetValue()
+  {
+  if (m_size == 0)
+    return std::string("");
+  return std::string(m_arena, m_size - 1);
+  }
+
 ////////////////////////////////////////////////////////////////////////
 // OvmsNotifyType is the container for an ordered list of
-// OvmsNotifyEntry objects (being the notification data queued)
+// OvmsNotifyEntry objects (being the notification data queued), indexed
+// by ID in a ring. The ring spans from the oldest to the newest entry,
+// so it only grows while old entries stay unread.
+//
+// With a spool attached, the RAM list is limited to m_spool_ram entries:
+// further entries are paged out to the spool, and paged back in order
+// by FirstUnreadEntry(). Types configured to be always spooled are
+// written through, so they survive a restart.
+//
+// The ring, the entry reader bits and the ID counter are shared by the
+// notifying tasks, the reader tasks and the scheduler worker, and guarded
+// by m_entries_mutex. It is not held while rendering, doing spool I/O or
+// calling readers. Entries are removed from the ring (Unlink()) with the
+// mutex held, and deleted (Release()) after giving it. The lock order is
+// m_entries_mutex before m_spool_mutex.
+//
+// Spool writes are done by SpoolWrite() on the scheduler worker task, so
+// the notifying task (i.e. a vehicle or CAN task) neither renders entries
+// nor waits for the file system. Entries to page out are not added to the
+// RAM list, the writer owns them. Entries written through stay in the RAM
+// list, Release() leaves deleting them to the writer while they're queued.
 
 OvmsNotifyType::OvmsNotifyType(const char* name)
   {
   m_name = name;
   m_nextid = 1;
+  m_entries_mutex = xSemaphoreCreateMutex();
+  memset(m_fetched, 0, sizeof(m_fetched));
+  m_spool = NULL;
+  m_spool_ram = NOTIFY_SPOOL_RAM;
+  m_spool_always = false;
+  m_spool_mutex = xSemaphoreCreateMutex();
+  m_spool_pageouts = 0;
+  m_spool_writer = xSemaphoreCreateMutex();
+  m_batch_window = 0;
+  m_batch = NULL;
+  m_batch_mutex = xSemaphoreCreateMutex();
   }
 
 OvmsNotifyType::~OvmsNotifyType()
   {
+  SpoolClose();
   }
 
 uint32_t OvmsNotifyType::QueueEntry(OvmsNotifyEntry* entry)
   {
+  xSemaphoreTake(m_entries_mutex, portMAX_DELAY);
   uint32_t id = m_nextid++;
+  OvmsNotifyEntryBatch* batch = entry->AsBatch();
+  if (batch)
+    m_nextid += batch->m_count;   // Reserve the record IDs
 
   entry->m_id = id;
-  m_entries[id] = entry;
+  // Hold the entry while notifying, so a reader task cannot release it
+  // meanwhile:
+  entry->m_readers.set(NOTIFY_READER_QUEUEING);
+  bool pageout = SpoolPageout();
+  if (!pageout && !m_entries.Insert(id, entry))
+    {
+    xSemaphoreGive(m_entries_mutex);
+    ESP_LOGE(TAG, "Cannot queue type %s id %d: out of memory", m_name, id);
+    delete entry;
+    return 0;
+    }
+  xSemaphoreGive(m_entries_mutex);
 
   std::string event("notify.");
   event.append(m_name);
@@ -207,71 +496,523 @@ uint32_t OvmsNotifyType::QueueEntry(OvmsNotifyEntry* entry)
   // Dispatch the callbacks...
   MyNotify.NotifyReaders(this, entry);
 
-  // Check if we can cleanup...
-  Cleanup(entry);
+  // Drop the hold, check if we can cleanup, else spool...
+  bool release;
+  xSemaphoreTake(m_entries_mutex, portMAX_DELAY);
+  entry->m_readers.reset(NOTIFY_READER_QUEUEING);
+  if (pageout)
+    release = entry->IsAllRead();
+  else
+    release = Unlink(entry);
+  if (!release && (pageout || m_spool))
+    release = !SpoolEntry(entry, pageout);
+  xSemaphoreGive(m_entries_mutex);
+  if (release)
+    Release(entry);
 
   return id;
   }
 
 uint32_t OvmsNotifyType::AllocateNextID()
   {
-  return m_nextid++;
+  xSemaphoreTake(m_entries_mutex, portMAX_DELAY);
+  uint32_t id = m_nextid++;
+  xSemaphoreGive(m_entries_mutex);
+  return id;
   }
 
 void OvmsNotifyType::ClearReader(size_t reader)
   {
-  if (m_entries.size() > 0)
+  std::list<OvmsNotifyEntry*> done;
+  xSemaphoreTake(m_entries_mutex, portMAX_DELAY);
+  for (OvmsNotifyEntry* e = m_entries.First(); e; )
     {
-    for (NotifyEntryMap_t::iterator ite=m_entries.begin(); ite!=m_entries.end(); )
-      {
-      OvmsNotifyEntry* e = ite->second;
-      ++ite;
-      e->m_readers.reset(reader);
-      Cleanup(e);
-      }
+    uint32_t id = e->m_id;
+    e->m_readers.reset(reader);
+    if (Unlink(e))
+      done.push_back(e);
+    e = m_entries.Next(id);
     }
+  xSemaphoreGive(m_entries_mutex);
+  for (OvmsNotifyEntry* e : done)
+    Release(e);
   }
 
+// The reader holds the entry returned until it marks it read, it must not
+// be dropped before (see DropOldest()).
 OvmsNotifyEntry* OvmsNotifyType::FirstUnreadEntry(size_t reader, uint32_t floor)
   {
-  for (NotifyEntryMap_t::iterator ite=m_entries.begin(); ite!=m_entries.end(); ++ite)
+  while (1)
     {
-    OvmsNotifyEntry* e = ite->second;
-    if ((!e->IsRead(reader))&&(e->m_id > floor))
+    OvmsNotifyEntryBatch* expanded = NULL;
+    bool release = false;
+    xSemaphoreTake(m_entries_mutex, portMAX_DELAY);
+    for (OvmsNotifyEntry* e = m_entries.Next(floor); e; e = m_entries.Next(e->m_id))
+      {
+      if (e->IsRead(reader))
+        continue;
+      OvmsNotifyEntryBatch* b = e->AsBatch();
+      if (b && !MyNotify.m_batch_readers[reader])
+        {
+        release = Expand(b);
+        expanded = b;
+        break;
+        }
+      if (e->m_id > m_fetched[reader])
+        m_fetched[reader] = e->m_id;
+      xSemaphoreGive(m_entries_mutex);
       return e;
+      }
+    // Nothing in RAM, continue with the spooled entries:
+    if (!expanded && !m_entries.empty() && (m_entries.LastId() > floor))
+      floor = m_entries.LastId();
+    xSemaphoreGive(m_entries_mutex);
+    if (release)
+      Release(expanded);
+    if (expanded)
+      continue;
+    if (!PageIn())
+      return NULL;
     }
-  return NULL;
   }
 
+// Find an entry by ID, for a batch record ID this is the batch.
 OvmsNotifyEntry* OvmsNotifyType::FindEntry(uint32_t id)
   {
-  auto k = m_entries.find(id);
-  if (k == m_entries.end())
-    return NULL;
-  else
-    return k->second;
+  xSemaphoreTake(m_entries_mutex, portMAX_DELAY);
+  OvmsNotifyEntry* e = m_entries.Floor(id);
+  if (e && (e->m_id != id))
+    {
+    OvmsNotifyEntryBatch* b = e->AsBatch();
+    if (!b || (id > b->m_id + b->m_count))
+      e = NULL;
+    }
+  xSemaphoreGive(m_entries_mutex);
+  return e;
   }
 
 void OvmsNotifyType::MarkRead(size_t reader, OvmsNotifyEntry* entry)
   {
+  xSemaphoreTake(m_entries_mutex, portMAX_DELAY);
   entry->m_readers.reset(reader);
-  Cleanup(entry);
+  bool release = Unlink(entry);
+  xSemaphoreGive(m_entries_mutex);
+  if (release)
+    Release(entry);
+  }
+
+// Drop the oldest unread entry held in the pool that no reader is working
+// on. Entries a reader has fetched and not marked read yet are kept: the
+// reader may be sending them, or waiting for their ACK (V2 "data").
+bool OvmsNotifyType::DropOldest()
+  {
+  OvmsNotifyEntry* dropped = NULL;
+  xSemaphoreTake(m_entries_mutex, portMAX_DELAY);
+  for (OvmsNotifyEntry* e = m_entries.First(); e; e = m_entries.Next(e->m_id))
+    {
+    if (MyNotify.m_pool.Owns(e) && !InUse(e))
+      {
+      e->m_readers.reset();
+      if (Unlink(e))
+        dropped = e;
+      break;
+      }
+    }
+  xSemaphoreGive(m_entries_mutex);
+  if (dropped == NULL)
+    return false;
+  if (MyNotify.m_trace)
+    ESP_LOGI(TAG,"Dropped type %s id %d",m_name,dropped->m_id);
+  Release(dropped);
+  return true;
+  }
+
+// Creation time of the oldest entry in RAM, false if there is none
+bool OvmsNotifyType::OldestCreated(uint32_t& created)
+  {
+  xSemaphoreTake(m_entries_mutex, portMAX_DELAY);
+  OvmsNotifyEntry* e = m_entries.First();
+  if (e)
+    created = e->m_created;
+  xSemaphoreGive(m_entries_mutex);
+  return (e != NULL);
+  }
+
+// An entry is in use if it is being queued, or a pending reader has
+// fetched it. Call with the entries mutex held.
+bool OvmsNotifyType::InUse(OvmsNotifyEntry* entry)
+  {
+  if (entry->m_readers[NOTIFY_READER_QUEUEING])
+    return true;
+  for (size_t reader = 1; reader < NOTIFY_MAX_READERS; reader++)
+    {
+    if (entry->m_readers[reader] && (m_fetched[reader] >= entry->m_id))
+      return true;
+    }
+  return false;
   }
 
 void OvmsNotifyType::Cleanup(OvmsNotifyEntry* entry)
   {
-  if (entry->IsAllRead())
+  xSemaphoreTake(m_entries_mutex, portMAX_DELAY);
+  bool release = Unlink(entry);
+  xSemaphoreGive(m_entries_mutex);
+  if (release)
+    Release(entry);
+  }
+
+// Remove an entry read by all readers from the ring, call with the entries
+// mutex held. Returns true if the caller is to Release() the entry: this
+// is true for one caller only, as it must have been in the ring.
+bool OvmsNotifyType::Unlink(OvmsNotifyEntry* entry)
+  {
+  if (!entry->IsAllRead() || (m_entries.Find(entry->m_id) != entry))
+    return false;
+  m_entries.Remove(entry->m_id);
+  return true;
+  }
+
+// Delete an entry no longer in the ring, call without the entries mutex.
+void OvmsNotifyType::Release(OvmsNotifyEntry* entry)
+  {
+  if (entry->m_spool_seq != 0)
     {
-    // We can cleanup...
-    auto k = m_entries.find(entry->m_id);
-    if (k != m_entries.end())
-       {
-       m_entries.erase(k);
-       }
-    if (MyNotify.m_trace)
-      ESP_LOGI(TAG,"Cleanup type %s id %d",m_name,entry->m_id);
-    delete entry;
+    OvmsNotifyEntryBatch* b = entry->AsBatch();
+    bool queued = false;
+    xSemaphoreTake(m_spool_mutex, portMAX_DELAY);
+    if (entry->m_spool_seq == NOTIFY_SPOOL_QUEUED)
+      {
+      // The spool writer holds the entry, and deletes it when done:
+      entry->m_spool_seq = NOTIFY_SPOOL_RELEASED;
+      queued = true;
+      }
+    else if (m_spool)
+      m_spool->Done(entry->m_spool_seq, b ? b->m_count : 1);
+    xSemaphoreGive(m_spool_mutex);
+    if (queued)
+      return;
+    }
+  if (MyNotify.m_trace)
+    ESP_LOGI(TAG,"Cleanup type %s id %d",m_name,entry->m_id);
+  delete entry;
+  }
+
+// Expand a batch into single entries for the readers not supporting
+// batches. The batch keeps the spool accounting. Call with the entries
+// mutex held, returns true if the caller is to Release() the batch.
+bool OvmsNotifyType::Expand(OvmsNotifyEntryBatch* batch)
+  {
+  std::bitset<NOTIFY_MAX_READERS> readers = batch->m_readers & ~MyNotify.m_batch_readers;
+  size_t pos = 0;
+  const char* rec;
+  size_t len;
+  uint32_t id = batch->m_id;
+  while (batch->NextRecord(pos, rec, len))
+    {
+    OvmsNotifyEntry* e = new OvmsNotifyEntryString(rec, len);
+    e->m_id = ++id;
+    e->m_created = batch->m_created;
+    e->m_readers = readers;
+    if (!m_entries.Insert(e->m_id, e))
+      {
+      ESP_LOGE(TAG, "Cannot expand type %s id %d: out of memory", m_name, e->m_id);
+      delete e;
+      }
+    }
+  if (MyNotify.m_trace)
+    ESP_LOGI(TAG,"Expanded type %s batch id %d: %u records",m_name,batch->m_id,batch->m_count);
+  batch->m_readers &= MyNotify.m_batch_readers;
+  return Unlink(batch);
+  }
+
+bool OvmsNotifyType::AddRecord(const char* record)
+  {
+  bool open = false, full = false, added;
+  xSemaphoreTake(m_batch_mutex, portMAX_DELAY);
+  if (m_batch == NULL)
+    {
+    m_batch = new OvmsNotifyEntryBatch();
+    open = true;
+    }
+  added = m_batch->Append(record, strlen(record));
+  full = (m_batch->m_size >= NOTIFY_BATCH_MAX);
+  xSemaphoreGive(m_batch_mutex);
+
+  if (full)
+    FlushBatch();
+  else if (open)
+    MyScheduler.RunOnce(TAG, m_batch_window, [this]() { FlushBatch(); }, true);
+  return added;
+  }
+
+void OvmsNotifyType::FlushBatch()
+  {
+  xSemaphoreTake(m_batch_mutex, portMAX_DELAY);
+  OvmsNotifyEntryBatch* batch = m_batch;
+  m_batch = NULL;
+  xSemaphoreGive(m_batch_mutex);
+  if (batch)
+    MyNotify.NotifyBatch(m_name, batch);
+  }
+
+// Once entries have been paged out, new ones need to follow them, to keep
+// the order. Call with the entries mutex held.
+bool OvmsNotifyType::SpoolPageout()
+  {
+  xSemaphoreTake(m_spool_mutex, portMAX_DELAY);
+  bool pageout = m_spool &&
+    ((m_spool->Backlog() > 0) || (m_spool_pageouts > 0) || (m_entries.size() >= m_spool_ram));
+  xSemaphoreGive(m_spool_mutex);
+  return pageout;
+  }
+
+// Hand an entry to the spool writer. This only queues the entry: it may
+// be called by any task, rendering and file I/O are done by SpoolWrite().
+// Call with the entries mutex held. Returns false if the entry could not
+// be kept, the caller is to Release() it.
+bool OvmsNotifyType::SpoolEntry(OvmsNotifyEntry* entry, bool pageout)
+  {
+  bool kept = true;
+  bool start = false;
+  xSemaphoreTake(m_spool_mutex, portMAX_DELAY);
+  if (m_spool && (pageout || m_spool_always))
+    {
+    entry->m_spool_seq = pageout ? NOTIFY_SPOOL_PAGEOUT : NOTIFY_SPOOL_QUEUED;
+    if (pageout)
+      m_spool_pageouts++;
+    start = m_spool_queue.empty();
+    m_spool_queue.push_back(entry);
+    }
+  else if (pageout)
+    {
+    // The spool has been closed meanwhile
+    kept = KeepEntry(entry);
+    }
+  xSemaphoreGive(m_spool_mutex);
+
+  if (start)
+    MyScheduler.RunOnce(TAG, 0, [this]() { SpoolWrite(); }, true);
+  return kept;
+  }
+
+// Write the queued entries to the spool, in order. Runs on the scheduler
+// worker, and from PageIn(), so readers see all entries paged out so far.
+void OvmsNotifyType::SpoolWrite()
+  {
+  xSemaphoreTake(m_spool_writer, portMAX_DELAY);
+  while (1)
+    {
+    OvmsNotifyEntry* entry = NULL;
+    bool release = false;
+    xSemaphoreTake(m_spool_mutex, portMAX_DELAY);
+    if (!m_spool_queue.empty())
+      {
+      entry = m_spool_queue.front();
+      m_spool_queue.pop_front();
+      release = (entry->m_spool_seq == NOTIFY_SPOOL_RELEASED);
+      }
+    xSemaphoreGive(m_spool_mutex);
+    if (entry == NULL)
+      break;
+    if (release)
+      {
+      delete entry;
+      continue;
+      }
+
+    // Render outside of the spool mutex, the entry stays valid while queued:
+    std::string value;
+    if (entry->AsBatch() == NULL)
+      value = entry->GetValue();
+
+    bool keep = false;
+    xSemaphoreTake(m_spool_mutex, portMAX_DELAY);
+    bool pageout = (entry->m_spool_seq == NOTIFY_SPOOL_PAGEOUT);
+    uint32_t seq = m_spool ? SpoolAppend(entry, value, pageout) : 0;
+    if (pageout)
+      {
+      m_spool_pageouts--;
+      if (seq)
+        {
+        if (MyNotify.m_trace)
+          ESP_LOGI(TAG,"Paged out type %s id %d",m_name,entry->m_id);
+        release = true;
+        }
+      else
+        keep = true;
+      }
+    else if (entry->m_spool_seq == NOTIFY_SPOOL_RELEASED)
+      {
+      OvmsNotifyEntryBatch* b = entry->AsBatch();
+      if (seq && m_spool)
+        m_spool->Done(seq, b ? b->m_count : 1);
+      release = true;
+      }
+    else
+      entry->m_spool_seq = seq;
+    xSemaphoreGive(m_spool_mutex);
+
+    if (keep)
+      {
+      // The entry is only owned by the writer, so it can be added to the
+      // ring after giving the spool mutex (keeping the lock order):
+      xSemaphoreTake(m_entries_mutex, portMAX_DELAY);
+      release = !KeepEntry(entry);
+      xSemaphoreGive(m_entries_mutex);
+      }
+    if (release)
+      delete entry;
+    }
+  xSemaphoreGive(m_spool_writer);
+  }
+
+// Append an entry to the spool, call with the spool mutex held. Batches
+// are spooled as their records, to be paged in as single entries.
+// Returns the segment number, 0 on error.
+uint32_t OvmsNotifyType::SpoolAppend(OvmsNotifyEntry* entry, const std::string& value, bool pageout)
+  {
+  OvmsNotifyEntryBatch* b = entry->AsBatch();
+  if (b == NULL)
+    return m_spool->Append(entry->m_id, entry->m_created,
+      entry->m_readers.to_ulong(), value, !pageout);
+
+  uint32_t seq = 0;
+  size_t pos = 0;
+  const char* rec;
+  size_t len;
+  for (uint32_t id = b->m_id + 1; b->NextRecord(pos, rec, len); id++)
+    {
+    bool first = (id == b->m_id + 1);
+    uint32_t s = m_spool->Append(id, entry->m_created,
+      entry->m_readers.to_ulong(), std::string(rec, len), !pageout, !first);
+    if (first)
+      seq = s;
+    else if (s != seq)
+      seq = 0;
+    }
+  return seq;
+  }
+
+// An entry to page out could not be spooled: keep it in RAM. Call with
+// the entries mutex held. Returns false if the entry could not be added,
+// the caller is to delete it (without the entries mutex).
+bool OvmsNotifyType::KeepEntry(OvmsNotifyEntry* entry)
+  {
+  entry->m_spool_seq = 0;
+  if (!m_entries.Insert(entry->m_id, entry))
+    {
+    ESP_LOGE(TAG, "Cannot keep type %s id %d: out of memory", m_name, entry->m_id);
+    return false;
+    }
+  return true;
+  }
+
+// Refill the RAM list from the spool, up to the high water mark but at
+// least one entry, as readers may hold back entries they have already
+// been sent (i.e. "data" waiting for the server ACK). The entries are read
+// with the spool mutex held, and added to the ring after giving it.
+bool OvmsNotifyType::PageIn()
+  {
+  std::list<OvmsNotifyEntry*> paged, done;
+  uint32_t n = 0;
+
+  SpoolWrite();
+  xSemaphoreTake(m_entries_mutex, portMAX_DELAY);
+  size_t inram = m_entries.size();
+  xSemaphoreGive(m_entries_mutex);
+
+  xSemaphoreTake(m_spool_mutex, portMAX_DELAY);
+  if (m_spool && (m_spool->Backlog() > 0))
+    {
+    size_t count = (inram < m_spool_ram) ? (m_spool_ram - inram) : 1;
+    n = m_spool->PageIn(count, [&paged](uint32_t seq, uint32_t id, uint32_t created,
+                                        uint32_t readers, const std::string& value, bool replayed)
+      {
+      OvmsNotifyEntry* e = new OvmsNotifyEntryString(value.data(), value.length());
+      e->m_id = id;
+      e->m_created = replayed ? monotonictime : created;
+      // Reader numbers are assigned at runtime, so the pending readers
+      // saved by a previous run are meaningless: a replayed entry is
+      // unread by all current readers.
+      std::bitset<NOTIFY_MAX_READERS> current = MyNotify.ReadersFor(value.length());
+      if (replayed)
+        e->m_readers = current;
+      else
+        e->m_readers = std::bitset<NOTIFY_MAX_READERS>(readers) & current;
+      e->m_spool_seq = seq;
+      paged.push_back(e);
+      });
+    }
+  xSemaphoreGive(m_spool_mutex);
+
+  xSemaphoreTake(m_entries_mutex, portMAX_DELAY);
+  for (OvmsNotifyEntry* e : paged)
+    {
+    if (!e->IsAllRead() && !m_entries.Insert(e->m_id, e))
+      {
+      // Keep the spool accounting, but skip the entry:
+      ESP_LOGE(TAG, "Cannot page in type %s id %d", m_name, e->m_id);
+      e->m_readers.reset();
+      }
+    if (e->IsAllRead())
+      done.push_back(e);
+    }
+  xSemaphoreGive(m_entries_mutex);
+
+  for (OvmsNotifyEntry* e : done)
+    Release(e);
+  if ((n > 0) && MyNotify.m_trace)
+    ESP_LOGI(TAG,"Paged in type %s: %u entries",m_name,n);
+  return (n > 0);
+  }
+
+void OvmsNotifyType::SpoolOpen(const std::string& dir, size_t ram, bool always)
+  {
+  xSemaphoreTake(m_spool_mutex, portMAX_DELAY);
+  m_spool_ram = ram;
+  m_spool_always = always;
+  bool same = (m_spool && (m_spool->Dir() == dir));
+  xSemaphoreGive(m_spool_mutex);
+  if (same)
+    return;
+
+  SpoolClose();
+
+  xSemaphoreTake(m_spool_mutex, portMAX_DELAY);
+  mkdir(dir.c_str(), 0);
+  OvmsNotifySpool* spool = new OvmsNotifySpool();
+  if (spool->Open(dir, m_nextid))
+    m_spool = spool;
+  else
+    {
+    ESP_LOGE(TAG, "Cannot open spool %s for type %s", dir.c_str(), m_name);
+    delete spool;
+    }
+  xSemaphoreGive(m_spool_mutex);
+  }
+
+// Entries already paged out stay in the spool, to be replayed when it is
+// opened again.
+void OvmsNotifyType::SpoolClose()
+  {
+  SpoolWrite();
+  xSemaphoreTake(m_entries_mutex, portMAX_DELAY);
+  xSemaphoreTake(m_spool_mutex, portMAX_DELAY);
+  OvmsNotifySpool* spool = m_spool;
+  if (spool)
+    {
+    // Entries still queued are kept in RAM by the writer
+    for (OvmsNotifyEntry* e = m_entries.First(); e; e = m_entries.Next(e->m_id))
+      {
+      if (e->m_spool_seq != NOTIFY_SPOOL_QUEUED)
+        e->m_spool_seq = 0;
+      }
+    m_spool = NULL;
     }
+  xSemaphoreGive(m_spool_mutex);
+  xSemaphoreGive(m_entries_mutex);
+  // Close the files unlocked, the spool is detached:
+  delete spool;
   }
 
 ////////////////////////////////////////////////////////////////////////
@@ -295,10 +1036,20 @@ OvmsNotifyCallbackEntry::~OvmsNotifyCallbackEntry()
 //
 
 OvmsNotify::OvmsNotify()
+  : m_pool(notify_pool_memory, NOTIFY_POOL_SLOT, NOTIFY_POOL_SIZE)
   {
   ESP_LOGI(TAG, "Initialising NOTIFICATIONS (1820)");
 
   m_nextreader = 1;
+  m_render_mutex = xSemaphoreCreateRecursiveMutex();
+  m_stat_lazy = 0;
+  m_stat_rendered = 0;
+  m_stat_render_cycles = 0;
+  m_pool_mutex = xSemaphoreCreateMutex();
+  m_pool_overflow = NOTIFY_OVERFLOW_SPILL;
+  m_stat_spilled = 0;
+  m_stat_dropped = 0;
+  m_stat_rejected = 0;
 
 #ifdef CONFIG_OVMS_DEV_DEBUGNOTIFICATIONS
   m_trace = true;
@@ -320,15 +1071,200 @@ OvmsNotify::OvmsNotify()
   RegisterType("error");
   RegisterType("alert");
   RegisterType("data");
+
+  MyConfig.RegisterParam("notify", "Notification configuration", true, true);
+
+  #undef bind  // Kludgy, but works
+  using std::placeholders::_1;
+  using std::placeholders::_2;
+  MyEvents.RegisterEvent(TAG,"config.mounted", std::bind(&OvmsNotify::SpoolEvent, this, _1, _2));
+  MyEvents.RegisterEvent(TAG,"config.unmounted", std::bind(&OvmsNotify::SpoolEvent, this, _1, _2));
+  MyEvents.RegisterEvent(TAG,"sd.mounted", std::bind(&OvmsNotify::SpoolEvent, this, _1, _2));
+  MyEvents.RegisterEvent(TAG,"sd.unmounted", std::bind(&OvmsNotify::SpoolEvent, this, _1, _2));
+  MyEvents.RegisterEvent(TAG,"system.shutdown", std::bind(&OvmsNotify::SpoolEvent, this, _1, _2));
+  MyConfig.RegisterChangeListener(TAG, "notify", "spool.",
+    [this](const ConfigChangeList& changes) { SpoolConfig(); });
+  MyEvents.RegisterEvent(TAG,"config.mounted", [this](std::string event, void* data) { BatchConfig(); });
+  MyConfig.RegisterChangeListener(TAG, "notify", "batch.",
+    [this](const ConfigChangeList& changes) { BatchConfig(); });
+  MyEvents.RegisterEvent(TAG,"config.mounted", [this](std::string event, void* data) { PoolConfig(); });
+  MyConfig.RegisterChangeListener(TAG, "notify", "pool.",
+    [this](const ConfigChangeList& changes) { PoolConfig(); });
   }
 
 OvmsNotify::~OvmsNotify()
   {
   }
 
-size_t OvmsNotify::RegisterReader(const char* caller, int verbosity, OvmsNotifyCallback_t callback)
+// Spool configuration (param "notify"):
+//   spool.path   directory for the spools, i.e. /store/notify or /sd/notify
+//                (one subdirectory per type), empty = RAM only (default)
+//   spool.ram    entries per type kept in RAM before paging out (default 20)
+//   spool.types  comma separated types to write through, i.e. "alert,data"
+void OvmsNotify::SpoolConfig()
+  {
+  std::string path;
+  if (MyConfig.ismounted())
+    path = MyConfig.GetParamValue("notify", "spool.path");
+  int ram = MyConfig.GetParamValueInt("notify", "spool.ram", NOTIFY_SPOOL_RAM);
+  if (ram < 0) ram = 0;
+  std::string types = "," + MyConfig.GetParamValue("notify", "spool.types") + ",";
+
+  while ((path.length() > 1) && (path.back() == '/'))
+    path.pop_back();
+  if (!path.empty())
+    mkdir(path.c_str(), 0);
+
+  for (OvmsNotifyTypeMap_t::iterator itt=m_types.begin(); itt!=m_types.end(); ++itt)
+    {
+    OvmsNotifyType* mt = itt->second;
+    if (path.empty())
+      mt->SpoolClose();
+    else
+      {
+      std::string name(mt->m_name);
+      bool always = (types.find("," + name + ",") != std::string::npos);
+      mt->SpoolOpen(path + "/" + name, ram, always);
+      }
+    }
+  }
+
+// Coalescing windows (param "notify"):
+//   batch.<type>  window in ms to collect text notifications of the type
+//                 into one batch, i.e. batch.data=2000, 0 = off (default);
+//                 multi-line texts are not batched
+void OvmsNotify::BatchConfig()
+  {
+  for (OvmsNotifyTypeMap_t::iterator itt=m_types.begin(); itt!=m_types.end(); ++itt)
+    {
+    OvmsNotifyType* mt = itt->second;
+    int window = MyConfig.GetParamValueInt("notify", std::string("batch.") + mt->m_name, 0);
+    mt->m_batch_window = (window > 0) ? window : 0;
+    if (mt->m_batch_window == 0)
+      mt->FlushBatch();
+    }
+  }
+
+// Entry pool (param "notify"):
+//   pool.overflow  handling of an exhausted pool: "spill" to the heap
+//                  (default), "drop" the oldest pooled entry no reader is
+//                  working on (else spill), or "reject"
+//                  new notifications
+void OvmsNotify::PoolConfig()
+  {
+  std::string overflow = MyConfig.GetParamValue("notify", "pool.overflow");
+  if (overflow == "drop")
+    m_pool_overflow = NOTIFY_OVERFLOW_DROP;
+  else if (overflow == "reject")
+    m_pool_overflow = NOTIFY_OVERFLOW_REJECT;
+  else
+    m_pool_overflow = NOTIFY_OVERFLOW_SPILL;
+  }
+
+// Make room for count new entries according to the overflow policy,
+// returns false if the notification is to be rejected. Entries needed
+// beyond the pool capacity (and for batch expansion and spool paging)
+// always spill to the heap.
+bool OvmsNotify::PoolReserve(size_t count)
+  {
+  if ((m_pool.Available() >= count) || (m_pool_overflow == NOTIFY_OVERFLOW_SPILL))
+    return true;
+  if (m_pool_overflow == NOTIFY_OVERFLOW_REJECT)
+    {
+    m_stat_rejected++;
+    return false;
+    }
+  std::set<OvmsNotifyType*> exhausted;
+  while (m_pool.Available() < count)
+    {
+    // Drop from the type having the oldest entry:
+    OvmsNotifyType* oldest = NULL;
+    uint32_t oldest_created = 0, created;
+    for (OvmsNotifyTypeMap_t::iterator itt=m_types.begin(); itt!=m_types.end(); ++itt)
+      {
+      if (exhausted.count(itt->second))
+        continue;
+      if (itt->second->OldestCreated(created) && (!oldest || (created < oldest_created)))
+        {
+        oldest = itt->second;
+        oldest_created = created;
+        }
+      }
+    if (!oldest)
+      break;
+    if (oldest->DropOldest())
+      m_stat_dropped++;
+    else
+      exhausted.insert(oldest);
+    }
+  return true;
+  }
+
+void* OvmsNotify::PoolAlloc(size_t size)
+  {
+  void* p = NULL;
+  if (size <= m_pool.SlotSize())
+    {
+    xSemaphoreTake(m_pool_mutex, portMAX_DELAY);
+    p = m_pool.Alloc();
+    xSemaphoreGive(m_pool_mutex);
+    }
+  if (p == NULL)
+    {
+    m_stat_spilled++;
+    p = ::operator new(size);
+    }
+  return p;
+  }
+
+void OvmsNotify::PoolFree(void* p)
+  {
+  if (m_pool.Owns(p))
+    {
+    xSemaphoreTake(m_pool_mutex, portMAX_DELAY);
+    m_pool.Free(p);
+    xSemaphoreGive(m_pool_mutex);
+    }
+  else
+    ::operator delete(p);
+  }
+
+void OvmsNotify::SpoolEvent(std::string event, void* data)
+  {
+  std::string root;
+  if (event == "sd.unmounted")
+    root = "/sd/";
+  else if (event == "config.unmounted")
+    root = "/store/";
+  else if (event == "system.shutdown")
+    {
+    // Queue open batches, so they get spooled:
+    for (OvmsNotifyTypeMap_t::iterator itt=m_types.begin(); itt!=m_types.end(); ++itt)
+      itt->second->FlushBatch();
+    root = "/";
+    }
+  else
+    {
+    SpoolConfig();
+    return;
+    }
+
+  // Close the spools on the file system going away:
+  for (OvmsNotifyTypeMap_t::iterator itt=m_types.begin(); itt!=m_types.end(); ++itt)
+    {
+    OvmsNotifyType* mt = itt->second;
+    if (mt->m_spool && (mt->m_spool->Dir().compare(0, root.length(), root) == 0))
+      mt->SpoolClose();
+    }
+  }
+
+// Readers registered with batches=true get OvmsNotifyEntryBatch entries,
+// for other readers batches are expanded.
+size_t OvmsNotify::RegisterReader(const char* caller, int verbosity, OvmsNotifyCallback_t callback, bool batches)
   {
   size_t reader = m_nextreader++;
+  if (batches)
+    m_batch_readers.set(reader);
 
   m_readers[caller] = new OvmsNotifyCallbackEntry(caller, reader, verbosity, callback);
 
@@ -368,8 +1304,26 @@ void OvmsNotify::NotifyReaders(OvmsNotifyType* type, OvmsNotifyEntry* entry)
     {
     OvmsNotifyCallbackEntry* mc = itc->second;
     bool result = mc->m_callback(type,entry);
-    if (result) entry->m_readers.reset(mc->m_reader);
+    if (result)
+      {
+      xSemaphoreTake(type->m_entries_mutex, portMAX_DELAY);
+      entry->m_readers.reset(mc->m_reader);
+      xSemaphoreGive(type->m_entries_mutex);
+      }
+    }
+  }
+
+// Readers accepting a notification of the given length
+std::bitset<NOTIFY_MAX_READERS> OvmsNotify::ReadersFor(size_t length)
+  {
+  std::bitset<NOTIFY_MAX_READERS> readers;
+  for (OvmsNotifyCallbackMap_t::iterator itc=m_readers.begin(); itc!=m_readers.end(); ++itc)
+    {
+    OvmsNotifyCallbackEntry* mc = itc->second;
+    if (length <= mc->m_verbosity)
+      readers.set(mc->m_reader);
     }
+  return readers;
   }
 
 void OvmsNotify::RegisterType(const char* type)
@@ -383,6 +1337,13 @@ void OvmsNotify::RegisterType(const char* type)
     }
   }
 
+/**
+ * NotifyString: queue a text notification.
+ *  Returns the entry ID, or 0 if the notification was not accepted. With
+ *  batching enabled for the type, single line texts are coalesced and
+ *  NOTIFY_ID_PENDING is returned: the pool overflow policy applies when
+ *  the batch is queued.
+ */
 uint32_t OvmsNotify::NotifyString(const char* type, const char* value)
   {
   OvmsNotifyType* mt = GetType(type);
@@ -399,17 +1360,32 @@ uint32_t OvmsNotify::NotifyString(const char* type, const char* value)
     ESP_LOGD(TAG, "Abort: no readers");
     return 0;
     }
+
+  if (mt->m_batch_window > 0)
+    {
+    // Batch records are single lines: multi-line texts (i.e. info or alert
+    // command output) are queued on their own, after the records collected
+    // so far to keep the order.
+    const char* eol = strchr(value, '\n');
+    if ((eol == NULL) || (eol[1] == 0))
+      {
+      // Coalesce, the ID gets assigned when the batch is queued:
+      return mt->AddRecord(value) ? NOTIFY_ID_PENDING : 0;
+      }
+    mt->FlushBatch();
+    }
   
+  if (!PoolReserve(1))
+    {
+    ESP_LOGW(TAG, "Notification rejected, pool exhausted: %s", value);
+    return 0;
+    }
+
   // create message:
   OvmsNotifyEntry* msg = (OvmsNotifyEntry*) new OvmsNotifyEntryString(value);
 
   // add all currently active readers accepting the message length:
-  for (OvmsNotifyCallbackMap_t::iterator itc=m_readers.begin(); itc!=m_readers.end(); ++itc)
-    {
-    OvmsNotifyCallbackEntry* mc = itc->second;
-    if (strlen(value) <= mc->m_verbosity)
-      msg->m_readers.set(mc->m_reader);
-    }
+  msg->m_readers = ReadersFor(strlen(value));
   
   ESP_LOGD(TAG, "Created entry with length %d has %d readers pending", strlen(value), msg->m_readers.count());
   
@@ -426,81 +1402,158 @@ uint32_t OvmsNotify::NotifyCommand(const char* type, const char* cmd)
     }
 
   if (m_trace) ESP_LOGI(TAG, "Raise command %s: %s", type, cmd);
-  
+
+  return QueueLazy(mt, cmd, nullptr, NULL);
+  }
+
+/**
+ * NotifyProducer: like NotifyCommand, but the value is rendered by
+ *  calling the producer with the reader verbosity and a writer, without
+ *  parsing a command line. The producer is called from the reader task,
+ *  so any data captured needs to stay valid until the entry is read:
+ *  a module capturing its instance passes its caller name and calls
+ *  ReleaseProducers() on shutdown.
+ */
+uint32_t OvmsNotify::NotifyProducer(const char* type, OvmsNotifyProducer_t producer, const char* caller)
+  {
+  OvmsNotifyType* mt = GetType(type);
+  if (mt == NULL)
+    {
+    ESP_LOGW(TAG, "Notification raised for non-existent type %s", type);
+    return 0;
+    }
+
+  if (m_trace) ESP_LOGI(TAG, "Raise producer %s", type);
+
+  return QueueLazy(mt, NULL, producer, caller);
+  }
+
+/**
+ * ReleaseProducers: render all pending entries of a producer owner now.
+ *  The render mutex is taken before looking up an entry, so the entry
+ *  cannot be deleted before it has been rendered (the destructor waits
+ *  for the mutex), and the entries mutex is not held while rendering.
+ */
+void OvmsNotify::ReleaseProducers(const char* caller)
+  {
+  for (OvmsNotifyTypeMap_t::iterator itt=m_types.begin(); itt!=m_types.end(); ++itt)
+    {
+    OvmsNotifyType* mt = itt->second;
+    uint32_t id = 0;
+    while (1)
+      {
+      xSemaphoreTakeRecursive(m_render_mutex, portMAX_DELAY);
+      xSemaphoreTake(mt->m_entries_mutex, portMAX_DELAY);
+      OvmsNotifyEntry* e;
+      for (e = mt->m_entries.Next(id); e; e = mt->m_entries.Next(e->m_id))
+        {
+        if (!e->IsRendered() && ((OvmsNotifyEntryCommand*)e)->m_caller &&
+            (strcmp(((OvmsNotifyEntryCommand*)e)->m_caller, caller) == 0))
+          break;
+        }
+      if (e)
+        id = e->m_id;
+      xSemaphoreGive(mt->m_entries_mutex);
+      if (e)
+        e->GetValue();
+      xSemaphoreGiveRecursive(m_render_mutex);
+      if (e == NULL)
+        break;
+      }
+    }
+  }
+
+uint32_t OvmsNotify::QueueLazy(OvmsNotifyType* mt, const char* cmd, OvmsNotifyProducer_t producer, const char* caller)
+  {
   if (m_readers.size() == 0)
     {
     ESP_LOGD(TAG, "Abort: no readers");
     return 0;
     }
-  
+
   // Strategy:
-  //  to minimize RAM usage and command calls we try to reuse higher verbosity messages
-  //  if their result length fits for lower verbosity readers as well.
-  
+  //  the output length is unknown until rendering, so we create one
+  //  (unrendered) entry per verbosity level needed by the readers.
+
   std::map<int, OvmsNotifyEntryCommand*> verbosity_msgs;
   std::map<int, OvmsNotifyEntryCommand*>::iterator itm;
-  std::map<int, OvmsNotifyEntryCommand*>::reverse_iterator ritm;
   OvmsNotifyCallbackMap_t::iterator itc;
-  OvmsNotifyEntryCommand *msg;
-  size_t msglen;
-  
-  // get verbosity levels needed by readers:
+
   for (itc=m_readers.begin(); itc!=m_readers.end(); itc++)
+    verbosity_msgs[itc->second->m_verbosity] = NULL;
+  if (!PoolReserve(verbosity_msgs.size()))
     {
-    OvmsNotifyCallbackEntry* mc = itc->second;
-    verbosity_msgs[mc->m_verbosity] = NULL;
-    }
-  
-  // fetch verbosity levels beginning at highest verbosity:
-  msg = NULL;
-  msglen = 0;
-  for (ritm=verbosity_msgs.rbegin(); ritm!=verbosity_msgs.rend(); ritm++)
-    {
-    int verbosity = ritm->first;
-    
-    if (msg && msglen <= verbosity)
-      {
-      // reuse last verbosity level message:
-      verbosity_msgs[verbosity] = msg;
-      }
-    else
-      {
-      msg = verbosity_msgs[verbosity];
-      if (!msg)
-        {
-        // create verbosity level message:
-        msg = new OvmsNotifyEntryCommand(verbosity, cmd);
-        msglen = msg->GetValue().length();
-        verbosity_msgs[verbosity] = msg;
-        }
-      }
+    ESP_LOGW(TAG, "Notification rejected, pool exhausted: %s", cmd ? cmd : "<producer>");
+    return 0;
     }
-  
-  // add readers:
+
   for (itc=m_readers.begin(); itc!=m_readers.end(); itc++)
     {
     OvmsNotifyCallbackEntry* mc = itc->second;
-    msg = verbosity_msgs[mc->m_verbosity];
+    OvmsNotifyEntryCommand*& msg = verbosity_msgs[mc->m_verbosity];
+    if (!msg)
+      {
+      if (cmd)
+        msg = new OvmsNotifyEntryCommand(mc->m_verbosity, cmd);
+      else
+        msg = new OvmsNotifyEntryCommand(mc->m_verbosity, producer, caller);
+      m_stat_lazy++;
+      }
     msg->m_readers.set(mc->m_reader);
     }
-  
+
   // queue all verbosity level messages beginning at lowest verbosity (fastest delivery):
-  msg = NULL;
   uint32_t queue_id = 0;
   for (itm=verbosity_msgs.begin(); itm!=verbosity_msgs.end(); itm++)
     {
-    if (itm->second == msg)
-      continue; // already queued
-    
-    msg = itm->second;
-    ESP_LOGD(TAG, "Created entry for verbosity %d has %d readers pending", itm->first, msg->m_readers.count());
-    queue_id = mt->QueueEntry(msg);
+    ESP_LOGD(TAG, "Created entry for verbosity %d has %d readers pending", itm->first, itm->second->m_readers.count());
+    queue_id = mt->QueueEntry(itm->second);
     }
-  
+
   return queue_id;
   }
 
 
+/**
+ * NotifyBatch: queue a batch of records, i.e. a data update burst.
+ *  The batch is taken over (and deleted if it cannot be queued).
+ *  Readers get the batch if their verbosity allows the longest record.
+ */
+uint32_t OvmsNotify::NotifyBatch(const char* type, OvmsNotifyEntryBatch* batch)
+  {
+  OvmsNotifyType* mt = GetType(type);
+  if (mt == NULL)
+    {
+    ESP_LOGW(TAG, "Notification raised for non-existent type %s: batch", type);
+    delete batch;
+    return 0;
+    }
+
+  if (m_trace) ESP_LOGI(TAG, "Raise batch %s: %u records", type, batch->m_count);
+
+  if ((m_readers.size() == 0) || (batch->m_count == 0))
+    {
+    ESP_LOGD(TAG, "Abort: no readers or records");
+    delete batch;
+    return 0;
+    }
+
+  // The batch takes one entry slot, like a single notification:
+  if (!PoolReserve(1))
+    {
+    ESP_LOGW(TAG, "Notification rejected, pool exhausted: batch of %u records", batch->m_count);
+    delete batch;
+    return 0;
+    }
+
+  batch->Seal();
+  batch->m_readers = ReadersFor(batch->m_maxlen);
+
+  ESP_LOGD(TAG, "Created batch with %u records has %d readers pending", batch->m_count, batch->m_readers.count());
+
+  return mt->QueueEntry(batch);
+  }
+
 /**
  * NotifyStringf: printf style API
  */
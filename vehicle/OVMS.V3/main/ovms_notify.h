@@ -36,14 +36,46 @@
 #include <list>
 #include <string>
 #include <bitset>
+#include <vector>
 #include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 #include "ovms_utils.h"
+#include "ovms_notify_spool.h"
+#include "ovms_notify_pool.h"
 
 #define NOTIFY_MAX_READERS 32
+#define NOTIFY_SPOOL_RAM   20     // Default RAM high water mark per spooled type
+#define NOTIFY_BATCH_ARENA 256    // Initial batch arena size
+#define NOTIFY_BATCH_MAX   4096   // Coalesced batches are queued at this size
+#define NOTIFY_POOL_SIZE   32     // Preallocated entry slots
+#define NOTIFY_INLINE_SIZE 96     // Text stored within the entry up to this length
+
+#define NOTIFY_OVERFLOW_SPILL   0 // Pool exhausted: allocate from the heap
+#define NOTIFY_OVERFLOW_DROP    1 // ...drop the oldest pooled entry not in use
+#define NOTIFY_OVERFLOW_REJECT  2 // ...reject the notification
+
+#define NOTIFY_READER_QUEUEING  0 // Reader bit holding an entry while it is queued
+
+// Returned by NotifyString() for a record coalesced into a batch: it is
+// accepted, the ID gets assigned when the batch is queued. 0 means the
+// notification has not been accepted.
+#define NOTIFY_ID_PENDING       0xffffffff
+
+// Special OvmsNotifyEntry::m_spool_seq values for entries handed to the
+// spool writer (see OvmsNotifyType::SpoolWrite()):
+#define NOTIFY_SPOOL_QUEUED     0xffffffff  // Write through, entry is in RAM
+#define NOTIFY_SPOOL_PAGEOUT    0xfffffffe  // Page out, entry is owned by the writer
+#define NOTIFY_SPOOL_RELEASED   0xfffffffd  // Queued, but read by all readers meanwhile
 
 using namespace std;
 
 class OvmsNotifyType;
+class OvmsNotifyEntryBatch;
+class OvmsWriter;
+
+// A producer renders a notification on demand, like a command handler:
+typedef std::function<void(int verbosity, OvmsWriter* writer)> OvmsNotifyProducer_t;
 
 class OvmsNotifyEntry
   {
@@ -55,41 +87,95 @@ class OvmsNotifyEntry
     virtual const std::string GetValue();
     virtual bool IsRead(size_t reader);
     virtual bool IsAllRead();
+    virtual bool IsRendered() { return true; }
+    virtual OvmsNotifyEntryBatch* AsBatch() { return NULL; }
+
+  public:
+    // Entries are allocated from the MyNotify pool, see PoolReserve()
+    static void* operator new(size_t size);
+    static void operator delete(void* p);
 
   public:
     std::bitset<NOTIFY_MAX_READERS> m_readers;
     uint32_t m_id;
     uint32_t m_created;
+    uint32_t m_spool_seq;         // Spool segment holding a copy, 0 = none, or NOTIFY_SPOOL_*
   };
 
 class OvmsNotifyEntryString : public OvmsNotifyEntry
   {
   public:
     OvmsNotifyEntryString(const char* value);
+    OvmsNotifyEntryString(const char* value, size_t length);
     virtual ~OvmsNotifyEntryString();
 
   public:
     virtual const std::string GetValue();
 
+  protected:
+    void SetValue(const char* value, size_t length);
+
   public:
-     std::string m_value;
+     char* m_value;               // m_inline or heap, NUL terminated
+     size_t m_length;
+     char m_inline[NOTIFY_INLINE_SIZE];
   };
 
+// Command and producer entries are rendered on the first GetValue() call,
+// the result is cached for the remaining readers.
 class OvmsNotifyEntryCommand : public OvmsNotifyEntry
   {
   public:
     OvmsNotifyEntryCommand(int verbosity, const char* cmd);
+    OvmsNotifyEntryCommand(int verbosity, OvmsNotifyProducer_t producer, const char* caller);
     virtual ~OvmsNotifyEntryCommand();
 
   public:
     virtual const std::string GetValue();
+    virtual bool IsRendered() { return m_rendered; }
+
+  protected:
+    void Render();
 
   public:
+     int m_verbosity;
      char* m_cmd;
+     OvmsNotifyProducer_t m_producer;
+     const char* m_caller;        // Producer owner, see ReleaseProducers()
      std::string m_value;
+     volatile bool m_rendered;
   };
 
-typedef std::map<uint32_t, OvmsNotifyEntry*> NotifyEntryMap_t;
+// A batch holds many single line records (i.e. historical data) in one
+// contiguous arena, and is queued as one entry. The records use the IDs
+// m_id+1 .. m_id+m_count. Readers registered as batch capable get the
+// batch, for other readers it is expanded into single entries on access.
+class OvmsNotifyEntryBatch : public OvmsNotifyEntry
+  {
+  public:
+    OvmsNotifyEntryBatch(size_t capacity = NOTIFY_BATCH_ARENA);
+    virtual ~OvmsNotifyEntryBatch();
+
+  public:
+    virtual const std::string GetValue();
+    virtual OvmsNotifyEntryBatch* AsBatch() { return this; }
+    bool Append(const char* record, size_t len);
+    bool Append(const std::string& record) { return Append(record.data(), record.length()); }
+    bool NextRecord(size_t& pos, const char*& record, size_t& len);
+    void Seal();
+    bool AckRecord(uint32_t id);
+
+  public:
+    char* m_arena;                // Records, each terminated by LF
+    size_t m_size;
+    size_t m_capacity;
+    uint32_t m_count;
+    size_t m_maxlen;
+    std::vector<bool> m_acked;
+    uint32_t m_nacked;
+  };
+
+typedef OvmsIdRing<OvmsNotifyEntry> NotifyEntryRing_t;
 
 class OvmsNotifyType
   {
@@ -104,14 +190,48 @@ class OvmsNotifyType
     OvmsNotifyEntry* FirstUnreadEntry(size_t reader, uint32_t floor);
     OvmsNotifyEntry* FindEntry(uint32_t id);
     void MarkRead(size_t reader, OvmsNotifyEntry* entry);
+    bool DropOldest();
+    bool OldestCreated(uint32_t& created);
+
+  public:
+    void SpoolOpen(const std::string& dir, size_t ram, bool always);
+    void SpoolClose();
+    bool AddRecord(const char* record);
+    void FlushBatch();
 
   protected:
     void Cleanup(OvmsNotifyEntry* entry);
+    bool Unlink(OvmsNotifyEntry* entry);
+    void Release(OvmsNotifyEntry* entry);
+    bool InUse(OvmsNotifyEntry* entry);
+    bool Expand(OvmsNotifyEntryBatch* batch);
+    bool SpoolPageout();
+    bool SpoolEntry(OvmsNotifyEntry* entry, bool pageout);
+    void SpoolWrite();
+    uint32_t SpoolAppend(OvmsNotifyEntry* entry, const std::string& value, bool pageout);
+    bool KeepEntry(OvmsNotifyEntry* entry);
+    bool PageIn();
 
   public:
     const char* m_name;
     uint32_t m_nextid;
-    NotifyEntryMap_t m_entries;
+    NotifyEntryRing_t m_entries;
+    SemaphoreHandle_t m_entries_mutex;  // Guards m_nextid, m_entries, m_fetched and the entry reader bits
+    uint32_t m_fetched[NOTIFY_MAX_READERS]; // Highest ID fetched per reader
+
+  public:
+    OvmsNotifySpool* m_spool;     // NULL = RAM only
+    size_t m_spool_ram;           // Entries kept in RAM before paging out
+    bool m_spool_always;          // Write all entries through to the spool
+    SemaphoreHandle_t m_spool_mutex;
+    std::list<OvmsNotifyEntry*> m_spool_queue;  // Entries waiting for the spool writer
+    size_t m_spool_pageouts;      // ...of which to be paged out
+    SemaphoreHandle_t m_spool_writer; // Serializes SpoolWrite() runs
+
+  public:
+    uint32_t m_batch_window;      // Coalescing window in ms, 0 = off
+    OvmsNotifyEntryBatch* m_batch;  // Open batch collecting records
+    SemaphoreHandle_t m_batch_mutex;
   };
 
 typedef std::function<bool(OvmsNotifyType*,OvmsNotifyEntry*)> OvmsNotifyCallback_t;
@@ -139,11 +259,12 @@ class OvmsNotify
     virtual ~OvmsNotify();
 
   public:
-    size_t RegisterReader(const char* caller, int verbosity, OvmsNotifyCallback_t callback);
+    size_t RegisterReader(const char* caller, int verbosity, OvmsNotifyCallback_t callback, bool batches = false);
     void ClearReader(const char* caller);
     size_t CountReaders();
     OvmsNotifyType* GetType(const char* type);
     void NotifyReaders(OvmsNotifyType* type, OvmsNotifyEntry* entry);
+    std::bitset<NOTIFY_MAX_READERS> ReadersFor(size_t length);
 
   public:
     void RegisterType(const char* type);
@@ -151,9 +272,27 @@ class OvmsNotify
     uint32_t NotifyStringf(const char* type, const char* fmt, ...);
     uint32_t NotifyCommand(const char* type, const char* cmd);
     uint32_t NotifyCommandf(const char* type, const char* fmt, ...);
+    uint32_t NotifyBatch(const char* type, OvmsNotifyEntryBatch* batch);
+    uint32_t NotifyProducer(const char* type, OvmsNotifyProducer_t producer, const char* caller = NULL);
+    void ReleaseProducers(const char* caller);
+
+  protected:
+    uint32_t QueueLazy(OvmsNotifyType* mt, const char* cmd, OvmsNotifyProducer_t producer, const char* caller);
+
+  public:
+    bool PoolReserve(size_t count);
+    void* PoolAlloc(size_t size);
+    void PoolFree(void* p);
+
+  public:
+    void SpoolConfig();
+    void BatchConfig();
+    void PoolConfig();
+    void SpoolEvent(std::string event, void* data);
 
   public:
     OvmsNotifyCallbackMap_t m_readers;
+    std::bitset<NOTIFY_MAX_READERS> m_batch_readers;
 
   protected:
     size_t m_nextreader;
@@ -161,6 +300,20 @@ class OvmsNotify
   public:
     OvmsNotifyTypeMap_t m_types;
     bool m_trace;
+
+  public:
+    SemaphoreHandle_t m_render_mutex;   // Recursive, serializes lazy rendering
+    uint32_t m_stat_lazy;               // Command/producer entries queued
+    uint32_t m_stat_rendered;           // ...of which rendered
+    uint64_t m_stat_render_cycles;
+
+  public:
+    OvmsSlabPool m_pool;
+    SemaphoreHandle_t m_pool_mutex;
+    int m_pool_overflow;                // NOTIFY_OVERFLOW_*
+    uint32_t m_stat_spilled;            // Entries allocated from the heap
+    uint32_t m_stat_dropped;            // Unread entries dropped for new ones
+    uint32_t m_stat_rejected;           // Notifications rejected
   };
 
 extern OvmsNotify MyNotify;
@@ -0,0 +1,77 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Date:          14th March 2017
+;
+;    Changes:
+;    1.0  Initial release
+;
+;    (C) 2011       Michael Stegen / Stegen Electronics
+;    (C) 2011-2017  Mark Webb-Johnson
+;    (C) 2011        Sonny Chen @ EPRO/DX
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+
+#include "ovms_notify_pool.h"
+
+OvmsSlabPool::OvmsSlabPool(void* memory, size_t slotsize, size_t slots)
+  {
+  // Slots need to hold the free list link, and keep the alignment:
+  slotsize = (slotsize < sizeof(void*)) ? sizeof(void*) : slotsize;
+  slotsize = (slotsize + 7) & ~7;
+  m_memory = (char*)memory;
+  m_slotsize = slotsize;
+  m_slots = slots;
+  m_free = NULL;
+  for (size_t k = slots; k > 0; k--)
+    {
+    void* slot = m_memory + (k-1) * m_slotsize;
+    *(void**)slot = m_free;
+    m_free = slot;
+    }
+  m_used = 0;
+  m_peak = 0;
+  m_stat_allocs = 0;
+  m_stat_exhausted = 0;
+  }
+
+void* OvmsSlabPool::Alloc()
+  {
+  void* slot = m_free;
+  if (slot == NULL)
+    {
+    m_stat_exhausted++;
+    return NULL;
+    }
+  m_free = *(void**)slot;
+  m_stat_allocs++;
+  if (++m_used > m_peak)
+    m_peak = m_used;
+  return slot;
+  }
+
+bool OvmsSlabPool::Free(void* p)
+  {
+  if (!Owns(p))
+    return false;
+  *(void**)p = m_free;
+  m_free = p;
+  m_used--;
+  return true;
+  }
@@ -0,0 +1,281 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Date:          14th March 2017
+;
+;    Changes:
+;    1.0  Initial release
+;
+;    (C) 2011       Michael Stegen / Stegen Electronics
+;    (C) 2011-2017  Mark Webb-Johnson
+;    (C) 2011        Sonny Chen @ EPRO/DX
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+
+#ifndef __NOTIFY_POOL_H__
+#define __NOTIFY_POOL_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+
+// Storage primitives of the notification framework. Both only use the
+// standard library, so they can be measured on any host. Neither does any
+// locking.
+
+// OvmsSlabPool: fixed number of equally sized slots in caller provided
+// memory, allocation and release are O(1) via an intrusive free list.
+class OvmsSlabPool
+  {
+  public:
+    OvmsSlabPool(void* memory, size_t slotsize, size_t slots);
+
+  public:
+    void* Alloc();                  // NULL if exhausted
+    bool Free(void* p);             // false if p is not from this pool
+    bool Owns(const void* p) const
+      {
+      return ((const char*)p >= m_memory) && ((const char*)p < m_memory + m_slotsize * m_slots);
+      }
+
+  protected:
+    char* m_memory;
+    size_t m_slotsize;
+    size_t m_slots;
+    void* m_free;
+
+  public:
+    size_t m_used;
+    size_t m_peak;
+    uint32_t m_stat_allocs;
+    uint32_t m_stat_exhausted;
+
+  public:
+    size_t SlotSize() const { return m_slotsize; }
+    size_t Capacity() const { return m_slots; }
+    size_t Available() const { return m_slots - m_used; }
+  };
+
+// OvmsIdRing: items indexed by their ascending uint32 ID, in a power of
+// two sized ring covering the ID span from the first to the last item.
+// Lookup and insert are O(1), iteration is in ID order. The ring grows
+// when the span exceeds the capacity, up to maxspan IDs: items older than
+// that (i.e. an entry a reader never marks read) move to a map, so one
+// stuck item doesn't make the ring grow until memory runs out. Next(),
+// Floor() and removing the first or last item scan over empty slots, so
+// they are O(gap), bounded by maxspan.
+template <class T> class OvmsIdRing
+  {
+  public:
+    OvmsIdRing(size_t capacity = 16, size_t maxspan = 1024)
+      {
+      size_t c = 1;
+      while (c < capacity) c <<= 1;
+      m_maxspan = 1;
+      while (m_maxspan < maxspan) m_maxspan <<= 1;
+      if (c > m_maxspan) c = m_maxspan;
+      m_slots = (T**)calloc(c, sizeof(T*));
+      m_mask = c - 1;
+      m_first = m_end = 0;
+      m_count = 0;
+      }
+    ~OvmsIdRing()
+      {
+      free(m_slots);
+      }
+
+  public:
+    size_t size() const { return m_count + m_old.size(); }
+    bool empty() const { return (size() == 0); }
+    size_t capacity() const { return m_mask + 1; }
+    size_t outside() const { return m_old.size(); }
+
+    T* Find(uint32_t id) const
+      {
+      if ((m_count == 0) || (id < m_first) || (id >= m_end))
+        {
+        auto it = m_old.find(id);
+        return (it == m_old.end()) ? NULL : it->second;
+        }
+      return m_slots[id & m_mask];
+      }
+
+    bool Insert(uint32_t id, T* item)
+      {
+      if (m_count == 0)
+        {
+        if (!m_old.empty() && (id < m_old.rbegin()->first))
+          return m_old.insert(std::make_pair(id, item)).second;
+        m_first = id;
+        m_end = id + 1;
+        }
+      else if (id < m_first)
+        {
+        // Older than the ring: extend it down if the span allows
+        if (((m_end - id) > m_maxspan) || (!m_old.empty() && (id < m_old.rbegin()->first)))
+          return m_old.insert(std::make_pair(id, item)).second;
+        if (((m_end - id) > (m_mask + 1)) && !Grow(m_end - id))
+          return false;
+        m_first = id;
+        }
+      else
+        {
+        if (id >= m_end)
+          {
+          if ((id + 1 - m_first) > m_maxspan)
+            Evict(id + 1 - m_maxspan);
+          if ((m_count > 0) && ((id + 1 - m_first) > (m_mask + 1)) && !Grow(id + 1 - m_first))
+            return false;
+          if (m_count == 0)
+            m_first = id;
+          m_end = id + 1;
+          }
+        if (m_slots[id & m_mask])
+          return false;
+        }
+      m_slots[id & m_mask] = item;
+      m_count++;
+      return true;
+      }
+
+    T* Remove(uint32_t id)
+      {
+      if ((m_count == 0) || (id < m_first) || (id >= m_end))
+        {
+        auto it = m_old.find(id);
+        if (it == m_old.end())
+          return NULL;
+        T* item = it->second;
+        m_old.erase(it);
+        return item;
+        }
+      T* item = m_slots[id & m_mask];
+      if (item == NULL)
+        return NULL;
+      m_slots[id & m_mask] = NULL;
+      if (--m_count == 0)
+        {
+        m_first = m_end = 0;
+        return item;
+        }
+      while (m_slots[m_first & m_mask] == NULL) m_first++;
+      while (m_slots[(m_end-1) & m_mask] == NULL) m_end--;
+      return item;
+      }
+
+    T* First() const
+      {
+      if (!m_old.empty())
+        return m_old.begin()->second;
+      return (m_count == 0) ? NULL : m_slots[m_first & m_mask];
+      }
+
+    T* Last() const
+      {
+      if (m_count == 0)
+        return m_old.empty() ? NULL : m_old.rbegin()->second;
+      return m_slots[(m_end-1) & m_mask];
+      }
+
+    uint32_t LastId() const
+      {
+      if (m_count == 0)
+        return m_old.empty() ? 0 : m_old.rbegin()->first;
+      return m_end - 1;
+      }
+
+    // First item with an ID above id
+    T* Next(uint32_t id) const
+      {
+      auto it = m_old.upper_bound(id);
+      if (it != m_old.end())
+        return it->second;
+      if ((m_count == 0) || (id >= m_end - 1))
+        return NULL;
+      for (uint32_t k = (id < m_first) ? m_first : id + 1; k < m_end; k++)
+        {
+        if (m_slots[k & m_mask])
+          return m_slots[k & m_mask];
+        }
+      return NULL;
+      }
+
+    // Last item with an ID at or below id
+    T* Floor(uint32_t id) const
+      {
+      if ((m_count > 0) && (id >= m_first))
+        {
+        uint32_t k = (id >= m_end) ? m_end - 1 : id;
+        while (m_slots[k & m_mask] == NULL)
+          k--;
+        return m_slots[k & m_mask];
+        }
+      auto it = m_old.upper_bound(id);
+      if (it == m_old.begin())
+        return NULL;
+      return (--it)->second;
+      }
+
+  protected:
+    bool Grow(uint32_t span)
+      {
+      size_t c = (m_mask + 1) << 1;
+      while (c < span) c <<= 1;
+      T** slots = (T**)calloc(c, sizeof(T*));
+      if (slots == NULL)
+        return false;
+      for (uint32_t k = m_first; k != m_end; k++)
+        slots[k & (c - 1)] = m_slots[k & m_mask];
+      free(m_slots);
+      m_slots = slots;
+      m_mask = c - 1;
+      return true;
+      }
+
+    // Move the items below first from the ring to the map
+    void Evict(uint32_t first)
+      {
+      for (; (m_count > 0) && (m_first < first); m_first++)
+        {
+        T* item = m_slots[m_first & m_mask];
+        if (item == NULL)
+          continue;
+        m_slots[m_first & m_mask] = NULL;
+        m_count--;
+        m_old[m_first] = item;
+        }
+      if (m_count == 0)
+        m_first = m_end = 0;
+      else
+        while (m_slots[m_first & m_mask] == NULL) m_first++;
+      }
+
+  protected:
+    T** m_slots;
+    size_t m_mask;
+    size_t m_maxspan;               // Ring capacity limit
+    uint32_t m_first;               // Lowest ID in use
+    uint32_t m_end;                 // Highest ID in use + 1
+    size_t m_count;                 // Items in the ring
+    std::map<uint32_t, T*> m_old;   // Items beyond the span, all below m_first
+  };
+
+#endif //#ifndef __NOTIFY_POOL_H__
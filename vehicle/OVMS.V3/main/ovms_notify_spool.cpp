@@ -0,0 +1,348 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Date:          14th March 2017
+;
+;    Changes:
+;    1.0  Initial release
+;
+;    (C) 2011       Michael Stegen / Stegen Electronics
+;    (C) 2011-2017  Mark Webb-Johnson
+;    (C) 2011        Sonny Chen @ EPRO/DX
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+
+#include "ovms_log.h"
+static const char *TAG = "notify";
+
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <vector>
+#include <algorithm>
+#include "ovms_notify_spool.h"
+#include "crypt_crc.h"
+
+OvmsNotifySpoolSegment::OvmsNotifySpoolSegment(uint32_t seq)
+  {
+  m_seq = seq;
+  m_records = 0;
+  m_paged = 0;
+  m_done = 0;
+  m_offset = 0;
+  m_size = 0;
+  m_idbase = 0;
+  }
+
+OvmsNotifySpool::OvmsNotifySpool()
+  {
+  m_file = NULL;
+  m_fileseq = 0;
+  m_nextseq = 1;
+  m_backlog = 0;
+  m_size = 0;
+  m_stat_spooled = 0;
+  m_stat_paged = 0;
+  m_stat_replayed = 0;
+  m_stat_truncations = 0;
+  }
+
+OvmsNotifySpool::~OvmsNotifySpool()
+  {
+  Close();
+  }
+
+std::string OvmsNotifySpool::SegmentPath(uint32_t seq)
+  {
+  char name[16];
+  snprintf(name, sizeof(name), "/%08x", seq);
+  std::string path = m_dir;
+  path.append(name);
+  path.append(NOTIFYSPOOL_SUFFIX);
+  return path;
+  }
+
+// Open the spool directory and replay the segments left over from a previous
+// run. Their records get new IDs starting at nextid (the old ones may clash
+// with entries queued since boot), nextid is advanced accordingly.
+bool OvmsNotifySpool::Open(std::string dir, uint32_t& nextid)
+  {
+  Close();
+
+  DIR* d = opendir(dir.c_str());
+  if (d == NULL)
+    return false;
+  m_dir = dir;
+
+  std::vector<uint32_t> seqs;
+  struct dirent* dp;
+  while ((dp = readdir(d)) != NULL)
+    {
+    char* end;
+    uint32_t seq = strtoul(dp->d_name, &end, 16);
+    if ((seq > 0) && (end == dp->d_name + 8) && (strcmp(end, NOTIFYSPOOL_SUFFIX) == 0))
+      seqs.push_back(seq);
+    }
+  closedir(d);
+  std::sort(seqs.begin(), seqs.end());
+
+  for (uint32_t seq : seqs)
+    {
+    OvmsNotifySpoolSegment seg(seq);
+    if (Scan(seg) && (seg.m_records > 0))
+      {
+      seg.m_idbase = nextid;
+      nextid += seg.m_records;
+      m_backlog += seg.m_records;
+      m_size += seg.m_size;
+      m_stat_replayed += seg.m_records;
+      m_segments.push_back(seg);
+      }
+    else
+      unlink(SegmentPath(seq).c_str());
+    m_nextseq = seq + 1;
+    }
+
+  if (m_backlog > 0)
+    ESP_LOGI(TAG, "Spool: %s has %u entries in %u segments",
+      m_dir.c_str(), m_backlog, m_segments.size());
+  return true;
+  }
+
+void OvmsNotifySpool::Close()
+  {
+  if (m_file)
+    {
+    fclose(m_file);
+    m_file = NULL;
+    }
+  m_fileseq = 0;
+  m_segments.clear();
+  m_backlog = 0;
+  m_size = 0;
+  m_dir.clear();
+  }
+
+// Count the valid records of a segment; everything after the first bad
+// record (a torn write at power loss) is ignored.
+bool OvmsNotifySpool::Scan(OvmsNotifySpoolSegment& seg)
+  {
+  FILE* f = fopen(SegmentPath(seg.m_seq).c_str(), "rb");
+  if (f == NULL)
+    return false;
+
+  notifyspool_record_t rec;
+  std::string value;
+  size_t n;
+  while ((n = fread(&rec, 1, sizeof(rec), f)) > 0)
+    {
+    bool ok = (n == sizeof(rec)) && (rec.magic == NOTIFYSPOOL_MAGIC);
+    if (ok)
+      {
+      value.resize(rec.length);
+      ok = (rec.length == 0) || (fread(&value[0], 1, rec.length, f) == rec.length);
+      }
+    if (ok)
+      {
+      uint32_t crc = rec.crc;
+      rec.crc = 0;
+      ok = (crc32(crc32(0, (const char*)&rec, sizeof(rec)), value.data(), value.length()) == crc);
+      }
+    if (!ok)
+      {
+      m_stat_truncations++;
+      ESP_LOGW(TAG, "Spool: discarding torn tail of segment %08x after %u records",
+        seg.m_seq, seg.m_records);
+      break;
+      }
+    seg.m_records++;
+    seg.m_size += sizeof(rec) + rec.length;
+    }
+  fclose(f);
+  return true;
+  }
+
+// Append an entry to the newest segment. With paged=true, the caller keeps
+// the entry in RAM (write through), so it will not be paged in again; this
+// is only valid while there is no backlog. Returns the segment number, to
+// be passed to Done() once the entry has been read, or 0 on error. With
+// keep=true, the record is not rolled over into a new segment, so the
+// records of a batch share one segment.
+uint32_t OvmsNotifySpool::Append(uint32_t id, uint32_t created, uint32_t readers,
+                                 const std::string& value, bool paged, bool keep)
+  {
+  if (m_dir.empty() || (value.length() > 0xffff))
+    return 0;
+
+  if (m_file && !keep && (m_segments.back().m_size >= NOTIFYSPOOL_SEGMENT_SIZE))
+    {
+    fclose(m_file);
+    m_file = NULL;
+    }
+  if (m_file == NULL)
+    {
+    uint32_t seq = m_nextseq;
+    m_file = fopen(SegmentPath(seq).c_str(), "wb");
+    if (m_file == NULL)
+      {
+      ESP_LOGE(TAG, "Spool: cannot create segment %08x in %s", seq, m_dir.c_str());
+      return 0;
+      }
+    m_nextseq++;
+    m_fileseq = seq;
+    m_segments.push_back(OvmsNotifySpoolSegment(seq));
+    }
+
+  notifyspool_record_t rec;
+  rec.magic = NOTIFYSPOOL_MAGIC;
+  rec.length = value.length();
+  rec.id = id;
+  rec.created = created;
+  rec.readers = readers;
+  rec.crc = 0;
+  rec.crc = crc32(crc32(0, (const char*)&rec, sizeof(rec)), value.data(), value.length());
+
+  OvmsNotifySpoolSegment& seg = m_segments.back();
+  if ((fwrite(&rec, 1, sizeof(rec), m_file) != sizeof(rec)) ||
+      (fwrite(value.data(), 1, value.length(), m_file) != value.length()) ||
+      (fflush(m_file) != 0))
+    {
+    // The segment may now end in a partial record: continue in a new one
+    ESP_LOGE(TAG, "Spool: write error on segment %08x in %s", seg.m_seq, m_dir.c_str());
+    fclose(m_file);
+    m_file = NULL;
+    if (seg.m_records == 0)
+      Remove(--m_segments.end());
+    return 0;
+    }
+
+  uint32_t size = sizeof(rec) + value.length();
+  seg.m_records++;
+  seg.m_size += size;
+  m_size += size;
+  if (paged)
+    {
+    seg.m_paged++;
+    seg.m_offset = seg.m_size;
+    }
+  else
+    m_backlog++;
+  m_stat_spooled++;
+  return seg.m_seq;
+  }
+
+// Read up to count records in order, calling reader for each of them.
+// Returns the number of records paged in.
+uint32_t OvmsNotifySpool::PageIn(uint32_t count, NotifySpoolReader reader)
+  {
+  uint32_t n = 0;
+  notifyspool_record_t rec;
+  std::string value;
+
+  for (auto it = m_segments.begin(); (it != m_segments.end()) && (n < count); )
+    {
+    OvmsNotifySpoolSegment& seg = *it;
+    if (seg.m_paged >= seg.m_records)
+      {
+      ++it;
+      continue;
+      }
+
+    FILE* f = fopen(SegmentPath(seg.m_seq).c_str(), "rb");
+    if ((f != NULL) && (fseek(f, seg.m_offset, SEEK_SET) != 0))
+      {
+      fclose(f);
+      f = NULL;
+      }
+    while ((f != NULL) && (n < count) && (seg.m_paged < seg.m_records))
+      {
+      bool ok = (fread(&rec, 1, sizeof(rec), f) == sizeof(rec)) && (rec.magic == NOTIFYSPOOL_MAGIC);
+      if (ok)
+        {
+        value.resize(rec.length);
+        ok = (rec.length == 0) || (fread(&value[0], 1, rec.length, f) == rec.length);
+        }
+      if (ok)
+        {
+        uint32_t crc = rec.crc;
+        rec.crc = 0;
+        ok = (crc32(crc32(0, (const char*)&rec, sizeof(rec)), value.data(), value.length()) == crc);
+        }
+      if (!ok)
+        break;
+
+      uint32_t id = (seg.m_idbase != 0) ? (seg.m_idbase + seg.m_paged) : rec.id;
+      seg.m_paged++;
+      seg.m_offset += sizeof(rec) + rec.length;
+      m_backlog--;
+      m_stat_paged++;
+      n++;
+      reader(seg.m_seq, id, rec.created, rec.readers, value, (seg.m_idbase != 0));
+      }
+    if (f != NULL)
+      fclose(f);
+
+    if ((n < count) && (seg.m_paged < seg.m_records))
+      {
+      // The segment has been damaged or removed behind our back
+      m_stat_truncations++;
+      ESP_LOGE(TAG, "Spool: lost %u entries of segment %08x in %s",
+        seg.m_records - seg.m_paged, seg.m_seq, m_dir.c_str());
+      m_backlog -= seg.m_records - seg.m_paged;
+      seg.m_records = seg.m_paged;
+      if (seg.m_done >= seg.m_records)
+        {
+        auto rm = it++;
+        Remove(rm);
+        continue;
+        }
+      }
+    ++it;
+    }
+
+  return n;
+  }
+
+// Entries have been read by all readers: remove their segment once all of
+// its entries are done.
+void OvmsNotifySpool::Done(uint32_t seq, uint32_t count)
+  {
+  for (auto it = m_segments.begin(); it != m_segments.end(); ++it)
+    {
+    if (it->m_seq != seq)
+      continue;
+    it->m_done += count;
+    if ((it->m_done >= it->m_records) && (it->m_paged >= it->m_records))
+      Remove(it);
+    return;
+    }
+  }
+
+void OvmsNotifySpool::Remove(NotifySpoolSegmentList_t::iterator it)
+  {
+  if (m_file && (it->m_seq == m_fileseq))
+    {
+    fclose(m_file);
+    m_file = NULL;
+    }
+  unlink(SegmentPath(it->m_seq).c_str());
+  m_size -= it->m_size;
+  m_segments.erase(it);
+  }
@@ -0,0 +1,126 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Date:          14th March 2017
+;
+;    Changes:
+;    1.0  Initial release
+;
+;    (C) 2011       Michael Stegen / Stegen Electronics
+;    (C) 2011-2017  Mark Webb-Johnson
+;    (C) 2011        Sonny Chen @ EPRO/DX
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+
+#ifndef __NOTIFY_SPOOL_H__
+#define __NOTIFY_SPOOL_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <list>
+#include <functional>
+
+// Segmented on-disk FIFO for notification entries: records are appended to
+// the newest segment file, paged back in order, and a segment file is
+// removed once all of its entries have been read by all readers. Open()
+// replays the segments left by a previous run, so delivery is "at least
+// once": entries of a partially read segment are delivered again after a
+// restart.
+//
+// The spool only uses stdio, so it can be tested on any host against a plain
+// directory (see "test notifyspool").
+
+#define NOTIFYSPOOL_MAGIC           0x534E      // "NS"
+#define NOTIFYSPOOL_SEGMENT_SIZE    4096        // Segment roll over size
+#define NOTIFYSPOOL_SUFFIX          ".nsp"
+
+typedef struct __attribute__ ((__packed__))
+  {
+  uint16_t magic;
+  uint16_t length;                // Value length
+  uint32_t id;
+  uint32_t created;
+  uint32_t readers;               // Pending readers bitset, valid for the writing run only
+  uint32_t crc;                   // Header (with crc=0) plus value
+  } notifyspool_record_t;
+
+class OvmsNotifySpoolSegment
+  {
+  public:
+    OvmsNotifySpoolSegment(uint32_t seq);
+
+  public:
+    uint32_t m_seq;
+    uint32_t m_records;             // Valid records in the file
+    uint32_t m_paged;               // Records read back (or kept in RAM)
+    uint32_t m_done;                // Records read by all readers
+    uint32_t m_offset;              // File position of the next record to page in
+    uint32_t m_size;
+    uint32_t m_idbase;              // Replayed segment: ID of the first record, else 0
+  };
+
+typedef std::list<OvmsNotifySpoolSegment> NotifySpoolSegmentList_t;
+
+typedef std::function<void(uint32_t seq, uint32_t id, uint32_t created,
+                           uint32_t readers, const std::string& value, bool replayed)> NotifySpoolReader;
+
+class OvmsNotifySpool
+  {
+  public:
+    OvmsNotifySpool();
+    ~OvmsNotifySpool();
+
+  public:
+    bool Open(std::string dir, uint32_t& nextid);
+    void Close();
+    bool IsOpen() { return !m_dir.empty(); }
+    uint32_t Append(uint32_t id, uint32_t created, uint32_t readers,
+                    const std::string& value, bool paged, bool keep = false);
+    uint32_t PageIn(uint32_t count, NotifySpoolReader reader);
+    void Done(uint32_t seq, uint32_t count = 1);
+
+  protected:
+    std::string SegmentPath(uint32_t seq);
+    bool Scan(OvmsNotifySpoolSegment& seg);
+    void Remove(NotifySpoolSegmentList_t::iterator it);
+
+  protected:
+    std::string m_dir;
+    FILE* m_file;                   // Newest segment, open for appending
+    uint32_t m_fileseq;
+    uint32_t m_nextseq;
+    NotifySpoolSegmentList_t m_segments;
+    uint32_t m_backlog;             // Records not paged in yet
+    uint32_t m_size;
+
+  public:
+    uint32_t m_stat_spooled;
+    uint32_t m_stat_paged;
+    uint32_t m_stat_replayed;       // Records found on Open()
+    uint32_t m_stat_truncations;    // Torn/corrupt segment tails discarded
+
+  public:
+    uint32_t Backlog() { return m_backlog; }
+    uint32_t Segments() { return m_segments.size(); }
+    uint32_t Size() { return m_size; }
+    const std::string& Dir() { return m_dir; }
+  };
+
+#endif //#ifndef __NOTIFY_SPOOL_H__
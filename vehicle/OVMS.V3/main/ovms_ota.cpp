@@ -435,6 +435,7 @@ void OvmsOTA::AutoFlashSD(std::string event, void* data)
                  (int)ds.st_size,target->label);
 
   ESP_LOGI(TAG, "AutoFlashSD restarting...");
+  MyEvents.SignalEventSync("system.shutdown", NULL);
   esp_restart();
   }
 
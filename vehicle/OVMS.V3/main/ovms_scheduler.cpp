@@ -0,0 +1,430 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Date:          14th March 2017
+;
+;    Changes:
+;    1.0  Initial release
+;
+;    (C) 2011       Michael Stegen / Stegen Electronics
+;    (C) 2011-2017  Mark Webb-Johnson
+;    (C) 2011        Sonny Chen @ EPRO/DX
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+
+#include "ovms_log.h"
+static const char *TAG = "scheduler";
+
+#include <string.h>
+#include <stdio.h>
+#include "xtensa/hal.h"
+#include "ovms_scheduler.h"
+#include "ovms_command.h"
+#include "ovms_module.h"
+
+OvmsScheduler MyScheduler __attribute__ ((init_priority (1250)));
+
+void scheduler_status(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  if ((argc > 0)&&(strcmp(argv[0],"reset")==0))
+    {
+    MyScheduler.ResetStats();
+    writer->puts("Scheduler statistics reset");
+    return;
+    }
+  MyScheduler.ShowStatus(writer);
+  }
+
+static void SchedulerLaunchTask(void *pvParameters)
+  {
+  OvmsScheduler* me = (OvmsScheduler*)pvParameters;
+  me->SchedulerTask();
+  }
+
+static void SchedulerLaunchWorker(void *pvParameters)
+  {
+  OvmsScheduler* me = (OvmsScheduler*)pvParameters;
+  me->WorkerTask();
+  }
+
+OvmsSchedulerJob::OvmsSchedulerJob(std::string caller, uint32_t period, SchedulerCallback callback, event_id_t event)
+  {
+  m_id = 0;
+  m_caller = caller;
+  m_period = period;
+  m_rounds = 0;
+  m_slot = 0;
+  m_cancelled = false;
+  m_worker = false;
+  m_callback = callback;
+  m_event = event;
+  m_next = NULL;
+  m_runs = 0;
+  m_overruns = 0;
+  m_time_max = 0;
+  m_time_total = 0;
+  }
+
+OvmsSchedulerJob::~OvmsSchedulerJob()
+  {
+  }
+
+OvmsScheduler::OvmsScheduler()
+  {
+  ESP_LOGI(TAG, "Initialising SCHEDULER (1250)");
+
+  for (int k=0; k<SCHEDULER_SLOTS; k++)
+    m_wheel[k] = NULL;
+  m_running = NULL;
+  m_current = 0;
+  m_lastid = 0;
+  m_stat_ticks = 0;
+  m_stat_late = 0;
+  m_stat_runs = 0;
+  m_stat_worker_runs = 0;
+  m_stat_worker_busy = 0;
+
+  m_mutex = xSemaphoreCreateMutex();
+  m_workerqueue = xQueueCreate(SCHEDULER_WORKER_QUEUE, sizeof(OvmsSchedulerJob*));
+  xTaskCreatePinnedToCore(SchedulerLaunchTask, "OVMS Scheduler", 4096, (void*)this, 5, &m_taskid, 1);
+  AddTaskToMap(m_taskid);
+  xTaskCreatePinnedToCore(SchedulerLaunchWorker, "OVMS SchedWork", SCHEDULER_WORKER_STACK, (void*)this, 5, &m_workerid, 1);
+  AddTaskToMap(m_workerid);
+
+  OvmsCommand* cmd_sched = MyCommandApp.RegisterCommand("scheduler","SCHEDULER framework",NULL, "", 1);
+  cmd_sched->RegisterCommand("status","Show scheduled jobs and statistics",scheduler_status,"[reset]", 0, 1, true);
+  }
+
+OvmsScheduler::~OvmsScheduler()
+  {
+  }
+
+void OvmsScheduler::SchedulerTask()
+  {
+  TickType_t period = SCHEDULER_TICK_MS / portTICK_PERIOD_MS;
+  TickType_t last = xTaskGetTickCount();
+
+  while (1)
+    {
+    vTaskDelayUntil(&last, period);
+    // vTaskDelayUntil() returns at once while we are catching up:
+    if ((TickType_t)(xTaskGetTickCount() - last) >= period)
+      m_stat_late++;
+    Tick();
+    }
+  }
+
+void OvmsScheduler::WorkerTask()
+  {
+  OvmsSchedulerJob* job;
+
+  while (1)
+    {
+    if (xQueueReceive(m_workerqueue, &job, (portTickType)portMAX_DELAY) == pdTRUE)
+      {
+      // Worker jobs are one-shots handed over by Tick(), not in the wheel
+      // any more, so they are ours to run and delete:
+      if (!job->m_cancelled)
+        {
+        uint32_t start = xthal_get_ccount();
+        job->m_callback();
+        uint32_t cycles = xthal_get_ccount() - start;
+        xSemaphoreTake(m_mutex, portMAX_DELAY);
+        m_stat_worker_runs++;
+        xSemaphoreGive(m_mutex);
+        if (cycles > SCHEDULER_TICK_MS * 1000 * CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ)
+          ESP_LOGD(TAG, "Worker job of %s took %u us", job->m_caller.c_str(),
+            cycles / CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ);
+        }
+      delete job;
+      }
+    }
+  }
+
+scheduler_job_t OvmsScheduler::Register(std::string caller, uint32_t period_ms, SchedulerCallback callback, int32_t offset_ms)
+  {
+  uint32_t period = (period_ms + SCHEDULER_TICK_MS - 1) / SCHEDULER_TICK_MS;
+  if (period == 0) period = 1;
+  return Add(new OvmsSchedulerJob(caller, period, callback, EVENT_NONE), period, offset_ms);
+  }
+
+scheduler_job_t OvmsScheduler::RegisterEvent(std::string caller, uint32_t period_ms, event_id_t event, int32_t offset_ms)
+  {
+  uint32_t period = (period_ms + SCHEDULER_TICK_MS - 1) / SCHEDULER_TICK_MS;
+  if (period == 0) period = 1;
+  return Add(new OvmsSchedulerJob(caller, period, NULL, event), period, offset_ms);
+  }
+
+scheduler_job_t OvmsScheduler::RunOnce(std::string caller, uint32_t delay_ms, SchedulerCallback callback, bool worker)
+  {
+  uint32_t delay = (delay_ms + SCHEDULER_TICK_MS - 1) / SCHEDULER_TICK_MS;
+  if (delay == 0) delay = 1;
+  OvmsSchedulerJob* job = new OvmsSchedulerJob(caller, 0, callback, EVENT_NONE);
+  job->m_worker = worker;
+  return Add(job, delay, 0);
+  }
+
+scheduler_job_t OvmsScheduler::Add(OvmsSchedulerJob* job, uint32_t delay, int32_t offset_ms)
+  {
+  xSemaphoreTake(m_mutex, portMAX_DELAY);
+  job->m_id = ++m_lastid;
+  if ((offset_ms == SCHEDULER_OFFSET_AUTO) && (job->m_period > 0))
+    {
+    // Choose the least loaded phase within one second (or the period):
+    uint32_t phases = 1000 / SCHEDULER_TICK_MS;
+    if (phases > job->m_period) phases = job->m_period;
+    uint32_t best = 0;
+    int bestload = -1;
+    for (uint32_t p=0; p<phases; p++)
+      {
+      int load = SlotLoad((m_current + delay + p) % SCHEDULER_SLOTS);
+      if ((bestload < 0) || (load < bestload))
+        {
+        best = p;
+        bestload = load;
+        }
+      }
+    delay += best;
+    }
+  else if (offset_ms > 0)
+    {
+    delay += offset_ms / SCHEDULER_TICK_MS;
+    }
+  Insert(job, delay);
+  scheduler_job_t id = job->m_id;
+  xSemaphoreGive(m_mutex);
+  return id;
+  }
+
+int OvmsScheduler::SlotLoad(uint16_t slot)
+  {
+  int load = 0;
+  for (OvmsSchedulerJob* job = m_wheel[slot]; job; job = job->m_next)
+    load++;
+  return load;
+  }
+
+void OvmsScheduler::Insert(OvmsSchedulerJob* job, uint32_t delay)
+  {
+  // Mutex held by caller
+  job->m_slot = (m_current + delay) % SCHEDULER_SLOTS;
+  job->m_rounds = (delay - 1) / SCHEDULER_SLOTS;
+  job->m_next = m_wheel[job->m_slot];
+  m_wheel[job->m_slot] = job;
+  }
+
+bool OvmsScheduler::Unlink(OvmsSchedulerJob* job)
+  {
+  // Mutex held by caller
+  for (OvmsSchedulerJob** pp = &m_wheel[job->m_slot]; *pp; pp = &(*pp)->m_next)
+    {
+    if (*pp == job)
+      {
+      *pp = job->m_next;
+      job->m_next = NULL;
+      return true;
+      }
+    }
+  return false;
+  }
+
+void OvmsScheduler::Cancel(scheduler_job_t id)
+  {
+  xSemaphoreTake(m_mutex, portMAX_DELAY);
+  for (OvmsSchedulerJob* job = m_running; job; job = job->m_next)
+    {
+    if (job->m_id == id)
+      {
+      // Currently running, the scheduler task disposes of it
+      job->m_cancelled = true;
+      xSemaphoreGive(m_mutex);
+      return;
+      }
+    }
+  for (int k=0; k<SCHEDULER_SLOTS; k++)
+    {
+    for (OvmsSchedulerJob* job = m_wheel[k]; job; job = job->m_next)
+      {
+      if (job->m_id == id)
+        {
+        Unlink(job);
+        delete job;
+        xSemaphoreGive(m_mutex);
+        return;
+        }
+      }
+    }
+  xSemaphoreGive(m_mutex);
+  }
+
+void OvmsScheduler::Deregister(std::string caller)
+  {
+  xSemaphoreTake(m_mutex, portMAX_DELAY);
+  for (OvmsSchedulerJob* job = m_running; job; job = job->m_next)
+    {
+    if (job->m_caller == caller)
+      job->m_cancelled = true;
+    }
+  for (int k=0; k<SCHEDULER_SLOTS; k++)
+    {
+    OvmsSchedulerJob** pp = &m_wheel[k];
+    while (*pp)
+      {
+      OvmsSchedulerJob* job = *pp;
+      if (job->m_caller == caller)
+        {
+        *pp = job->m_next;
+        delete job;
+        }
+      else
+        pp = &job->m_next;
+      }
+    }
+  xSemaphoreGive(m_mutex);
+  }
+
+void OvmsScheduler::Tick()
+  {
+  // Collect the due jobs of the next slot:
+  xSemaphoreTake(m_mutex, portMAX_DELAY);
+  m_stat_ticks++;
+  m_current = (m_current + 1) % SCHEDULER_SLOTS;
+  OvmsSchedulerJob** pp = &m_wheel[m_current];
+  OvmsSchedulerJob** tail = &m_running;
+  while (*pp)
+    {
+    OvmsSchedulerJob* job = *pp;
+    if (job->m_rounds > 0)
+      {
+      job->m_rounds--;
+      pp = &job->m_next;
+      }
+    else
+      {
+      *pp = job->m_next;
+      job->m_next = NULL;
+      *tail = job;
+      tail = &job->m_next;
+      }
+    }
+  xSemaphoreGive(m_mutex);
+
+  if (m_running == NULL)
+    return;
+
+  // Run them without holding the mutex, so jobs may (de)register jobs:
+  for (OvmsSchedulerJob* job = m_running; job; job = job->m_next)
+    {
+    if (job->m_cancelled || job->m_worker)
+      continue;
+    uint32_t start = xthal_get_ccount();
+    if (job->m_callback)
+      job->m_callback();
+    else
+      MyEvents.SignalEvent(job->m_event, NULL);
+    uint32_t cycles = xthal_get_ccount() - start;
+    job->m_runs++;
+    job->m_time_total += cycles;
+    if (cycles > job->m_time_max) job->m_time_max = cycles;
+    if (cycles > SCHEDULER_TICK_MS * 1000 * CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ)
+      job->m_overruns++;
+    m_stat_runs++;
+    }
+
+  // Reschedule periodic jobs relative to their due time, to avoid drift:
+  xSemaphoreTake(m_mutex, portMAX_DELAY);
+  while (m_running)
+    {
+    OvmsSchedulerJob* job = m_running;
+    m_running = job->m_next;
+    job->m_next = NULL;
+    if (job->m_worker && !job->m_cancelled)
+      {
+      // Hand over to the worker, retry next tick if it is busy:
+      if (xQueueSend(m_workerqueue, &job, 0) != pdTRUE)
+        {
+        m_stat_worker_busy++;
+        Insert(job, 1);
+        }
+      }
+    else if (job->m_cancelled || job->m_period == 0)
+      delete job;
+    else
+      Insert(job, job->m_period);
+    }
+  xSemaphoreGive(m_mutex);
+  }
+
+void OvmsScheduler::ResetStats()
+  {
+  xSemaphoreTake(m_mutex, portMAX_DELAY);
+  m_stat_ticks = 0;
+  m_stat_late = 0;
+  m_stat_runs = 0;
+  m_stat_worker_runs = 0;
+  m_stat_worker_busy = 0;
+  for (int k=0; k<SCHEDULER_SLOTS; k++)
+    {
+    for (OvmsSchedulerJob* job = m_wheel[k]; job; job = job->m_next)
+      {
+      job->m_runs = 0;
+      job->m_overruns = 0;
+      job->m_time_max = 0;
+      job->m_time_total = 0;
+      }
+    }
+  xSemaphoreGive(m_mutex);
+  }
+
+void OvmsScheduler::ShowStatus(OvmsWriter* writer)
+  {
+  // Format under the mutex, output after: the writer may block
+  std::string out;
+  char line[160];
+  int jobs = 0;
+  snprintf(line, sizeof(line), "%-5s %-16s %-20s %8s %8s %8s %8s %6s\n",
+    "Id", "Caller", "Target", "Period", "Next(s)", "Runs", "Max(us)", "Overr");
+  out.append(line);
+  xSemaphoreTake(m_mutex, portMAX_DELAY);
+  for (int k=0; k<SCHEDULER_SLOTS; k++)
+    {
+    for (OvmsSchedulerJob* job = m_wheel[k]; job; job = job->m_next)
+      {
+      uint32_t next = ((k - m_current + SCHEDULER_SLOTS) % SCHEDULER_SLOTS
+                       + job->m_rounds * SCHEDULER_SLOTS) * SCHEDULER_TICK_MS;
+      char period[16];
+      if (job->m_period)
+        snprintf(period, sizeof(period), "%.1f", (float)(job->m_period * SCHEDULER_TICK_MS) / 1000);
+      else
+        strcpy(period, "once");
+      snprintf(line, sizeof(line), "%-5u %-16s %-20s %8s %8.1f %8u %8u %6u\n",
+        job->m_id, job->m_caller.c_str(),
+        job->m_callback ? (job->m_worker ? "(worker task)" : "(scheduler task)") : MyEvents.GetEventName(job->m_event).c_str(),
+        period, (float)next / 1000, job->m_runs,
+        job->m_time_max / CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ, job->m_overruns);
+      out.append(line);
+      jobs++;
+      }
+    }
+  snprintf(line, sizeof(line), "%d jobs, %u ticks (%u late), %u runs, %u worker runs (%u postponed)\n",
+    jobs, m_stat_ticks, m_stat_late, m_stat_runs, m_stat_worker_runs, m_stat_worker_busy);
+  out.append(line);
+  xSemaphoreGive(m_mutex);
+  writer->write(out.c_str(), out.length());
+  }
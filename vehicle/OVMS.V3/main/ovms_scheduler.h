@@ -0,0 +1,137 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Date:          14th March 2017
+;
+;    Changes:
+;    1.0  Initial release
+;
+;    (C) 2011       Michael Stegen / Stegen Electronics
+;    (C) 2011-2017  Mark Webb-Johnson
+;    (C) 2011        Sonny Chen @ EPRO/DX
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+
+#ifndef __SCHEDULER_H__
+#define __SCHEDULER_H__
+
+#include <string>
+#include <functional>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "freertos/queue.h"
+#include "ovms_events.h"
+
+// The scheduler runs a hashed timer wheel: SCHEDULER_SLOTS slots of
+// SCHEDULER_TICK_MS each, jobs further out than one wheel revolution
+// wait for the necessary number of rounds in their slot.
+#define SCHEDULER_TICK_MS     100
+#define SCHEDULER_SLOTS       256
+
+// Offset value to let the scheduler choose the least loaded phase (within
+// one second) for a periodic job, so e.g. all minute jobs don't coincide.
+// This is opt in: jobs registered without an offset run in phase 0.
+#define SCHEDULER_OFFSET_AUTO -1
+
+// One-shot jobs doing file I/O or other stack hungry work run on the worker
+// task, so they neither overflow the scheduler stack nor delay other jobs.
+// Once due, a worker job is queued and can no longer be cancelled.
+#define SCHEDULER_WORKER_STACK  8192
+#define SCHEDULER_WORKER_QUEUE  8
+
+typedef uint32_t scheduler_job_t;
+typedef std::function<void()> SchedulerCallback;
+
+class OvmsSchedulerJob
+  {
+  public:
+    OvmsSchedulerJob(std::string caller, uint32_t period, SchedulerCallback callback, event_id_t event);
+    ~OvmsSchedulerJob();
+
+  public:
+    scheduler_job_t m_id;
+    std::string m_caller;
+    uint32_t m_period;              // Ticks, 0 = one-shot
+    uint32_t m_rounds;              // Wheel revolutions left
+    uint16_t m_slot;
+    bool m_cancelled;
+    bool m_worker;                  // Run the callback on the worker task
+    SchedulerCallback m_callback;   // Runs on the scheduler task, or...
+    event_id_t m_event;             // ...signals an event (runs on the event task)
+    OvmsSchedulerJob* m_next;
+
+  public:
+    uint32_t m_runs;
+    uint32_t m_overruns;            // Runs longer than one tick
+    uint32_t m_time_max;            // CPU cycles
+    uint64_t m_time_total;
+  };
+
+class OvmsScheduler
+  {
+  public:
+    OvmsScheduler();
+    ~OvmsScheduler();
+
+  public:
+    scheduler_job_t Register(std::string caller, uint32_t period_ms, SchedulerCallback callback,
+                             int32_t offset_ms = 0);
+    scheduler_job_t RegisterEvent(std::string caller, uint32_t period_ms, event_id_t event,
+                                  int32_t offset_ms = 0);
+    scheduler_job_t RunOnce(std::string caller, uint32_t delay_ms, SchedulerCallback callback,
+                            bool worker = false);
+    void Cancel(scheduler_job_t job);
+    void Deregister(std::string caller);
+
+  public:
+    void SchedulerTask();
+    void WorkerTask();
+    void ShowStatus(OvmsWriter* writer);
+    void ResetStats();
+
+  protected:
+    scheduler_job_t Add(OvmsSchedulerJob* job, uint32_t delay, int32_t offset_ms);
+    void Insert(OvmsSchedulerJob* job, uint32_t delay);
+    bool Unlink(OvmsSchedulerJob* job);
+    int SlotLoad(uint16_t slot);
+    void Tick();
+
+  protected:
+    SemaphoreHandle_t m_mutex;
+    TaskHandle_t m_taskid;
+    TaskHandle_t m_workerid;
+    QueueHandle_t m_workerqueue;    // Due worker jobs, owned by the worker
+    OvmsSchedulerJob* m_wheel[SCHEDULER_SLOTS];
+    OvmsSchedulerJob* m_running;    // Due jobs of the current tick
+    uint16_t m_current;
+    scheduler_job_t m_lastid;
+
+  public:
+    uint32_t m_stat_ticks;
+    uint32_t m_stat_late;           // Ticks processed behind schedule
+    uint32_t m_stat_runs;
+    uint32_t m_stat_worker_runs;
+    uint32_t m_stat_worker_busy;    // Worker jobs postponed on a full queue
+  };
+
+extern OvmsScheduler MyScheduler;
+
+#endif //#ifndef __SCHEDULER_H__
@@ -113,19 +113,86 @@ void OvmsScripts::AllScripts(std::string path)
     }
   }
 
-void OvmsScripts::EventScript(std::string event, void* data)
+// The event script directories are indexed once, so the common case of an
+// event without scripts costs a single hash lookup instead of two failed
+// opendir() calls. Only the event directories themselves are indexed: new
+// scripts within an existing directory are found without reindexing, new
+// directories need InvalidateEventIndex().
+void OvmsScripts::IndexEventRoot(const char* root, uint8_t flag)
   {
+  DIR *dir;
+  struct dirent *dp;
+
+  if ((dir = opendir(root)) != NULL)
+    {
+    while ((dp = readdir(dir)) != NULL)
+      {
+      if (dp->d_name[0] == '.') continue;
+      m_eventindex[dp->d_name] |= flag;
+      }
+    closedir(dir);
+    }
+  }
+
+void OvmsScripts::BuildEventIndex()
+  {
+  m_eventindex.clear();
+#ifdef CONFIG_OMMS_DEV_SDCARDSCRIPTS
+  IndexEventRoot("/sd/events", EVENTINDEX_SD);
+#endif // #ifdef CONFIG_OMMS_DEV_SDCARDSCRIPTS
+  IndexEventRoot("/store/events", EVENTINDEX_STORE);
+  m_eventindex_valid = true;
+  ESP_LOGD(TAG, "Event script index rebuilt: %u events", m_eventindex.size());
+  }
+
+void OvmsScripts::InvalidateEventIndex(const char* path)
+  {
+  if ((path != NULL) &&
+      (strncmp(path, "/store/events", 13) != 0) &&
+      (strncmp(path, "/sd/events", 10) != 0) &&
+      (strcmp(path, "/store") != 0) &&
+      (strcmp(path, "/sd") != 0))
+    return;
+
+  xSemaphoreTake(m_eventindex_mutex, portMAX_DELAY);
+  m_eventindex_valid = false;
+  xSemaphoreGive(m_eventindex_mutex);
+  }
+
+void OvmsScripts::EventTrigger(std::string event, void* data)
+  {
+  InvalidateEventIndex();
+  }
+
+void OvmsScripts::EventScript(const std::string& event, void* data)
+  {
+  xSemaphoreTake(m_eventindex_mutex, portMAX_DELAY);
+  if (!m_eventindex_valid)
+    BuildEventIndex();
+  auto k = m_eventindex.find(event);
+  uint8_t flags = (k == m_eventindex.end()) ? 0 : k->second;
+  xSemaphoreGive(m_eventindex_mutex);
+
+  if (flags == 0)
+    return;
+
   std::string path;
 
 #ifdef CONFIG_OMMS_DEV_SDCARDSCRIPTS
-  path=std::string("/sd/events/");
-  path.append(event);
-  AllScripts(path);
+  if (flags & EVENTINDEX_SD)
+    {
+    path=std::string("/sd/events/");
+    path.append(event);
+    AllScripts(path);
+    }
 #endif // #ifdef CONFIG_OMMS_DEV_SDCARDSCRIPTS
 
-  path=std::string("/store/events/");
-  path.append(event);
-  AllScripts(path);
+  if (flags & EVENTINDEX_STORE)
+    {
+    path=std::string("/store/events/");
+    path.append(event);
+    AllScripts(path);
+    }
   }
 
 #ifdef CONFIG_OVMS_SC_JAVASCRIPT_DUKTAPE
@@ -141,6 +208,17 @@ OvmsScripts::OvmsScripts()
   {
   ESP_LOGI(TAG, "Initialising SCRIPTS (1600)");
 
+  m_eventindex_mutex = xSemaphoreCreateMutex();
+  m_eventindex_valid = false;
+
+  #undef bind  // Kludgy, but works
+  using std::placeholders::_1;
+  using std::placeholders::_2;
+  MyEvents.RegisterEvent(TAG,"config.mounted", std::bind(&OvmsScripts::EventTrigger, this, _1, _2));
+  MyEvents.RegisterEvent(TAG,"config.unmounted", std::bind(&OvmsScripts::EventTrigger, this, _1, _2));
+  MyEvents.RegisterEvent(TAG,"sd.mounted", std::bind(&OvmsScripts::EventTrigger, this, _1, _2));
+  MyEvents.RegisterEvent(TAG,"sd.unmounted", std::bind(&OvmsScripts::EventTrigger, this, _1, _2));
+
 #ifdef CONFIG_OVMS_SC_JAVASCRIPT_NONE
   ESP_LOGI(TAG, "No javascript engines enabled (command scripting only)");
 #endif //#ifdef CONFIG_OVMS_SC_JAVASCRIPT_NONE
@@ -31,12 +31,19 @@
 #ifndef __SCRIPT_H__
 #define __SCRIPT_H__
 
+#include <string>
+#include <unordered_map>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 #include "ovms_command.h"
 
 #ifdef CONFIG_OVMS_SC_JAVASCRIPT_DUKTAPE
 #include "duktape.h"
 #endif //#ifdef CONFIG_OVMS_SC_JAVASCRIPT_DUKTAPE
 
+#define EVENTINDEX_SD      0x01
+#define EVENTINDEX_STORE   0x02
+
 class OvmsScripts
   {
   public:
@@ -44,8 +51,19 @@ class OvmsScripts
     ~OvmsScripts();
 
   public:
-    void EventScript(std::string event, void* data);
+    void EventScript(const std::string& event, void* data);
     void AllScripts(std::string path);
+    void InvalidateEventIndex(const char* path = NULL);
+
+  protected:
+    void BuildEventIndex();
+    void IndexEventRoot(const char* root, uint8_t flag);
+    void EventTrigger(std::string event, void* data);
+
+  protected:
+    SemaphoreHandle_t m_eventindex_mutex;
+    std::unordered_map<std::string, uint8_t> m_eventindex;   // event name → EVENTINDEX_* flags
+    bool m_eventindex_valid;
 
 #ifdef CONFIG_OVMS_SC_JAVASCRIPT_DUKTAPE
   public:
@@ -42,6 +42,7 @@ static const char *TAG = "vfs";
 #include "ovms_vfs.h"
 #include "ovms_config.h"
 #include "ovms_command.h"
+#include "ovms_script.h"
 
 #ifdef CONFIG_OVMS_COMP_EDITOR
 #include "vfsedit.h"
@@ -131,7 +132,11 @@ void vfs_mv(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const
     return;
     }
   if (rename(argv[0],argv[1]) == 0)
-    { writer->puts("VFS File renamed"); }
+    {
+    MyScripts.InvalidateEventIndex(argv[0]);
+    MyScripts.InvalidateEventIndex(argv[1]);
+    writer->puts("VFS File renamed");
+    }
   else
     { writer->puts("Error: Could not rename VFS file"); }
   }
@@ -145,7 +150,10 @@ void vfs_mkdir(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, co
     }
 
   if (mkdir(argv[0],0) == 0)
-    { writer->puts("VFS directory created"); }
+    {
+    MyScripts.InvalidateEventIndex(argv[0]);
+    writer->puts("VFS directory created");
+    }
   else
     { writer->puts("Error: Could not create VFS directory"); }
   }
@@ -159,7 +167,10 @@ void vfs_rmdir(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, co
     }
 
   if (rmdir(argv[0]) == 0)
-    { writer->puts("VFS directory removed"); }
+    {
+    MyScripts.InvalidateEventIndex(argv[0]);
+    writer->puts("VFS directory removed");
+    }
   else
     { writer->puts("Error: Could not remove VFS directory"); }
   }
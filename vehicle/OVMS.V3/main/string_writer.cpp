@@ -0,0 +1,98 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Date:          14th March 2017
+;
+;    Changes:
+;    1.0  Initial release
+;
+;    (C) 2011       Michael Stegen / Stegen Electronics
+;    (C) 2011-2017  Mark Webb-Johnson
+;    (C) 2011        Sonny Chen @ EPRO/DX
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include "string_writer.h"
+#include "log_buffers.h"
+
+StringWriter::StringWriter(size_t size)
+  {
+  if (size)
+    reserve(size);
+  }
+
+StringWriter::~StringWriter()
+  {
+  }
+
+int StringWriter::puts(const char* s)
+  {
+  append(s);
+  push_back('\n');
+  return 0;
+  }
+
+int StringWriter::printf(const char* fmt, ...)
+  {
+  // Format on the stack, only long output needs a heap buffer:
+  char buf[128];
+  va_list args;
+  va_start(args, fmt);
+  int ret = vsnprintf(buf, sizeof(buf), fmt, args);
+  va_end(args);
+  if (ret < 0)
+    return ret;
+  if ((size_t)ret < sizeof(buf))
+    {
+    append(buf, ret);
+    return ret;
+    }
+  char *buffer;
+  va_start(args, fmt);
+  ret = vasprintf(&buffer, fmt, args);
+  va_end(args);
+  if (ret >= 0)
+    {
+    append(buffer, ret);
+    free(buffer);
+    }
+  return ret;
+  }
+
+ssize_t StringWriter::write(const void *buf, size_t nbyte)
+  {
+  append((const char*)buf, nbyte);
+  return nbyte;
+  }
+
+char ** StringWriter::GetCompletion(OvmsCommandMap& children, const char* token)
+  {
+  return NULL;
+  }
+
+void StringWriter::Log(LogBuffers* message)
+  {
+  for (LogBuffers::iterator i = message->begin(); i != message->end(); ++i)
+    append(*i);
+  message->release();
+  }
@@ -33,14 +33,33 @@ static const char *TAG = "test";
 
 #include <stdio.h>
 #include <string.h>
+#include <sstream>
 #include "esp_system.h"
 #include "esp_event.h"
 #include "esp_event_loop.h"
 #include "esp_deep_sleep.h"
+#include "xtensa/hal.h"
 #include "test_framework.h"
 #include "ovms_command.h"
 #include "ovms_peripherals.h"
 #include "ovms_script.h"
+#include "ovms_metrics.h"
+#include "ovms_events.h"
+#include "ovms_config.h"
+#include "ovms_config_store.h"
+#include "ovms_notify_spool.h"
+#include "ovms_notify.h"
+#include "esp_heap_alloc_caps.h"
+#include "crypt_rc4.h"
+#include "crypt_base64.h"
+#include "ovms_net.h"
+#include "freertos/timers.h"
+#include <unistd.h>
+#include <sys/stat.h>
+#include <list>
+#include <vector>
+#include <atomic>
+#include <map>
 
 void test_deepsleep(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
   {
@@ -137,6 +156,774 @@ void test_chargen(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc,
     }
   }
 
+// Measure the cost of metric reads and writes (in CPU cycles per call).
+void test_metrics(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  int loops = 1000;
+  if (argc==1)
+    {
+    loops = atoi(argv[0]);
+    }
+  if (loops <= 0) loops = 1;
+
+  // Scratch metrics are created once and kept, metrics cannot be deleted safely:
+  static OvmsMetricFloat* mf = NULL;
+  static OvmsMetricString* ms = NULL;
+  if (mf == NULL)
+    mf = MyMetrics.InitFloat("test.metric.float");
+  if (ms == NULL)
+    ms = MyMetrics.InitString("test.metric.string");
+
+  uint32_t start, cycles;
+  float f = 0;
+
+  mf->SetValue(1.0f);
+  start = xthal_get_ccount();
+  for (int k=0;k<loops;k++)
+    mf->SetValue(1.0f);
+  cycles = xthal_get_ccount() - start;
+  writer->printf("Float SetValue (unchanged): %u cycles/call\n", cycles/loops);
+
+  start = xthal_get_ccount();
+  for (int k=0;k<loops;k++)
+    mf->SetValue((float)(k&1));
+  cycles = xthal_get_ccount() - start;
+  writer->printf("Float SetValue (changed):   %u cycles/call\n", cycles/loops);
+
+  start = xthal_get_ccount();
+  for (int k=0;k<loops;k++)
+    f += mf->AsFloat();
+  cycles = xthal_get_ccount() - start;
+  writer->printf("Float AsFloat:              %u cycles/call\n", cycles/loops);
+
+  start = xthal_get_ccount();
+  for (int k=0;k<loops;k++)
+    ms->SetValue((k&1) ? "odd" : "even");
+  cycles = xthal_get_ccount() - start;
+  writer->printf("String SetValue (changed):  %u cycles/call\n", cycles/loops);
+
+  size_t len = 0;
+  start = xthal_get_ccount();
+  for (int k=0;k<loops;k++)
+    len += ms->AsString().length();
+  cycles = xthal_get_ccount() - start;
+  writer->printf("String AsString:            %u cycles/call\n", cycles/loops);
+
+  OvmsMetricSnapshot snapshot({ mf, ms });
+  start = xthal_get_ccount();
+  for (int k=0;k<loops;k++)
+    {
+    do
+      {
+      snapshot.Begin();
+      f += mf->AsFloat();
+      } while (snapshot.Changed());
+    }
+  cycles = xthal_get_ccount() - start;
+  writer->printf("Snapshot read (2 metrics):  %u cycles/call\n", cycles/loops);
+
+  // Formatting: iostream vs. heap free formatters
+  char buf[32];
+  mf->SetValue(1234.5678f);
+  start = xthal_get_ccount();
+  for (int k=0;k<loops;k++)
+    {
+    std::ostringstream ss;
+    ss.precision(2);
+    ss << std::fixed << mf->AsFloat();
+    len += ss.str().length();
+    }
+  cycles = xthal_get_ccount() - start;
+  writer->printf("Float format (iostream):    %u cycles/call\n", cycles/loops);
+
+  start = xthal_get_ccount();
+  for (int k=0;k<loops;k++)
+    len += mf->AsString("",Other,2).length();
+  cycles = xthal_get_ccount() - start;
+  writer->printf("Float AsString:             %u cycles/call\n", cycles/loops);
+
+  start = xthal_get_ccount();
+  for (int k=0;k<loops;k++)
+    len += mf->AppendTo(buf, sizeof(buf), "", Other, 2);
+  cycles = xthal_get_ccount() - start;
+  writer->printf("Float AppendTo:             %u cycles/call\n", cycles/loops);
+
+  start = xthal_get_ccount();
+  for (int k=0;k<loops;k++)
+    {
+    std::ostringstream ss;
+    ss << k;
+    len += ss.str().length();
+    }
+  cycles = xthal_get_ccount() - start;
+  writer->printf("Int format (iostream):      %u cycles/call\n", cycles/loops);
+
+  start = xthal_get_ccount();
+  for (int k=0;k<loops;k++)
+    len += OvmsMetricFormatInt(buf, sizeof(buf), k);
+  cycles = xthal_get_ccount() - start;
+  writer->printf("Int format (OvmsMetricFormatInt): %u cycles/call\n", cycles/loops);
+
+  ESP_LOGD(TAG, "test metrics: checksum %f/%u", f, len);
+  }
+
+// Measure the timer service task latency: a 10 ms periodic timer records the
+// deviation of each callback from its nominal period. Heavy work done in other
+// timer callbacks (i.e. the housekeeping ticker events) shows up as lateness.
+static struct
+  {
+  uint32_t last;
+  uint32_t period;
+  uint32_t count;
+  uint32_t late_max;
+  uint64_t late_total;
+  } test_timers_data;
+
+static void test_timers_callback(TimerHandle_t timer)
+  {
+  uint32_t now = xthal_get_ccount();
+  if (test_timers_data.last != 0)
+    {
+    uint32_t elapsed = now - test_timers_data.last;
+    uint32_t late = (elapsed > test_timers_data.period) ? elapsed - test_timers_data.period : 0;
+    if (late > test_timers_data.late_max) test_timers_data.late_max = late;
+    test_timers_data.late_total += late;
+    test_timers_data.count++;
+    }
+  test_timers_data.last = now;
+  }
+
+void test_timers(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  int seconds = 10;
+  if (argc==1)
+    {
+    seconds = atoi(argv[0]);
+    }
+  if (seconds <= 0) seconds = 1;
+
+  memset(&test_timers_data, 0, sizeof(test_timers_data));
+  test_timers_data.period = (10 / portTICK_PERIOD_MS) * portTICK_PERIOD_MS * 1000 * CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ;
+
+  writer->printf("Measuring timer latency for %d seconds (%s event dispatch)...\n",
+    seconds, MyEvents.m_async ? "asynchronous" : "synchronous");
+  TimerHandle_t timer = xTimerCreate("Test timers", 10 / portTICK_PERIOD_MS, pdTRUE, NULL, test_timers_callback);
+  xTimerStart(timer, 0);
+  vTaskDelay(seconds * 1000 / portTICK_PERIOD_MS);
+  xTimerStop(timer, 0);
+  xTimerDelete(timer, 0);
+  vTaskDelay(20 / portTICK_PERIOD_MS);
+
+  if (test_timers_data.count == 0)
+    {
+    writer->puts("No timer callbacks recorded");
+    return;
+    }
+  writer->printf("Timer callbacks: %u\n", test_timers_data.count);
+  writer->printf("Lateness:        avg %u us, max %u us\n",
+    (uint32_t)(test_timers_data.late_total / test_timers_data.count / CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ),
+    test_timers_data.late_max / CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ);
+  }
+
+// Event delivery order checks: the handlers log a character per call
+static char test_events_log[64];
+static std::atomic<int> test_events_len;
+static void* test_events_data;
+
+static void test_events_record(char c)
+  {
+  int n = test_events_len++;
+  if (n < (int)sizeof(test_events_log)-1)
+    test_events_log[n] = c;
+  }
+
+static bool test_events_expect(OvmsWriter* writer, const char* check, const char* expected, int wait_ms)
+  {
+  int len = strlen(expected);
+  for (int t = 0; test_events_len < len && t < wait_ms; t += 10)
+    vTaskDelay(10 / portTICK_PERIOD_MS);
+  int n = test_events_len;
+  if (n > (int)sizeof(test_events_log)-1) n = sizeof(test_events_log)-1;
+  test_events_log[n] = 0;
+  bool ok = (strcmp(test_events_log, expected) == 0);
+  writer->printf("%-40s %s", check, ok ? "OK\n" : "FAILED: ");
+  if (!ok) writer->printf("got '%s', expected '%s'\n", test_events_log, expected);
+  test_events_len = 0;
+  return ok;
+  }
+
+static bool test_events_ordering(OvmsWriter* writer)
+  {
+  bool ok = true;
+  test_events_len = 0;
+
+  // Exact handlers in registration order, then prefixes from the most
+  // to the least specific, all before the signal returns:
+  MyEvents.RegisterEvent(TAG, "test.order.sync", [](event_id_t e, void* d) { test_events_record('A'); });
+  MyEvents.RegisterEvent(TAG, "test.order.sync", [](event_id_t e, void* d) { test_events_record('B'); });
+  MyEvents.RegisterEvent(TAG, "test.*", [](event_id_t e, void* d) { test_events_record('Q'); });
+  MyEvents.RegisterEvent(TAG, "test.order.*", [](event_id_t e, void* d) { test_events_record('P'); });
+  MyEvents.SignalEventSync("test.order.sync", NULL);
+  ok &= test_events_expect(writer, "SignalEventSync handler order:", "ABPQ", 0);
+  MyEvents.SignalEvent("test.order.sync", NULL);
+  ok &= test_events_expect(writer, "SignalEvent default synchronous:", "ABPQ", 0);
+  MyEvents.DeregisterEvent(TAG);
+
+  // Async events of one producer are dispatched in signal order:
+  MyEvents.RegisterEvent(TAG, "test.async.1", [](event_id_t e, void* d) { test_events_record('1'); });
+  MyEvents.RegisterEvent(TAG, "test.async.2", [](event_id_t e, void* d) { test_events_record('2'); });
+  MyEvents.RegisterEvent(TAG, "test.async.3", [](event_id_t e, void* d) { test_events_record('3'); });
+  MyEvents.SetEventAsync("test.async.1");
+  MyEvents.SetEventAsync("test.async.2");
+  MyEvents.SetEventAsync("test.async.3");
+  // (5 rounds stay well below EVENT_QUEUE_SIZE, an overflow is delivered inline)
+  std::string expected;
+  for (int k=0; k<5; k++)
+    {
+    MyEvents.SignalEvent("test.async.1", NULL);
+    MyEvents.SignalEvent("test.async.2", NULL);
+    MyEvents.SignalEvent("test.async.3", NULL);
+    expected.append("123");
+    }
+  ok &= test_events_expect(writer, "SignalEvent async order:", expected.c_str(), 2000);
+
+  // Events carrying data stay synchronous, even when opted in, as the
+  // pointer is only valid during the call:
+  MyEvents.RegisterEvent(TAG, "test.async.data", [](event_id_t e, void* d)
+    { test_events_data = d; test_events_record('D'); });
+  MyEvents.SetEventAsync("test.async.data");
+  int value = 42;
+  test_events_data = NULL;
+  MyEvents.SignalEvent("test.async.data", &value);
+  ok &= test_events_expect(writer, "SignalEvent with data synchronous:", "D", 0);
+  if (test_events_data != &value)
+    {
+    writer->printf("%-40s FAILED: data pointer not passed\n", "SignalEvent data pointer:");
+    ok = false;
+    }
+
+  MyEvents.SetEventAsync("test.async.1", false);
+  MyEvents.SetEventAsync("test.async.2", false);
+  MyEvents.SetEventAsync("test.async.3", false);
+  MyEvents.SetEventAsync("test.async.data", false);
+  MyEvents.DeregisterEvent(TAG);
+  return ok;
+  }
+
+// Check the event delivery order, then measure the synchronous event
+// delivery rate for an event without handlers or scripts, i.e. the fixed
+// framework overhead per event.
+void test_events(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  if (!test_events_ordering(writer))
+    writer->puts("Event ordering checks FAILED");
+
+  int loops = 1000;
+  if (argc==1)
+    {
+    loops = atoi(argv[0]);
+    }
+  if (loops <= 0) loops = 1;
+
+  uint32_t start, cycles;
+  std::string event("test.event.none");
+
+  start = xthal_get_ccount();
+  for (int k=0;k<loops;k++)
+    MyScripts.EventScript(event, NULL);
+  cycles = xthal_get_ccount() - start;
+  writer->printf("EventScript:     %u cycles/call, %u events/s\n", cycles/loops,
+    (uint32_t)(1000000ULL * CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ * loops / (cycles ? cycles : 1)));
+
+  start = xthal_get_ccount();
+  for (int k=0;k<loops;k++)
+    MyEvents.SignalEventSync(event, NULL);
+  cycles = xthal_get_ccount() - start;
+  writer->printf("SignalEventSync: %u cycles/call, %u events/s\n", cycles/loops,
+    (uint32_t)(1000000ULL * CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ * loops / (cycles ? cycles : 1)));
+
+  event_id_t id = MyEvents.GetEventId(event);
+  start = xthal_get_ccount();
+  for (int k=0;k<loops;k++)
+    MyEvents.SignalEventSync(id, NULL);
+  cycles = xthal_get_ccount() - start;
+  writer->printf("SignalEventSync (id): %u cycles/call, %u events/s\n", cycles/loops,
+    (uint32_t)(1000000ULL * CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ * loops / (cycles ? cycles : 1)));
+
+  // Subscribing to a family of events: per name vs. "*" + compare vs. prefix
+  static uint32_t hits;
+  hits = 0;
+  MyEvents.RegisterEvent(TAG, "test.bench.name.x", [](event_id_t e, void* d) { hits++; });
+  MyEvents.RegisterEvent(TAG, "*", [](std::string e, void* d)
+    { if (e.compare(0,17,"test.bench.match.") == 0) hits++; });
+  MyEvents.RegisterEvent(TAG, "test.bench.prefix.*", [](event_id_t e, void* d) { hits++; });
+
+  const char* names[] = { "test.bench.name.x", "test.bench.match.x", "test.bench.prefix.x" };
+  const char* labels[] = { "per name", "\"*\" + compare", "prefix" };
+  for (int i=0;i<3;i++)
+    {
+    id = MyEvents.GetEventId(names[i]);
+    start = xthal_get_ccount();
+    for (int k=0;k<loops;k++)
+      MyEvents.SignalEventSync(id, NULL);
+    cycles = xthal_get_ccount() - start;
+    writer->printf("Subscription %s: %u cycles/call, %u events/s\n", labels[i], cycles/loops,
+      (uint32_t)(1000000ULL * CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ * loops / (cycles ? cycles : 1)));
+    }
+  MyEvents.DeregisterEvent(TAG);
+  ESP_LOGD(TAG, "test events: %u handler calls", hits);
+  }
+
+void test_config(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  int loops = 1000;
+  if (argc==1)
+    {
+    loops = atoi(argv[0]);
+    }
+  if (loops <= 0) loops = 1;
+
+  uint32_t start, cycles;
+  volatile int ival = 0;
+  volatile bool bval = false;
+
+  start = xthal_get_ccount();
+  for (int k=0;k<loops;k++)
+    ival = MyConfig.GetParamValueInt("vehicle", "stream", 0);
+  cycles = xthal_get_ccount() - start;
+  writer->printf("GetParamValueInt:  %u cycles/read\n", cycles/loops);
+
+  start = xthal_get_ccount();
+  for (int k=0;k<loops;k++)
+    bval = MyConfig.GetParamValueBool("modem", "enable.gps", false);
+  cycles = xthal_get_ccount() - start;
+  writer->printf("GetParamValueBool: %u cycles/read\n", cycles/loops);
+
+  ConfigHandle<int> stream("vehicle", "stream", 0);
+  ConfigHandle<bool> gps("modem", "enable.gps", false);
+
+  start = xthal_get_ccount();
+  for (int k=0;k<loops;k++)
+    ival = stream;
+  cycles = xthal_get_ccount() - start;
+  writer->printf("ConfigHandle<int>:  %u cycles/read\n", cycles/loops);
+
+  start = xthal_get_ccount();
+  for (int k=0;k<loops;k++)
+    bval = gps;
+  cycles = xthal_get_ccount() - start;
+  writer->printf("ConfigHandle<bool>: %u cycles/read\n", cycles/loops);
+  ESP_LOGD(TAG, "test config: %d %d", ival, bval);
+  }
+
+// Config store power loss simulation: random changes are written to a test
+// log, then the "power" is cut after a random number of bytes while writing
+// a change or compacting. After reopening, the store must contain either the
+// state before or after the interrupted operation.
+typedef std::map<std::string, std::map<std::string, std::string> > TestStoreState;
+
+static void test_configstore_apply(TestStoreState& state, uint8_t type,
+  const std::string& param, const std::string& instance, const std::string& value)
+  {
+  switch (type)
+    {
+    case CONFIGSTORE_SET:       state[param][instance] = value; break;
+    case CONFIGSTORE_DEL:       state[param].erase(instance); break;
+    case CONFIGSTORE_DELPARAM:  state.erase(param); break;
+    }
+  if ((state.count(param) > 0) && state[param].empty())
+    state.erase(param);
+  }
+
+static void test_configstore_snapshot(TestStoreState& state, OvmsConfigStore* store)
+  {
+  for (auto p=state.begin(); p!=state.end(); ++p)
+    for (auto i=p->second.begin(); i!=p->second.end(); ++i)
+      store->Append(CONFIGSTORE_SET, p->first, i->first, i->second);
+  }
+
+void test_configstore(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  int rounds = 100;
+  if (argc==1)
+    {
+    rounds = atoi(argv[0]);
+    }
+  if (rounds <= 0) rounds = 1;
+
+  const char* path = "/store/configstore.test";
+  int passed = 0, cuts = 0, failed = 0;
+
+  for (int r=0;r<rounds;r++)
+    {
+    unlink(path);
+    unlink((std::string(path) + ".new").c_str());
+
+    TestStoreState state;
+    OvmsConfigStore store;
+    store.Open(path, NULL);
+
+    // Build up some history, including garbage for the compactions:
+    int ops = 20 + rand() % 200;
+    uint8_t type = CONFIGSTORE_SET;
+    std::string param, instance, value;
+    for (int k=0;k<=ops;k++)
+      {
+      int sel = rand() % 20;
+      type = (sel == 0) ? CONFIGSTORE_DELPARAM : (sel < 4) ? CONFIGSTORE_DEL : CONFIGSTORE_SET;
+      param = "p" + std::to_string(rand() % 4);
+      instance = (type == CONFIGSTORE_DELPARAM) ? "" : "i" + std::to_string(rand() % 8);
+      value = (type == CONFIGSTORE_SET) ? std::string(rand() % 64, 'a' + (rand() % 26)) : "";
+      if (k == ops)
+        break;  // ...the last one is written with the power cut
+      store.Append(type, param, instance, value);
+      store.End();
+      test_configstore_apply(state, type, param, instance, value);
+      if (store.NeedsCompaction())
+        store.Compact(std::bind(test_configstore_snapshot, std::ref(state), std::placeholders::_1));
+      }
+
+    TestStoreState before = state;
+    store.m_fail_after = rand() % 200;
+    if (rand() % 2)
+      {
+      store.Append(type, param, instance, value);
+      store.End();
+      test_configstore_apply(state, type, param, instance, value);
+      }
+    else
+      {
+      store.Compact(std::bind(test_configstore_snapshot, std::ref(state), std::placeholders::_1));
+      }
+    bool cut = (store.m_fail_after == 0);
+    store.Close();
+
+    TestStoreState result;
+    OvmsConfigStore reopened;
+    reopened.Open(path, [&result](uint8_t t, const std::string& p, const std::string& i, const std::string& v)
+      { test_configstore_apply(result, t, p, i, v); });
+    reopened.Close();
+
+    if (cut) cuts++;
+    if ((result == before) || (result == state))
+      passed++;
+    else
+      {
+      failed++;
+      if (verbosity >= COMMAND_RESULT_NORMAL)
+        writer->printf("Round %d: state mismatch after %s\n", r, cut ? "power cut" : "clean write");
+      }
+    }
+
+  unlink(path);
+  unlink((std::string(path) + ".new").c_str());
+  writer->printf("Config store: %d rounds, %d power cuts, %d passed, %d failed\n",
+    rounds, cuts, passed, failed);
+  }
+
+void test_notifyspool(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  int entries = 500;
+  if (argc==1)
+    {
+    entries = atoi(argv[0]);
+    }
+  if (entries <= 1) entries = 2;
+
+  const char* dir = "/store/notifyspool.test";
+  mkdir(dir, 0);
+  uint32_t nextid = 1;
+  OvmsNotifySpool* spool = new OvmsNotifySpool();
+  if (!spool->Open(dir, nextid))
+    {
+    writer->printf("Error: cannot open %s\n", dir);
+    delete spool;
+    return;
+    }
+
+  // Spool all, read & ack the first half, then replay the rest:
+  uint32_t start = xthal_get_ccount();
+  for (int k=1;k<=entries;k++)
+    spool->Append(k, k, 1, "MP-0 h" + std::to_string(k) + ",0,RT-TEST,0,86400,some,data,to,spool", false);
+  uint32_t t_append = xthal_get_ccount() - start;
+
+  int errors = 0;
+  uint32_t expect = 1;
+  std::list<uint32_t> seqs;
+  start = xthal_get_ccount();
+  while ((expect <= (uint32_t)entries/2) &&
+         spool->PageIn(10, [&](uint32_t seq, uint32_t id, uint32_t created, uint32_t readers, const std::string& value, bool replayed)
+    {
+    if (id != expect++) errors++;
+    seqs.push_back(seq);
+    }));
+  for (uint32_t seq : seqs) spool->Done(seq);
+  uint32_t t_pagein = xthal_get_ccount() - start;
+  uint32_t segments = spool->Segments();
+  delete spool;
+
+  spool = new OvmsNotifySpool();
+  nextid = 1;
+  spool->Open(dir, nextid);
+  uint32_t backlog = spool->Backlog();
+  seqs.clear();
+  while (spool->PageIn(10, [&](uint32_t seq, uint32_t id, uint32_t created, uint32_t readers, const std::string& value, bool replayed)
+    {
+    seqs.push_back(seq);
+    }));
+  for (uint32_t seq : seqs) spool->Done(seq);
+  if ((spool->Segments() != 0) || (backlog < (uint32_t)(entries - entries/2)))
+    errors++;
+  delete spool;
+  rmdir(dir);
+
+  writer->printf("Notify spool: %d entries, append %u us/entry, page in+done %u us/entry\n",
+    entries,
+    t_append / entries / CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ,
+    t_pagein / (entries/2) / CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ);
+  writer->printf("  %u segments after half read, %u entries replayed (at least %d), %d errors\n",
+    segments, backlog, entries - entries/2, errors);
+  }
+
+// Cost of a batch of command/producer notifications (i.e. one battery
+// data update), queued (unrendered) and rendered.
+void test_notify(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  int cells = 14;
+  if (argc==1)
+    {
+    cells = atoi(argv[0]);
+    }
+  if (cells <= 0) cells = 1;
+
+  std::vector<OvmsNotifyEntryCommand*> batch;
+  batch.reserve(cells);
+  for (int mode=0;mode<2;mode++)
+    {
+    size_t heap0 = xPortGetFreeHeapSizeCaps(MALLOC_CAP_8BIT);
+    uint32_t start = xthal_get_ccount();
+    for (int k=0;k<cells;k++)
+      {
+      if (mode == 0)
+        batch.push_back(new OvmsNotifyEntryCommand(COMMAND_RESULT_NORMAL, "metrics list m.freeram"));
+      else
+        batch.push_back(new OvmsNotifyEntryCommand(COMMAND_RESULT_NORMAL,
+          [k](int verbosity, OvmsWriter* writer)
+            {
+            writer->printf("RT-BAT-C,%d,86400,1,1,4012,3998,4025,12,21,18,24,3\n", k+1);
+            }, TAG));
+      }
+    uint32_t t_queue = xthal_get_ccount() - start;
+    size_t heap1 = xPortGetFreeHeapSizeCaps(MALLOC_CAP_8BIT);
+
+    size_t len = 0;
+    start = xthal_get_ccount();
+    for (OvmsNotifyEntryCommand* e : batch)
+      len += e->GetValue().length();
+    uint32_t t_render = xthal_get_ccount() - start;
+    size_t heap2 = xPortGetFreeHeapSizeCaps(MALLOC_CAP_8BIT);
+
+    for (OvmsNotifyEntryCommand* e : batch)
+      delete e;
+    batch.clear();
+
+    writer->printf("%s x%d: queue %u us, %d bytes heap; render %u us, %d bytes heap, %u chars\n",
+      (mode == 0) ? "Command " : "Producer", cells,
+      t_queue / CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ, (int)(heap0 - heap1),
+      t_render / CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ, (int)(heap0 - heap2), len);
+    }
+  }
+
+// A data update burst (i.e. battery cells) as single entries vs. one batch
+void test_notifybatch(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  int records = 100;
+  if (argc==1)
+    {
+    records = atoi(argv[0]);
+    }
+  if (records <= 0) records = 1;
+
+  char rec[80];
+  NotifyEntryRing_t queue;
+  size_t heap0 = xPortGetFreeHeapSizeCaps(MALLOC_CAP_8BIT);
+  uint32_t start = xthal_get_ccount();
+  for (int k=0;k<records;k++)
+    {
+    snprintf(rec, sizeof(rec), "RT-BAT-C,%d,86400,1,1,4012,3998,4025,12,21,18,24,3", k+1);
+    OvmsNotifyEntry* e = new OvmsNotifyEntryString(rec);
+    e->m_id = k+1;
+    queue.Insert(e->m_id, e);
+    }
+  uint32_t t_single = xthal_get_ccount() - start;
+  size_t heap_single = heap0 - xPortGetFreeHeapSizeCaps(MALLOC_CAP_8BIT);
+  while (!queue.empty())
+    delete queue.Remove(queue.First()->m_id);
+
+  heap0 = xPortGetFreeHeapSizeCaps(MALLOC_CAP_8BIT);
+  start = xthal_get_ccount();
+  OvmsNotifyEntryBatch* batch = new OvmsNotifyEntryBatch();
+  for (int k=0;k<records;k++)
+    {
+    int len = snprintf(rec, sizeof(rec), "RT-BAT-C,%d,86400,1,1,4012,3998,4025,12,21,18,24,3", k+1);
+    batch->Append(rec, len);
+    }
+  batch->Seal();
+  batch->m_id = 1;
+  queue.Insert(batch->m_id, batch);
+  uint32_t t_batch = xthal_get_ccount() - start;
+  size_t heap_batch = heap0 - xPortGetFreeHeapSizeCaps(MALLOC_CAP_8BIT);
+  delete queue.Remove(batch->m_id);
+
+  writer->printf("%d records as single entries: %u us, %u bytes heap\n",
+    records, t_single / CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ, heap_single);
+  writer->printf("%d records as one batch:      %u us, %u bytes heap\n",
+    records, t_batch / CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ, heap_batch);
+  }
+
+// ID ring with one entry stuck unread: the ring span must stay capped, the
+// stuck entry moves to the overflow map, order and lookups must hold.
+void test_idring(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  int items = 5000;
+  if (argc==1)
+    {
+    items = atoi(argv[0]);
+    }
+  if (items < 2) items = 2;
+
+  static int values[2];
+  OvmsIdRing<int> ring(16, 256);
+  int errors = 0;
+  ring.Insert(1, &values[0]);
+  for (int k=2;k<=items;k++)
+    {
+    if (!ring.Insert(k, &values[1]))
+      errors++;
+    if ((k > 2) && (ring.Remove(k-1) != &values[1]))
+      errors++;
+    }
+  if ((ring.capacity() > 256) || (ring.size() != 2) || (ring.First() != &values[0]))
+    errors++;
+  if ((ring.Find(1) != &values[0]) || (ring.Next(1) != &values[1]) || (ring.Floor(items-1) != &values[0]))
+    errors++;
+  size_t outside = ring.outside();
+  if ((ring.Remove(1) != &values[0]) || (ring.First() != &values[1]) || (ring.LastId() != (uint32_t)items))
+    errors++;
+
+  writer->printf("%d items, ring capacity %u, %u outside: %s (%d errors)\n",
+    items, ring.capacity(), outside, errors ? "FAILED" : "OK", errors);
+  }
+
+// V2 transmit encoding: per message buffers (RC4 in place, then base64)
+// vs. the fused single pass encoder writing into one arena.
+// tools/v2txbench.cpp runs the same comparison on a host.
+void test_v2encode(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  int messages = 1000;
+  if (argc==1)
+    {
+    messages = atoi(argv[0]);
+    }
+  if (messages <= 0) messages = 1;
+
+  const char* msg = "MP-0 h123,17,RT-BAT-C,12,86400,1,1,4012,3998,4025,12,21,18,24,3";
+  int len = strlen(msg);
+  uint8_t key[16];
+  memset(key, 0x5a, sizeof(key));
+  RC4_CTX1 ctx1;
+  RC4_CTX2* ctx2 = new RC4_CTX2;
+  RC4_setup(&ctx1, ctx2, key, sizeof(key));
+
+  size_t heap0 = xPortGetFreeHeapSizeCaps(MALLOC_CAP_8BIT);
+  size_t heapmin = heap0;
+  uint32_t start = xthal_get_ccount();
+  for (int k=0;k<messages;k++)
+    {
+    char* s = new char[len];
+    memcpy(s,msg,len);
+    RC4_crypt(&ctx1, ctx2, (uint8_t*)s, len);
+    char* buf = new char[(len*2)+4];
+    base64encode((uint8_t*)s, len, (uint8_t*)buf);
+    strcat(buf,"\r\n");
+    size_t heap = xPortGetFreeHeapSizeCaps(MALLOC_CAP_8BIT);
+    if (heap < heapmin) heapmin = heap;
+    delete [] buf;
+    delete [] s;
+    }
+  uint32_t t_old = xthal_get_ccount() - start;
+  size_t heap_old = heap0 - heapmin;
+
+  char* arena = new char[2048];
+  size_t size = 0;
+  heap0 = heapmin = xPortGetFreeHeapSizeCaps(MALLOC_CAP_8BIT);
+  start = xthal_get_ccount();
+  for (int k=0;k<messages;k++)
+    {
+    if (size + len*2 + 4 > 2048) size = 0;
+    size = (char*)RC4_crypt_base64(&ctx1, ctx2, (const uint8_t*)msg, len, (uint8_t*)arena + size) - arena;
+    arena[size++] = '\r';
+    arena[size++] = '\n';
+    size_t heap = xPortGetFreeHeapSizeCaps(MALLOC_CAP_8BIT);
+    if (heap < heapmin) heapmin = heap;
+    }
+  uint32_t t_new = xthal_get_ccount() - start;
+  size_t heap_new = heap0 - heapmin;
+  delete [] arena;
+  delete ctx2;
+
+  writer->printf("%d messages of %d chars:\n", messages, len);
+  writer->printf("  copy+RC4+base64: %u msgs/s, %u bytes heap per message\n",
+    (uint32_t)((uint64_t)messages * CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ * 1000000 / (t_old ? t_old : 1)), heap_old);
+  writer->printf("  fused to arena:  %u msgs/s, %u bytes heap per message\n",
+    (uint32_t)((uint64_t)messages * CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ * 1000000 / (t_new ? t_new : 1)), heap_new);
+  }
+
+#ifdef CONFIG_OVMS_COMP_SERVER_V2_TLS
+// TLS handshakes, alternating full and resumed sessions, against an echo
+// server, i.e. "openssl s_server -accept <port> -cert c.pem -key k.pem -rev"
+void test_tls(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  int rounds = 10;
+  if (argc==3)
+    {
+    rounds = atoi(argv[2]);
+    }
+  if (rounds <= 0) rounds = 1;
+
+  OvmsNetTlsConnection* conn = new OvmsNetTlsConnection();
+  uint32_t n[2] = { 0, 0 }, ms[2] = { 0, 0 }, tx[2] = { 0, 0 }, rx[2] = { 0, 0 };
+  for (int k=0; k<rounds*2; k++)
+    {
+    conn->m_resume = (k % 2) == 1;
+    if (!conn->Connect(argv[0], argv[1], 20000))
+      {
+      writer->printf("Error: Connect #%d failed\n", k);
+      break;
+      }
+    char buf[16];
+    if ((conn->Write("ping\n", 5) != 5) || ((int)conn->Read(buf, sizeof(buf)) <= 0))
+      writer->printf("Error: No echo on connection #%d\n", k);
+    int r = conn->m_resumed ? 1 : 0;
+    n[r]++;
+    ms[r] += conn->m_handshake_ms;
+    tx[r] += conn->m_handshake_tx;
+    rx[r] += conn->m_handshake_rx;
+    conn->Disconnect();
+    }
+  if (!conn->m_fingerprint.empty())
+    writer->printf("Server certificate SHA-256: %s\n", conn->m_fingerprint.c_str());
+  delete conn;
+
+  for (int r=0; r<2; r++)
+    {
+    if (n[r] == 0) continue;
+    writer->printf("  %-7s %u handshakes: %u ms, %u bytes sent, %u received\n",
+      r ? "resumed" : "full", n[r], ms[r]/n[r], tx[r]/n[r], rx[r]/n[r]);
+    }
+  }
+#endif // #ifdef CONFIG_OVMS_COMP_SERVER_V2_TLS
+
 class TestFrameworkInit
   {
   public: TestFrameworkInit();
@@ -152,5 +939,18 @@ TestFrameworkInit::TestFrameworkInit()
   cmd_test->RegisterCommand("sdcard","Test CD CARD",test_sdcard,"",0,0,true);
 #endif // #ifdef CONFIG_OVMS_COMP_SDCARD
   cmd_test->RegisterCommand("javascript","Test Javascript",test_javascript,"",0,0,true);
+  cmd_test->RegisterCommand("metrics","Benchmark metric access",test_metrics,"[<loops>]",0,1,true);
+  cmd_test->RegisterCommand("events","Check event ordering, benchmark event delivery",test_events,"[<loops>]",0,1,true);
+  cmd_test->RegisterCommand("config","Benchmark config access",test_config,"[<loops>]",0,1,true);
+  cmd_test->RegisterCommand("configstore","Config store power loss simulation",test_configstore,"[<rounds>]",0,1,true);
+  cmd_test->RegisterCommand("notify","Benchmark lazy notification rendering",test_notify,"[<entries>]",0,1,true);
+  cmd_test->RegisterCommand("notifybatch","Benchmark batched data notifications",test_notifybatch,"[<records>]",0,1,true);
+  cmd_test->RegisterCommand("idring","Check the notification ID ring span limit",test_idring,"[<items>]",0,1,true);
+  cmd_test->RegisterCommand("notifyspool","Notification spool round trip",test_notifyspool,"[<entries>]",0,1,true);
+  cmd_test->RegisterCommand("v2encode","Benchmark V2 transmit encoding",test_v2encode,"[<messages>]",0,1,true);
+#ifdef CONFIG_OVMS_COMP_SERVER_V2_TLS
+  cmd_test->RegisterCommand("tls","Benchmark TLS full vs. resumed handshakes",test_tls,"<host> <port> [<rounds>]",2,3,true);
+#endif // #ifdef CONFIG_OVMS_COMP_SERVER_V2_TLS
+  cmd_test->RegisterCommand("timers","Measure timer task latency",test_timers,"[<seconds>]",0,1,true);
   cmd_test->RegisterCommand("chargen","Character generator [<#lines>]",test_chargen,"",0,1,false);
   }
@@ -0,0 +1,217 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;
+;    (C) 2011-2017  Mark Webb-Johnson
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+
+// Host benchmark of the config bundle (main/ovms_config_bundle.cpp), as
+// used by "config export" and "config import": a config of a few thousand
+// instances is exported to a file and imported again, in both formats.
+// Import runs twice over the file as on the module, verifying the bundle
+// first, then applying it.
+//
+// Reports the bundle size, the time per instance, the heap allocations
+// per instance (for import including the map the config is read into),
+// and checks the imported config equals the exported one.
+// Oversize instances are rejected by the binary format, and counted.
+//
+// Build & run from vehicle/OVMS.V3:
+//
+//   g++ -O2 -Imain -Icomponents/crypto -o /tmp/configbundlebench
+//       tools/configbundlebench.cpp main/ovms_config_bundle.cpp
+//       components/crypto/crypt_crc.cpp
+//   /tmp/configbundlebench [<instances>] [<rounds>]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+#include <map>
+#include <string>
+#include <chrono>
+#include "ovms_config_bundle.h"
+
+typedef std::map<std::string, std::map<std::string, std::string> > ConfigState;
+
+static const char* s_path = "/tmp/configbundlebench.bin";
+
+static size_t s_allocs = 0;
+static bool s_counting = false;
+
+static void* CountedAlloc(size_t size)
+  {
+  if (s_counting) s_allocs++;
+  void* p = malloc(size ? size : 1);
+  if (p == NULL) throw std::bad_alloc();
+  return p;
+  }
+
+void* operator new(size_t size) { return CountedAlloc(size); }
+void* operator new[](size_t size) { return CountedAlloc(size); }
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+
+static ConfigState MakeConfig(int instances)
+  {
+  ConfigState config;
+  for (int k=0; k<instances; k++)
+    {
+    std::string param = "param" + std::to_string(k % 40);
+    std::string instance = "some.instance." + std::to_string(k);
+    std::string value;
+    switch (k % 4)
+      {
+      case 0: value = std::to_string(rand()); break;
+      case 1: value = (rand() % 2) ? "yes" : "no"; break;
+      case 2: value = std::string(10 + rand() % 60, 'a' + rand() % 26); break;
+      case 3: value = "quote \" backslash \\ tab \t end"; break;
+      }
+    config[param][instance] = value;
+    }
+  return config;
+  }
+
+static bool Export(const ConfigState& config, bool json, uint32_t& rejected)
+  {
+  FILE* f = fopen(s_path, "w");
+  if (f == NULL)
+    return false;
+  OvmsConfigBundleWriter bundle(f, json);
+  rejected = 0;
+  for (auto p=config.begin(); p!=config.end(); ++p)
+    for (auto i=p->second.begin(); i!=p->second.end(); ++i)
+      {
+      if (!bundle.Add(p->first, i->first, i->second))
+        rejected++;
+      }
+  bool ok = bundle.Finish();
+  if (fclose(f) != 0) ok = false;
+  return ok;
+  }
+
+static bool Import(ConfigState& config)
+  {
+  FILE* f = fopen(s_path, "r");
+  if (f == NULL)
+    return false;
+  OvmsConfigBundleReader bundle(f);
+  bool ok = bundle.Read(NULL);
+  if (ok)
+    {
+    rewind(f);
+    ok = bundle.Read([&config](const std::string& param, const std::string& instance, const std::string& value)
+      { config[param][instance] = value; });
+    }
+  if (!ok)
+    printf("  import failed: %s\n", bundle.m_error ? bundle.m_error : "read error");
+  fclose(f);
+  return ok;
+  }
+
+static long FileSize()
+  {
+  FILE* f = fopen(s_path, "r");
+  if (f == NULL)
+    return -1;
+  fseek(f, 0, SEEK_END);
+  long size = ftell(f);
+  fclose(f);
+  return size;
+  }
+
+static int Run(const ConfigState& config, int instances, int rounds, bool json)
+  {
+  uint32_t rejected = 0;
+  double export_s = 0, import_s = 0;
+  size_t export_allocs = 0, import_allocs = 0;
+  ConfigState imported;
+  for (int r=0; r<rounds; r++)
+    {
+    s_allocs = 0;
+    s_counting = true;
+    auto start = std::chrono::steady_clock::now();
+    bool ok = Export(config, json, rejected);
+    export_s += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    s_counting = false;
+    export_allocs += s_allocs;
+    if (!ok)
+      {
+      printf("  export failed\n");
+      return 1;
+      }
+
+    imported.clear();
+    s_allocs = 0;
+    s_counting = true;
+    start = std::chrono::steady_clock::now();
+    ok = Import(imported);
+    import_s += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    s_counting = false;
+    import_allocs += s_allocs;
+    if (!ok)
+      return 1;
+    }
+
+  double n = (double)instances * rounds;
+  printf("%-6s %7ld bytes, export %.2f us/instance (%.1f allocs), import %.2f us/instance (%.1f allocs)%s\n",
+    json ? "JSON" : "Binary", FileSize(),
+    export_s * 1e6 / n, export_allocs / n, import_s * 1e6 / n, import_allocs / n,
+    (imported == config) ? "" : " MISMATCH");
+  return (imported == config) ? 0 : 1;
+  }
+
+static int TestOversize()
+  {
+  ConfigState config;
+  config["param"]["small"] = "value";
+  config["param"]["large"] = std::string(0x10000, 'x');
+  uint32_t rejected = 0;
+  ConfigState imported;
+  if (!Export(config, false, rejected) || (rejected != 1) || !Import(imported))
+    return 1;
+  config["param"].erase("large");
+  return (imported == config) ? 0 : 1;
+  }
+
+int main(int argc, char* argv[])
+  {
+  int instances = 3000;
+  int rounds = 20;
+  if (argc > 1) instances = atoi(argv[1]);
+  if (argc > 2) rounds = atoi(argv[2]);
+  if (instances <= 0) instances = 1;
+  if (rounds <= 0) rounds = 1;
+
+  srand(1);
+  ConfigState config = MakeConfig(instances);
+  printf("%d instances in %u params, %d rounds\n", instances, (unsigned)config.size(), rounds);
+  int errors = Run(config, instances, rounds, false);
+  errors += Run(config, instances, rounds, true);
+  int failed = TestOversize();
+  printf("Oversize instance: %s\n", failed ? "FAILED" : "rejected");
+  errors += failed;
+
+  remove(s_path);
+  return errors ? 1 : 0;
+  }
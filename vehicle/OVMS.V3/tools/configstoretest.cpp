@@ -0,0 +1,319 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;
+;    (C) 2011-2017  Mark Webb-Johnson
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+
+// Host test of the config store (main/ovms_config_store.cpp) against a
+// plain file, as the on-device "test configstore" but with more rounds:
+//
+//  - Power loss: random changes are written, then the "power" is cut after
+//    a random number of bytes while writing a change or compacting. After
+//    reopening, the store must contain the state before or after the
+//    interrupted operation, and a change written after that must survive
+//    the next reopen (the torn tail must not hide it).
+//  - Corrupt header: a record header with lengths beyond the store limits
+//    is discarded as a torn tail, without allocating by it.
+//  - Failed repair: while a torn tail cannot be repaired, appends are
+//    refused; reopening once the file system works again repairs it.
+//  - Timing of writes, reopening and compaction with a few thousand keys.
+//
+// Build & run from vehicle/OVMS.V3:
+//
+//   g++ -O2 -Itools/host -Imain -Icomponents/crypto -o /tmp/configstoretest
+//       tools/configstoretest.cpp main/ovms_config_store.cpp
+//       components/crypto/crypt_crc.cpp
+//   /tmp/configstoretest [<rounds>] [<keys>]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <map>
+#include <string>
+#include <chrono>
+#include <functional>
+#include "ovms_config_store.h"
+
+typedef std::map<std::string, std::map<std::string, std::string> > StoreState;
+
+static const char* s_path = "/tmp/configstoretest.kv";
+
+static void Apply(StoreState& state, uint8_t type,
+  const std::string& param, const std::string& instance, const std::string& value)
+  {
+  switch (type)
+    {
+    case CONFIGSTORE_SET:       state[param][instance] = value; break;
+    case CONFIGSTORE_DEL:       state[param].erase(instance); break;
+    case CONFIGSTORE_DELPARAM:  state.erase(param); break;
+    }
+  if ((state.count(param) > 0) && state[param].empty())
+    state.erase(param);
+  }
+
+static void Snapshot(StoreState& state, OvmsConfigStore* store)
+  {
+  for (auto p=state.begin(); p!=state.end(); ++p)
+    for (auto i=p->second.begin(); i!=p->second.end(); ++i)
+      store->Append(CONFIGSTORE_SET, p->first, i->first, i->second);
+  }
+
+static StoreState Load(uint32_t* truncations = NULL)
+  {
+  StoreState result;
+  OvmsConfigStore store;
+  store.Open(s_path, [&result](uint8_t t, const std::string& p, const std::string& i, const std::string& v)
+    { Apply(result, t, p, i, v); });
+  if (truncations) *truncations = store.m_stat_truncations;
+  store.Close();
+  return result;
+  }
+
+static void Reset()
+  {
+  unlink(s_path);
+  std::string newpath = std::string(s_path) + ".new";
+  unlink(newpath.c_str());
+  rmdir(newpath.c_str());
+  }
+
+static void RandomOp(uint8_t& type, std::string& param, std::string& instance, std::string& value)
+  {
+  int sel = rand() % 20;
+  type = (sel == 0) ? CONFIGSTORE_DELPARAM : (sel < 4) ? CONFIGSTORE_DEL : CONFIGSTORE_SET;
+  param = "p" + std::to_string(rand() % 4);
+  instance = (type == CONFIGSTORE_DELPARAM) ? "" : "i" + std::to_string(rand() % 8);
+  value = (type == CONFIGSTORE_SET) ? std::string(rand() % 64, 'a' + (rand() % 26)) : "";
+  }
+
+static int TestPowerLoss(int rounds, int& cuts)
+  {
+  int failed = 0;
+  cuts = 0;
+  for (int r=0;r<rounds;r++)
+    {
+    Reset();
+    StoreState state;
+    OvmsConfigStore store;
+    store.Open(s_path, NULL);
+
+    int ops = 20 + rand() % 200;
+    uint8_t type;
+    std::string param, instance, value;
+    for (int k=0;k<ops;k++)
+      {
+      RandomOp(type, param, instance, value);
+      store.Append(type, param, instance, value);
+      store.End();
+      Apply(state, type, param, instance, value);
+      if (store.NeedsCompaction())
+        store.Compact(std::bind(Snapshot, std::ref(state), std::placeholders::_1));
+      }
+
+    StoreState before = state;
+    store.m_fail_after = rand() % 200;
+    if (rand() % 2)
+      {
+      RandomOp(type, param, instance, value);
+      store.Append(type, param, instance, value);
+      store.End();
+      Apply(state, type, param, instance, value);
+      }
+    else
+      store.Compact(std::bind(Snapshot, std::ref(state), std::placeholders::_1));
+    if (store.m_fail_after == 0) cuts++;
+    store.Close();
+
+    StoreState result = Load();
+    if ((result != before) && (result != state))
+      {
+      printf("  round %d: state mismatch after the power cut\n", r);
+      failed++;
+      continue;
+      }
+
+    // Continue writing on the recovered log:
+    OvmsConfigStore reopened;
+    reopened.Open(s_path, NULL);
+    bool ok = reopened.Append(CONFIGSTORE_SET, "after", "cut", std::to_string(r)) && reopened.End();
+    reopened.Close();
+    Apply(result, CONFIGSTORE_SET, "after", "cut", std::to_string(r));
+    if (!ok || (Load() != result))
+      {
+      printf("  round %d: change after the power cut lost\n", r);
+      failed++;
+      }
+    }
+  return failed;
+  }
+
+static int TestCorruptHeader()
+  {
+  Reset();
+  StoreState state;
+  OvmsConfigStore store;
+  store.Open(s_path, NULL);
+  for (int k=0;k<10;k++)
+    {
+    store.Append(CONFIGSTORE_SET, "p", "i" + std::to_string(k), "v");
+    Apply(state, CONFIGSTORE_SET, "p", "i" + std::to_string(k), "v");
+    }
+  store.Close();
+
+  // A header claiming the maximum lengths, followed by a few bytes:
+  configstore_record_t rec;
+  rec.magic = CONFIGSTORE_MAGIC;
+  rec.type = CONFIGSTORE_SET;
+  rec.paramlen = 0xff;
+  rec.instancelen = 0xffff;
+  rec.valuelen = 0xffff;
+  rec.crc = 0;
+  FILE* f = fopen(s_path, "ab");
+  fwrite(&rec, sizeof(rec), 1, f);
+  fwrite("garbage", 7, 1, f);
+  fclose(f);
+
+  uint32_t truncations = 0;
+  if ((Load(&truncations) != state) || (truncations != 1))
+    {
+    printf("  corrupt header: not discarded\n");
+    return 1;
+    }
+  if (Load(&truncations) != state || (truncations != 0))
+    {
+    printf("  corrupt header: tail not repaired\n");
+    return 1;
+    }
+  return 0;
+  }
+
+static int TestFailedRepair()
+  {
+  int failed = 0;
+  Reset();
+  OvmsConfigStore store;
+  store.Open(s_path, NULL);
+  store.Append(CONFIGSTORE_SET, "p", "i", "v1");
+  store.Close();
+  FILE* f = fopen(s_path, "ab");
+  fwrite("torn", 4, 1, f);
+  fclose(f);
+
+  // A directory in place of the repair file makes the repair fail:
+  std::string newpath = std::string(s_path) + ".new";
+  mkdir(newpath.c_str(), 0700);
+  store.Open(s_path, NULL);
+  if (!store.Failed() || store.Append(CONFIGSTORE_SET, "p", "i", "v2"))
+    {
+    printf("  failed repair: append not refused\n");
+    failed++;
+    }
+  store.Close();
+
+  rmdir(newpath.c_str());
+  store.Open(s_path, NULL);
+  if (store.Failed() || !store.Append(CONFIGSTORE_SET, "p", "i", "v3") || !store.End())
+    {
+    printf("  failed repair: store not usable after reopen\n");
+    failed++;
+    }
+  store.Close();
+  StoreState state = Load();
+  if (state["p"]["i"] != "v3")
+    {
+    printf("  failed repair: change after repair lost\n");
+    failed++;
+    }
+  return failed;
+  }
+
+static void Bench(int keys)
+  {
+  Reset();
+  StoreState state;
+  OvmsConfigStore store;
+  store.Open(s_path, NULL);
+
+  auto start = std::chrono::steady_clock::now();
+  for (int k=0;k<keys;k++)
+    {
+    std::string param = "p" + std::to_string(k % 50);
+    std::string instance = "instance." + std::to_string(k);
+    std::string value = std::to_string(rand());
+    store.Append(CONFIGSTORE_SET, param, instance, value);
+    Apply(state, CONFIGSTORE_SET, param, instance, value);
+    }
+  store.End();
+  double write = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  // Overwrite all keys, then compact:
+  for (auto p=state.begin(); p!=state.end(); ++p)
+    for (auto i=p->second.begin(); i!=p->second.end(); ++i)
+      {
+      i->second = std::to_string(rand());
+      store.Append(CONFIGSTORE_SET, p->first, i->first, i->second);
+      }
+  store.End();
+  uint32_t size = store.Size();
+  start = std::chrono::steady_clock::now();
+  store.Compact(std::bind(Snapshot, std::ref(state), std::placeholders::_1));
+  double compact = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  store.Close();
+
+  start = std::chrono::steady_clock::now();
+  StoreState result = Load();
+  double open = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  printf("%d keys: write %.1f us/key, compact %u to %u bytes in %.1f ms, reopen %.1f ms%s\n",
+    keys, write * 1e6 / keys, size, store.Size(), compact * 1e3, open * 1e3,
+    (result == state) ? "" : " (MISMATCH)");
+  }
+
+int main(int argc, char* argv[])
+  {
+  int rounds = 2000;
+  int keys = 5000;
+  if (argc > 1) rounds = atoi(argv[1]);
+  if (argc > 2) keys = atoi(argv[2]);
+  if (rounds <= 0) rounds = 1;
+  if (keys <= 0) keys = 1;
+
+  // The simulated power cuts log write errors by design:
+  setenv("HOST_LOG_LEVEL", "0", 0);
+
+  srand(1);
+  int cuts = 0;
+  int failed = TestPowerLoss(rounds, cuts);
+  printf("Power loss: %d rounds, %d power cuts, %d failed\n", rounds, cuts, failed);
+  int errors = failed;
+  failed = TestCorruptHeader();
+  printf("Corrupt header: %s\n", failed ? "FAILED" : "OK");
+  errors += failed;
+  failed = TestFailedRepair();
+  printf("Failed repair: %s\n", failed ? "FAILED" : "OK");
+  errors += failed;
+  Bench(keys);
+
+  Reset();
+  return errors ? 1 : 0;
+  }
@@ -0,0 +1,66 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;
+;    (C) 2011-2017  Mark Webb-Johnson
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+
+// Host shim of the ESP-IDF log API, so modules logging via ovms_log.h can
+// be built into the host harnesses in tools/ (add -Itools/host). Messages
+// up to the level given by the environment variable HOST_LOG_LEVEL are
+// written to stderr (default 1 = errors).
+
+#ifndef __ESP_LOG_H__
+#define __ESP_LOG_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdarg.h>
+
+typedef enum
+  {
+  ESP_LOG_NONE,
+  ESP_LOG_ERROR,
+  ESP_LOG_WARN,
+  ESP_LOG_INFO,
+  ESP_LOG_DEBUG,
+  ESP_LOG_VERBOSE
+  } esp_log_level_t;
+
+#define LOG_FORMAT(letter, format)  #letter " (%u) %s: " format "\n"
+
+static inline uint32_t esp_log_timestamp()
+  {
+  return 0;
+  }
+
+static inline void esp_log_write(esp_log_level_t level, const char* tag, const char* format, ...)
+  {
+  const char* env = getenv("HOST_LOG_LEVEL");
+  if ((int)level > (env ? atoi(env) : ESP_LOG_ERROR))
+    return;
+  va_list args;
+  va_start(args, format);
+  vfprintf(stderr, format, args);
+  va_end(args);
+  }
+
+#endif //#ifndef __ESP_LOG_H__
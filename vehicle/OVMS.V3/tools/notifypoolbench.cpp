@@ -0,0 +1,246 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;
+;    (C) 2011-2017  Mark Webb-Johnson
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+
+// Host benchmark of the notification entry storage (main/ovms_notify_pool.h):
+// the former path allocating each entry from the heap and indexing it in a
+// std::map, vs. entries from an OvmsSlabPool indexed in an OvmsIdRing, as
+// done by OvmsNotifyType.
+//
+// The workload queues entries with ascending IDs and reads them in order,
+// removing each once read, with a configurable backlog of unread entries.
+// The "stuck" variant keeps the first entry unread throughout, as a reader
+// that never marks it, which makes the ring move old entries to its map.
+// Reports entries per second, and heap allocations per entry.
+//
+// A randomized run then checks OvmsIdRing against a std::map for Insert,
+// Remove, Find, First, Last, Next and Floor.
+//
+// Build & run from vehicle/OVMS.V3:
+//
+//   g++ -O2 -Imain -o /tmp/notifypoolbench tools/notifypoolbench.cpp
+//       main/ovms_notify_pool.cpp
+//   /tmp/notifypoolbench [<entries>] [<backlog>]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <new>
+#include <map>
+#include <chrono>
+#include "ovms_notify_pool.h"
+
+#define POOL_SIZE   32            // NOTIFY_POOL_SIZE
+#define ENTRY_SIZE  128           // About sizeof(OvmsNotifyEntryString) on the module
+
+static size_t s_allocs = 0;
+static bool s_counting = false;
+
+static void* CountedAlloc(size_t size)
+  {
+  if (s_counting) s_allocs++;
+  void* p = malloc(size ? size : 1);
+  if (p == NULL) throw std::bad_alloc();
+  return p;
+  }
+
+void* operator new(size_t size) { return CountedAlloc(size); }
+void* operator new[](size_t size) { return CountedAlloc(size); }
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+
+struct Entry
+  {
+  uint32_t id;
+  char data[ENTRY_SIZE - sizeof(uint32_t)];
+  };
+
+static uint64_t s_pool_memory[POOL_SIZE * ((sizeof(Entry) + 7) / 8)];
+
+// The former storage: heap entries in a map
+class MapStore
+  {
+  public:
+    Entry* Add(uint32_t id)
+      {
+      Entry* e = new Entry;
+      e->id = id;
+      m_map[id] = e;
+      return e;
+      }
+    Entry* Oldest(uint32_t above)
+      {
+      auto it = m_map.upper_bound(above);
+      return (it == m_map.end()) ? NULL : it->second;
+      }
+    void Drop(Entry* e)
+      {
+      m_map.erase(e->id);
+      delete e;
+      }
+
+  protected:
+    std::map<uint32_t, Entry*> m_map;
+  };
+
+// The current storage: pool entries (heap if exhausted) in an ID ring
+class RingStore
+  {
+  public:
+    RingStore() : m_pool(s_pool_memory, sizeof(Entry), POOL_SIZE) {}
+    Entry* Add(uint32_t id)
+      {
+      void* p = m_pool.Alloc();
+      Entry* e = p ? (Entry*)p : new Entry;
+      e->id = id;
+      m_ring.Insert(id, e);
+      return e;
+      }
+    Entry* Oldest(uint32_t above)
+      {
+      return m_ring.Next(above);
+      }
+    void Drop(Entry* e)
+      {
+      m_ring.Remove(e->id);
+      if (!m_pool.Free(e))
+        delete e;
+      }
+
+  protected:
+    OvmsSlabPool m_pool;
+    OvmsIdRing<Entry> m_ring;
+  };
+
+template <class Store> static void Bench(const char* name, int entries, int backlog, bool stuck)
+  {
+  Store* store = new Store();
+  uint32_t id = 0;
+  uint32_t floor = 0;       // Read position
+  s_allocs = 0;
+  s_counting = true;
+  auto start = std::chrono::steady_clock::now();
+  if (stuck)
+    {
+    store->Add(++id);
+    floor = id;
+    }
+  for (int k=0; k<entries; k++)
+    {
+    Entry* e = store->Add(++id);
+    memset(e->data, k, 16);
+    if ((int)(id - floor) > backlog)
+      {
+      Entry* r = store->Oldest(floor);
+      if (r)
+        {
+        floor = r->id;
+        store->Drop(r);
+        }
+      }
+    }
+  while (Entry* r = store->Oldest(floor))
+    {
+    floor = r->id;
+    store->Drop(r);
+    }
+  double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  s_counting = false;
+  printf("  %-12s %8.2f M entries/s, %.2f allocs/entry\n", name,
+    entries / secs / 1e6, (double)s_allocs / entries);
+  delete store;
+  }
+
+static int Check(int ops)
+  {
+  OvmsIdRing<Entry> ring(4, 64);
+  std::map<uint32_t, Entry*> ref;
+  static Entry items[4096];
+  uint32_t next = 1;
+  for (int k=0; k<ops; k++)
+    {
+    int op = rand() % 10;
+    if ((op < 5) && (next < 4096))
+      {
+      // Mostly ascending, sometimes just below the last ID:
+      uint32_t id = next++;
+      if ((rand() % 8 == 0) && (id > 2)) id -= 1 + rand() % 2;
+      bool a = ring.Insert(id, &items[id]);
+      bool b = ref.insert(std::make_pair(id, &items[id])).second;
+      if (a != b) { printf("  Insert(%u) mismatch\n", id); return 1; }
+      }
+    else if ((op < 8) && !ref.empty())
+      {
+      auto it = ref.begin();
+      if (rand() % 2) std::advance(it, rand() % ref.size());
+      uint32_t id = it->first;
+      Entry* e = ring.Remove(id);
+      if (e != it->second) { printf("  Remove(%u) mismatch\n", id); return 1; }
+      ref.erase(it);
+      }
+    uint32_t probe = rand() % (next + 2);
+    auto up = ref.upper_bound(probe);
+    Entry* next_ref = (up == ref.end()) ? NULL : up->second;
+    Entry* floor_ref = (up == ref.begin()) ? NULL : std::prev(up)->second;
+    auto found = ref.find(probe);
+    if ((ring.size() != ref.size()) ||
+        (ring.Find(probe) != ((found == ref.end()) ? NULL : found->second)) ||
+        (ring.First() != (ref.empty() ? NULL : ref.begin()->second)) ||
+        (ring.Last() != (ref.empty() ? NULL : ref.rbegin()->second)) ||
+        (ring.Next(probe) != next_ref) ||
+        (ring.Floor(probe) != floor_ref))
+      {
+      printf("  op %d: ring differs from map at ID %u\n", k, probe);
+      return 1;
+      }
+    }
+  return 0;
+  }
+
+int main(int argc, char* argv[])
+  {
+  int entries = 1000000;
+  int backlog = 20;
+  if (argc > 1) entries = atoi(argv[1]);
+  if (argc > 2) backlog = atoi(argv[2]);
+  if (entries <= 0) entries = 1;
+  if (backlog < 0) backlog = 0;
+
+  printf("%d entries, backlog %d:\n", entries, backlog);
+  Bench<MapStore>("heap+map", entries, backlog, false);
+  Bench<RingStore>("pool+ring", entries, backlog, false);
+  printf("%d entries, backlog %d, first entry stuck:\n", entries, backlog);
+  Bench<MapStore>("heap+map", entries, backlog, true);
+  Bench<RingStore>("pool+ring", entries, backlog, true);
+
+  srand(1);
+  int failed = 0;
+  for (int r=0; r<50; r++)
+    failed += Check(5000);
+  printf("Ring vs. map check: %s\n", failed ? "FAILED" : "OK");
+  return failed ? 1 : 0;
+  }
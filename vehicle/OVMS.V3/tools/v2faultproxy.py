@@ -0,0 +1,151 @@
+#!/usr/bin/env python3
+#
+# OVMS V2 server fault injection proxy
+#
+# Relays module connections to an OVMS V2 server and breaks them in
+# the ways seen on mobile networks, to test the module's connection
+# supervision (connect timeout, keepalive, ping, reconnect backoff):
+#
+#   drop     close the connection cleanly (FIN)
+#   stall    keep the connection open, but stop relaying in both
+#            directions (a NAT gateway that lost the connection state)
+#   reset    abort the connection (RST)
+#   blackhole  accept, but never connect to the server nor answer
+#   random   pick one of the above per connection
+#
+# The fault is applied --after seconds into each connection, with
+# --refuse N the first N connection attempts are refused to test the
+# backoff. Point the module to the proxy:
+#
+#   config set server.v2 server <proxy ip>
+#   config set server.v2 port 6868
+#
+# The proxy relays to the local server simulator (v2server.py) by default,
+# use a test server of your own with --server. Don't run fault tests
+# against the production server.
+#
+# Usage:
+#   v2server.py --password secret &
+#   v2faultproxy.py --mode stall --after 120
+#
+
+import argparse
+import random
+import select
+import socket
+import struct
+import threading
+import time
+
+MODES = ('drop', 'stall', 'reset', 'blackhole')
+
+
+def log(conn, msg):
+    print('%s [%s] %s' % (time.strftime('%H:%M:%S'), conn, msg), flush=True)
+
+
+def abort(sock):
+    # SO_LINGER with a zero timeout makes close() send a RST:
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_LINGER, struct.pack('ii', 1, 0))
+    sock.close()
+
+
+def relay(client, addr, args):
+    conn = '%s:%d' % addr
+    mode = args.mode if args.mode != 'random' else random.choice(MODES)
+    after = args.after
+    if args.jitter:
+        after += random.uniform(0, args.jitter)
+    log(conn, 'connected, %s after %.1f s' % (mode, after))
+
+    server = None
+    if mode != 'blackhole':
+        try:
+            server = socket.create_connection(args.server, timeout=10)
+        except OSError as e:
+            log(conn, 'server connect failed: %s' % e)
+            client.close()
+            return
+
+    deadline = time.time() + after
+    socks = [client] + ([server] if server else [])
+    faulted = False
+    rx = tx = 0
+    try:
+        while True:
+            timeout = max(0, deadline - time.time()) if not faulted else None
+            readable, _, _ = select.select(socks, [], [], timeout)
+
+            if not faulted and time.time() >= deadline:
+                faulted = True
+                log(conn, 'injecting %s (%d bytes up, %d down)' % (mode, tx, rx))
+                if mode == 'drop':
+                    break
+                elif mode == 'reset':
+                    abort(client)
+                    client = None
+                    break
+                # stall / blackhole: swallow everything from now on
+                continue
+
+            for s in readable:
+                data = s.recv(4096)
+                if not data:
+                    log(conn, '%s closed' % ('module' if s is client else 'server'))
+                    return
+                if faulted or server is None:
+                    continue
+                if s is client:
+                    server.sendall(data)
+                    tx += len(data)
+                else:
+                    client.sendall(data)
+                    rx += len(data)
+    except OSError as e:
+        log(conn, 'error: %s' % e)
+    finally:
+        for s in (client, server):
+            if s:
+                s.close()
+        log(conn, 'finished')
+
+
+def main():
+    parser = argparse.ArgumentParser(description='OVMS V2 server fault injection proxy')
+    parser.add_argument('--listen', default='0.0.0.0:6868', help='listen address (host:port)')
+    parser.add_argument('--server', default='127.0.0.1:6867', help='OVMS V2 server (host:port), default: local v2server.py')
+    parser.add_argument('--mode', default='random', choices=MODES + ('random',))
+    parser.add_argument('--after', type=float, default=60, help='seconds into the connection to inject the fault')
+    parser.add_argument('--jitter', type=float, default=0, help='random extra seconds added to --after')
+    parser.add_argument('--refuse', type=int, default=0, help='refuse (reset) the first N connections')
+    args = parser.parse_args()
+
+    host, port = args.listen.rsplit(':', 1)
+    listen = (host, int(port))
+    host, port = args.server.rsplit(':', 1)
+    args.server = (host, int(port))
+
+    lsock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    lsock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    lsock.bind(listen)
+    lsock.listen(5)
+    print('Listening on %s:%d, relaying to %s:%d' % (listen + args.server), flush=True)
+
+    attempts = 0
+    last = None
+    while True:
+        client, addr = lsock.accept()
+        attempts += 1
+        now = time.time()
+        log('%s:%d' % addr, 'attempt #%d%s' % (attempts,
+            '' if last is None else ', %.1f s after previous' % (now - last)))
+        last = now
+        if attempts <= args.refuse:
+            log('%s:%d' % addr, 'refused')
+            abort(client)
+            continue
+        threading.Thread(target=relay, args=(client, addr, args), daemon=True).start()
+
+
+if __name__ == '__main__':
+    main()
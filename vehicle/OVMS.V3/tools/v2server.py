@@ -0,0 +1,579 @@
+#!/usr/bin/env python3
+#
+# OVMS V2 server simulator and load harness
+#
+# A local stand in for the OVMS V2 server: implements the login handshake
+# (MP-C / MP-S with HMAC-MD5 digests and the RC4 key setup), decodes the
+# module messages, injects commands and pings, acknowledges historical
+# data records, and measures:
+#
+#   - message throughput per vehicle and message code
+#   - command and ping round trip latency
+#   - reconnect time after the server dropped / stalled the connection
+#   - historical data record age and acknowledgement
+#   - module free memory (m.freeram, polled by the "memory" step)
+#
+# Modules are a real OVMS module (config server.v2 server <this host>)
+# or simulated modules started by this script (--modules N), so the
+# server side and the load profile can be tested on localhost.
+#
+# Scenario scripts run per vehicle after its first login, one step per
+# line, '#' starts a comment:
+#
+#   wait <seconds>                  pause
+#   peers <n>                       report n connected apps (MP-0 Z<n>)
+#   command <cmd>[,<args>]          inject a command, wait for the response
+#   memory                          poll m.freeram through command 7
+#   ping                            MP-0 A, wait for the response
+#   load <rate> <seconds> <cmd>     pipelined commands at <rate> per second
+#   drop                            close the connection, wait for the reconnect
+#   stall <seconds>                 stop reading and answering, then drop
+#   repeat <n> ... end              repeat the enclosed steps
+#   stats                           print the statistics so far
+#
+# Examples:
+#
+#   v2server.py --password secret --scenario soak.txt
+#   v2server.py --password secret --modules 50 --module-rate 2 \
+#       --module-data 5 --scenario soak.txt --duration 300
+#
+
+import argparse
+import asyncio
+import base64
+import hashlib
+import hmac
+import random
+import re
+import statistics
+import sys
+import time
+
+TOKEN_CHARS = 'ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/'
+
+
+# Protocol primitives
+
+class RC4:
+    def __init__(self, key):
+        s = list(range(256))
+        j = 0
+        for i in range(256):
+            j = (j + s[i] + key[i % len(key)]) & 0xff
+            s[i], s[j] = s[j], s[i]
+        self.s, self.i, self.j = s, 0, 0
+        self.crypt(bytes(1024))  # Discard the first 1024 bytes, as the module does
+
+    def crypt(self, data):
+        s, i, j = self.s, self.i, self.j
+        out = bytearray(len(data))
+        for k, b in enumerate(data):
+            i = (i + 1) & 0xff
+            j = (j + s[i]) & 0xff
+            s[i], s[j] = s[j], s[i]
+            out[k] = b ^ s[(s[i] + s[j]) & 0xff]
+        self.i, self.j = i, j
+        return bytes(out)
+
+
+def digest(password, token):
+    return base64.b64encode(hmac.new(password.encode(), token.encode(), hashlib.md5).digest()).decode()
+
+
+def new_token():
+    return ''.join(random.choice(TOKEN_CHARS) for _ in range(22))
+
+
+class Channel:
+    """Encrypted line transport after the login"""
+
+    def __init__(self, reader, writer, password, server_token, client_token):
+        key = hmac.new(password.encode(), (server_token + client_token).encode(), hashlib.md5).digest()
+        self.rx = RC4(key)
+        self.tx = RC4(key)
+        self.reader, self.writer = reader, writer
+        self.rx_bytes = self.tx_bytes = 0
+
+    async def recv(self):
+        line = await self.reader.readline()
+        if not line:
+            return None
+        self.rx_bytes += len(line)
+        line = line.strip()
+        if not line:
+            return ''
+        return self.rx.crypt(base64.b64decode(line)).decode('utf-8', 'replace')
+
+    def send(self, msg):
+        data = base64.b64encode(self.tx.crypt(msg.encode())) + b'\r\n'
+        self.tx_bytes += len(data)
+        self.writer.write(data)
+
+
+# Statistics
+
+class Series:
+    def __init__(self):
+        self.values = []
+
+    def add(self, v):
+        self.values.append(v)
+
+    def __str__(self):
+        v = sorted(self.values)
+        if not v:
+            return '-'
+        return 'n=%d avg=%.1f p50=%.1f p95=%.1f max=%.1f' % (
+            len(v), statistics.mean(v), v[len(v) // 2], v[min(len(v) - 1, int(len(v) * 0.95))], v[-1])
+
+
+class Stats:
+    def __init__(self):
+        self.start = time.time()
+        self.logins = 0
+        self.login_failures = 0
+        self.msgs = {}
+        self.rx_bytes = 0
+        self.tx_bytes = 0
+        self.cmd_latency = Series()     # ms
+        self.cmd_errors = 0
+        self.cmd_timeouts = 0
+        self.ping_latency = Series()    # ms
+        self.reconnect = Series()       # s
+        self.data_records = 0
+        self.data_age = Series()        # s, as reported by the module
+        self.freeram = Series()         # bytes
+
+    def count(self, code):
+        self.msgs[code] = self.msgs.get(code, 0) + 1
+
+    def report(self, title, out=sys.stdout):
+        t = max(time.time() - self.start, 0.001)
+        n = sum(self.msgs.values())
+        print('== %s: %.0f s, %d logins, %d login failures' % (title, t, self.logins, self.login_failures), file=out)
+        print('  received %d messages (%.1f/s), %d bytes (%.0f B/s), sent %d bytes' % (
+            n, n / t, self.rx_bytes, self.rx_bytes / t, self.tx_bytes), file=out)
+        print('  by code: %s' % ' '.join('%s=%d' % kv for kv in sorted(self.msgs.items())), file=out)
+        print('  command latency ms: %s, %d errors, %d timeouts' % (self.cmd_latency, self.cmd_errors, self.cmd_timeouts), file=out)
+        print('  ping latency ms:    %s' % self.ping_latency, file=out)
+        print('  reconnect s:        %s' % self.reconnect, file=out)
+        print('  data records:       %d, age s: %s' % (self.data_records, self.data_age), file=out)
+        print('  module freeram:     %s' % self.freeram, file=out)
+        out.flush()
+
+
+TOTAL = Stats()
+
+
+def log(vid, msg):
+    print('%s [%s] %s' % (time.strftime('%H:%M:%S'), vid, msg), flush=True)
+
+
+# Server side
+
+class Vehicle:
+    def __init__(self, vid, args):
+        self.vid = vid
+        self.args = args
+        self.stats = Stats()
+        self.session = None
+        self.connected = asyncio.Event()
+        self.dropped_at = None
+        self.pending = {}               # command code -> [(send time, memory poll), ...]
+        self.ping_sent = []
+        self.scenario = None
+
+    def count(self, code, nbytes):
+        for s in (self.stats, TOTAL):
+            s.count(code)
+            s.rx_bytes += nbytes
+
+    def sent(self, nbytes):
+        self.stats.tx_bytes += nbytes
+        TOTAL.tx_bytes += nbytes
+
+
+class Session:
+    def __init__(self, vehicle, channel):
+        self.vehicle = vehicle
+        self.channel = channel
+        self.stalled = False
+        self.closed = asyncio.Event()
+
+    def send(self, msg):
+        if self.closed.is_set():
+            return
+        before = self.channel.tx_bytes
+        self.channel.send(msg)
+        self.vehicle.sent(self.channel.tx_bytes - before)
+
+    def close(self):
+        self.closed.set()
+        try:
+            self.channel.writer.close()
+        except OSError:
+            pass
+
+
+class Server:
+    def __init__(self, args):
+        self.args = args
+        self.vehicles = {}
+        self.steps = parse_scenario(args.scenario) if args.scenario else None
+
+    async def handle(self, reader, writer):
+        peer = writer.get_extra_info('peername')
+        try:
+            line = await asyncio.wait_for(reader.readline(), 20)
+        except asyncio.TimeoutError:
+            writer.close()
+            return
+        parts = line.decode('ascii', 'replace').split()
+        if len(parts) != 5 or parts[0] != 'MP-C' or parts[1] != '0':
+            log('%s:%d' % peer[:2], 'invalid login: %r' % line[:80])
+            TOTAL.login_failures += 1
+            writer.close()
+            return
+        client_token, client_digest, vid = parts[2], parts[3], parts[4]
+        if client_digest != digest(self.args.password, client_token):
+            log(vid, 'login failed: wrong password')
+            TOTAL.login_failures += 1
+            writer.close()
+            return
+
+        server_token = new_token()
+        writer.write(('MP-S 0 %s %s\r\n' % (server_token, digest(self.args.password, server_token))).encode())
+        channel = Channel(reader, writer, self.args.password, server_token, client_token)
+
+        v = self.vehicles.get(vid)
+        if v is None:
+            v = self.vehicles[vid] = Vehicle(vid, self.args)
+        if v.session:
+            v.session.close()
+        session = Session(v, channel)
+        v.session = session
+        v.pending.clear()
+        v.ping_sent.clear()
+        for s in (v.stats, TOTAL):
+            s.logins += 1
+        if v.dropped_at is not None:
+            t = time.time() - v.dropped_at
+            v.stats.reconnect.add(t)
+            TOTAL.reconnect.add(t)
+            v.dropped_at = None
+            if not self.args.quiet:
+                log(vid, 'reconnected after %.1f s' % t)
+        elif not self.args.quiet:
+            log(vid, 'logged in from %s:%d' % peer[:2])
+        v.connected.set()
+        if self.steps and v.scenario is None:
+            v.scenario = asyncio.ensure_future(run_scenario(v, self.steps))
+
+        try:
+            await self.receive(v, session)
+        finally:
+            if v.session is session:
+                v.connected.clear()
+                if v.dropped_at is None:
+                    v.dropped_at = time.time()
+            session.close()
+
+    async def receive(self, v, session):
+        ch = session.channel
+        while True:
+            if session.stalled:
+                await session.closed.wait()
+                return
+            before = ch.rx_bytes
+            try:
+                msg = await ch.recv()
+            except (OSError, ValueError) as e:
+                log(v.vid, 'receive error: %s' % e)
+                return
+            if msg is None:
+                if not self.args.quiet:
+                    log(v.vid, 'connection closed by module')
+                return
+            if session.stalled:
+                await session.closed.wait()
+                return
+            if not msg.startswith('MP-0 ') or len(msg) < 6:
+                log(v.vid, 'invalid message: %r' % msg[:80])
+                continue
+            code, payload = msg[5], msg[6:]
+            v.count(code if code != 'P' else msg[5:7], ch.rx_bytes - before)
+            if self.args.verbose:
+                log(v.vid, '< %s' % msg[:120])
+            self.process(v, session, code, payload)
+
+    def process(self, v, session, code, payload):
+        now = time.time()
+        if code == 'A':
+            session.send('MP-0 a')
+        elif code == 'a':
+            if v.ping_sent:
+                t = (now - v.ping_sent.pop(0)) * 1000
+                v.stats.ping_latency.add(t)
+                TOTAL.ping_latency.add(t)
+        elif code == 'c':
+            f = payload.split(',', 2)
+            cmd = int(f[0]) if f[0].isdigit() else -1
+            rc = f[1] if len(f) > 1 else ''
+            sent = v.pending.get(cmd)
+            if not sent:
+                return  # Further responses of a multi part command (1, 3)
+            t0, memory = sent.pop(0)
+            t = (now - t0) * 1000
+            for s in (v.stats, TOTAL):
+                s.cmd_latency.add(t)
+                if rc not in ('0', ''):
+                    s.cmd_errors += 1
+            if memory and len(f) > 2:
+                m = re.findall(r'\d+', f[2])
+                if m:
+                    v.stats.freeram.add(int(m[-1]))
+                    TOTAL.freeram.add(int(m[-1]))
+        elif code == 'h':
+            # h<id>,<age>,<record>: acknowledge, so the module can release it
+            f = payload.split(',', 2)
+            if f[0].isdigit():
+                session.send('MP-0 h%s' % f[0])
+                for s in (v.stats, TOTAL):
+                    s.data_records += 1
+                    if len(f) > 1 and f[1].isdigit():
+                        s.data_age.add(int(f[1]))
+
+
+# Scenarios
+
+def parse_scenario(path):
+    steps = []
+    stack = [steps]
+    with open(path) as f:
+        for n, line in enumerate(f, 1):
+            line = line.split('#', 1)[0].strip()
+            if not line:
+                continue
+            word, _, rest = line.partition(' ')
+            rest = rest.strip()
+            if word == 'repeat':
+                block = []
+                stack[-1].append(('repeat', int(rest), block))
+                stack.append(block)
+            elif word == 'end':
+                if len(stack) == 1:
+                    sys.exit('%s:%d: end without repeat' % (path, n))
+                stack.pop()
+            elif word in ('wait', 'peers', 'command', 'memory', 'ping', 'load', 'drop', 'stall', 'stats'):
+                stack[-1].append((word, rest))
+            else:
+                sys.exit('%s:%d: unknown step "%s"' % (path, n, word))
+    if len(stack) != 1:
+        sys.exit('%s: repeat without end' % path)
+    return steps
+
+
+async def session_of(v):
+    await v.connected.wait()
+    return v.session
+
+
+async def command(v, cmd, wait=True, memory=False):
+    session = await session_of(v)
+    code = int(cmd.split(',', 1)[0])
+    v.pending.setdefault(code, []).append((time.time(), memory))
+    session.send('MP-0 C%s' % cmd)
+    if not wait:
+        return
+    deadline = time.time() + v.args.timeout
+    while v.pending.get(code) and time.time() < deadline:
+        await asyncio.sleep(0.01)
+    if v.pending.get(code):
+        v.pending[code].pop(0)
+        for s in (v.stats, TOTAL):
+            s.cmd_timeouts += 1
+
+
+async def run_steps(v, steps):
+    for step in steps:
+        word = step[0]
+        if word == 'repeat':
+            for _ in range(step[1]):
+                await run_steps(v, step[2])
+        elif word == 'wait':
+            await asyncio.sleep(float(step[1]))
+        elif word == 'peers':
+            (await session_of(v)).send('MP-0 Z%d' % int(step[1]))
+        elif word == 'command':
+            await command(v, step[1])
+        elif word == 'memory':
+            await command(v, '7,metrics list m.freeram', memory=True)
+        elif word == 'ping':
+            session = await session_of(v)
+            v.ping_sent.append(time.time())
+            session.send('MP-0 A')
+            deadline = time.time() + v.args.timeout
+            while v.ping_sent and time.time() < deadline:
+                await asyncio.sleep(0.01)
+        elif word == 'load':
+            rate, seconds, cmd = step[1].split(None, 2)
+            interval = 1.0 / float(rate)
+            end = time.time() + float(seconds)
+            while time.time() < end:
+                await command(v, cmd, wait=False)
+                await asyncio.sleep(interval)
+        elif word == 'drop':
+            session = await session_of(v)
+            session.close()
+            await asyncio.sleep(0.1)
+            await v.connected.wait()
+        elif word == 'stall':
+            session = await session_of(v)
+            session.stalled = True
+            await asyncio.sleep(float(step[1]))
+            session.close()
+            await asyncio.sleep(0.1)
+            await v.connected.wait()
+        elif word == 'stats':
+            v.stats.report(v.vid)
+
+
+async def run_scenario(v, steps):
+    await run_steps(v, steps)
+    if not v.args.quiet:
+        log(v.vid, 'scenario finished')
+
+
+# Simulated modules
+
+class Module:
+    def __init__(self, n, args):
+        self.vid = '%s%04d' % (args.module_prefix, n)
+        self.args = args
+        self.record = 0
+        self.backoff = 1
+
+    async def run(self):
+        await asyncio.sleep(random.uniform(0, 1))
+        while True:
+            try:
+                await self.session()
+                self.backoff = 1
+            except (OSError, asyncio.IncompleteReadError, ValueError, ConnectionError) as e:
+                if self.args.verbose:
+                    log(self.vid, 'module: %s' % e)
+            await asyncio.sleep(self.backoff * random.uniform(0.5, 1))
+            self.backoff = min(self.backoff * 2, 30)
+
+    async def session(self):
+        host, port = self.args.listen.rsplit(':', 1)
+        if host == '0.0.0.0':
+            host = '127.0.0.1'
+        reader, writer = await asyncio.open_connection(host, int(port))
+        token = new_token()
+        writer.write(('MP-C 0 %s %s %s\r\n' % (token, digest(self.args.password, token), self.vid)).encode())
+        parts = (await asyncio.wait_for(reader.readline(), 20)).decode().split()
+        if len(parts) != 4 or parts[0] != 'MP-S' or parts[3] != digest(self.args.password, parts[2]):
+            raise ValueError('server authentication failed')
+        ch = Channel(reader, writer, self.args.password, server_token=parts[2], client_token=token)
+        sender = asyncio.ensure_future(self.send_loop(ch))
+        try:
+            while True:
+                msg = await ch.recv()
+                if msg is None:
+                    return
+                self.process(ch, msg)
+                await writer.drain()
+        finally:
+            sender.cancel()
+            writer.close()
+
+    def process(self, ch, msg):
+        code, payload = msg[5:6], msg[6:]
+        if code == 'A':
+            ch.send('MP-0 a')
+        elif code == 'C':
+            f = payload.split(',', 1)
+            cmd = f[0]
+            if cmd == '7':
+                ch.send('MP-0 c7,0,m.freeram %d' % random.randint(80000, 120000))
+            elif cmd in ('1', '3'):
+                for k in range(32):
+                    ch.send('MP-0 c%s,0,%d,32,0' % (cmd, k))
+            else:
+                ch.send('MP-0 c%s,0' % cmd)
+        elif code == 'Z' and payload != '0':
+            self.send_status(ch)
+
+    def send_status(self, ch):
+        ch.send('MP-0 S%d,K,0,0,stopped,standard,200,180,16,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0' % random.randint(20, 100))
+        ch.send('MP-0 D0,0,5,10,20,30,40,0,0,0,0,0,0,12.6,0,0,0,0,0')
+        ch.send('MP-0 L52.5,13.4,90,30,1,1,0,0,0,0')
+
+    async def send_loop(self, ch):
+        # Status messages at --module-rate, data records at --module-data per second
+        status = 1.0 / self.args.module_rate if self.args.module_rate > 0 else None
+        data = 1.0 / self.args.module_data if self.args.module_data > 0 else None
+        next_status = next_data = time.time()
+        while True:
+            now = time.time()
+            if status and now >= next_status:
+                self.send_status(ch)
+                next_status += status
+            if data and now >= next_data:
+                self.record += 1
+                ch.send('MP-0 h%d,0,RT-SIM-LOAD,0,86400,%d,%d' % (self.record, self.record, random.randint(0, 1000)))
+                next_data += data
+            await ch.writer.drain()
+            wake = min(t for t in (next_status if status else None, next_data if data else None, now + 1) if t)
+            await asyncio.sleep(max(0, wake - time.time()))
+
+
+# Main
+
+async def main(args):
+    server = Server(args)
+    host, port = args.listen.rsplit(':', 1)
+    srv = await asyncio.start_server(server.handle, host, int(port), limit=1 << 16)
+    print('OVMS V2 server simulator listening on %s' % args.listen, flush=True)
+
+    modules = [asyncio.ensure_future(Module(n, args).run()) for n in range(1, args.modules + 1)]
+
+    try:
+        if args.duration:
+            await asyncio.sleep(args.duration)
+        else:
+            while True:
+                await asyncio.sleep(args.report or 3600)
+                if args.report:
+                    TOTAL.report('total')
+    finally:
+        for m in modules:
+            m.cancel()
+        srv.close()
+        if args.per_vehicle:
+            for vid in sorted(server.vehicles):
+                server.vehicles[vid].stats.report(vid)
+        TOTAL.report('total')
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='OVMS V2 server simulator and load harness')
+    parser.add_argument('--listen', default='0.0.0.0:6867', help='listen address (host:port)')
+    parser.add_argument('--password', required=True, help='server password of the vehicles')
+    parser.add_argument('--scenario', help='scenario script run per vehicle')
+    parser.add_argument('--timeout', type=float, default=30, help='command / ping response timeout (s)')
+    parser.add_argument('--duration', type=float, default=0, help='stop after seconds (default: run until ^C)')
+    parser.add_argument('--report', type=float, default=0, help='print statistics every n seconds')
+    parser.add_argument('--per-vehicle', action='store_true', help='print statistics per vehicle at the end')
+    parser.add_argument('--modules', type=int, default=0, help='number of simulated modules to connect')
+    parser.add_argument('--module-prefix', default='SIM', help='simulated module vehicle id prefix')
+    parser.add_argument('--module-rate', type=float, default=0.1, help='simulated status messages per second')
+    parser.add_argument('--module-data', type=float, default=0, help='simulated data records per second')
+    parser.add_argument('--quiet', action='store_true', help='no per connection log')
+    parser.add_argument('--verbose', action='store_true', help='log all messages')
+    args = parser.parse_args()
+    try:
+        asyncio.get_event_loop().run_until_complete(main(args))
+    except KeyboardInterrupt:
+        TOTAL.report('total')
@@ -0,0 +1,260 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;
+;    (C) 2011-2017  Mark Webb-Johnson
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+
+// Host benchmark of the V2 transmit encoding: the former per message
+// pipeline (copy, RC4 in place, base64 into a second buffer, one write
+// per message) vs. the fused RC4_crypt_base64() encoder collecting the
+// messages in a transmit arena, as done by OvmsServerV2::TransmitEncode().
+//
+// Reports messages per second, allocations and bytes allocated per
+// message, and socket writes (to /dev/null). A randomized run then checks
+// both pipelines produce identical wire output, including messages
+// longer than the arena and random flush points.
+//
+// Build & run from vehicle/OVMS.V3:
+//
+//   g++ -O2 -Icomponents/crypto -o /tmp/v2txbench tools/v2txbench.cpp
+//       components/crypto/crypt_rc4.cpp components/crypto/crypt_base64.cpp
+//   /tmp/v2txbench [<messages>] [<flush every>]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <new>
+#include <string>
+#include <chrono>
+#include "crypt_rc4.h"
+#include "crypt_base64.h"
+
+#define TXARENA 2048              // OVMS_PROTOCOL_V2_TXARENA
+
+static size_t s_allocs = 0;
+static size_t s_alloc_bytes = 0;
+static bool s_counting = false;
+
+static void* CountedAlloc(size_t size)
+  {
+  if (s_counting)
+    {
+    s_allocs++;
+    s_alloc_bytes += size;
+    }
+  void* p = malloc(size ? size : 1);
+  if (p == NULL) throw std::bad_alloc();
+  return p;
+  }
+
+void* operator new(size_t size) { return CountedAlloc(size); }
+void* operator new[](size_t size) { return CountedAlloc(size); }
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+
+class Sink
+  {
+  public:
+    Sink(int fd) { m_fd = fd; m_writes = 0; }
+
+  public:
+    void Write(const char* data, size_t length)
+      {
+      m_writes++;
+      if (m_fd >= 0)
+        {
+        if (write(m_fd, data, length) < 0)
+          perror("write");
+        }
+      else
+        m_data.append(data, length);
+      }
+
+  public:
+    int m_fd;
+    size_t m_writes;
+    std::string m_data;
+  };
+
+// The pipeline before the arena, as the former OvmsServerV2::Transmit()
+class OldEncoder
+  {
+  public:
+    OldEncoder(const uint8_t* key, int keylen, Sink* sink)
+      {
+      RC4_setup(&m_ctx1, &m_ctx2, key, keylen);
+      m_sink = sink;
+      }
+
+  public:
+    void Transmit(const char* message, size_t length)
+      {
+      char* s = new char[length+1];
+      memcpy(s, message, length);
+      s[length] = 0;
+      RC4_crypt(&m_ctx1, &m_ctx2, (uint8_t*)s, length);
+      char* buf = new char[(length*2)+4];
+      base64encode((uint8_t*)s, length, (uint8_t*)buf);
+      strcat(buf, "\r\n");
+      m_sink->Write(buf, strlen(buf));
+      delete [] buf;
+      delete [] s;
+      }
+    void Flush() {}
+
+  protected:
+    RC4_CTX1 m_ctx1;
+    RC4_CTX2 m_ctx2;
+    Sink* m_sink;
+  };
+
+// The arena pipeline, as OvmsServerV2::TransmitEncode() / TransmitWrite()
+class ArenaEncoder
+  {
+  public:
+    ArenaEncoder(const uint8_t* key, int keylen, Sink* sink)
+      {
+      RC4_setup(&m_ctx1, &m_ctx2, key, keylen);
+      m_sink = sink;
+      m_size = 0;
+      }
+
+  public:
+    void Transmit(const char* message, size_t length)
+      {
+      if ((m_size > 0) && (((length+2)/3)*4 + 2 > TXARENA - m_size))
+        Flush();
+      while (length > 0)
+        {
+        size_t room = TXARENA - m_size;
+        if (room < 6)
+          {
+          Flush();
+          continue;
+          }
+        size_t n = ((room-2)/4)*3;
+        if (n > length) n = length;
+        uint8_t* end = RC4_crypt_base64(&m_ctx1, &m_ctx2,
+          (const uint8_t*)message, n, (uint8_t*)m_arena + m_size);
+        m_size = (char*)end - m_arena;
+        message += n;
+        length -= n;
+        }
+      m_arena[m_size++] = '\r';
+      m_arena[m_size++] = '\n';
+      }
+    void Flush()
+      {
+      if (m_size > 0)
+        m_sink->Write(m_arena, m_size);
+      m_size = 0;
+      }
+
+  protected:
+    RC4_CTX1 m_ctx1;
+    RC4_CTX2 m_ctx2;
+    Sink* m_sink;
+    char m_arena[TXARENA];
+    size_t m_size;
+  };
+
+template <class E> void Bench(const char* title, int messages, int flush, int fd)
+  {
+  uint8_t key[16];
+  memset(key, 0x5a, sizeof(key));
+  Sink sink(fd);
+  E* enc = new E(key, sizeof(key), &sink);
+  char msg[128];
+
+  s_allocs = s_alloc_bytes = 0;
+  s_counting = true;
+  auto start = std::chrono::steady_clock::now();
+  for (int k=1;k<=messages;k++)
+    {
+    int len = snprintf(msg, sizeof(msg), "MP-0 h%d,17,RT-BAT-C,12,86400,1,1,4012,3998,4025,12,21,18,24,3", k);
+    enc->Transmit(msg, len);
+    if ((k % flush) == 0)
+      enc->Flush();
+    }
+  enc->Flush();
+  auto end = std::chrono::steady_clock::now();
+  s_counting = false;
+  delete enc;
+
+  double secs = std::chrono::duration<double>(end - start).count();
+  printf("  %-16s %10.0f msgs/s, %.2f allocations / %.0f bytes per message, %zu writes\n",
+    title, messages / secs, (double)s_allocs / messages, (double)s_alloc_bytes / messages,
+    sink.m_writes);
+  }
+
+// Both pipelines must produce the same byte stream
+static int Compare(int messages)
+  {
+  uint8_t key[16];
+  for (size_t k=0; k<sizeof(key); k++) key[k] = rand();
+  Sink oldsink(-1), newsink(-1);
+  OldEncoder oldenc(key, sizeof(key), &oldsink);
+  ArenaEncoder newenc(key, sizeof(key), &newsink);
+  std::string msg;
+
+  for (int k=0;k<messages;k++)
+    {
+    size_t len = 1 + ((rand() % 8 == 0) ? rand() % 7000 : rand() % 200);
+    msg.resize(len);
+    for (size_t i=0; i<len; i++)
+      msg[i] = ' ' + rand() % 95;
+    oldenc.Transmit(msg.data(), len);
+    newenc.Transmit(msg.data(), len);
+    if (rand() % 16 == 0)
+      newenc.Flush();
+    }
+  newenc.Flush();
+  return (oldsink.m_data == newsink.m_data) ? 0 : 1;
+  }
+
+int main(int argc, char* argv[])
+  {
+  int messages = 200000;
+  int flush = 16;
+  if (argc > 1) messages = atoi(argv[1]);
+  if (argc > 2) flush = atoi(argv[2]);
+  if (messages <= 0) messages = 1;
+  if (flush <= 0) flush = 1;
+
+  int fd = open("/dev/null", O_WRONLY);
+  printf("%d messages, arena flushed every %d messages:\n", messages, flush);
+  Bench<OldEncoder>("copy+RC4+base64:", messages, flush, fd);
+  Bench<ArenaEncoder>("fused to arena:", messages, flush, fd);
+  close(fd);
+
+  srand(1);
+  int errors = 0;
+  for (int round=0; round<20; round++)
+    errors += Compare(1000);
+  printf("Wire output identical in 20 randomized runs: %s\n", errors ? "FAILED" : "OK");
+  return errors ? 1 : 0;
+  }